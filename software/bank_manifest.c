@@ -0,0 +1,276 @@
+#include "bank_manifest.h"
+#include "bus_core.h"
+#include "cart.h"
+#include "gb.h"
+#include "rom_cache.h"
+#include "sched.h"
+#include "utils.h"
+
+#include <stdio.h>
+#include <string.h>
+
+struct BankHash {
+  uint32_t crc;   // Running CRC32, CRC32_SEED until the first byte
+  uint32_t next;  // Bytes of the bank hashed so far, done when it gets to the bank size
+};
+
+/*  - Private Variables -  */
+struct BankHash rom_hashes[BANK_MANIFEST_MAX_ROM_BANKS] = {0};
+struct BankHash ram_hashes[BANK_MANIFEST_MAX_RAM_BANKS] = {0};
+uint16_t manifest_rom_banks = 0;
+uint16_t manifest_ram_banks = 0;
+// Saves smaller than a bank are one bank that size
+uint32_t manifest_ram_bank_size = 0;
+// Nothing gets hashed in the background until someone reads BANKS.TXT
+uint8_t manifest_wanted = 0;
+// Core 1 counts SRAM writes, core 0 notices the count went up and starts the SRAM hashes over
+volatile uint32_t manifest_ram_writes = 0;
+uint32_t manifest_ram_writes_seen = 0;
+// Goes up whenever the ROM hashes get thrown away, so a step in flight knows it's stale
+uint32_t manifest_rom_changes = 0;
+// The background step, one read at a time
+uint8_t step_buf[BANK_MANIFEST_STEP] = {0};
+struct BusCmd step_cmd = {0};
+uint8_t step_active = 0;
+uint8_t step_space = 0;
+uint16_t step_bank = 0;
+uint32_t step_offset = 0;
+uint32_t step_len = 0;
+uint32_t step_rom_changes = 0;
+uint32_t step_ram_writes = 0;
+
+/*  - Private Function Declarations -  */
+
+uint32_t manifest_bank_size(uint8_t space);
+// Hash for a bank, NULL if there's no such bank
+struct BankHash* manifest_hash(uint8_t space, uint16_t bank);
+void manifest_reset(struct BankHash* hashes, uint16_t count);
+// Start the SRAM hashes over if anything wrote to SRAM since last time
+void manifest_check_ram_writes();
+// Fold a finished step into its bank, unless something changed under it
+void manifest_step_done();
+// Pick the next bank that isn't done and read the next piece of it. Returns 0 if they're all done
+uint8_t manifest_step_start();
+// One line of the file, with the terminator
+void manifest_line(uint32_t line, char* out);
+
+/*  - Private Function Definitions -  */
+
+uint32_t manifest_bank_size(uint8_t space){
+  return space == BUS_SPACE_ROM ? ROM_BANK_SIZE : manifest_ram_bank_size;
+}
+
+struct BankHash* manifest_hash(uint8_t space, uint16_t bank){
+  if(space == BUS_SPACE_ROM){
+    return bank < manifest_rom_banks ? &rom_hashes[bank] : NULL;
+  }
+  return bank < manifest_ram_banks ? &ram_hashes[bank] : NULL;
+}
+
+void manifest_reset(struct BankHash* hashes, uint16_t count){
+  for(uint16_t i = 0; i < count; i++){
+    hashes[i].crc = CRC32_SEED;
+    hashes[i].next = 0;
+  }
+}
+
+void manifest_check_ram_writes(){
+  uint32_t writes = manifest_ram_writes;
+  if(writes != manifest_ram_writes_seen){
+    manifest_ram_writes_seen = writes;
+    manifest_reset(ram_hashes, manifest_ram_banks);
+  }
+}
+
+void manifest_step_done(){
+  struct BankHash* h = manifest_hash(step_space, step_bank);
+  if((step_space == BUS_SPACE_ROM) && (step_rom_changes != manifest_rom_changes)){
+    return;
+  }
+  if((step_space == BUS_SPACE_RAM) && (step_ram_writes != manifest_ram_writes)){
+    return;
+  }
+  if(!h || (h->next != step_offset)){
+    return;
+  }
+  h->crc = crc32_update(step_buf, step_len, h->crc);
+  h->next += step_len;
+}
+
+uint8_t manifest_step_start(){
+  uint8_t space = BUS_SPACE_ROM;
+  uint16_t bank = 0;
+  struct BankHash* h = NULL;
+  // ROM first, it's what gets dumped most
+  for(bank = 0; bank < manifest_rom_banks; bank++){
+    if(rom_hashes[bank].next < ROM_BANK_SIZE){
+      h = &rom_hashes[bank];
+      break;
+    }
+  }
+  if(!h){
+    space = BUS_SPACE_RAM;
+    for(bank = 0; bank < manifest_ram_banks; bank++){
+      if(ram_hashes[bank].next < manifest_ram_bank_size){
+        h = &ram_hashes[bank];
+        break;
+      }
+    }
+  }
+  if(!h){
+    return 0;
+  }
+  uint32_t size = manifest_bank_size(space);
+  step_space = space;
+  step_bank = bank;
+  step_offset = h->next;
+  step_len = (size - h->next) < BANK_MANIFEST_STEP ? (size - h->next) : BANK_MANIFEST_STEP;
+  step_rom_changes = manifest_rom_changes;
+  step_ram_writes = manifest_ram_writes;
+  uint32_t addr = (bank * size) + step_offset;
+  // A cached ROM hashes out of flash, no need to bother the cart
+  if((space == BUS_SPACE_ROM) && rom_cache_read(step_buf, addr, step_len)){
+    manifest_step_done();
+    return 1;
+  }
+  if(!bus_core_owns_bus()){
+    bus_read(space, addr, step_buf, step_len);
+    manifest_step_done();
+    return 1;
+  }
+  step_cmd.op = BUS_CMD_READ;
+  step_cmd.space = space;
+  step_cmd.addr = addr;
+  step_cmd.len = step_len;
+  step_cmd.buf = step_buf;
+  bus_submit(&step_cmd);
+  step_active = 1;
+  return 1;
+}
+
+void manifest_line(uint32_t line, char* out){
+  uint8_t space = line < manifest_rom_banks ? BUS_SPACE_ROM : BUS_SPACE_RAM;
+  uint16_t bank = space == BUS_SPACE_ROM ? line : line - manifest_rom_banks;
+  struct BankHash* h = manifest_hash(space, bank);
+  const char* name = space == BUS_SPACE_ROM ? "ROM" : "RAM";
+  if(h && (h->next >= manifest_bank_size(space))){
+    snprintf(out, BANK_MANIFEST_LINE_LEN + 1, "%s %03u %08lX\n", name, bank, (unsigned long) ~h->crc);
+  }
+  else{
+    snprintf(out, BANK_MANIFEST_LINE_LEN + 1, "%s %03u --------\n", name, bank);
+  }
+}
+
+/*  - Public Function Definitions -  */
+
+uint32_t bank_manifest_size(){
+  return (uint32_t) (manifest_rom_banks + manifest_ram_banks) * BANK_MANIFEST_LINE_LEN;
+}
+
+void init_bank_manifest(){
+  manifest_rom_banks = the_cart.rom_size_bytes / ROM_BANK_SIZE;
+  if(manifest_rom_banks > BANK_MANIFEST_MAX_ROM_BANKS){
+    manifest_rom_banks = BANK_MANIFEST_MAX_ROM_BANKS;
+  }
+  manifest_ram_bank_size = the_cart.ram_size_bytes < SRAM_BANK_SIZE ? the_cart.ram_size_bytes : SRAM_BANK_SIZE;
+  manifest_ram_banks = 0;
+  if(manifest_ram_bank_size && the_cart.ram_memcpy_func){
+    manifest_ram_banks = (the_cart.ram_size_bytes + manifest_ram_bank_size - 1) / manifest_ram_bank_size;
+  }
+  if(manifest_ram_banks > BANK_MANIFEST_MAX_RAM_BANKS){
+    manifest_ram_banks = BANK_MANIFEST_MAX_RAM_BANKS;
+  }
+  manifest_reset(rom_hashes, manifest_rom_banks);
+  manifest_reset(ram_hashes, manifest_ram_banks);
+}
+
+uint8_t bank_manifest_task(){
+  manifest_check_ram_writes();
+  if(!manifest_wanted){
+    return 0;
+  }
+  if(step_active){
+    // Core 1 wakes this core up when it's done, no need to spin on it
+    if(!step_cmd.done){
+      return 0;
+    }
+    bus_wait(&step_cmd);
+    step_active = 0;
+    manifest_step_done();
+    return 1;
+  }
+  return manifest_step_start();
+}
+
+uint8_t bank_manifest_progress(){
+  uint32_t total = 0;
+  uint32_t done = 0;
+  for(uint16_t bank = 0; bank < manifest_rom_banks; bank++){
+    total += ROM_BANK_SIZE;
+    done += rom_hashes[bank].next;
+  }
+  for(uint16_t bank = 0; bank < manifest_ram_banks; bank++){
+    total += manifest_ram_bank_size;
+    done += ram_hashes[bank].next;
+  }
+  return total ? (((uint64_t) done * 100) / total) : SCHED_PROGRESS_NONE;
+}
+
+void bank_manifest_read(uint8_t* dest, uint32_t offset, uint32_t num){
+  manifest_wanted = 1;
+  manifest_check_ram_writes();
+  char line[BANK_MANIFEST_LINE_LEN + 1];
+  uint32_t total = bank_manifest_size();
+  uint32_t rendered = 0xFFFFFFFF;
+  for(uint32_t i = 0; i < num; i++){
+    uint32_t pos = offset + i;
+    if(pos >= total){
+      dest[i] = 0;
+      continue;
+    }
+    if((pos / BANK_MANIFEST_LINE_LEN) != rendered){
+      rendered = pos / BANK_MANIFEST_LINE_LEN;
+      manifest_line(rendered, line);
+    }
+    dest[i] = line[pos % BANK_MANIFEST_LINE_LEN];
+  }
+}
+
+void bank_manifest_observe(uint8_t space, uint32_t addr, const uint8_t* buf, uint32_t num){
+  manifest_check_ram_writes();
+  uint32_t size = manifest_bank_size(space);
+  if(!size){
+    return;
+  }
+  while(num){
+    uint16_t bank = addr / size;
+    uint32_t offset = addr % size;
+    uint32_t len = (size - offset) < num ? (size - offset) : num;
+    struct BankHash* h = manifest_hash(space, bank);
+    // The background step owns its bank until it lands
+    uint8_t busy = step_active && (step_space == space) && (step_bank == bank);
+    if(h && !busy && (h->next < size)){
+      // Reading a bank from the top starts it over, whatever got left half done
+      if(!offset){
+        h->crc = CRC32_SEED;
+        h->next = 0;
+      }
+      if(h->next == offset){
+        h->crc = crc32_update(buf, len, h->crc);
+        h->next += len;
+      }
+    }
+    addr += len;
+    buf += len;
+    num -= len;
+  }
+}
+
+void bank_manifest_rom_changed(){
+  manifest_rom_changes++;
+  manifest_reset(rom_hashes, manifest_rom_banks);
+}
+
+void bank_manifest_ram_written(){
+  manifest_ram_writes++;
+}
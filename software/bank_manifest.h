@@ -0,0 +1,43 @@
+#ifndef BANK_MANIFEST_H_
+#define BANK_MANIFEST_H_
+
+#include <stdint.h>
+
+// BANKS.TXT on the drive, a CRC32 for every ROM bank and every SRAM bank, one a line:
+//
+//   ROM 000 3F0A21C4
+//   RAM 000 --------
+//
+// Dashes mean that bank hasn't been hashed yet. Hashing starts the first time the file is
+// read and carries on in the background, a step per trip round the main loop, so read it
+// again to get the rest. Banks that go past in a sequential dump get hashed for free, and
+// a cached ROM gets hashed straight out of flash. SRAM hashes get thrown away whenever
+// anything writes to SRAM, so a host can tell whether the save changed by reading this file
+// instead of the whole save.
+
+// Every line is the same length, so the file size is known when the disk gets built
+#define BANK_MANIFEST_LINE_LEN      17
+// Bytes read from the cart per background step
+#define BANK_MANIFEST_STEP          1024
+#define BANK_MANIFEST_MAX_ROM_BANKS 512
+#define BANK_MANIFEST_MAX_RAM_BANKS 16
+
+// Size of BANKS.TXT for the cart that's in
+uint32_t bank_manifest_size();
+// Work out how many banks there are. Call after the cart info is filled in
+void init_bank_manifest();
+// Hash a little more. A background job for sched, on core 0. Returns 1 if it got anywhere
+uint8_t bank_manifest_task();
+// Percent of every bank hashed so far
+uint8_t bank_manifest_progress();
+// Copy part of BANKS.TXT into dest
+void bank_manifest_read(uint8_t* dest, uint32_t offset, uint32_t num);
+// Something read ROM or SRAM and got this back. Extends a bank's hash if it carries on
+// from where that bank got to. space is BUS_SPACE_ROM or BUS_SPACE_RAM
+void bank_manifest_observe(uint8_t space, uint32_t addr, const uint8_t* buf, uint32_t num);
+// Throw away every ROM hash, for when the ROM itself changes
+void bank_manifest_rom_changed();
+// Count a write to SRAM. Safe to call from core 1, core 0 throws the SRAM hashes away later
+void bank_manifest_ram_written();
+
+#endif
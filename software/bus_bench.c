@@ -0,0 +1,235 @@
+#include "bus_bench.h"
+#include "gb.h"
+#include "cart.h"
+#include "utils.h"
+#include "disk/msc_disk.h"
+#include "pico/stdlib.h"
+#include "hardware/structs/systick.h"
+#include "hardware/structs/xip_ctrl.h"
+
+#include <stdio.h>
+#include <string.h>
+
+/*  - Private #defines -  */
+// Bank 0 is always there without touching the mapper
+#define BUS_BENCH_ADDR          ROM_BANK0_START_ADDR
+#define BUS_BENCH_LEN           ROM_BANK_SIZE
+// SysTick is the only cycle counter an M0+ has, it counts down and is 24 bits wide
+#define BUS_BENCH_SYSTICK_MASK  0xFFFFFF
+
+struct BusBenchResult {
+    uint8_t clean;      // Read clean at BUS_BENCH_MAX_SETTLE at least
+    uint8_t settle;     // Shortest that read clean
+    uint32_t kbps;      // At that settle
+};
+
+struct BusBenchJitter {
+    uint32_t min;       // Cycles for the quickest readb
+    uint32_t max;       // And the slowest, which is what the bus timings have to allow for
+    uint32_t total;
+};
+
+/*  - Private Function Declarations -  */
+
+// Read a bank's window BUS_BENCH_PASSES times with one setting. Returns 1 if every read matched
+uint8_t bus_bench_pass(uint8_t mode, uint8_t settle, uint16_t addr, const uint8_t* ref, uint8_t* test, uint32_t* us);
+// Step the settle down until reads stop matching
+void bus_bench_mode(uint8_t mode, const uint8_t* ref, uint8_t* test, struct BusBenchResult* result);
+void bus_bench_report(const char* name, struct BusBenchResult* result);
+// A settle with the margin on top
+uint8_t bus_bench_margin(uint8_t settle);
+// Read BUS_BENCH_CHECK_BANKS banks spread over the ROM byte at a time and in bursts at one
+// setting. Returns how many got checked, 0 if any of them didn't match
+uint16_t bus_bench_check_banks(uint8_t mode, uint8_t settle, uint8_t* ref, uint8_t* test);
+uint32_t bus_bench_kbps(uint32_t us);
+// Time a read one call at a time, readb or readb_flash. Cold throws the XIP cache away
+// before every call, so anything on the way that still runs out of flash has to be fetched again
+void bus_bench_jitter(uint8_t (*read)(uint16_t), uint8_t cold, struct BusBenchJitter* result);
+void bus_bench_jitter_report(const char* name, struct BusBenchJitter* result);
+
+/*  - Private Function Definitions -  */
+
+uint32_t bus_bench_kbps(uint32_t us){
+    return us ? ((uint64_t) BUS_BENCH_LEN * 1000000) / ((uint64_t) us * 1024) : 0;
+}
+
+uint8_t bus_bench_pass(uint8_t mode, uint8_t settle, uint16_t addr, const uint8_t* ref, uint8_t* test, uint32_t* us){
+    set_burst_mode(mode, settle);
+    for(uint8_t pass = 0; pass < BUS_BENCH_PASSES; pass++){
+        // Whatever was there from the last pass can't count as a match
+        memset(test, pass & 0x1 ? 0x00 : 0xFF, BUS_BENCH_LEN);
+        uint64_t start = time_us_64();
+        readbuf_rom(addr, test, BUS_BENCH_LEN);
+        *us = time_us_64() - start;
+        if(memcmp(ref, test, BUS_BENCH_LEN)){
+            return 0;
+        }
+    }
+    return 1;
+}
+
+void bus_bench_mode(uint8_t mode, const uint8_t* ref, uint8_t* test, struct BusBenchResult* result){
+    result->clean = 0;
+    for(int16_t settle = BUS_BENCH_MAX_SETTLE; settle >= 0; settle--){
+        uint32_t us = 0;
+        if(!bus_bench_pass(mode, settle, BUS_BENCH_ADDR, ref, test, &us)){
+            break;
+        }
+        result->clean = 1;
+        result->settle = settle;
+        result->kbps = bus_bench_kbps(us);
+    }
+}
+
+void bus_bench_report(const char* name, struct BusBenchResult* result){
+    char line[64];
+    if(result->clean){
+        snprintf(line, sizeof(line), "BURST %s: SETTLE %u (%uNS), %lu KB/S\n", name, result->settle,
+            result->settle * DELAY_WAIT_STEP_NS, (unsigned long) result->kbps);
+    }
+    else{
+        snprintf(line, sizeof(line), "BURST %s: NEVER READ CLEAN\n", name);
+    }
+    append_status_file_buf((uint8_t*) line);
+}
+
+uint8_t bus_bench_margin(uint8_t settle){
+    uint16_t margin = (settle * BUS_BENCH_MARGIN_PCT) / 100;
+    if(margin < BUS_BENCH_MARGIN){
+        margin = BUS_BENCH_MARGIN;
+    }
+    return (settle + margin) < BUS_BENCH_MAX_SETTLE ? (settle + margin) : BUS_BENCH_MAX_SETTLE;
+}
+
+uint16_t bus_bench_check_banks(uint8_t mode, uint8_t settle, uint8_t* ref, uint8_t* test){
+    // Without a mapper only bank 1 is there to switch to
+    uint16_t banks = the_cart.rom_banksw_func ? the_cart.rom_banks : 2;
+    uint16_t checks = banks < BUS_BENCH_CHECK_BANKS ? banks : BUS_BENCH_CHECK_BANKS;
+    uint16_t checked = 0;
+    for(uint16_t i = 0; i < checks; i++){
+        // Evenly spread, ending on the last bank where the most bank lines are high
+        uint16_t bank = ((uint32_t) (banks - 1) * (i + 1)) / checks;
+        uint16_t addr = BUS_BENCH_ADDR;
+        if(bank){
+            if(the_cart.rom_banksw_func){
+                the_cart.rom_banksw_func(bank);
+            }
+            addr = ROM_BANKN_START_ADDR;
+        }
+        readbuf(addr, ref, BUS_BENCH_LEN);
+        uint32_t us = 0;
+        if(!bus_bench_pass(mode, settle, addr, ref, test, &us)){
+            checked = 0;
+            break;
+        }
+        checked++;
+    }
+    if(the_cart.rom_banksw_func){
+        the_cart.rom_banksw_func(1);
+    }
+    return checked;
+}
+
+void bus_bench_jitter(uint8_t (*read)(uint16_t), uint8_t cold, struct BusBenchJitter* result){
+    result->min = BUS_BENCH_SYSTICK_MASK;
+    result->max = 0;
+    result->total = 0;
+    for(uint16_t i = 0; i < BUS_BENCH_JITTER_READS; i++){
+        if(cold){
+            // Reading it back waits for the flush to finish
+            xip_ctrl_hw->flush = 1;
+            (void) xip_ctrl_hw->flush;
+        }
+        uint32_t start = systick_hw->cvr;
+        read(BUS_BENCH_ADDR + i);
+        uint32_t cycles = (start - systick_hw->cvr) & BUS_BENCH_SYSTICK_MASK;
+        if(cycles < result->min){
+            result->min = cycles;
+        }
+        if(cycles > result->max){
+            result->max = cycles;
+        }
+        result->total += cycles;
+    }
+}
+
+void bus_bench_jitter_report(const char* name, struct BusBenchJitter* result){
+    char line[64];
+    snprintf(line, sizeof(line), "READB %s: %lu-%lu CYC, AVG %lu\n", name, (unsigned long) result->min,
+        (unsigned long) result->max, (unsigned long) (result->total / BUS_BENCH_JITTER_READS));
+    append_status_file_buf((uint8_t*) line);
+}
+
+/*  - Public Function Definitions -  */
+
+void bus_bench(){
+    uint8_t* ref = working_mem;
+    uint8_t* test = working_mem + BUS_BENCH_LEN;
+    // How much readb's time moves around, warm and with nothing cached. With the bus code in
+    // RAM the two should match, a gap between them means something slow is still in flash.
+    // The same strobe run out of flash is the before to compare them with
+    systick_hw->rvr = BUS_BENCH_SYSTICK_MASK;
+    systick_hw->cvr = 0;
+    systick_hw->csr = M0PLUS_SYST_CSR_ENABLE_BITS | M0PLUS_SYST_CSR_CLKSOURCE_BITS;
+    struct BusBenchJitter warm = {0};
+    struct BusBenchJitter cold = {0};
+    struct BusBenchJitter flash_warm = {0};
+    struct BusBenchJitter flash_cold = {0};
+    bus_bench_jitter(readb, 0, &warm);
+    bus_bench_jitter(readb, 1, &cold);
+    bus_bench_jitter(readb_flash, 0, &flash_warm);
+    bus_bench_jitter(readb_flash, 1, &flash_cold);
+    systick_hw->csr = 0;
+    bus_bench_jitter_report("WARM", &warm);
+    bus_bench_jitter_report("COLD", &cold);
+    bus_bench_jitter_report("FLASH WARM", &flash_warm);
+    bus_bench_jitter_report("FLASH COLD", &flash_cold);
+
+    // Byte at a time with readb's full timings is the reference
+    uint64_t start = time_us_64();
+    readbuf(BUS_BENCH_ADDR, ref, BUS_BENCH_LEN);
+    uint32_t readb_us = time_us_64() - start;
+    char line[64];
+    snprintf(line, sizeof(line), "BURST OFF: %lu KB/S\n", (unsigned long) bus_bench_kbps(readb_us));
+    append_status_file_buf((uint8_t*) line);
+
+    struct BusBenchResult linear = {0};
+    struct BusBenchResult gray = {0};
+    bus_bench_mode(BURST_LINEAR, ref, test, &linear);
+    bus_bench_mode(BURST_GRAY, ref, test, &gray);
+    bus_bench_report("LINEAR", &linear);
+    bus_bench_report("GRAY", &gray);
+
+    struct BusBenchResult* best = NULL;
+    uint8_t mode = BURST_OFF;
+    if(gray.clean && (!linear.clean || (gray.kbps >= linear.kbps))){
+        best = &gray;
+        mode = BURST_GRAY;
+    }
+    else if(linear.clean){
+        best = &linear;
+        mode = BURST_LINEAR;
+    }
+    if(!best){
+        set_burst_mode(BURST_OFF, BURST_SETTLE_DEFAULT);
+        append_status_file((const uint8_t*) "BURST: USING READB\n");
+        return;
+    }
+    // Three clean reads of bank 0 is thin to go on for every read from here on. Step up
+    // until the spread of banks reads clean too
+    uint8_t settle = bus_bench_margin(best->settle);
+    uint16_t checked = bus_bench_check_banks(mode, settle, ref, test);
+    while(!checked && (settle < BUS_BENCH_MAX_SETTLE)){
+        settle = bus_bench_margin(settle);
+        checked = bus_bench_check_banks(mode, settle, ref, test);
+    }
+    if(!checked){
+        set_burst_mode(BURST_OFF, BURST_SETTLE_DEFAULT);
+        append_status_file((const uint8_t*) "BURST: USING READB\n");
+        return;
+    }
+    set_burst_mode(mode, settle);
+    snprintf(line, sizeof(line), "BURST: USING %s, SETTLE %u (%uNS), %u BANKS\n", mode == BURST_GRAY ? "GRAY" : "LINEAR",
+        settle, settle * DELAY_WAIT_STEP_NS, checked);
+    append_status_file_buf((uint8_t*) line);
+}
@@ -0,0 +1,31 @@
+#ifndef BUS_BENCH_H_
+#define BUS_BENCH_H_
+
+#include <stdint.h>
+
+// Finds how short readbuf_rom's settle time can go in linear and Gray order. Bank 0 gets
+// read byte at a time with readb as the reference, then in bursts with less and less
+// settle until they stop matching. The fastest order that read clean is kept, with a margin
+// on top that grows with the settle. A spread of banks across the whole ROM then has to read
+// clean at that setting too, and the settle goes up until they do. Before any of that,
+// single readb calls get timed in core clock cycles, with the XIP cache warm and then
+// flushed, to show how much they jitter. The same strobe left in flash gets timed the same
+// way, as the before for the RAM copy. What it found goes in the status file
+
+// Reads at each setting that all have to match
+#define BUS_BENCH_PASSES        3
+// Added to the shortest settle that read clean, whichever of these is more. 2 steps is 80 ns,
+// and a quarter covers mask ROMs slowing down as they warm up or the supply sags
+#define BUS_BENCH_MARGIN        2
+#define BUS_BENCH_MARGIN_PCT    25
+// Banks across the ROM that have to read clean at the settle that gets used
+#define BUS_BENCH_CHECK_BANKS   8
+// Longest settle tried, 1.2 us
+#define BUS_BENCH_MAX_SETTLE    (BURST_SETTLE_DEFAULT * 2)
+// readb calls timed for the jitter numbers
+#define BUS_BENCH_JITTER_READS  256
+
+// Run the bench and set the burst mode from it. Needs the bus to itself
+void bus_bench();
+
+#endif
@@ -0,0 +1,248 @@
+#include "bus_core.h"
+#include "gb.h"
+#include "cart.h"
+#include "read_verify.h"
+#include "bank_manifest.h"
+#include "irq_latency.h"
+#include "metrics.h"
+#include "disk/gb_disk.h"
+#include "pico/stdlib.h"
+#include "pico/multicore.h"
+#include "pico/platform.h"
+#include "hardware/sync.h"
+
+#include <stdio.h>
+
+/*  - Private Variables -  */
+
+// One ring per lane. Only the producer moves head and only core 1 moves tail
+struct BusLane {
+    struct BusCmd* volatile slots[BUS_QUEUE_LEN];
+    volatile uint32_t head;
+    volatile uint32_t tail;
+};
+// Core 1 polls these between commands, SRAM4 keeps that off the banks core 0 copies USB data through
+struct BusLane __scratch_x("bus_lanes") bus_lanes[BUS_LANE_COUNT] = {0};
+volatile uint8_t bus_core_running = 0;
+struct BusCmdStats bus_cmd_stats[BUS_CMD_COUNT] = {0};
+const char* bus_cmd_names[BUS_CMD_COUNT] = {"READ", "WRITE", "BANK", "PROBE"};
+uint16_t bus_stats_line_offsets[BUS_CMD_COUNT] = {STATUS_LINE_NONE, STATUS_LINE_NONE, STATUS_LINE_NONE, STATUS_LINE_NONE};
+uint64_t bus_stats_last_us = 0;
+
+/*  - Private Function Declarations -  */
+
+// Do a command on whatever core this is
+void bus_run(struct BusCmd* cmd);
+// Core 1's loop. Takes commands from the lanes in turn
+void bus_core1_main();
+// Submit a command and wait for it
+void bus_do(struct BusCmd* cmd);
+// Stats line for one command type
+void bus_format_stats_line(uint8_t op, char* line);
+
+/*  - Private Function Definitions -  */
+
+void __not_in_flash_func(bus_run)(struct BusCmd* cmd){
+    switch(cmd->op){
+        case BUS_CMD_READ:
+            METRICS_ADD(metrics.bus_bytes, cmd->len);
+            if((cmd->space == BUS_SPACE_ROM) || (cmd->space == BUS_SPACE_RAM)){
+                read_verify_memcpy(cmd->space, cmd->buf, cmd->addr, cmd->len);
+            }
+            else{
+                readbuf(cmd->addr, cmd->buf, cmd->len);
+            }
+            break;
+        case BUS_CMD_WRITE:
+            // ROM can't be written, that one doesn't go anywhere
+            if(cmd->space != BUS_SPACE_ROM){
+                METRICS_ADD(metrics.bus_bytes, cmd->len);
+            }
+            // Whatever is hashed of SRAM might not be true any more
+            if((cmd->space == BUS_SPACE_RAM) || ((cmd->space != BUS_SPACE_ROM) && (cmd->addr >= SRAM_START_ADDR) && (cmd->addr <= SRAM_END_ADDR))){
+                bank_manifest_ram_written();
+            }
+            if(cmd->space == BUS_SPACE_RAM){
+                (*the_cart.ram_memset_func)(cmd->buf, cmd->addr, cmd->len);
+            }
+            else if(cmd->space != BUS_SPACE_ROM){
+                for(uint32_t i = 0; i < cmd->len; i++){
+                    if(cmd->space == BUS_SPACE_ADDR_FAST){
+                        writeb_fast(cmd->buf[i], cmd->addr + i);
+                    }
+                    else{
+                        writeb(cmd->buf[i], cmd->addr + i);
+                    }
+                }
+            }
+            break;
+        case BUS_CMD_BANK:
+            if((cmd->space == BUS_SPACE_ROM) && the_cart.rom_banksw_func){
+                (*the_cart.rom_banksw_func)(cmd->bank);
+            }
+            else if((cmd->space == BUS_SPACE_RAM) && the_cart.ram_banksw_func){
+                (*the_cart.ram_banksw_func)(cmd->bank);
+            }
+            break;
+        case BUS_CMD_PROBE:
+            cmd->result = cart_check(cmd->buf);
+            break;
+    }
+}
+
+void __not_in_flash_func(bus_core1_main)(){
+    // Lets core 0 park this core while it writes flash
+    multicore_lockout_victim_init();
+    // Bus work is here from now on, so the latency sampling should be too
+    irq_latency_core1_start();
+    uint8_t lane = 0;
+    while(1){
+        uint8_t idle = 1;
+        for(uint8_t i = 0; i < BUS_LANE_COUNT; i++){
+            // Take turns, so a busy lane can't starve the other one
+            struct BusLane* l = &bus_lanes[lane];
+            lane = (lane + 1) % BUS_LANE_COUNT;
+            if(l->tail == l->head){
+                continue;
+            }
+            __dmb();
+            struct BusCmd* cmd = l->slots[l->tail % BUS_QUEUE_LEN];
+            l->tail++;
+            uint64_t start = time_us_64();
+            bus_run(cmd);
+            uint64_t end = time_us_64();
+            struct BusCmdStats* stats = &bus_cmd_stats[cmd->op % BUS_CMD_COUNT];
+            uint32_t latency = end - cmd->submit_us;
+            stats->count++;
+            stats->bytes += (cmd->op == BUS_CMD_BANK) ? 0 : cmd->len;
+            stats->busy_us += end - start;
+            stats->latency_us += latency;
+            if(latency > stats->max_latency_us){
+                stats->max_latency_us = latency;
+            }
+            // Everything in buf has to be out before the caller sees done
+            __dmb();
+            cmd->done = 1;
+            __sev();
+            idle = 0;
+        }
+        if(idle){
+            __wfe();
+        }
+    }
+}
+
+void bus_do(struct BusCmd* cmd){
+    bus_submit(cmd);
+    bus_wait(cmd);
+}
+
+void bus_format_stats_line(uint8_t op, char* line){
+    struct BusCmdStats* stats = &bus_cmd_stats[op];
+    uint32_t avg_us = stats->count ? (stats->latency_us / stats->count) : 0;
+    uint32_t kbps = stats->busy_us ? (((uint64_t) stats->bytes * 1000000) / (stats->busy_us * 1024)) : 0;
+    snprintf(line, STATUS_LINE_LEN + 1, "BUS %-5s %7lu %6luus %5luKB/s\n", bus_cmd_names[op],
+        (unsigned long) stats->count, (unsigned long) avg_us, (unsigned long) kbps);
+}
+
+/*  - Public Function Definitions -  */
+
+void init_bus_core(){
+    // Fixed width so they can be rewritten in place
+    char line[STATUS_LINE_LEN + 1];
+    for(uint8_t op = 0; op < BUS_CMD_COUNT; op++){
+        bus_format_stats_line(op, line);
+        bus_stats_line_offsets[op] = reserve_status_line(line);
+    }
+    multicore_launch_core1(bus_core1_main);
+    bus_core_running = 1;
+}
+
+void bus_core_task(){
+    uint64_t now = time_us_64();
+    if((now - bus_stats_last_us) < BUS_STATS_PERIOD_US){
+        return;
+    }
+    bus_stats_last_us = now;
+    char line[STATUS_LINE_LEN + 1];
+    for(uint8_t op = 0; op < BUS_CMD_COUNT; op++){
+        bus_format_stats_line(op, line);
+        update_status_line(bus_stats_line_offsets[op], line);
+    }
+}
+
+uint8_t __not_in_flash_func(bus_core_owns_bus)(){
+    return bus_core_running && (get_core_num() == 0);
+}
+
+void __not_in_flash_func(bus_submit)(struct BusCmd* cmd){
+    struct BusLane* l = &bus_lanes[__get_current_exception() ? BUS_LANE_IRQ : BUS_LANE_THREAD];
+    cmd->done = 0;
+    cmd->submit_us = time_us_64();
+    // Full, wait for core 1 to take something
+    while((l->head - l->tail) >= BUS_QUEUE_LEN){
+        tight_loop_contents();
+    }
+    l->slots[l->head % BUS_QUEUE_LEN] = cmd;
+    // The slot has to be there before core 1 can see it
+    __dmb();
+    l->head++;
+    __sev();
+}
+
+void __not_in_flash_func(bus_wait)(struct BusCmd* cmd){
+    while(!cmd->done){
+        tight_loop_contents();
+    }
+    __dmb();
+}
+
+void bus_read(uint8_t space, uint32_t addr, uint8_t* buf, uint32_t len){
+    struct BusCmd cmd = {.op = BUS_CMD_READ, .space = space, .addr = addr, .len = len, .buf = buf};
+    if(bus_core_owns_bus()){
+        bus_do(&cmd);
+        return;
+    }
+    bus_run(&cmd);
+}
+
+void bus_write(uint8_t space, uint32_t addr, uint8_t* buf, uint32_t len){
+    struct BusCmd cmd = {.op = BUS_CMD_WRITE, .space = space, .addr = addr, .len = len, .buf = buf};
+    if(bus_core_owns_bus()){
+        bus_do(&cmd);
+        return;
+    }
+    bus_run(&cmd);
+}
+
+void bus_bank(uint8_t space, uint16_t bank){
+    struct BusCmd cmd = {.op = BUS_CMD_BANK, .space = space, .bank = bank};
+    if(bus_core_owns_bus()){
+        bus_do(&cmd);
+        return;
+    }
+    bus_run(&cmd);
+}
+
+uint16_t bus_probe(uint8_t* logo_buf){
+    struct BusCmd cmd = {.op = BUS_CMD_PROBE, .buf = logo_buf};
+    if(bus_core_owns_bus()){
+        bus_do(&cmd);
+    }
+    else{
+        bus_run(&cmd);
+    }
+    return cmd.result;
+}
+
+void bus_core_pause(){
+    if(bus_core_owns_bus()){
+        multicore_lockout_start_blocking();
+    }
+}
+
+void bus_core_resume(){
+    if(bus_core_owns_bus()){
+        multicore_lockout_end_blocking();
+    }
+}
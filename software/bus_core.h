@@ -0,0 +1,81 @@
+#ifndef BUS_CORE_H_
+#define BUS_CORE_H_
+
+#include <stdint.h>
+
+// Core 1 owns the cart bus once init_bus_core runs. Everything that wants the bus hands it a
+// command through a queue and core 1 does the work into the caller's buffer, so core 0 is left
+// with USB and the protocols. readb, writeb and readbuf on core 0 turn into commands too, so
+// code that talks to the bus directly keeps working, a round trip per call.
+//
+// The queue is a ring per producer lane, one for thread code and one for interrupts, each
+// with a single writer. That keeps it lock free without the compare and swap the M0+ doesn't
+// have. Core 1 sleeps in wfe when there's nothing to do and producers sev it awake.
+
+// What a command does
+#define BUS_CMD_READ            0x0 // Read a span into buf
+#define BUS_CMD_WRITE           0x1 // Write a span from buf
+#define BUS_CMD_BANK            0x2 // Switch banks through the mapper
+#define BUS_CMD_PROBE           0x3 // Check the cart is there, result is cart_check's
+#define BUS_CMD_COUNT           4
+
+// What addr means
+#define BUS_SPACE_ROM           0x0 // Offset into the ROM, banked by the mapper
+#define BUS_SPACE_RAM           0x1 // Offset into SRAM, banked by the mapper
+#define BUS_SPACE_ADDR          0x2 // Straight onto the bus, no banking
+#define BUS_SPACE_ADDR_FAST     0x3 // Same, but writes use writeb_fast
+
+// Commands that can be waiting in each lane
+#define BUS_QUEUE_LEN           8
+#define BUS_LANE_THREAD         0
+#define BUS_LANE_IRQ            1
+#define BUS_LANE_COUNT          2
+// How often the stats in the status file get redone
+#define BUS_STATS_PERIOD_US     1000000
+
+struct BusCmd {
+    uint8_t op;
+    uint8_t space;
+    uint16_t bank;              // For BUS_CMD_BANK
+    uint32_t addr;
+    uint32_t len;
+    uint8_t* buf;               // Caller's, and has to stay put until done is set
+    uint16_t result;
+    uint64_t submit_us;
+    volatile uint8_t done;
+};
+
+struct BusCmdStats {
+    uint32_t count;
+    uint32_t bytes;
+    uint64_t busy_us;           // Time core 1 spent doing them
+    uint64_t latency_us;        // Time from submit to done, summed
+    uint32_t max_latency_us;
+};
+
+extern struct BusCmdStats bus_cmd_stats[BUS_CMD_COUNT];
+
+// Hand the bus to core 1 and put the stats in the status file. Do every bit of direct bus
+// work (probing, tests, caches) before this
+void init_bus_core();
+// Keep the stats in the status file up to date. Call from the main loop
+void bus_core_task();
+// 1 if core 1 has the bus and the caller isn't core 1, meaning bus work has to be sent over
+uint8_t bus_core_owns_bus();
+// Queue a command. Returns straight away, done gets set when it's finished
+void bus_submit(struct BusCmd* cmd);
+// Spin until a submitted command is finished
+void bus_wait(struct BusCmd* cmd);
+// Blocking read, write and bank switch. Go through core 1 when it has the bus, straight
+// to the bus otherwise
+void bus_read(uint8_t space, uint32_t addr, uint8_t* buf, uint32_t len);
+void bus_write(uint8_t space, uint32_t addr, uint8_t* buf, uint32_t len);
+void bus_bank(uint8_t space, uint16_t bank);
+// Check the cart is still there. logo_buf gets the logo, like cart_check
+uint16_t bus_probe(uint8_t* logo_buf);
+// Park core 1 somewhere safe while core 0 writes to the Pico's flash, since core 1
+// runs out of it. Safe to call when core 1 isn't running
+void bus_core_pause();
+void bus_core_resume();
+
+#endif
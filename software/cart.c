@@ -155,7 +155,7 @@ void populate_cart_info(){
     else if(ram_size == 2){
         the_cart.ram_banks = 1;
         the_cart.ram_end_address = 0xA7FF;
-        the_cart.ram_size_bytes =  (1 + 0xA7FF) - (SRAM_START_ADDR + 1);
+        the_cart.ram_size_bytes =  (1 + 0xA7FF) - SRAM_START_ADDR;
     }
     // All others will use the full address space
     else if(ram_size == 3){
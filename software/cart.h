@@ -31,7 +31,7 @@ extern const uint8_t logo[0x30];
 struct Cart {
    uint8_t  cart_type;
    uint8_t  mapper_type;
-   uint8_t  rom_banks;
+   uint16_t rom_banks;
    uint8_t  ram_banks;
    uint16_t ram_end_address;
    uint32_t rom_size_bytes;
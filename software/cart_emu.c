@@ -0,0 +1,231 @@
+#include "cart_emu.h"
+#include "cart.h"
+#include "gb.h"
+#include "pins.h"
+#include "rom_cache.h"
+#include "flash_layout.h"
+#include "status_led.h"
+#include "mappers/mbc_regs.h"
+#include "gbbus.pio.h"
+
+#include "pico/stdlib.h"
+#include "pico/multicore.h"
+#include "hardware/pio.h"
+#include "hardware/dma.h"
+#include "hardware/structs/bus_ctrl.h"
+
+#include <malloc.h>
+#include <stdio.h>
+#include <string.h>
+
+/*  - Private Variables -  */
+// Where every bank gets served from, already >> 14 so it can go straight to the PIO as the
+// top bits of the lookup address
+uint32_t cart_emu_bank_base[CART_EMU_MAX_BANKS] = {0};
+uint8_t* cart_emu_rom = NULL;
+// Cart RAM starts out blank every time, it isn't kept anywhere
+uint8_t* cart_emu_ram = NULL;
+struct MbcRegs cart_emu_regs = {0};
+// RAM bank the RAM SM is serving, MBC_REGS_RAM_OFF while it is stopped
+int16_t cart_emu_ram_bank = MBC_REGS_RAM_OFF;
+uint cart_emu_ram_entry = 0;
+uint cart_emu_sm_lo = 0;
+uint cart_emu_sm_hi = 0;
+uint cart_emu_sm_ram = 0;
+uint cart_emu_sm_data = 0;
+uint cart_emu_sm_write = 0;
+
+/*  - Private Function Declarations -  */
+
+// Copy the image into RAM and make room for cart RAM. Returns 0 if either doesn't fit
+uint8_t init_memory(const uint8_t* image, uint16_t banks, uint8_t ram_banks);
+// Chain two DMA channels so every address a lookup SM pushes turns into a byte for the data SM
+void start_lookup_dma(uint sm_lookup);
+// Start one of the gbcart_rom SMs, looping through its own entry point
+void start_lookup_sm(uint sm, uint offset, uint entry, uint32_t base);
+// Point the RAM SM at another RAM bank, or stop it so the bus floats while RAM is off
+void switch_ram_bank(int16_t bank);
+// Core 1, watches the writes for mapper registers and cart RAM. Runs out of RAM so flash
+// never slows it down
+void cart_emu_core1();
+
+/*  - Private Function Definitions -  */
+
+uint8_t init_memory(const uint8_t* image, uint16_t banks, uint8_t ram_banks){
+    // The lookup address is base | the low address bits, so both have to be aligned to
+    // their bank size
+    cart_emu_rom = memalign(ROM_BANK_SIZE, banks * ROM_BANK_SIZE);
+    if(!cart_emu_rom){
+        return 0;
+    }
+    if(ram_banks && !(cart_emu_ram = memalign(MBC_REGS_RAM_BANK_SIZE, ram_banks * MBC_REGS_RAM_BANK_SIZE))){
+        free(cart_emu_rom);
+        return 0;
+    }
+    memcpy(cart_emu_rom, image, banks * ROM_BANK_SIZE);
+    for(uint16_t bank = 0; bank < banks; bank++){
+        cart_emu_bank_base[bank] = ((uint32_t) (cart_emu_rom + (bank * ROM_BANK_SIZE))) >> 14;
+    }
+    if(ram_banks){
+        memset(cart_emu_ram, 0xFF, ram_banks * MBC_REGS_RAM_BANK_SIZE);
+    }
+    return 1;
+}
+
+void start_lookup_dma(uint sm_lookup){
+    uint addr_chan = dma_claim_unused_channel(true);
+    uint data_chan = dma_claim_unused_channel(true);
+    // Reads the byte and hands it to the data SM, then rearms the address channel
+    dma_channel_config c = dma_channel_get_default_config(data_chan);
+    channel_config_set_transfer_data_size(&c, DMA_SIZE_8);
+    channel_config_set_read_increment(&c, false);
+    channel_config_set_write_increment(&c, false);
+    channel_config_set_chain_to(&c, addr_chan);
+    channel_config_set_high_priority(&c, true);
+    dma_channel_configure(data_chan, &c, &pio1->txf[cart_emu_sm_data], NULL, 1, false);
+    // Waits on the lookup SM and writes the address it pushes into the data channel's read
+    // address trigger, which kicks that channel off
+    c = dma_channel_get_default_config(addr_chan);
+    channel_config_set_transfer_data_size(&c, DMA_SIZE_32);
+    channel_config_set_read_increment(&c, false);
+    channel_config_set_write_increment(&c, false);
+    channel_config_set_dreq(&c, pio_get_dreq(pio0, sm_lookup, false));
+    channel_config_set_high_priority(&c, true);
+    dma_channel_configure(addr_chan, &c, &dma_hw->ch[data_chan].al3_read_addr_trig, &pio0->rxf[sm_lookup], 1, true);
+}
+
+void start_lookup_sm(uint sm, uint offset, uint entry, uint32_t base){
+    pio_sm_config c = gbcart_rom_program_get_default_config(offset);
+    sm_config_set_in_pins(&c, A15);
+    sm_config_set_jmp_pin(&c, A14);
+    sm_config_set_in_shift(&c, false, false, 32);
+    sm_config_set_out_shift(&c, false, false, 32);
+    sm_config_set_wrap(&c, offset + entry, offset + gbcart_rom_wrap);
+    pio_sm_init(pio0, sm, offset + entry, &c);
+    // X holds the base of the bank. The hi and RAM SMs pull it again every cycle anyway
+    pio_sm_put(pio0, sm, base);
+    pio_sm_exec(pio0, sm, pio_encode_pull(false, false));
+    pio_sm_exec(pio0, sm, pio_encode_mov(pio_x, pio_osr));
+}
+
+void __not_in_flash_func(switch_ram_bank)(int16_t bank){
+    if(bank == MBC_REGS_RAM_OFF){
+        pio_sm_set_enabled(pio0, cart_emu_sm_ram, false);
+    }
+    else if(cart_emu_ram_bank == MBC_REGS_RAM_OFF){
+        // It could have been stopped anywhere in a cycle, so start it over from the top
+        pio_sm_clear_fifos(pio0, cart_emu_sm_ram);
+        pio_sm_restart(pio0, cart_emu_sm_ram);
+        pio_sm_exec(pio0, cart_emu_sm_ram, pio_encode_jmp(cart_emu_ram_entry));
+        pio_sm_put(pio0, cart_emu_sm_ram, ((uint32_t) (cart_emu_ram + (bank * MBC_REGS_RAM_BANK_SIZE))) >> 13);
+        pio_sm_set_enabled(pio0, cart_emu_sm_ram, true);
+    }
+    else{
+        pio_sm_put(pio0, cart_emu_sm_ram, ((uint32_t) (cart_emu_ram + (bank * MBC_REGS_RAM_BANK_SIZE))) >> 13);
+    }
+    cart_emu_ram_bank = bank;
+}
+
+void __not_in_flash_func(cart_emu_core1)(){
+    while(1){
+        uint32_t pins = pio_sm_get_blocking(pio1, cart_emu_sm_write);
+        uint16_t addr = (pins >> 7) & 0xFFFF;
+        uint8_t data = pins >> 24;
+        if(!(addr & 0x8000)){
+            uint8_t changed = mbc_regs_write(&cart_emu_regs, addr, data);
+            if(changed & MBC_REGS_ROM_CHANGED){
+                pio_sm_put(pio0, cart_emu_sm_hi, cart_emu_bank_base[mbc_regs_bank(&cart_emu_regs)]);
+            }
+            if(changed & MBC_REGS_RAM_CHANGED){
+                switch_ram_bank(mbc_regs_ram_bank(&cart_emu_regs));
+            }
+        }
+        // Reading it back takes at least another opcode fetch first, so this is in plenty of time
+        else if(((addr & 0xE000) == CART_EMU_RAM_ADDR) && (cart_emu_ram_bank != MBC_REGS_RAM_OFF)){
+            cart_emu_ram[(cart_emu_ram_bank * MBC_REGS_RAM_BANK_SIZE) + (addr & (MBC_REGS_RAM_BANK_SIZE - 1))] = data;
+        }
+    }
+}
+
+/*  - Public Function Definitions -  */
+
+void cart_emu_run(){
+    const struct RomCacheEntry* entry = rom_cache_newest();
+    if(!entry){
+        set_led_speed(LED_SPEED_ERR);
+        return;
+    }
+    const uint8_t* image = FLASH_OFFSET_TO_XIP(entry->offset);
+    uint16_t banks = entry->size / ROM_BANK_SIZE;
+    uint8_t mapper_type = mbc_regs_mapper_type(image[CART_TYPE_ADDR]);
+    uint8_t ram_banks = (mapper_type == MAPPER_ROM_ONLY) ? 0 : mbc_regs_ram_banks(image[RAM_BANK_COUNT_ADDR]);
+    // Anything under 1 MB never has MBC1 mode 1 move bank 0, so the lo SM's base stays put
+    if((mapper_type == MAPPER_UNKNOWN) || (banks < 2)){
+        printf("Cart emu: can't emulate cart type 0x%x\n", image[CART_TYPE_ADDR]);
+        set_led_speed(LED_SPEED_ERR);
+        return;
+    }
+    if((banks > CART_EMU_MAX_BANKS) || (ram_banks > CART_EMU_MAX_RAM_BANKS) || !init_memory(image, banks, ram_banks)){
+        printf("Cart emu: %u ROM banks and %u RAM banks don't fit, up to %u and %u do\n", banks, ram_banks,
+               CART_EMU_MAX_BANKS, CART_EMU_MAX_RAM_BANKS);
+        set_led_speed(LED_SPEED_ERR);
+        return;
+    }
+    mbc_regs_init(&cart_emu_regs, mapper_type, banks, ram_banks);
+    cart_emu_ram_bank = mbc_regs_ram_bank(&cart_emu_regs);
+
+    // The console drives everything but the data bus, and that only when it is reading us
+    for(uint8_t pin = A15; pin <= CLK; pin++){
+        gpio_init(pin);
+        gpio_set_dir(pin, GPIO_IN);
+    }
+    for(uint8_t pin = D7; pin <= D0; pin++){
+        pio_gpio_init(pio1, pin);
+    }
+
+    // DMA has to win the bus every time or the byte shows up late
+    bus_ctrl_hw->priority = BUSCTRL_BUS_PRIORITY_DMA_W_BITS | BUSCTRL_BUS_PRIORITY_DMA_R_BITS;
+
+    // gbcart_rom takes up all of pio0, so the data SM goes on pio1 with the write SM
+    cart_emu_sm_data = pio_claim_unused_sm(pio1, true);
+    uint offset = pio_add_program(pio1, &gbcart_data_program);
+    pio_sm_config c = gbcart_data_program_get_default_config(offset);
+    sm_config_set_out_pins(&c, D7, NUM_D_PINS);
+    sm_config_set_out_shift(&c, false, false, 32);
+    sm_config_set_jmp_pin(&c, CLK);
+    sm_config_set_mov_status(&c, STATUS_TX_LESSTHAN, 1);
+    pio_sm_init(pio1, cart_emu_sm_data, offset, &c);
+    pio_sm_set_consecutive_pindirs(pio1, cart_emu_sm_data, D7, NUM_D_PINS, false);
+
+    // gbcart_rom needs every instruction pio0 has, so the LED can't blink from here on
+    release_status_led();
+    cart_emu_sm_lo = pio_claim_unused_sm(pio0, true);
+    cart_emu_sm_hi = pio_claim_unused_sm(pio0, true);
+    cart_emu_sm_ram = pio_claim_unused_sm(pio0, true);
+    offset = pio_add_program(pio0, &gbcart_rom_program);
+    cart_emu_ram_entry = offset + gbcart_rom_offset_ram_entry;
+    start_lookup_sm(cart_emu_sm_lo, offset, gbcart_rom_offset_lo_entry, cart_emu_bank_base[0]);
+    start_lookup_sm(cart_emu_sm_hi, offset, gbcart_rom_offset_hi_entry, cart_emu_bank_base[mbc_regs_bank(&cart_emu_regs)]);
+    start_lookup_sm(cart_emu_sm_ram, offset, gbcart_rom_offset_ram_entry, ((uint32_t) cart_emu_ram) >> 13);
+    start_lookup_dma(cart_emu_sm_lo);
+    start_lookup_dma(cart_emu_sm_hi);
+    start_lookup_dma(cart_emu_sm_ram);
+
+    cart_emu_sm_write = pio_claim_unused_sm(pio1, true);
+    offset = pio_add_program(pio1, &gbcart_write_program);
+    c = gbcart_write_program_get_default_config(offset);
+    sm_config_set_in_pins(&c, 0);
+    sm_config_set_in_shift(&c, false, false, 32);
+    pio_sm_init(pio1, cart_emu_sm_write, offset, &c);
+
+    // Cart RAM only gets served once it is turned on, except on carts without a mapper. This
+    // goes before core 1 starts, as from then on it is the one turning the RAM SM on and off
+    pio_enable_sm_mask_in_sync(pio0, (1u << cart_emu_sm_lo) | (1u << cart_emu_sm_hi) |
+                               ((cart_emu_ram_bank != MBC_REGS_RAM_OFF) ? (1u << cart_emu_sm_ram) : 0));
+    multicore_launch_core1(cart_emu_core1);
+    pio_enable_sm_mask_in_sync(pio1, (1u << cart_emu_sm_data) | (1u << cart_emu_sm_write));
+    set_led_speed(LED_SPEED_HEALTHY);
+    while(1){
+        tight_loop_contents();
+    }
+}
@@ -0,0 +1,24 @@
+#ifndef CART_EMU_H_
+#define CART_EMU_H_
+
+#include <stdint.h>
+
+// Turns GBPunk around so it sits in a console and pretends to be the cart, serving the
+// newest image in the ROM cache. PIO watches the bus and DMA looks up every byte, so the CPU
+// is never in the path of a read. Core 1 keeps up with the mapper registers and takes cart
+// RAM writes. The whole image and cart RAM live in RAM, as XIP flash can't always answer in
+// time, so images that don't fit get refused instead of served late
+
+// Biggest image that fits, 32K. The rest of the firmware's buffers take up most of RAM
+// before main() even runs, and memalign() can waste up to a bank lining the image up, so
+// this is what is left in the heap
+#define CART_EMU_MAX_BANKS          2
+// One 8K bank of cart RAM, on top of the image
+#define CART_EMU_MAX_RAM_BANKS      1
+#define CART_EMU_RAM_ADDR           0xA000
+
+// Start emulating. Only returns if there is nothing to emulate or it doesn't fit, after
+// setting the LED to error
+void cart_emu_run();
+
+#endif
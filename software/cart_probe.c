@@ -0,0 +1,224 @@
+#include "cart_probe.h"
+#include "cart.h"
+#include "gb.h"
+#include "utils.h"
+#include "rom_cache.h"
+#include "flash_layout.h"
+#include "disk/gb_disk.h"
+#include "bus_core.h"
+#include "hardware/flash.h"
+#include "hardware/sync.h"
+
+#include <string.h>
+#include <stdio.h>
+
+/*  - Private Variables -  */
+// Lines of a bank get read in here to be hashed
+uint8_t probe_line[CART_PROBE_LINE_LEN] = {0};
+
+/*  - Private Function Declarations -  */
+
+// Hash a handful of lines spread across a ROM bank
+uint32_t rom_bank_hash(uint16_t bank);
+// Find the smallest power of two number of banks the ROM mirrors at. 0 if it never does
+uint16_t probe_rom_banks();
+// Read and write single bytes of SRAM
+uint8_t sram_peek(uint32_t ram_addr);
+void sram_poke(uint32_t ram_addr, uint8_t val);
+// Most RAM banks the mapper can select. Going past it selects something else, like the MBC3 RTC
+uint16_t max_ram_banks();
+// Find out how big SRAM is by writing to it and seeing where else the write shows up.
+// Everything written gets put back the way it was
+uint32_t probe_ram_size();
+// Look for this cart in the probe results we already have
+const struct CartProbeEntry* find_probe_entry(uint32_t fingerprint);
+// Remember the probe results for this cart
+void store_probe_entry(const struct CartProbeEntry* entry);
+
+/*  - Private Function Definitions -  */
+
+uint32_t rom_bank_hash(uint16_t bank){
+    uint32_t hash = FNV1A_SEED;
+    for(uint8_t line = 0; line < CART_PROBE_LINES; line++){
+        uint32_t offset = (line * (ROM_BANK_SIZE / CART_PROBE_LINES)) + (line * CART_PROBE_LINE_LEN);
+        (*the_cart.rom_memcpy_func)(probe_line, (bank * ROM_BANK_SIZE) + offset, CART_PROBE_LINE_LEN);
+        hash = fnv1a_hash(probe_line, CART_PROBE_LINE_LEN, hash);
+    }
+    return hash;
+}
+
+uint16_t probe_rom_banks(){
+    // Bank 0 can't always be switched in (MBC1 gives bank 1 instead), so compare against bank 1
+    uint32_t bank1_hash = rom_bank_hash(1);
+    for(uint16_t banks = 2; banks < CART_PROBE_MAX_ROM_BANKS; banks <<= 1){
+        // Once the bank number goes past the end of the ROM, the mapper wraps back around.
+        // Check two spots so a couple of banks that happen to match don't fool us
+        if(rom_bank_hash(banks + 1) != bank1_hash){
+            continue;
+        }
+        if(rom_bank_hash(banks + (banks / 2)) != rom_bank_hash(banks / 2)){
+            continue;
+        }
+        return banks;
+    }
+    return 0;
+}
+
+uint8_t sram_peek(uint32_t ram_addr){
+    uint8_t val = 0;
+    (*the_cart.ram_memcpy_func)(&val, ram_addr, 1);
+    return val;
+}
+
+void sram_poke(uint32_t ram_addr, uint8_t val){
+    (*the_cart.ram_memset_func)(&val, ram_addr, 1);
+}
+
+uint16_t max_ram_banks(){
+    switch(the_cart.mapper_type){
+        case MAPPER_MBC1:
+        case MAPPER_MBC3:
+        case MAPPER_HUC1:
+            return 4;
+        case MAPPER_MBC5:
+        case MAPPER_GBCAM:
+            return CART_PROBE_MAX_RAM_BANKS;
+        default:
+            return 1;
+    }
+}
+
+uint32_t probe_ram_size(){
+    uint8_t original = sram_peek(0);
+    // First make sure there is anything there at all. Read something else in between
+    // so we don't just get back whatever was left floating on the data bus
+    sram_poke(0, ~original);
+    readb(CART_TITLE_ADDR);
+    uint8_t readback = sram_peek(0);
+    sram_poke(0, original);
+    if(readback != (uint8_t) ~original){
+        return 0;
+    }
+    // 2K chips only decode 11 address lines, so they repeat every 2K
+    uint8_t upper = sram_peek(0x800);
+    sram_poke(0x800, ~original);
+    readback = sram_peek(0);
+    sram_poke(0x800, upper);
+    sram_poke(0, original);
+    if(readback == (uint8_t) ~original){
+        return 0x800;
+    }
+    // Same deal with banks, a bank past the end lands back on bank 0
+    uint16_t max_banks = max_ram_banks();
+    for(uint16_t banks = 1; banks < max_banks; banks <<= 1){
+        uint32_t mirror_addr = banks * SRAM_BANK_SIZE;
+        uint8_t mirror_original = sram_peek(mirror_addr);
+        sram_poke(mirror_addr, ~original);
+        readback = sram_peek(0);
+        // If it did mirror, bank 0 gets written last so it ends up right
+        sram_poke(mirror_addr, mirror_original);
+        sram_poke(0, original);
+        if(readback == (uint8_t) ~original){
+            return banks * SRAM_BANK_SIZE;
+        }
+    }
+    return max_banks * SRAM_BANK_SIZE;
+}
+
+const struct CartProbeEntry* find_probe_entry(uint32_t fingerprint){
+    const struct CartProbeEntry* entries = (const struct CartProbeEntry*) FLASH_OFFSET_TO_XIP(FLASH_CART_PROBE_START);
+    // Newest entry for a cart wins
+    const struct CartProbeEntry* found = NULL;
+    for(uint32_t i = 0; i < CART_PROBE_ENTRIES; i++){
+        if(entries[i].magic != CART_PROBE_MAGIC){
+            break;
+        }
+        if(entries[i].fingerprint == fingerprint){
+            found = &entries[i];
+        }
+    }
+    return found;
+}
+
+void store_probe_entry(const struct CartProbeEntry* entry){
+    const struct CartProbeEntry* entries = (const struct CartProbeEntry*) FLASH_OFFSET_TO_XIP(FLASH_CART_PROBE_START);
+    uint32_t slot = 0;
+    while((slot < CART_PROBE_ENTRIES) && (entries[slot].magic == CART_PROBE_MAGIC)){
+        slot++;
+    }
+    bus_core_pause();
+    uint32_t ints = save_and_disable_interrupts();
+    // Out of room, start over. Carts will just get probed again the next time they show up
+    if(slot >= CART_PROBE_ENTRIES){
+        flash_range_erase(FLASH_CART_PROBE_START, FLASH_SECTOR_SIZE);
+        slot = 0;
+    }
+    // Programming 1s leaves flash alone, so the rest of the page can just be 0xFF
+    uint8_t page[FLASH_PAGE_SIZE];
+    uint32_t entry_offset = slot * sizeof(struct CartProbeEntry);
+    uint32_t page_offset = entry_offset & ~(FLASH_PAGE_SIZE - 1);
+    memset(page, 0xFF, FLASH_PAGE_SIZE);
+    memcpy(page + (entry_offset - page_offset), entry, sizeof(struct CartProbeEntry));
+    flash_range_program(FLASH_CART_PROBE_START + page_offset, page, FLASH_PAGE_SIZE);
+    restore_interrupts(ints);
+    bus_core_resume();
+}
+
+/*  - Public Function Definitions -  */
+
+void probe_cart_sizes(){
+    // Nothing to probe without a mapper we know how to drive
+    if(!the_cart.rom_memcpy_func){
+        append_status_file("CART PROBE: SKIPPED\n\0");
+        return;
+    }
+    uint16_t header_rom_banks = the_cart.rom_banks;
+    uint32_t header_ram_size = the_cart.ram_size_bytes;
+    uint32_t fingerprint = rom_cache_fingerprint();
+    const struct CartProbeEntry* cached = find_probe_entry(fingerprint);
+    struct CartProbeEntry entry = {0};
+    // Entries from before the RAM probe stopped at the mapper's limit can claim banks that
+    // aren't there, so those get probed again
+    if(cached && (cached->ram_banks <= max_ram_banks())){
+        entry = *cached;
+    }
+    else{
+        entry.magic = CART_PROBE_MAGIC;
+        entry.fingerprint = fingerprint;
+        entry.rom_banks = the_cart.rom_banks;
+        entry.ram_banks = the_cart.ram_banks;
+        entry.ram_size_bytes = the_cart.ram_size_bytes;
+        // No bank switching, no banks to probe
+        if(the_cart.rom_banksw_func){
+            uint16_t rom_banks = probe_rom_banks();
+            if(rom_banks){
+                entry.rom_banks = rom_banks;
+            }
+        }
+        // MBC2 RAM is inside the mapper and always the same size
+        if(the_cart.ram_memcpy_func && the_cart.ram_memset_func && (the_cart.mapper_type != MAPPER_MBC2)){
+            entry.ram_size_bytes = probe_ram_size();
+            entry.ram_banks = (entry.ram_size_bytes + SRAM_BANK_SIZE - 1) / SRAM_BANK_SIZE;
+        }
+        store_probe_entry(&entry);
+    }
+    the_cart.rom_banks = entry.rom_banks;
+    the_cart.rom_size_bytes = ROM_BANK_SIZE * the_cart.rom_banks;
+    the_cart.ram_banks = entry.ram_banks;
+    the_cart.ram_size_bytes = entry.ram_size_bytes;
+    if(!the_cart.ram_size_bytes){
+        the_cart.ram_end_address = SRAM_START_ADDR;
+    }
+    else if(the_cart.ram_size_bytes < SRAM_BANK_SIZE){
+        the_cart.ram_end_address = SRAM_START_ADDR + the_cart.ram_size_bytes - 1;
+    }
+    else{
+        the_cart.ram_end_address = SRAM_END_ADDR;
+    }
+    char line[64];
+    snprintf(line, sizeof(line), "CART PROBE: %s ROM %iK (HDR %iK), RAM %iK (HDR %iK)\n",
+        cached ? "CACHED" : "PROBED",
+        (int) (the_cart.rom_size_bytes / 1024), (int) ((header_rom_banks * ROM_BANK_SIZE) / 1024),
+        (int) (the_cart.ram_size_bytes / 1024), (int) (header_ram_size / 1024));
+    append_status_file_buf(line);
+}
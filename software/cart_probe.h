@@ -0,0 +1,32 @@
+#ifndef CART_PROBE_H_
+#define CART_PROBE_H_
+
+#include <stdint.h>
+
+// Figures out how much ROM and SRAM a cart really has instead of trusting the header.
+// Bad and bootleg headers can claim way more ROM than there is, which just dumps mirrors,
+// or less, which cuts the dump short
+
+#define CART_PROBE_MAGIC            0x50434247 // "GBCP"
+// Biggest cart any supported mapper can address, 8 MB of ROM and 128K of SRAM
+#define CART_PROBE_MAX_ROM_BANKS    512
+#define CART_PROBE_MAX_RAM_BANKS    16
+// How much of each bank gets hashed to compare banks
+#define CART_PROBE_LINES            4
+#define CART_PROBE_LINE_LEN         16
+// Results are remembered in one sector, one entry per cart
+#define CART_PROBE_ENTRIES          (FLASH_SECTOR_SIZE / sizeof(struct CartProbeEntry))
+
+struct CartProbeEntry {
+    uint32_t magic;
+    uint32_t fingerprint;    // Cart header fingerprint, same one the ROM cache uses
+    uint16_t rom_banks;
+    uint16_t ram_banks;
+    uint32_t ram_size_bytes;
+};
+
+// Probe the ROM and SRAM sizes, or look them up if this cart has been seen before,
+// and fix up the_cart to match. Call after populate_cart_info()
+void probe_cart_sizes();
+
+#endif
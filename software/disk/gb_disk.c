@@ -3,6 +3,11 @@
 #include "msc_disk.h"
 #include "mappers/gbcam.h"
 #include "gb.h"
+#include "save_snapshots.h"
+#include "bank_manifest.h"
+#include "log_ring.h"
+#include "metrics.h"
+#include "sram_writeback.h"
 
 #include <string.h>
 #include <stdio.h>
@@ -23,7 +28,13 @@ enum {
   INDEX_CLUSTER_SIZE_STATUS_FILE  = 0,
   INDEX_CLUSTER_SIZE_ROM_FILE     = 1,
   INDEX_CLUSTER_SIZE_RAM_FILE     = 2,
-  INDEX_CLUSTER_SIZE_PHOTOS       = 3
+  INDEX_CLUSTER_SIZE_PHOTOS       = 3,
+  INDEX_CLUSTER_SIZE_SAVES_DIR    = 4,
+  INDEX_CLUSTER_SIZE_SAVE_SNAPSHOT = 5,
+  INDEX_CLUSTER_SIZE_PNGS         = 6,
+  INDEX_CLUSTER_SIZE_BANKS        = 7,
+  INDEX_CLUSTER_SIZE_LOG          = 8,
+  INDEX_CLUSTER_SIZE_METRICS      = 9
 };
 
 // Indexes of all the cluster starting points. This is not redundant, as
@@ -35,7 +46,14 @@ enum {
   INDEX_CLUSTER_START_STATUS_FILE = 1,
   INDEX_CLUSTER_START_ROM_FILE = 2,
   INDEX_CLUSTER_START_RAM_FILE = 3,
-  INDEX_CLUSTER_START_PHOTOS = 4
+  INDEX_CLUSTER_START_PHOTOS = 4,
+  INDEX_CLUSTER_START_LIVE_BMP = 5,
+  INDEX_CLUSTER_START_PNGS = 6,
+  INDEX_CLUSTER_START_SAVES_DIR = 7,
+  INDEX_CLUSTER_START_SAVES = 8,
+  INDEX_CLUSTER_START_BANKS = 9,
+  INDEX_CLUSTER_START_LOG = 10,
+  INDEX_CLUSTER_START_METRICS = 11
 };  
 
 /*  - Private Variables -  */
@@ -43,14 +61,26 @@ enum {
 uint32_t latest_rd_entry = 0;
 // The most recent FAT table entry byte
 uint32_t latest_fat_entry = 0;
+// Root directory entry of LOG.TXT, its size changes as things get logged
+uint32_t log_rd_entry = 0;
 // The file entries of all the file indexes
 uint32_t file_lba_indexes[30] = {0};
 // The cluster sizes of all the files
-uint32_t file_cluster_sizes[4] = {0};
+uint32_t file_cluster_sizes[10] = {0};
 // The starting clusters of all the files
-uint32_t file_starting_clusters[5] = {0};
+uint32_t file_starting_clusters[12] = {0};
 // The size of the status file
 uint16_t status_file_size = 0;
+// Clusters written before any .SAV entry claimed them. Held until one does, or until they're
+// the oldest and room is needed
+struct PendingCluster {
+  uint32_t cluster;     // 0 when the slot is free
+  uint8_t blocks;       // One bit per block that has been written
+  uint32_t age;
+  uint8_t data[CLUSTER_BYTE_SIZE];
+};
+struct PendingCluster pending_clusters[FAT_PENDING_CLUSTERS] = {0};
+uint32_t pending_age = 0;
 // A blank root directory entry to use
 uint8_t blank_rd_entry[] = {      
   ' ' , ' ' , ' ' , ' ' , ' ' , ' ' , ' ' , ' ' , ' ' , ' ' , ' ' , // filename (uninitialized)
@@ -63,6 +93,8 @@ void append_status_file(const uint8_t* buf){
   uint16_t buf_index = 0;
   for(;;){
     if(status_file_size > STATUS_FILE_SIZE - 1){
+      // Full, whatever doesn't fit still goes to the log
+      log_ring_write((const char*) buf + buf_index, strlen((const char*) buf + buf_index));
       return;
     }
     if(buf[buf_index] == '\0'){
@@ -77,6 +109,8 @@ void append_status_file_buf(uint8_t* buf){
   uint16_t buf_index = 0;
   for(;;){
     if(status_file_size > STATUS_FILE_SIZE - 1){
+      // Full, whatever doesn't fit still goes to the log
+      log_ring_write((const char*) buf + buf_index, strlen((const char*) buf + buf_index));
       return;
     }
     if(buf[buf_index] == '\0'){
@@ -88,6 +122,24 @@ void append_status_file_buf(uint8_t* buf){
   }
 }
 
+uint16_t reserve_status_line(const char* line){
+  if((status_file_size + strlen(line)) > STATUS_FILE_SIZE){
+    return STATUS_LINE_NONE;
+  }
+  uint16_t offset = status_file_size;
+  append_status_file((const uint8_t*) line);
+  return offset;
+}
+
+void update_status_line(uint16_t offset, const char* line){
+  if(offset == STATUS_LINE_NONE){
+    return;
+  }
+  for(uint16_t i = 0; line[i] != '\0' && (offset + i) < status_file_size; i++){
+    DISK_status_file[offset + i] = line[i];
+  }
+}
+
 void init_disk_mem(){
   memset(DISK_status_file, ' ', STATUS_FILE_SIZE);
   // memset(DISK_fatTable, 0xFF, FAT_TABLE_SIZE);
@@ -188,12 +240,28 @@ void append_status_file_buf(uint8_t* buf);
 void init_disk_mem();
 // Set the file size of a file in the root directory
 void rd_set_file_size(uint32_t entry, uint32_t filesize);
+void update_log_file_size(){
+  // Not on the drive yet
+  if(!log_rd_entry){
+    return;
+  }
+  rd_set_file_size(log_rd_entry, log_ring_snapshot());
+}
+
 // Set the starting cluster for a given file 
 void rd_set_cluster_start(uint32_t entry, uint16_t start_cluster);
 // Set the file name of the file in the root directory
 void rd_set_file_name(uint32_t entry, uint8_t* name, uint16_t namelen, const char* ext);
 // Append a new entry to the root directory
 void rd_append_new_entry();
+// Look up where a cluster points to in the FAT table
+uint16_t fat_get_entry(uint32_t cluster);
+// Find which save file in the root directory a cluster belongs to. Returns -1 if none of them
+int32_t fat_find_save_addr(uint32_t cluster);
+// Cluster a block in the data section is in
+uint32_t fat_lba_cluster(uint32_t lba);
+// Slot holding a pending cluster, NULL if it isn't held
+struct PendingCluster* fat_pending_slot(uint32_t cluster);
 // Build a cluster chain in the FAT table for a new file. Return the new most recent cluster after building the chain
 uint32_t fat_build_cluster_chain(uint32_t starting_cluster, uint32_t num_bytes);
 // Add a new file to the fake disk
@@ -235,6 +303,16 @@ void set_file_cluster_sizes(){
   file_cluster_sizes[INDEX_CLUSTER_SIZE_RAM_FILE] = byte2cls(the_cart.ram_size_bytes);
   // Determined emprically
   file_cluster_sizes[INDEX_CLUSTER_SIZE_PHOTOS] = 2;
+  // Depends on how far the PNGs get scaled up
+  file_cluster_sizes[INDEX_CLUSTER_SIZE_PNGS] = byte2cls(gbcam_png_photo_size());
+  // Save snapshots only show up if there is a save small enough to snapshot
+  if(the_cart.ram_size_bytes && (the_cart.ram_size_bytes <= SAVE_MAX_SIZE)){
+    file_cluster_sizes[INDEX_CLUSTER_SIZE_SAVES_DIR] = 1;
+    file_cluster_sizes[INDEX_CLUSTER_SIZE_SAVE_SNAPSHOT] = byte2cls(the_cart.ram_size_bytes);
+  }
+  file_cluster_sizes[INDEX_CLUSTER_SIZE_BANKS] = byte2cls(bank_manifest_size());
+  file_cluster_sizes[INDEX_CLUSTER_SIZE_LOG] = byte2cls(LOG_RING_SIZE);
+  file_cluster_sizes[INDEX_CLUSTER_SIZE_METRICS] = byte2cls(METRICS_FILE_MAX);
 }
 
 void set_file_lba_indexes(){
@@ -252,12 +330,23 @@ void set_file_lba_indexes(){
   file_lba_indexes[FILE_INDEX_ROM_BIN]                = file_lba_indexes[FILE_INDEX_STATUS_FILE] + CLS2BLK(file_cluster_sizes[INDEX_CLUSTER_SIZE_STATUS_FILE]);
   file_lba_indexes[FILE_INDEX_SRAM_BIN]               = file_lba_indexes[FILE_INDEX_ROM_BIN] + CLS2BLK(file_cluster_sizes[INDEX_CLUSTER_SIZE_ROM_FILE]);
   uint32_t photo_cluster_size = 0;
+  uint32_t png_cluster_size = 0;
   if(the_cart.mapper_type == MAPPER_GBCAM){
     photo_cluster_size = file_cluster_sizes[INDEX_CLUSTER_SIZE_PHOTOS];
+    png_cluster_size = file_cluster_sizes[INDEX_CLUSTER_SIZE_PNGS];
   }
   file_lba_indexes[FILE_INDEX_PHOTOS_START]           = file_lba_indexes[FILE_INDEX_SRAM_BIN] + CLS2BLK(file_cluster_sizes[INDEX_CLUSTER_SIZE_RAM_FILE]);
   file_lba_indexes[FILE_INDEX_PHOTOS_END]             = file_lba_indexes[FILE_INDEX_PHOTOS_START] + (CLS2BLK(photo_cluster_size) * 30);
-  file_lba_indexes[FILE_INDEX_DATA_END]               = file_lba_indexes[FILE_INDEX_PHOTOS_END];
+  file_lba_indexes[FILE_INDEX_LIVE_BMP]               = file_lba_indexes[FILE_INDEX_PHOTOS_END];
+  file_lba_indexes[FILE_INDEX_PNGS_START]             = file_lba_indexes[FILE_INDEX_LIVE_BMP] + CLS2BLK(photo_cluster_size);
+  file_lba_indexes[FILE_INDEX_PNGS_END]               = file_lba_indexes[FILE_INDEX_PNGS_START] + (CLS2BLK(png_cluster_size) * 30);
+  file_lba_indexes[FILE_INDEX_SAVES_DIR]              = file_lba_indexes[FILE_INDEX_PNGS_END];
+  file_lba_indexes[FILE_INDEX_SAVES_START]            = file_lba_indexes[FILE_INDEX_SAVES_DIR] + CLS2BLK(file_cluster_sizes[INDEX_CLUSTER_SIZE_SAVES_DIR]);
+  file_lba_indexes[FILE_INDEX_SAVES_END]              = file_lba_indexes[FILE_INDEX_SAVES_START] + (CLS2BLK(file_cluster_sizes[INDEX_CLUSTER_SIZE_SAVE_SNAPSHOT]) * SAVE_MANIFESTS_PER_HALF);
+  file_lba_indexes[FILE_INDEX_BANKS_TXT]              = file_lba_indexes[FILE_INDEX_SAVES_END];
+  file_lba_indexes[FILE_INDEX_LOG_TXT]                = file_lba_indexes[FILE_INDEX_BANKS_TXT] + CLS2BLK(file_cluster_sizes[INDEX_CLUSTER_SIZE_BANKS]);
+  file_lba_indexes[FILE_INDEX_METRICS_JSN]            = file_lba_indexes[FILE_INDEX_LOG_TXT] + CLS2BLK(file_cluster_sizes[INDEX_CLUSTER_SIZE_LOG]);
+  file_lba_indexes[FILE_INDEX_DATA_END]               = file_lba_indexes[FILE_INDEX_METRICS_JSN] + CLS2BLK(file_cluster_sizes[INDEX_CLUSTER_SIZE_METRICS]);
 }
 
 void set_starting_clusters(){
@@ -266,6 +355,23 @@ void set_starting_clusters(){
   file_starting_clusters[INDEX_CLUSTER_START_ROM_FILE] = file_starting_clusters[INDEX_CLUSTER_START_STATUS_FILE] + file_cluster_sizes[INDEX_CLUSTER_SIZE_STATUS_FILE];
   file_starting_clusters[INDEX_CLUSTER_START_RAM_FILE] = file_starting_clusters[INDEX_CLUSTER_START_ROM_FILE] + file_cluster_sizes[INDEX_CLUSTER_SIZE_ROM_FILE];
   file_starting_clusters[INDEX_CLUSTER_START_PHOTOS] = file_starting_clusters[INDEX_CLUSTER_START_RAM_FILE] + file_cluster_sizes[INDEX_CLUSTER_SIZE_RAM_FILE];
+  // Photos only take up space on the disk for the camera
+  uint32_t photo_clusters = 0;
+  uint32_t live_clusters = 0;
+  uint32_t png_clusters = 0;
+  if(the_cart.mapper_type == MAPPER_GBCAM){
+    photo_clusters = file_cluster_sizes[INDEX_CLUSTER_SIZE_PHOTOS] * 30;
+    // The live view is the same size as a photo
+    live_clusters = file_cluster_sizes[INDEX_CLUSTER_SIZE_PHOTOS];
+    png_clusters = file_cluster_sizes[INDEX_CLUSTER_SIZE_PNGS] * 30;
+  }
+  file_starting_clusters[INDEX_CLUSTER_START_LIVE_BMP] = file_starting_clusters[INDEX_CLUSTER_START_PHOTOS] + photo_clusters;
+  file_starting_clusters[INDEX_CLUSTER_START_PNGS] = file_starting_clusters[INDEX_CLUSTER_START_LIVE_BMP] + live_clusters;
+  file_starting_clusters[INDEX_CLUSTER_START_SAVES_DIR] = file_starting_clusters[INDEX_CLUSTER_START_PNGS] + png_clusters;
+  file_starting_clusters[INDEX_CLUSTER_START_SAVES] = file_starting_clusters[INDEX_CLUSTER_START_SAVES_DIR] + file_cluster_sizes[INDEX_CLUSTER_SIZE_SAVES_DIR];
+  file_starting_clusters[INDEX_CLUSTER_START_BANKS] = file_starting_clusters[INDEX_CLUSTER_START_SAVES] + (file_cluster_sizes[INDEX_CLUSTER_SIZE_SAVE_SNAPSHOT] * SAVE_MANIFESTS_PER_HALF);
+  file_starting_clusters[INDEX_CLUSTER_START_LOG] = file_starting_clusters[INDEX_CLUSTER_START_BANKS] + file_cluster_sizes[INDEX_CLUSTER_SIZE_BANKS];
+  file_starting_clusters[INDEX_CLUSTER_START_METRICS] = file_starting_clusters[INDEX_CLUSTER_START_LOG] + file_cluster_sizes[INDEX_CLUSTER_SIZE_LOG];
 }
 
 // Set the file size of a file in the root directory
@@ -320,6 +426,132 @@ uint32_t fat_build_cluster_chain(uint32_t starting_cluster, uint32_t num_bytes){
   return starting_cluster; // TODO: Not sure how accurate this is, make sure it works
 }
 
+uint16_t fat_get_entry(uint32_t cluster){
+  // Clusters past the table we keep are never handed out, they are always free
+  if(((cluster * 2) + 1) >= FAT_TABLE_BYTE_SIZE){
+    return 0;
+  }
+  return DISK_fatTable[cluster * 2] | (DISK_fatTable[(cluster * 2) + 1] << 8);
+}
+
+int32_t fat_find_save_addr(uint32_t cluster){
+  uint32_t max_clusters = byte2cls(the_cart.ram_size_bytes);
+  // Entry 0 is the volume label
+  for(uint32_t entry = 1; entry < (BYTE_SIZE_ROOT_DIRECTORY / ROOT_DIR_ENTRY_SIZE); entry++){
+    uint8_t* rd = DISK_rootDirectory + ROOT_DIR_ENTRY(entry);
+    // End of the directory
+    if(rd[0] == 0x00){
+      break;
+    }
+    // Skip deleted files, directories, labels, and long file names
+    if((rd[0] == 0xE5) || (rd[11] & 0x18) || (rd[11] == 0x0F)){
+      continue;
+    }
+    // Our own save file is lower case, hosts write upper case
+    if(((rd[8] & ~0x20) != 'S') || ((rd[9] & ~0x20) != 'A') || ((rd[10] & ~0x20) != 'V')){
+      continue;
+    }
+    // Follow the chain, but no further than a save can be long
+    uint32_t chain_cluster = rd[ROOT_DIR_CLST_OFFS] | (rd[ROOT_DIR_CLST_OFFS + 1] << 8);
+    for(uint32_t i = 0; (i < max_clusters) && (chain_cluster >= 2) && (chain_cluster < 0xFFF8); i++){
+      if(chain_cluster == cluster){
+        return i * CLUSTER_BYTE_SIZE;
+      }
+      chain_cluster = fat_get_entry(chain_cluster);
+    }
+  }
+  return -1;
+}
+
+uint32_t fat_lba_cluster(uint32_t lba){
+  return ((lba - file_lba_indexes[FILE_INDEX_DATA_STARTS]) / CLUSTER_BLOCK_SIZE) + file_starting_clusters[INDEX_CLUSTER_START_FS];
+}
+
+struct PendingCluster* fat_pending_slot(uint32_t cluster){
+  for(uint8_t i = 0; i < FAT_PENDING_CLUSTERS; i++){
+    if(pending_clusters[i].cluster == cluster){
+      return &pending_clusters[i];
+    }
+  }
+  return NULL;
+}
+
+int32_t fat_remap_save_addr(uint32_t lba){
+  if(!the_cart.ram_size_bytes || !the_cart.ram_memset_func){
+    return -1;
+  }
+  // Only clusters a .SAV entry's chain runs through. Anything else is some other file, or
+  // one whose entry hasn't shown up yet
+  int32_t save_addr = fat_find_save_addr(fat_lba_cluster(lba));
+  if(save_addr < 0){
+    return -1;
+  }
+  return save_addr + BLK2BYTE((lba - file_lba_indexes[FILE_INDEX_DATA_STARTS]) % CLUSTER_BLOCK_SIZE);
+}
+
+void fat_pending_write(uint32_t lba, uint32_t offset, const uint8_t* buf, uint32_t len){
+  if(!the_cart.ram_size_bytes || !the_cart.ram_memset_func){
+    return;
+  }
+  uint32_t cluster = fat_lba_cluster(lba);
+  uint32_t block = (lba - file_lba_indexes[FILE_INDEX_DATA_STARTS]) % CLUSTER_BLOCK_SIZE;
+  struct PendingCluster* slot = fat_pending_slot(cluster);
+  if(!slot){
+    // A free slot, or else the one held the longest
+    slot = &pending_clusters[0];
+    for(uint8_t i = 0; i < FAT_PENDING_CLUSTERS; i++){
+      if(!pending_clusters[i].cluster){
+        slot = &pending_clusters[i];
+        break;
+      }
+      if(pending_clusters[i].age < slot->age){
+        slot = &pending_clusters[i];
+      }
+    }
+    if(slot->cluster){
+      printf("FAT: cluster %lu dropped, no save claimed it\n", (unsigned long) slot->cluster);
+    }
+    slot->cluster = cluster;
+    slot->blocks = 0;
+    memset(slot->data, 0, CLUSTER_BYTE_SIZE);
+  }
+  slot->age = ++pending_age;
+  memcpy(slot->data + BLK2BYTE(block) + offset, buf, len);
+  slot->blocks |= 1 << block;
+}
+
+uint8_t fat_pending_read(uint32_t lba, uint32_t offset, uint8_t* buf, uint32_t len){
+  struct PendingCluster* slot = fat_pending_slot(fat_lba_cluster(lba));
+  uint32_t block = (lba - file_lba_indexes[FILE_INDEX_DATA_STARTS]) % CLUSTER_BLOCK_SIZE;
+  if(!slot || !(slot->blocks & (1 << block))){
+    return 0;
+  }
+  memcpy(buf, slot->data + BLK2BYTE(block) + offset, len);
+  return 1;
+}
+
+void fat_flush_pending(){
+  for(uint8_t i = 0; i < FAT_PENDING_CLUSTERS; i++){
+    struct PendingCluster* slot = &pending_clusters[i];
+    if(!slot->cluster){
+      continue;
+    }
+    int32_t save_addr = fat_find_save_addr(slot->cluster);
+    if(save_addr < 0){
+      continue;
+    }
+    for(uint8_t block = 0; block < CLUSTER_BLOCK_SIZE; block++){
+      uint32_t addr = save_addr + BLK2BYTE(block);
+      if(!(slot->blocks & (1 << block)) || (addr >= the_cart.ram_size_bytes)){
+        continue;
+      }
+      uint32_t len = (the_cart.ram_size_bytes - addr) < BLOCK_SIZE ? (the_cart.ram_size_bytes - addr) : BLOCK_SIZE;
+      sram_writeback(slot->data + BLK2BYTE(block), addr, len);
+    }
+    slot->cluster = 0;
+  }
+}
+
 void append_new_file(uint8_t* name, uint16_t namelen, const char* ext, uint32_t filesize, uint32_t fat_entry){
   // Append a new blank entry to the root directory so we can populate it
   rd_append_new_entry();
@@ -333,6 +565,59 @@ void append_new_file(uint8_t* name, uint16_t namelen, const char* ext, uint32_t
   fat_build_cluster_chain(fat_entry, filesize);
 }
 
+uint32_t save_snapshot_blocks(){
+  return CLS2BLK(file_cluster_sizes[INDEX_CLUSTER_SIZE_SAVE_SNAPSHOT]);
+}
+
+void render_saves_dir(uint8_t* buf, uint32_t block){
+  // Anything past the last entry is zeros, which marks the end of the directory
+  memset(buf, 0, BLOCK_SIZE);
+  uint32_t first_entry = (block * BLOCK_SIZE) / ROOT_DIR_ENTRY_SIZE;
+  uint32_t num_entries = 2 + save_snapshot_count();
+  for(uint32_t e = first_entry; (e < num_entries) && (e < first_entry + (BLOCK_SIZE / ROOT_DIR_ENTRY_SIZE)); e++){
+    uint8_t* entry = buf + ((e - first_entry) * ROOT_DIR_ENTRY_SIZE);
+    memcpy(entry, blank_rd_entry, ROOT_DIR_ENTRY_SIZE);
+    uint16_t cluster = 0;
+    uint32_t filesize = 0;
+    // Every directory starts with itself and its parent. Parent is the root, which is cluster 0
+    if(e == 0){
+      memcpy(entry, ".          ", 11);
+      entry[11] = 0x10;
+      cluster = file_starting_clusters[INDEX_CLUSTER_START_SAVES_DIR];
+    }
+    else if(e == 1){
+      memcpy(entry, "..         ", 11);
+      entry[11] = 0x10;
+    }
+    else{
+      const struct SaveManifest* manifest = save_snapshot_get(e - 2);
+      // Name is the start of the title and the snapshot version, FAT short names can only be so long
+      char name[9] = {0};
+      for(uint8_t i = 0; i < SAVE_SNAPSHOT_TITLE_LEN; i++){
+        char c = manifest->title[i];
+        if(c >= 'a' && c <= 'z'){
+          c -= 'a' - 'A';
+        }
+        if(!((c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9'))){
+          c = '_';
+        }
+        name[i] = c;
+      }
+      snprintf(name + SAVE_SNAPSHOT_TITLE_LEN, 9 - SAVE_SNAPSHOT_TITLE_LEN, "_%03u", manifest->version % 1000);
+      memcpy(entry, name, 8);
+      memcpy(entry + 8, "SAV", 3);
+      cluster = file_starting_clusters[INDEX_CLUSTER_START_SAVES] + ((e - 2) * file_cluster_sizes[INDEX_CLUSTER_SIZE_SAVE_SNAPSHOT]);
+      filesize = manifest->size;
+    }
+    for(uint8_t i = 0; i < 2; i++){
+      entry[ROOT_DIR_CLST_OFFS + i] = (cluster >> (i * 8)) & 0xFF;
+    }
+    for(uint8_t i = 0; i < 4; i++){
+      entry[ROOT_DIR_SIZE_OFFS + i] = (filesize >> (i * 8)) & 0xFF;
+    }
+  }
+}
+
 void init_disk(){
   // Set the cluster sizes of all the files
   set_file_cluster_sizes();
@@ -386,7 +671,44 @@ void init_disk(){
       snprintf(name, 9, "GBCAM_%i", i);
       append_new_file(name, 8, "bmp", 7286, file_starting_clusters[INDEX_CLUSTER_START_PHOTOS] + (i * file_cluster_sizes[INDEX_CLUSTER_SIZE_PHOTOS]));
     }
+    // A new frame from the sensor every time the host reads it from the start
+    char live_name[] = {"LIVE"};
+    append_new_file(live_name, 4, "bmp", GBCAM_BMP_PHOTO_SIZE, file_starting_clusters[INDEX_CLUSTER_START_LIVE_BMP]);
+    // The same photos again as PNGs, half the size going over USB
+    for(uint8_t i = 0; i < 30; i++){
+      char name[9] = {0};
+      snprintf(name, 9, "GBCAM_%i", i);
+      append_new_file(name, 8, "png", gbcam_png_photo_size(), file_starting_clusters[INDEX_CLUSTER_START_PNGS] + (i * file_cluster_sizes[INDEX_CLUSTER_SIZE_PNGS]));
+    }
+  }
+  // HANDLE SAVE SNAPSHOTS
+  // The directory itself is a fixed cluster, but what is in it is rendered on every read
+  // since a new snapshot can show up whenever the save gets written
+  if(file_cluster_sizes[INDEX_CLUSTER_SIZE_SAVES_DIR]){
+    char saves_name[] = {"SAVES"};
+    append_new_file(saves_name, 5, "   ", CLUSTER_BYTE_SIZE, file_starting_clusters[INDEX_CLUSTER_START_SAVES_DIR]);
+    // Directories are flagged as such and always have a size of 0
+    DISK_rootDirectory[ROOT_DIR_ENTRY(latest_rd_entry) + 11] = 0x10;
+    rd_set_file_size(latest_rd_entry, 0);
+    // Chain up every slot now, even empty ones, so the FAT never has to change later
+    for(uint8_t i = 0; i < SAVE_MANIFESTS_PER_HALF; i++){
+      fat_build_cluster_chain(file_starting_clusters[INDEX_CLUSTER_START_SAVES] + (i * file_cluster_sizes[INDEX_CLUSTER_SIZE_SAVE_SNAPSHOT]), the_cart.ram_size_bytes);
+    }
   }
+  // HANDLE BANK MANIFEST
+  // Hashes of every bank, filled in as they get worked out
+  char banks_name[] = {"BANKS"};
+  append_new_file(banks_name, 5, "txt", bank_manifest_size(), file_starting_clusters[INDEX_CLUSTER_START_BANKS]);
+  // HANDLE LOG
+  // Room for the whole ring, only as long as what's been logged so far
+  char log_name[] = {"LOG"};
+  append_new_file(log_name, 3, "txt", LOG_RING_SIZE, file_starting_clusters[INDEX_CLUSTER_START_LOG]);
+  log_rd_entry = latest_rd_entry;
+  update_log_file_size();
+  // HANDLE METRICS
+  // Rendered as it's read, always the same size
+  char metrics_name[] = {"METRICS"};
+  append_new_file(metrics_name, 7, "jsn", metrics_file_size(), file_starting_clusters[INDEX_CLUSTER_START_METRICS]);
 }
 
 
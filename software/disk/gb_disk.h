@@ -24,9 +24,15 @@ enum
   // 8192 entries for 32MB ROM
   // 8192 entries for 32MB SRAM
   // 2 entries (8K) for each photo, 32 photos total
+  // 4 entries (16K) for each photo as a PNG, 32 photos total
+  // 1 entry for the saves directory
+  // 32 entries (128K) for each save snapshot, 32 snapshots total
+  // 3 entries for the bank manifest
+  // 2 entries (8K) for the log
+  // 1 entry for the metrics
   // Two bytes per entry (FAT16 = 16 bit entries)
-  // Add 382 to make it block aligned (divisible by 512)
-  FAT_TABLE_BYTE_SIZE = ((1 + 8192 + 8192 + (2 * 32)) * 2) + 382, 
+  // Add 112 to make it block aligned (divisible by 512)
+  FAT_TABLE_BYTE_SIZE = ((1 + 8192 + 8192 + (2 * 32) + (4 * 32) + 1 + (32 * 32) + 3 + 2 + 1) * 2) + 112, 
   // I am not actually holding the whole FAT table in RAM, so need to know when 
   // the PC requests something beyond that so I can just send it a 0
   FAT_TABLE_BLOCK_SIZE = FAT_TABLE_BYTE_SIZE / BLOCK_SIZE,
@@ -35,11 +41,20 @@ enum
   // 1 ROM file
   // 1 SRAM file
   // 30 Photo files
+  // 1 live camera view
+  // 30 PNG photo files
+  // 1 saves directory
+  // 1 bank manifest
+  // 1 log
+  // 1 metrics
   // 32 bytes per entry
-  // Add 480 bytes to make it block aligned (divisible by 512)
-  BYTE_SIZE_ROOT_DIRECTORY = ((1 + 1 + 1 + 30) * 32) + 480, 
+  // Add 384 bytes to make it block aligned (divisible by 512)
+  BYTE_SIZE_ROOT_DIRECTORY = ((1 + 1 + 1 + 30 + 1 + 30 + 1 + 1 + 1 + 1) * 32) + 384, 
   BLOCK_SIZE_ROOT_DIRECTORY = BYTE_SIZE_ROOT_DIRECTORY / BLOCK_SIZE,
-  STATUS_FILE_SIZE = BLOCK_SIZE, // Small for now, can be up to 1 cluster (4k) with current layout
+  STATUS_FILE_SIZE = BLOCK_SIZE * 4, // Can be up to 1 cluster (4k) with current layout
+  STATUS_LINE_LEN = 40, // Longest line that can be reserved and rewritten in place
+  STATUS_LINE_NONE = 0xFFFF, // Line could not be reserved
+  FAT_PENDING_CLUSTERS = 8, // Unclaimed clusters held in case they're a save, 32K
 };
 
 // Indexes of all the LBA starting points
@@ -60,8 +75,26 @@ enum {
   FILE_INDEX_PHOTOS_START      = 8,
   // Photos end after 30 entries
   FILE_INDEX_PHOTOS_END        = 9,
+  // Live camera view comes after the photos, the same size as one (only there for the camera)
+  FILE_INDEX_LIVE_BMP          = 10,
+  // PNG copies of the photos start after the live view (only there for the camera)
+  FILE_INDEX_PNGS_START        = 11,
+  // PNGs end after 30 entries
+  FILE_INDEX_PNGS_END          = 12,
+  // Saves directory starts after the PNGs (1 cluster large, only there if the cart has RAM)
+  FILE_INDEX_SAVES_DIR         = 13,
+  // Save snapshots start after the saves directory, one RAM file sized slot per snapshot
+  FILE_INDEX_SAVES_START       = 14,
+  // Save snapshots end after SAVE_MANIFESTS_PER_HALF slots
+  FILE_INDEX_SAVES_END         = 15,
+  // Bank manifest comes after the save snapshots
+  FILE_INDEX_BANKS_TXT         = 16,
+  // Log comes after the bank manifest
+  FILE_INDEX_LOG_TXT           = 17,
+  // Metrics come after the log
+  FILE_INDEX_METRICS_JSN       = 18,
   // End of the files on the drive
-  FILE_INDEX_DATA_END          = 10  
+  FILE_INDEX_DATA_END          = 19
 };
 
 // Arrays that hold the fake disk data
@@ -78,4 +111,24 @@ void init_disk();
 void append_status_file(const uint8_t* buf);
 // Append data to the status file, arbitrary buf
 void append_status_file_buf(uint8_t* buf);
+// Append a line to the status file that gets rewritten later. Returns where it is, for update_status_line
+uint16_t reserve_status_line(const char* line);
+// Rewrite a reserved line in place. Keep it the same length it was reserved with
+void update_status_line(uint16_t offset, const char* line);
+// Size LOG.TXT in the root directory to match what it reads back as right now
+void update_log_file_size();
+// Work out where in the save a block in free space belongs, for saves the host writes
+// as a new file. Returns -1 unless a .SAV entry in the root directory claims its cluster
+int32_t fat_remap_save_addr(uint32_t lba);
+// Hold on to a block written to free space nothing claims yet. Hosts don't always write the
+// directory before the data, so it might turn out to be a save
+void fat_pending_write(uint32_t lba, uint32_t offset, const uint8_t* buf, uint32_t len);
+// Read back a held block. Returns 0 if it isn't held
+uint8_t fat_pending_read(uint32_t lba, uint32_t offset, uint8_t* buf, uint32_t len);
+// Send held blocks that a .SAV entry now claims to SRAM. Call after FAT or directory writes
+void fat_flush_pending();
+// Fill in one block of the saves directory, which lists the snapshots there are right now
+void render_saves_dir(uint8_t* buf, uint32_t block);
+// Number of blocks each save snapshot file takes up
+uint32_t save_snapshot_blocks();
 #endif
\ No newline at end of file
@@ -3,12 +3,48 @@
 #include "class/msc/msc.h"
 #include "Fat16Struct.h"
 #include "pico.h"
+#include "pico/stdlib.h"
 #include <hardware/flash.h>
 #include "msc_disk.h"
 #include "gb_disk.h"
 #include "mappers/gbcam.h"
+#include "rom_cache.h"
+#include "save_snapshots.h"
+#include "sram_writeback.h"
+#include "flash_cart.h"
+#include "live_cam.h"
+#include "bus_core.h"
+#include "bank_manifest.h"
+#include "log_ring.h"
+#include "metrics.h"
+
+#include <stdio.h>
 
 uint8_t ejected = 0;
+// Same thing for the raw LUNs, one bit each, so ejecting one doesn't take the others with it
+uint8_t raw_luns_ejected = 0;
+// The saves directory is rendered a block at a time as it is read
+uint8_t saves_dir_block[BLOCK_SIZE] = {0};
+// A cart read core 1 is doing for read10. The MSC driver only ever has one transfer
+// going, so one is all there can be
+struct MscPendingRead {
+  uint8_t active;
+  uint8_t lun;
+  uint32_t lba;
+  uint32_t offset;
+  uint32_t bufsize;
+  struct BusCmd cmd;
+};
+struct MscPendingRead msc_pending = {0};
+uint8_t msc_read_buf[CFG_TUD_MSC_EP_BUFSIZE] = {0};
+// Worst gap between trips round the main loop, which is how long tud_task can go without running
+uint64_t msc_loop_last_us = 0;
+uint32_t msc_loop_max_us = 0;
+uint32_t msc_loop_window_max_us = 0;
+uint64_t msc_loop_window_start_us = 0;
+uint16_t msc_loop_line_offset = STATUS_LINE_NONE;
+// When the READ10 in progress first called back, 0 if there isn't one
+uint64_t msc_read10_start_us = 0;
 
 
 void software_reset()
@@ -21,17 +57,174 @@ void software_reset()
 //   unsigned int pageCountFlash;
 // }flashingLocation = {.pageCountFlash = 0};
 
+// Size of the raw LUN in bytes, 0 if it has nothing behind it
+uint32_t raw_lun_size(uint8_t lun)
+{
+  if((lun == MSC_LUN_ROM) && the_cart.rom_memcpy_func){
+    return the_cart.rom_size_bytes;
+  }
+  if((lun == MSC_LUN_SRAM) && the_cart.ram_memcpy_func){
+    return the_cart.ram_size_bytes;
+  }
+  return 0;
+}
+
+// Check a raw LUN transfer lands inside the ROM or save
+bool raw_lun_in_range(uint8_t lun, uint32_t lba, uint32_t offset, uint32_t bufsize)
+{
+  uint32_t size = raw_lun_size(lun);
+  uint32_t addr = (lba * BLOCK_SIZE) + offset;
+  return (lba < (size / BLOCK_SIZE)) && (bufsize <= (size - addr));
+}
+
+// Read from the cart for read10 without holding up tud_task. The first call hands the read
+// to core 1 and returns 0, which has TinyUSB call again on its next pass. Once core 1 is
+// done the data gets copied out and the size returned. Goes straight to the bus when core 1
+// isn't running
+int32_t msc_cart_read(uint8_t lun, uint32_t lba, uint32_t offset, void* buffer, uint32_t bufsize, uint8_t space, uint32_t addr)
+{
+  if(!bus_core_owns_bus() || (bufsize > sizeof(msc_read_buf))){
+    bus_read(space, addr, buffer, bufsize);
+    bank_manifest_observe(space, addr, buffer, bufsize);
+    return (int32_t) bufsize;
+  }
+  uint8_t same = (msc_pending.lun == lun) && (msc_pending.lba == lba) && (msc_pending.offset == offset) && (msc_pending.bufsize == bufsize);
+  if(msc_pending.active && !same){
+    // Host gave up on the last one. Core 1 still has our buffer until it's finished
+    bus_wait(&msc_pending.cmd);
+    msc_pending.active = 0;
+  }
+  if(!msc_pending.active){
+    msc_pending.lun = lun;
+    msc_pending.lba = lba;
+    msc_pending.offset = offset;
+    msc_pending.bufsize = bufsize;
+    msc_pending.cmd.op = BUS_CMD_READ;
+    msc_pending.cmd.space = space;
+    msc_pending.cmd.addr = addr;
+    msc_pending.cmd.len = bufsize;
+    msc_pending.cmd.buf = msc_read_buf;
+    bus_submit(&msc_pending.cmd);
+    msc_pending.active = 1;
+    return 0;
+  }
+  if(!msc_pending.cmd.done){
+    return 0;
+  }
+  bus_wait(&msc_pending.cmd);
+  memcpy(buffer, msc_read_buf, bufsize);
+  msc_pending.active = 0;
+  bank_manifest_observe(space, addr, buffer, bufsize);
+  return (int32_t) bufsize;
+}
+
+// ROM reads come from the cache when it has them, and go in it when they come off the cart
+int32_t msc_rom_read(uint8_t lun, uint32_t lba, uint32_t offset, void* buffer, uint32_t bufsize, uint32_t rom_addr)
+{
+  // Mid-erase the chip reads back status, and bank switches could look like commands to it.
+  // Hold off until the write is in
+  if(flash_cart_busy()){
+    return 0;
+  }
+  if(rom_cache_read(buffer, rom_addr, bufsize)){
+    bank_manifest_observe(BUS_SPACE_ROM, rom_addr, buffer, bufsize);
+    METRICS_ADD(metrics.cache_hits, 1);
+    // Every bank the read touches is one the mapper didn't have to be switched to
+    METRICS_ADD(metrics.bank_switches_avoided, ((rom_addr + bufsize - 1) / ROM_BANK_SIZE) - (rom_addr / ROM_BANK_SIZE) + 1);
+    return (int32_t) bufsize;
+  }
+  int32_t ret = msc_cart_read(lun, lba, offset, buffer, bufsize, BUS_SPACE_ROM, rom_addr);
+  if(ret > 0){
+    METRICS_ADD(metrics.cache_misses, 1);
+    rom_cache_capture(buffer, rom_addr, bufsize);
+  }
+  return ret;
+}
+
+void init_msc_latency()
+{
+  // Fixed width so it can be rewritten in place
+  char line[STATUS_LINE_LEN + 1];
+  snprintf(line, sizeof(line), "TUD LOOP MAX %7luus 1S %7luus\n", 0UL, 0UL);
+  msc_loop_line_offset = reserve_status_line(line);
+}
+
+void msc_latency_task()
+{
+  uint64_t now = time_us_64();
+  if(msc_loop_last_us){
+    uint32_t gap = now - msc_loop_last_us;
+    if(gap > msc_loop_max_us){
+      msc_loop_max_us = gap;
+    }
+    if(gap > msc_loop_window_max_us){
+      msc_loop_window_max_us = gap;
+    }
+  }
+  msc_loop_last_us = now;
+  if((now - msc_loop_window_start_us) < 1000000){
+    return;
+  }
+  char line[STATUS_LINE_LEN + 1];
+  snprintf(line, sizeof(line), "TUD LOOP MAX %7luus 1S %7luus\n", (unsigned long) msc_loop_max_us, (unsigned long) msc_loop_window_max_us);
+  update_status_line(msc_loop_line_offset, line);
+  msc_loop_window_start_us = now;
+  msc_loop_window_max_us = 0;
+  // Don't count the time spent on the status file
+  msc_loop_last_us = time_us_64();
+}
+
+void msc_latency_idle()
+{
+  msc_loop_last_us = 0;
+}
+
+// Bytes of a transfer that land before end_lba. The stack asks again for the rest
+uint32_t msc_span(uint32_t lba, uint32_t offset, uint32_t bufsize, uint32_t end_lba)
+{
+  uint32_t left = ((end_lba - lba) * BLOCK_SIZE) - offset;
+  return bufsize < left ? bufsize : left;
+}
+
+// Which METRICS_REGION_* a transfer is for
+uint8_t msc_region(uint8_t lun, uint32_t lba)
+{
+  if(lun == MSC_LUN_ROM){
+    return METRICS_REGION_ROM;
+  }
+  if(lun == MSC_LUN_SRAM){
+    return METRICS_REGION_RAM;
+  }
+  if((lba >= file_lba_indexes[FILE_INDEX_ROM_BIN]) && (lba < file_lba_indexes[FILE_INDEX_SRAM_BIN])){
+    return METRICS_REGION_ROM;
+  }
+  if((lba >= file_lba_indexes[FILE_INDEX_SRAM_BIN]) && (lba < file_lba_indexes[FILE_INDEX_PHOTOS_START])){
+    return METRICS_REGION_RAM;
+  }
+  return METRICS_REGION_OTHER;
+}
+
 /*  - TinyUSB Function Callbacks -  */
 
+// Invoked when received GET_MAX_LUN request
+uint8_t tud_msc_get_maxlun_cb(void)
+{
+  return MSC_LUN_COUNT;
+}
+
 // Invoked when received SCSI_CMD_INQUIRY
 // Application fill vendor id, product id and revision with string up to 8, 16, 4 characters respectively
 void tud_msc_inquiry_cb(uint8_t lun, uint8_t vendor_id[8], uint8_t product_id[16], uint8_t product_rev[4])
 {
-  (void) lun;
-
   const char vid[] = "kidoutai";
-  const char pid[] = "GBPunk";
+  const char* pid = "GBPunk";
   const char rev[] = "1.0";
+  if(lun == MSC_LUN_ROM){
+    pid = "GBPunk ROM";
+  }
+  else if(lun == MSC_LUN_SRAM){
+    pid = "GBPunk SRAM";
+  }
 
   memcpy(vendor_id  , vid, strlen(vid));
   memcpy(product_id , pid, strlen(pid));
@@ -42,7 +235,14 @@ void tud_msc_inquiry_cb(uint8_t lun, uint8_t vendor_id[8], uint8_t product_id[16
 // return true allowing host to read/write this LUN e.g SD card inserted
 bool tud_msc_test_unit_ready_cb(uint8_t lun)
 {
-  (void) lun;
+  // Raw LUNs are ready as long as there's a ROM or save behind them
+  if(lun != MSC_LUN_FAT){
+    if((raw_luns_ejected & (1 << lun)) || !raw_lun_size(lun)){
+      tud_msc_set_sense(lun, SCSI_SENSE_NOT_READY, 0x3a, 0x00);
+      return false;
+    }
+    return true;
+  }
 
   // RAM disk is ready until ejected
   if (ejected) {
@@ -58,10 +258,11 @@ bool tud_msc_test_unit_ready_cb(uint8_t lun)
 // Application update block count and block size
 void tud_msc_capacity_cb(uint8_t lun, uint32_t* block_count, uint16_t* block_size)
 {
-  (void) lun;
-
   *block_count = DISK_BLOCK_COUNT;
   *block_size  = BLOCK_SIZE;
+  if(lun != MSC_LUN_FAT){
+    *block_count = raw_lun_size(lun) / BLOCK_SIZE;
+  }
 }
 
 // Invoked when received Start Stop Unit command
@@ -69,7 +270,6 @@ void tud_msc_capacity_cb(uint8_t lun, uint32_t* block_count, uint16_t* block_siz
 // - Start = 1 : active mode, if load_eject = 1 : load disk storage
 bool tud_msc_start_stop_cb(uint8_t lun, uint8_t power_condition, bool start, bool load_eject)
 {
-  (void) lun;
   (void) power_condition;
 
   if ( load_eject )
@@ -80,21 +280,37 @@ bool tud_msc_start_stop_cb(uint8_t lun, uint8_t power_condition, bool start, boo
     }else
     {
       // unload disk storage
-      ejected = true;
+      if(lun == MSC_LUN_FAT){
+        ejected = true;
+      }
+      else{
+        raw_luns_ejected |= (1 << lun);
+      }
     }
   }
 
   return true;
 }
 
-// Callback invoked when received READ10 command.
 // Copy disk's data to buffer (up to bufsize) and return number of copied bytes.
-int32_t tud_msc_read10_cb(uint8_t lun, uint32_t lba, uint32_t offset, void* buffer, uint32_t bufsize)
+int32_t msc_read10(uint8_t lun, uint32_t lba, uint32_t offset, void* buffer, uint32_t bufsize)
 {
-  (void) lun;
+  // Raw LUNs go straight to the cart, no FAT to get through
+  if(lun != MSC_LUN_FAT){
+    if(!raw_lun_in_range(lun, lba, offset, bufsize)) return -1;
+    uint32_t raw_addr = (lba * BLOCK_SIZE) + offset;
+    if(lun == MSC_LUN_SRAM){
+      return msc_cart_read(lun, lba, offset, buffer, bufsize, BUS_SPACE_RAM, raw_addr);
+    }
+    return msc_rom_read(lun, lba, offset, buffer, bufsize, raw_addr);
+  }
 
   // out of ramdisk
   if ( lba >= DISK_BLOCK_COUNT ) return -1;
+  // Only ROM.BIN and SRAM.BIN are read more than a block at a time, everything else is
+  // laid out in blocks. Returning less has TinyUSB call again for the rest
+  uint32_t cart_bufsize = bufsize;
+  bufsize = msc_span(lba, offset, bufsize, lba + 1);
   // printf("lba 0x%x, bufsize %d, offset %d\n",lba, bufsize, offset);
   uint8_t const* addr = 0;
   // memcpy(buffer, addr, bufsize);
@@ -116,20 +332,27 @@ int32_t tud_msc_read10_cb(uint8_t lun, uint32_t lba, uint32_t offset, void* buff
   }
   else if((lba >= file_lba_indexes[FILE_INDEX_ROOT_DIRECTORY]) && (lba < file_lba_indexes[FILE_INDEX_ROOT_DIRECTORY] + BLOCK_SIZE_ROOT_DIRECTORY))
   {
+    // Every directory read sees LOG.TXT as long as the log is now
+    update_log_file_size();
     addr = DISK_rootDirectory + ((lba - file_lba_indexes[FILE_INDEX_ROOT_DIRECTORY]) * BLOCK_SIZE) + offset;
   }
   else if(lba >= file_lba_indexes[FILE_INDEX_STATUS_FILE] && lba < file_lba_indexes[FILE_INDEX_ROM_BIN])
   {
-    addr = DISK_status_file; // TODO: This will fail if/when the status file is bigger than one block
+    // The status file's cluster is bigger than the file, the rest reads as zeros
+    uint32_t status_offset = ((lba - file_lba_indexes[FILE_INDEX_STATUS_FILE]) * BLOCK_SIZE) + offset;
+    if(status_offset < STATUS_FILE_SIZE){
+      addr = DISK_status_file + status_offset;
+    }
   }
   else if(lba >= file_lba_indexes[FILE_INDEX_ROM_BIN] && lba <  file_lba_indexes[FILE_INDEX_SRAM_BIN]){
-    (*the_cart.rom_memcpy_func)(buffer, ((lba - file_lba_indexes[FILE_INDEX_ROM_BIN]) * BLOCK_SIZE) + offset, bufsize);
-    return (int32_t) bufsize;
+    uint32_t rom_addr = ((lba - file_lba_indexes[FILE_INDEX_ROM_BIN]) * BLOCK_SIZE) + offset;
+    bufsize = msc_span(lba, offset, cart_bufsize, file_lba_indexes[FILE_INDEX_SRAM_BIN]);
+    // Serve from flash if we have this cart cached, otherwise go to the cart and record it for next time
+    return msc_rom_read(lun, lba, offset, buffer, bufsize, rom_addr);
   }
   else if(lba >= file_lba_indexes[FILE_INDEX_SRAM_BIN] && lba < file_lba_indexes[FILE_INDEX_PHOTOS_START] ){
-    (*the_cart.ram_memcpy_func)(buffer, ((lba - file_lba_indexes[FILE_INDEX_SRAM_BIN]) * BLOCK_SIZE) + offset, bufsize);
-    // memset(buffer, 0, bufsize); // TODO
-    return (int32_t) bufsize;
+    bufsize = msc_span(lba, offset, cart_bufsize, file_lba_indexes[FILE_INDEX_PHOTOS_START]);
+    return msc_cart_read(lun, lba, offset, buffer, bufsize, BUS_SPACE_RAM, ((lba - file_lba_indexes[FILE_INDEX_SRAM_BIN]) * BLOCK_SIZE) + offset);
   }
   // TODO: Not entering here when opening a photo
   else if((lba >= file_lba_indexes[FILE_INDEX_PHOTOS_START] ) && (lba < file_lba_indexes[FILE_INDEX_PHOTOS_END])){
@@ -140,6 +363,65 @@ int32_t tud_msc_read10_cb(uint8_t lun, uint32_t lba, uint32_t offset, void* buff
     memcpy(buffer, (working_mem + LBA2PHOTOOFFSET(lba - file_lba_indexes[FILE_INDEX_PHOTOS_START] ) * BLOCK_SIZE)  + offset, bufsize);
     return (int32_t) bufsize;
   }
+  else if((lba >= file_lba_indexes[FILE_INDEX_LIVE_BMP]) && (lba < file_lba_indexes[FILE_INDEX_PNGS_START])){
+    live_cam_read_bmp(buffer, ((lba - file_lba_indexes[FILE_INDEX_LIVE_BMP]) * BLOCK_SIZE) + offset, bufsize);
+    return (int32_t) bufsize;
+  }
+  else if((lba >= file_lba_indexes[FILE_INDEX_PNGS_START]) && (lba < file_lba_indexes[FILE_INDEX_PNGS_END])){
+    // Every PNG gets the same number of whole clusters, figure out which one and where in it
+    uint32_t png_lba = lba - file_lba_indexes[FILE_INDEX_PNGS_START];
+    uint32_t png_blocks = (file_lba_indexes[FILE_INDEX_PNGS_END] - file_lba_indexes[FILE_INDEX_PNGS_START]) / 30;
+    gbcam_read_png(png_lba / png_blocks, buffer, ((png_lba % png_blocks) * BLOCK_SIZE) + offset, bufsize);
+    return (int32_t) bufsize;
+  }
+  else if((lba >= file_lba_indexes[FILE_INDEX_SAVES_DIR]) && (lba < file_lba_indexes[FILE_INDEX_SAVES_START])){
+    render_saves_dir(saves_dir_block, lba - file_lba_indexes[FILE_INDEX_SAVES_DIR]);
+    addr = saves_dir_block + offset;
+  }
+  else if((lba >= file_lba_indexes[FILE_INDEX_SAVES_START]) && (lba < file_lba_indexes[FILE_INDEX_SAVES_END])){
+    // Every snapshot gets a slot the size of the RAM file, figure out which one and where in it
+    uint32_t snapshot_lba = lba - file_lba_indexes[FILE_INDEX_SAVES_START];
+    save_snapshot_read(buffer, snapshot_lba / save_snapshot_blocks(), ((snapshot_lba % save_snapshot_blocks()) * BLOCK_SIZE) + offset, bufsize);
+    return (int32_t) bufsize;
+  }
+  else if((lba >= file_lba_indexes[FILE_INDEX_BANKS_TXT]) && (lba < file_lba_indexes[FILE_INDEX_LOG_TXT])){
+    bank_manifest_read(buffer, ((lba - file_lba_indexes[FILE_INDEX_BANKS_TXT]) * BLOCK_SIZE) + offset, bufsize);
+    return (int32_t) bufsize;
+  }
+  else if((lba >= file_lba_indexes[FILE_INDEX_LOG_TXT]) && (lba < file_lba_indexes[FILE_INDEX_METRICS_JSN])){
+    log_ring_read(buffer, ((lba - file_lba_indexes[FILE_INDEX_LOG_TXT]) * BLOCK_SIZE) + offset, bufsize);
+    return (int32_t) bufsize;
+  }
+  else if((lba >= file_lba_indexes[FILE_INDEX_METRICS_JSN]) && (lba < file_lba_indexes[FILE_INDEX_DATA_END])){
+    metrics_read(buffer, ((lba - file_lba_indexes[FILE_INDEX_METRICS_JSN]) * BLOCK_SIZE) + offset, bufsize);
+    return (int32_t) bufsize;
+  }
+  else if(lba >= file_lba_indexes[FILE_INDEX_DATA_END]){
+    // A save the host wrote as a new file reads back out of SRAM, so it can verify the copy
+    int32_t save_addr = fat_remap_save_addr(lba);
+    if(save_addr >= 0){
+      uint32_t len = bufsize;
+      if((save_addr + offset) >= the_cart.ram_size_bytes){
+        len = 0;
+      }
+      else if((save_addr + offset + len) > the_cart.ram_size_bytes){
+        len = the_cart.ram_size_bytes - (save_addr + offset);
+      }
+      if(len == bufsize){
+        return msc_cart_read(lun, lba, offset, buffer, bufsize, BUS_SPACE_RAM, save_addr + offset);
+      }
+      // Runs off the end of the save, rare enough to just do it here
+      memset(buffer, 0, bufsize);
+      if(len){
+        bus_read(BUS_SPACE_RAM, save_addr + offset, buffer, len);
+      }
+      return (int32_t) bufsize;
+    }
+    // Written, but nothing has claimed it yet
+    if(fat_pending_read(lba, offset, buffer, bufsize)){
+      return (int32_t) bufsize;
+    }
+  }
   if(addr != 0)
   {
     memcpy(buffer, addr, bufsize);
@@ -150,25 +432,98 @@ int32_t tud_msc_read10_cb(uint8_t lun, uint32_t lba, uint32_t offset, void* buff
   return (int32_t) bufsize;
 }
 
-// Callback invoked when received WRITE10 command.
-// Process data in buffer to disk's storage and return number of written bytes
-int32_t tud_msc_write10_cb(uint8_t lun, uint32_t lba, uint32_t offset, uint8_t* buffer, uint32_t bufsize)
+// Callback invoked when received READ10 command. TinyUSB calls it until the whole command
+// is done, the time and bytes go in the metrics
+int32_t tud_msc_read10_cb(uint8_t lun, uint32_t lba, uint32_t offset, void* buffer, uint32_t bufsize)
+{
+  if(!msc_read10_start_us){
+    msc_read10_start_us = time_us_64();
+  }
+  int32_t ret = msc_read10(lun, lba, offset, buffer, bufsize);
+  if(ret > 0){
+    METRICS_ADD(metrics.read_bytes[msc_region(lun, lba)], ret);
+  }
+  else if(ret < 0){
+    msc_read10_start_us = 0;
+  }
+  return ret;
+}
+
+// Invoked when the status for a READ10 has gone out
+void tud_msc_read10_complete_cb(uint8_t lun)
 {
   (void) lun;
+  if(msc_read10_start_us){
+    metrics_read10_done(time_us_64() - msc_read10_start_us);
+  }
+  msc_read10_start_us = 0;
+}
+
+// Invoked to check if the LUN can be written to. ROM can't be, unless it's a flash cart
+bool tud_msc_is_writable_cb(uint8_t lun)
+{
+  return (lun != MSC_LUN_ROM) || (flash_cart_info.command_set != FLASH_CMD_NONE);
+}
+
+// Process data in buffer to disk's storage and return number of written bytes
+int32_t msc_write10(uint8_t lun, uint32_t lba, uint32_t offset, uint8_t* buffer, uint32_t bufsize)
+{
+  if(lun == MSC_LUN_ROM){
+    if((flash_cart_info.command_set == FLASH_CMD_NONE) || !raw_lun_in_range(lun, lba, offset, bufsize)) return -1;
+    // 0 while the last one is still going into the chip, and TinyUSB hands this over again
+    return (int32_t) flash_cart_disk_write(buffer, (lba * BLOCK_SIZE) + offset, bufsize);
+  }
+  if(lun == MSC_LUN_SRAM){
+    if(!raw_lun_in_range(lun, lba, offset, bufsize)) return -1;
+    sram_writeback(buffer, (lba * BLOCK_SIZE) + offset, bufsize);
+    return (int32_t) bufsize;
+  }
   // printf("write - lba 0x%x, bufsize%d\n", lba,bufsize);
   
   // out of ramdisk
   if ( lba >= DISK_BLOCK_COUNT ) return -1;
-  //page to sector
-  if(lba >= file_lba_indexes[FILE_INDEX_DATA_END]){
-    //memcpy(&flashingLocation.buff[flashingLocatio.sectionCount * 512], buffer, bufsize);
-    //uint32_t ints = save_and_disable_interrupts();
-    (*the_cart.ram_memset_func)(buffer, ((lba - file_lba_indexes[FILE_INDEX_DATA_END]) * BLOCK_SIZE) + offset, bufsize);
+  // Take it a block at a time, TinyUSB hands over the rest in the next call
+  bufsize = msc_span(lba, offset, bufsize, lba + 1);
+  // Both FAT tables land in the same copy, the host keeps them identical anyway.
+  // Anything past what we hold in RAM is for clusters that can't be used, so drop it
+  if((lba >= file_lba_indexes[FILE_INDEX_FAT_TABLE_1_START]) && (lba < (file_lba_indexes[FILE_INDEX_FAT_TABLE_1_START] + FAT_TABLE_BLOCK_SIZE)))
+  {
+    memcpy(DISK_fatTable + ((lba - file_lba_indexes[FILE_INDEX_FAT_TABLE_1_START]) * BLOCK_SIZE) + offset, buffer, bufsize);
+    fat_flush_pending();
   }
-
-  if(lba == file_lba_indexes[FILE_INDEX_ROOT_DIRECTORY])
+  else if((lba >= file_lba_indexes[FILE_INDEX_FAT_TABLE_2_START]) && (lba < (file_lba_indexes[FILE_INDEX_FAT_TABLE_2_START] + FAT_TABLE_BLOCK_SIZE)))
+  {
+    memcpy(DISK_fatTable + ((lba - file_lba_indexes[FILE_INDEX_FAT_TABLE_2_START]) * BLOCK_SIZE) + offset, buffer, bufsize);
+    fat_flush_pending();
+  }
+  else if((lba >= file_lba_indexes[FILE_INDEX_ROOT_DIRECTORY]) && (lba < file_lba_indexes[FILE_INDEX_ROOT_DIRECTORY] + BLOCK_SIZE_ROOT_DIRECTORY))
   {
-    printf("0x%x\n", lba);
+    memcpy(DISK_rootDirectory + ((lba - file_lba_indexes[FILE_INDEX_ROOT_DIRECTORY]) * BLOCK_SIZE) + offset, buffer, bufsize);
+    // A new .SAV entry can claim clusters that were written before it
+    fat_flush_pending();
+  }
+  // Overwriting the ROM file in place, which only does anything on a flash cart
+  else if(lba >= file_lba_indexes[FILE_INDEX_ROM_BIN] && lba < file_lba_indexes[FILE_INDEX_SRAM_BIN]){
+    return (int32_t) flash_cart_disk_write(buffer, ((lba - file_lba_indexes[FILE_INDEX_ROM_BIN]) * BLOCK_SIZE) + offset, bufsize);
+  }
+  // Overwriting the save file in place
+  else if(lba >= file_lba_indexes[FILE_INDEX_SRAM_BIN] && lba < file_lba_indexes[FILE_INDEX_PHOTOS_START]){
+    sram_writeback(buffer, ((lba - file_lba_indexes[FILE_INDEX_SRAM_BIN]) * BLOCK_SIZE) + offset, bufsize);
+  }
+  // A BMP copied over one of the camera's photos
+  else if((lba >= file_lba_indexes[FILE_INDEX_PHOTOS_START]) && (lba < file_lba_indexes[FILE_INDEX_PHOTOS_END])){
+    uint32_t photo_lba = lba - file_lba_indexes[FILE_INDEX_PHOTOS_START];
+    gbcam_write_bmp(LBA2PHOTO(photo_lba), (LBA2PHOTOOFFSET(photo_lba) * BLOCK_SIZE) + offset, buffer, bufsize);
+  }
+  // Writing the save as a new file somewhere in free space
+  else if(lba >= file_lba_indexes[FILE_INDEX_DATA_END]){
+    int32_t save_addr = fat_remap_save_addr(lba);
+    if(save_addr >= 0){
+      sram_writeback(buffer, save_addr + offset, bufsize);
+    }
+    else{
+      fat_pending_write(lba, offset, buffer, bufsize);
+    }
   }
 
 //#ifndef CFG_EXAMPLE_MSC_READONLY
@@ -180,6 +535,16 @@ int32_t tud_msc_write10_cb(uint8_t lun, uint32_t lba, uint32_t offset, uint8_t*
   return (int32_t) bufsize;
 }
 
+// Callback invoked when received WRITE10 command
+int32_t tud_msc_write10_cb(uint8_t lun, uint32_t lba, uint32_t offset, uint8_t* buffer, uint32_t bufsize)
+{
+  int32_t ret = msc_write10(lun, lba, offset, buffer, bufsize);
+  if(ret > 0){
+    METRICS_ADD(metrics.write_bytes[msc_region(lun, lba)], ret);
+  }
+  return ret;
+}
+
 // Callback invoked when received an SCSI command not in built-in list below
 // - READ_CAPACITY10, READ_FORMAT_CAPACITY, INQUIRY, MODE_SENSE6, REQUEST_SENSE
 // - READ10 and WRITE10 has their own callbacks
@@ -5,8 +5,23 @@
 #include "gb.h"
 #include "cart.h"
 
+// Logical units the MSC device shows up as. The FAT volume is what most users want, the
+// other two are the bare ROM and save with LBA N at byte N * 512, for dd and friends
+enum {
+  MSC_LUN_FAT   = 0,
+  MSC_LUN_ROM   = 1, // Read only, exactly rom_size_bytes long
+  MSC_LUN_SRAM  = 2, // Read/write, exactly ram_size_bytes long. No medium if the cart has no RAM
+  MSC_LUN_COUNT = 3
+};
+
 void init_disk_mem();
 void init_disk();
 void append_status_file(const uint8_t* buf);
 void append_status_file_buf(uint8_t* buf);
+// Put the worst main loop time in the status file, as a measure of how long USB waits on us
+void init_msc_latency();
+// Call every trip round the main loop
+void msc_latency_task();
+// The main loop slept waiting for something to do. Leaves that gap out of the worst case
+void msc_latency_idle();
 #endif
\ No newline at end of file
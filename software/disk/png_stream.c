@@ -0,0 +1,196 @@
+#include "png_stream.h"
+#include "utils.h"
+
+#include <string.h>
+
+/*  - Private #defines -  */
+// Signature, then the IHDR chunk (length, type, 13 bytes, CRC)
+#define PNG_SIG_LEN         8
+#define PNG_IHDR_START      PNG_SIG_LEN
+#define PNG_IHDR_DATA_LEN   13
+#define PNG_IDAT_START      (PNG_IHDR_START + 12 + PNG_IHDR_DATA_LEN)
+// Chunks are a 4 byte length and 4 byte type, the data, then a 4 byte CRC
+#define PNG_CHUNK_OVERHEAD  12
+// zlib header, deflate blocks, Adler-32
+#define PNG_ZLIB_HEADER_LEN 2
+#define PNG_ZLIB_ADLER_LEN  4
+#define PNG_STORED_HEADER   5
+#define PNG_ADLER_MOD       65521
+
+/*  - Private Variables -  */
+const uint8_t png_signature[PNG_SIG_LEN] = {0x89, 'P', 'N', 'G', 0x0D, 0x0A, 0x1A, 0x0A};
+// Empty chunk, the CRC never changes
+const uint8_t png_iend[PNG_CHUNK_OVERHEAD] = {0x00, 0x00, 0x00, 0x00, 'I', 'E', 'N', 'D', 0xAE, 0x42, 0x60, 0x82};
+
+/*  - Private Function Declarations -  */
+
+// Bytes of image data, a filter byte then the packed pixels for every row
+uint32_t png_raw_len(struct PngStream* s);
+// Bytes of the zlib stream that goes in IDAT
+uint32_t png_zlib_len(uint32_t raw_len);
+// Byte n of a big endian word
+uint8_t png_be_byte(uint32_t word, uint8_t n);
+// Byte of the image data, with the rows filled in and scaled as they're needed
+uint8_t png_raw_byte(struct PngStream* s, uint32_t r);
+// Byte of the zlib stream
+uint8_t png_zlib_byte(struct PngStream* s, uint32_t z, uint32_t raw_len, uint32_t zlib_len);
+// Byte of IHDR's data
+uint8_t png_ihdr_byte(struct PngStream* s, uint32_t d);
+// Byte off of a chunk, data being what goes there if off is in the data. Has to go in order for the CRC
+uint8_t png_chunk_byte(struct PngStream* s, uint32_t off, const char* type, uint32_t data_len, uint8_t data);
+// Next byte of the file
+uint8_t png_next_byte(struct PngStream* s);
+
+/*  - Private Function Definitions -  */
+
+uint32_t png_raw_len(struct PngStream* s){
+  return (uint32_t) s->height * s->scale * (1 + (((uint32_t) s->width * s->scale) / 4));
+}
+
+uint32_t png_zlib_len(uint32_t raw_len){
+  uint32_t blocks = (raw_len + PNG_STORED_BLOCK_MAX - 1) / PNG_STORED_BLOCK_MAX;
+  return PNG_ZLIB_HEADER_LEN + (blocks * PNG_STORED_HEADER) + raw_len + PNG_ZLIB_ADLER_LEN;
+}
+
+uint8_t png_be_byte(uint32_t word, uint8_t n){
+  return (word >> ((3 - n) * 8)) & 0xFF;
+}
+
+uint8_t png_raw_byte(struct PngStream* s, uint32_t r){
+  uint32_t out_width = (uint32_t) s->width * s->scale;
+  uint32_t row_len = 1 + (out_width / 4);
+  int32_t row = r / row_len;
+  if(row != s->out_row){
+    // Scaled rows repeat the source row, so only go get it when it changes
+    int32_t src_row = row / s->scale;
+    if(src_row != s->src_row){
+      s->row_func(s->ctx, src_row, s->src_buf);
+      s->src_row = src_row;
+    }
+    // Filter type 0, none
+    s->out_buf[0] = 0;
+    for(uint32_t x = 0; x < out_width; x++){
+      uint32_t src_x = x / s->scale;
+      uint8_t pixel = (s->src_buf[src_x / 4] >> (6 - ((src_x % 4) * 2))) & 0x3;
+      uint8_t* out = s->out_buf + 1 + (x / 4);
+      uint8_t shift = 6 - ((x % 4) * 2);
+      *out = (*out & ~(0x3 << shift)) | (pixel << shift);
+    }
+    s->out_row = row;
+  }
+  return s->out_buf[r % row_len];
+}
+
+uint8_t png_zlib_byte(struct PngStream* s, uint32_t z, uint32_t raw_len, uint32_t zlib_len){
+  // Deflate, 32K window, no dictionary, fastest. Checks out as a multiple of 31
+  if(z == 0){
+    return 0x78;
+  }
+  if(z == 1){
+    return 0x01;
+  }
+  if(z >= zlib_len - PNG_ZLIB_ADLER_LEN){
+    return png_be_byte((s->adler_b << 16) | s->adler_a, z - (zlib_len - PNG_ZLIB_ADLER_LEN));
+  }
+  // Every block but the last is full
+  uint32_t q = z - PNG_ZLIB_HEADER_LEN;
+  uint32_t block = q / (PNG_STORED_BLOCK_MAX + PNG_STORED_HEADER);
+  uint32_t in_block = q % (PNG_STORED_BLOCK_MAX + PNG_STORED_HEADER);
+  uint32_t block_start = block * PNG_STORED_BLOCK_MAX;
+  if(in_block < PNG_STORED_HEADER){
+    uint16_t len = (raw_len - block_start) > PNG_STORED_BLOCK_MAX ? PNG_STORED_BLOCK_MAX : (raw_len - block_start);
+    switch(in_block){
+      // BFINAL on the last one, BTYPE 00 is stored
+      case 0: return (raw_len - block_start) <= PNG_STORED_BLOCK_MAX;
+      case 1: return len & 0xFF;
+      case 2: return len >> 8;
+      case 3: return (uint16_t) ~len & 0xFF;
+      default: return (uint16_t) ~len >> 8;
+    }
+  }
+  uint8_t b = png_raw_byte(s, block_start + in_block - PNG_STORED_HEADER);
+  s->adler_a = (s->adler_a + b) % PNG_ADLER_MOD;
+  s->adler_b = (s->adler_b + s->adler_a) % PNG_ADLER_MOD;
+  return b;
+}
+
+uint8_t png_ihdr_byte(struct PngStream* s, uint32_t d){
+  if(d < 4){
+    return png_be_byte((uint32_t) s->width * s->scale, d);
+  }
+  if(d < 8){
+    return png_be_byte((uint32_t) s->height * s->scale, d - 4);
+  }
+  // Bit depth 2, then grayscale, deflate, no filter, no interlace
+  return d == 8 ? 2 : 0;
+}
+
+uint8_t png_chunk_byte(struct PngStream* s, uint32_t off, const char* type, uint32_t data_len, uint8_t data){
+  if(off < 4){
+    return png_be_byte(data_len, off);
+  }
+  if(off < 8 + data_len){
+    // The CRC covers the type and the data
+    uint8_t b = off < 8 ? type[off - 4] : data;
+    if(off == 4){
+      s->crc = CRC32_SEED;
+    }
+    s->crc = crc32_update(&b, 1, s->crc);
+    return b;
+  }
+  return png_be_byte(~s->crc, off - 8 - data_len);
+}
+
+uint8_t png_next_byte(struct PngStream* s){
+  uint32_t p = s->pos++;
+  if(p < PNG_SIG_LEN){
+    return png_signature[p];
+  }
+  if(p < PNG_IDAT_START){
+    uint32_t off = p - PNG_IHDR_START;
+    uint8_t data = (off >= 8) && (off < 8 + PNG_IHDR_DATA_LEN) ? png_ihdr_byte(s, off - 8) : 0;
+    return png_chunk_byte(s, off, "IHDR", PNG_IHDR_DATA_LEN, data);
+  }
+  uint32_t raw_len = png_raw_len(s);
+  uint32_t zlib_len = png_zlib_len(raw_len);
+  uint32_t off = p - PNG_IDAT_START;
+  if(off < PNG_CHUNK_OVERHEAD + zlib_len){
+    uint8_t data = (off >= 8) && (off < 8 + zlib_len) ? png_zlib_byte(s, off - 8, raw_len, zlib_len) : 0;
+    return png_chunk_byte(s, off, "IDAT", zlib_len, data);
+  }
+  off -= PNG_CHUNK_OVERHEAD + zlib_len;
+  return off < PNG_CHUNK_OVERHEAD ? png_iend[off] : 0;
+}
+
+/*  - Public Function Definitions -  */
+
+uint32_t png_stream_size(uint16_t width, uint16_t height, uint8_t scale){
+  struct PngStream s = {.width = width, .height = height, .scale = scale};
+  return PNG_IDAT_START + PNG_CHUNK_OVERHEAD + png_zlib_len(png_raw_len(&s)) + PNG_CHUNK_OVERHEAD;
+}
+
+void png_stream_init(struct PngStream* s, uint16_t width, uint16_t height, uint8_t scale, png_row_func row_func, void* ctx){
+  s->width = width;
+  s->height = height;
+  s->scale = scale;
+  s->row_func = row_func;
+  s->ctx = ctx;
+  s->pos = 0;
+  s->adler_a = 1;
+  s->adler_b = 0;
+  s->src_row = -1;
+  s->out_row = -1;
+}
+
+void png_stream_read(struct PngStream* s, uint8_t* dest, uint32_t offset, uint32_t num){
+  // The checksums only work going forwards, so going back means starting over
+  if(offset < s->pos){
+    png_stream_init(s, s->width, s->height, s->scale, s->row_func, s->ctx);
+  }
+  while(s->pos < offset){
+    png_next_byte(s);
+  }
+  for(uint32_t i = 0; i < num; i++){
+    dest[i] = png_next_byte(s);
+  }
+}
@@ -0,0 +1,43 @@
+#ifndef PNG_STREAM_H_
+#define PNG_STREAM_H_
+
+#include <stdint.h>
+
+// 2 bit grayscale PNGs made on the fly, a block at a time, for the disk. The deflate stream
+// is all stored blocks, so the file size only depends on the image size and is known when
+// the directory gets built. A read that carries on from the last one picks up where it
+// left off, CRC and Adler-32 included, anything else starts over from the top of the file.
+
+// Widest image that can be made, after scaling
+#define PNG_STREAM_MAX_WIDTH    512
+// Most a deflate stored block can hold
+#define PNG_STORED_BLOCK_MAX    0xFFFF
+
+// Fill in row y of the source image, 4 pixels a byte with the leftmost in the top bits.
+// 0 is black and 3 is white
+typedef void (*png_row_func)(void* ctx, uint16_t y, uint8_t* row);
+
+struct PngStream {
+  uint16_t width;       // Source size, before scaling
+  uint16_t height;
+  uint8_t scale;        // Every source pixel becomes scale x scale of them
+  png_row_func row_func;
+  void* ctx;
+  uint32_t pos;         // Next byte of the file
+  uint32_t crc;         // Running CRC of the chunk being sent
+  uint32_t adler_a;     // Running Adler-32 of the image data
+  uint32_t adler_b;
+  int32_t src_row;      // Source row in src_buf, -1 if none
+  int32_t out_row;      // Scaled row in out_buf, -1 if none
+  uint8_t src_buf[PNG_STREAM_MAX_WIDTH / 4];
+  uint8_t out_buf[1 + (PNG_STREAM_MAX_WIDTH / 4)];
+};
+
+// Size of the file for an image this big
+uint32_t png_stream_size(uint16_t width, uint16_t height, uint8_t scale);
+// Start a new file. Width times scale has to be a multiple of 4, up to PNG_STREAM_MAX_WIDTH
+void png_stream_init(struct PngStream* s, uint16_t width, uint16_t height, uint8_t scale, png_row_func row_func, void* ctx);
+// Copy num bytes of the file starting at offset into dest. Past the end is 0
+void png_stream_read(struct PngStream* s, uint8_t* dest, uint32_t offset, uint32_t num);
+
+#endif
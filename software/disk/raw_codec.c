@@ -0,0 +1,143 @@
+#include "raw_codec.h"
+
+#include <string.h>
+
+/*  - Private Variables -  */
+// Last position each hash of 4 bytes was seen at, plus one so 0 means never
+static uint16_t hash_table[1 << RAW_CODEC_HASH_BITS];
+
+/*  - Private Function Declarations -  */
+
+// Hash the 4 bytes at p
+static uint32_t hash4(const uint8_t* p);
+// Write out any literals waiting to be sent and move out along. Returns 0 if out of room
+static uint8_t flush_literals(const uint8_t* src, uint32_t lit_start, uint32_t lit_end, uint8_t* dest, uint32_t* out, uint32_t dest_max);
+
+/*  - Private Function Definitions -  */
+
+static uint32_t hash4(const uint8_t* p){
+  uint32_t v = p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t) p[3] << 24);
+  return (v * 2654435761u) >> (32 - RAW_CODEC_HASH_BITS);
+}
+
+static uint8_t flush_literals(const uint8_t* src, uint32_t lit_start, uint32_t lit_end, uint8_t* dest, uint32_t* out, uint32_t dest_max){
+  while(lit_start < lit_end){
+    uint32_t n = lit_end - lit_start;
+    if(n > RAW_CODEC_MAX_LITERAL){
+      n = RAW_CODEC_MAX_LITERAL;
+    }
+    if((*out + 1 + n) > dest_max){
+      return 0;
+    }
+    dest[(*out)++] = n - 1;
+    memcpy(dest + *out, src + lit_start, n);
+    *out += n;
+    lit_start += n;
+  }
+  return 1;
+}
+
+/*  - Public Function Definitions -  */
+
+uint32_t raw_codec_pack(const uint8_t* src, uint32_t len, uint8_t* dest, uint32_t dest_max){
+  memset(hash_table, 0, sizeof(hash_table));
+  uint32_t out = 0;
+  uint32_t pos = 0;
+  uint32_t lit_start = 0;
+  while(pos < len){
+    // Runs first, they're the cheapest to find and ROMs are full of fill bytes
+    uint32_t run = 1;
+    while(((pos + run) < len) && (run < RAW_CODEC_MAX_RUN) && (src[pos + run] == src[pos])){
+      run++;
+    }
+    if(run >= RAW_CODEC_MIN_RUN){
+      if(!flush_literals(src, lit_start, pos, dest, &out, dest_max) || ((out + 3) > dest_max)){
+        return 0;
+      }
+      uint32_t n = run - RAW_CODEC_MIN_RUN;
+      dest[out++] = 0x80 | (n >> 8);
+      dest[out++] = n & 0xFF;
+      dest[out++] = src[pos];
+      pos += run;
+      lit_start = pos;
+      continue;
+    }
+    // Then look for the same 4 bytes earlier on
+    uint32_t match = 0;
+    uint32_t offset = 0;
+    if((pos + RAW_CODEC_MIN_MATCH) <= len){
+      uint32_t h = hash4(src + pos);
+      uint32_t candidate = hash_table[h];
+      hash_table[h] = pos + 1;
+      if(candidate && ((pos - (candidate - 1)) <= RAW_CODEC_MAX_OFFSET)){
+        candidate--;
+        while(((pos + match) < len) && (match < RAW_CODEC_MAX_MATCH) && (src[candidate + match] == src[pos + match])){
+          match++;
+        }
+        offset = pos - candidate;
+      }
+    }
+    if(match >= RAW_CODEC_MIN_MATCH){
+      if(!flush_literals(src, lit_start, pos, dest, &out, dest_max) || ((out + 3) > dest_max)){
+        return 0;
+      }
+      dest[out++] = 0xC0 | (match - RAW_CODEC_MIN_MATCH);
+      dest[out++] = offset & 0xFF;
+      dest[out++] = offset >> 8;
+      pos += match;
+      lit_start = pos;
+      continue;
+    }
+    pos++;
+  }
+  if(!flush_literals(src, lit_start, len, dest, &out, dest_max)){
+    return 0;
+  }
+  return out;
+}
+
+uint32_t raw_codec_unpack(const uint8_t* src, uint32_t len, uint8_t* dest, uint32_t dest_max){
+  uint32_t in = 0;
+  uint32_t out = 0;
+  while(in < len){
+    uint8_t t = src[in++];
+    if(t < 0x80){
+      uint32_t n = t + 1;
+      if(((in + n) > len) || ((out + n) > dest_max)){
+        return 0;
+      }
+      memcpy(dest + out, src + in, n);
+      in += n;
+      out += n;
+    }
+    else if(t < 0xC0){
+      if((in + 2) > len){
+        return 0;
+      }
+      uint32_t n = (((t & 0x3F) << 8) | src[in]) + RAW_CODEC_MIN_RUN;
+      if((out + n) > dest_max){
+        return 0;
+      }
+      memset(dest + out, src[in + 1], n);
+      in += 2;
+      out += n;
+    }
+    else{
+      if((in + 2) > len){
+        return 0;
+      }
+      uint32_t n = (t & 0x3F) + RAW_CODEC_MIN_MATCH;
+      uint32_t offset = src[in] | (src[in + 1] << 8);
+      in += 2;
+      if(!offset || (offset > out) || ((out + n) > dest_max)){
+        return 0;
+      }
+      // Byte at a time, matches can overlap what they're writing
+      for(uint32_t i = 0; i < n; i++){
+        dest[out] = dest[out - offset];
+        out++;
+      }
+    }
+  }
+  return out;
+}
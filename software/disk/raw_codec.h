@@ -0,0 +1,40 @@
+#ifndef RAW_CODEC_H_
+#define RAW_CODEC_H_
+
+#include <stdint.h>
+
+// Small RLE+LZ codec for the raw transfer stream. Cheap enough to run on the M0+ while the
+// next bank is being read, and shared with the host client in utils/gbraw so both ends agree.
+//
+// The packed stream is a list of tokens:
+//   0x00-0x7F  Literal: (t + 1) bytes follow, copied as is
+//   0x80-0xBF  Run: one more length byte, then the byte to repeat
+//              ((t & 0x3F) << 8 | next) + RAW_CODEC_MIN_RUN times
+//   0xC0-0xFF  Match: two byte offset back into the output (1 is the last byte) follows,
+//              copy (t & 0x3F) + RAW_CODEC_MIN_MATCH bytes from there
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define RAW_CODEC_MAX_LITERAL   128
+#define RAW_CODEC_MIN_RUN       3
+#define RAW_CODEC_MAX_RUN       (0x3FFF + RAW_CODEC_MIN_RUN)
+#define RAW_CODEC_MIN_MATCH     4
+#define RAW_CODEC_MAX_MATCH     (0x3F + RAW_CODEC_MIN_MATCH)
+#define RAW_CODEC_MAX_OFFSET    0xFFFF
+// Matches are found through a small hash table of recent positions
+#define RAW_CODEC_HASH_BITS     10
+
+// Pack len bytes of src into dest, writing no more than dest_max bytes.
+// Returns the packed length, or 0 if it would not fit (send it unpacked instead)
+uint32_t raw_codec_pack(const uint8_t* src, uint32_t len, uint8_t* dest, uint32_t dest_max);
+// Unpack len packed bytes of src into dest, writing no more than dest_max bytes.
+// Returns the unpacked length, or 0 if the packed data is bad
+uint32_t raw_codec_unpack(const uint8_t* src, uint32_t len, uint8_t* dest, uint32_t dest_max);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,113 @@
+#ifndef RAW_PROTOCOL_H_
+#define RAW_PROTOCOL_H_
+
+#include <stdint.h>
+
+// Binary protocol for the vendor bulk interface. Shared with the host client in utils/gbraw,
+// so keep it plain C and little endian, the same as both ends.
+//
+// The host sends a RawCommand on the OUT endpoint. The device answers on the IN endpoint
+// with a RawResponse, followed by data_len bytes of data. Write commands are followed by
+// len bytes of data on the OUT endpoint, and get their response once all of it has landed.
+
+#define RAW_MAGIC               0x57524247 // "GBRW"
+#define RAW_MAX_SPAN            (8 * 1024 * 1024)
+
+enum {
+  RAW_OP_GET_HEADER  = 0x01, // Cart info and the raw header. Response data is a RawHeader
+  RAW_OP_READ        = 0x02, // Read len bytes of space starting at addr
+  RAW_OP_WRITE       = 0x03, // Write len bytes of space starting at addr. Only SRAM can be written
+  RAW_OP_SET_BANK    = 0x04, // Switch the ROM or SRAM bank (space) in the cart to bank
+  RAW_OP_GET_HASHES  = 0x05, // CRC32 of each of the count ROM banks starting at bank, one uint32 each
+  RAW_OP_READ_PACKED = 0x06, // Same as READ, but the data comes packed in RawFrames
+  RAW_OP_FLASH_INFO  = 0x07, // What flash chip the cart has, if any. Response data is a RawFlashInfo
+  RAW_OP_FLASH_WRITE = 0x08, // Erase and program len bytes of a flash cart starting at addr
+  RAW_OP_CAM_FRAME   = 0x09, // Next live camera frame newer than frame number addr. Waits for one
+  RAW_OP_CAM_REGS    = 0x0A, // Camera registers for live frames, len is RAW_CAM_REG_COUNT
+};
+
+enum {
+  RAW_SPACE_ROM = 0x00, // Addresses are offsets in the full ROM image, banks are handled for you
+  RAW_SPACE_RAM = 0x01, // Addresses are offsets in the full save, banks are handled for you
+  RAW_SPACE_BUS = 0x02, // Addresses are straight cart bus addresses with whatever banks are set
+};
+
+enum {
+  RAW_STATUS_OK           = 0x00,
+  RAW_STATUS_BAD_COMMAND  = 0x01,
+  RAW_STATUS_BAD_RANGE    = 0x02,
+  RAW_STATUS_NO_MAPPER    = 0x03,
+  RAW_STATUS_NO_FLASH     = 0x04, // FLASH_WRITE on a cart that isn't flash
+  RAW_STATUS_FLASH_FAILED = 0x05, // Something didn't erase, program or read back right
+  RAW_STATUS_NO_FRAME     = 0x06, // The camera didn't finish a frame in time
+};
+
+struct __attribute__((packed)) RawCommand {
+  uint32_t magic;
+  uint8_t  opcode;
+  uint8_t  space;
+  uint16_t bank;   // SET_BANK and GET_HASHES
+  uint32_t addr;   // READ and WRITE
+  uint32_t len;    // READ and WRITE, bank count for GET_HASHES
+};
+
+struct __attribute__((packed)) RawResponse {
+  uint32_t magic;
+  uint8_t  opcode; // Same as the command this answers
+  uint8_t  status;
+  uint16_t reserved;
+  uint32_t data_len;
+};
+
+// Packed reads answer with data_len set to the unpacked length, then one RawFrame per ROM bank
+// (less at either end if the span isn't bank aligned) until that much has been unpacked.
+// Frames that wouldn't get any smaller are sent as is, with packed_len the same as raw_len
+#define RAW_FRAME_MAX           0x4000
+struct __attribute__((packed)) RawFrame {
+  uint16_t raw_len;
+  uint16_t packed_len; // Bytes of frame data that follow
+  uint32_t pack_us;    // How long the device spent packing it, not counting the cart read
+};
+
+struct __attribute__((packed)) RawHeader {
+  uint8_t  cart_type;
+  uint8_t  mapper_type;
+  uint16_t rom_banks;
+  uint32_t rom_size_bytes;
+  uint32_t ram_size_bytes;
+  char     title[17];
+  uint8_t  header[0x50]; // 0x100 to 0x14F of the ROM
+};
+
+struct __attribute__((packed)) RawFlashInfo {
+  uint8_t  command_set;  // 0 if the cart isn't flash, 1 AMD, 2 Intel
+  uint8_t  program_mode; // 0 single bytes, 1 unlock bypass, 2 buffered
+  uint8_t  manufacturer;
+  uint8_t  swap_d0d1;
+  uint16_t device;
+  uint16_t buffer_size;
+  uint32_t size_bytes;
+};
+
+// FLASH_WRITE answers once all its data is in, with one of these as the response data.
+// A write starting at 0 starts a new flash, others carry on from the last one, so sectors
+// only get erased once however the image is split up. The stats cover the whole flash
+struct __attribute__((packed)) RawFlashResult {
+  uint32_t bytes;
+  uint32_t sectors_erased;
+  uint32_t erase_us;
+  uint32_t program_us;
+  uint32_t data_crc;     // CRC32 of the data the device got
+  uint32_t readback_crc; // CRC32 of what it read back after programming it
+};
+
+// CAM_FRAME answers with one of these, then the frame as a 128x112 16 color BMP
+#define RAW_CAM_FRAME_SIZE      7286
+#define RAW_CAM_REG_COUNT       0x36 // 0xA000 to 0xA035, trigger, settings and dither matrix
+struct __attribute__((packed)) RawCamFrame {
+  uint32_t frame;      // Frame number, pass it back to get the one after
+  uint16_t fps_tenths; // How fast the device is capturing
+  uint16_t reserved;
+};
+
+#endif
@@ -55,15 +55,18 @@ uint8_t const * tud_descriptor_device_cb(void)
 enum
 {
   ITF_NUM_MSC,
+  ITF_NUM_VENDOR,
   ITF_NUM_TOTAL
 };
 
 
 #define EPNUM_MSC_OUT     0x01
 #define EPNUM_MSC_IN      0x81
+#define EPNUM_VENDOR_OUT  0x02
+#define EPNUM_VENDOR_IN   0x82
 
 
-#define CONFIG_TOTAL_LEN    (TUD_CONFIG_DESC_LEN  + TUD_MSC_DESC_LEN)
+#define CONFIG_TOTAL_LEN    (TUD_CONFIG_DESC_LEN  + TUD_MSC_DESC_LEN + TUD_VENDOR_DESC_LEN)
 
 // full speed configuration
 uint8_t const desc_fs_configuration[] =
@@ -73,6 +76,9 @@ uint8_t const desc_fs_configuration[] =
 
   // Interface number, string index, EP Out & EP In address, EP size
   TUD_MSC_DESCRIPTOR(ITF_NUM_MSC, 3 , EPNUM_MSC_OUT, EPNUM_MSC_IN, 64),
+
+  // Interface number, string index, EP Out & EP In address, EP size
+  TUD_VENDOR_DESCRIPTOR(ITF_NUM_VENDOR, 4, EPNUM_VENDOR_OUT, EPNUM_VENDOR_IN, 64),
 };
 
 #if TUD_OPT_HIGH_SPEED
@@ -85,6 +91,8 @@ uint8_t const desc_hs_configuration[] =
   TUD_CONFIG_DESCRIPTOR(1, ITF_NUM_TOTAL, 0, CONFIG_TOTAL_LEN, 0x00, 100),
   // Interface number, string index, EP Out & EP In address, EP size
   TUD_MSC_DESCRIPTOR(ITF_NUM_MSC, 3, EPNUM_MSC_OUT, EPNUM_MSC_IN, 512),
+  // Interface number, string index, EP Out & EP In address, EP size
+  TUD_VENDOR_DESCRIPTOR(ITF_NUM_VENDOR, 4, EPNUM_VENDOR_OUT, EPNUM_VENDOR_IN, 512),
 };
 
 // other speed configuration
@@ -162,6 +170,7 @@ char const* string_desc_arr [] =
   "TinyUSB",                     // 1: Manufacturer
   "TinyUSB Device",              // 2: Product
   "RPI-RP2",                     // 3: MSC Interface
+  "GBPunk Raw",                  // 4: Vendor Interface
 };
 
 static uint16_t _desc_str[32];
@@ -0,0 +1,423 @@
+#include "tusb.h"
+#include "pico/stdlib.h"
+#include "vendor_raw.h"
+#include "cart.h"
+#include "gb.h"
+#include "utils.h"
+#include "rom_cache.h"
+#include "sram_writeback.h"
+#include "flash_cart.h"
+#include "live_cam.h"
+#include "bus_core.h"
+#include "raw_codec.h"
+#include "pico/platform.h"
+
+#include <string.h>
+
+/*  - Private #defines -  */
+// Older TinyUSB sends as soon as data is written, newer needs a flush for short packets
+#if defined(TUSB_VERSION_MINOR) && ((TUSB_VERSION_MAJOR > 0) || (TUSB_VERSION_MINOR >= 14))
+#define RAW_FLUSH() tud_vendor_write_flush()
+#else
+#define RAW_FLUSH()
+#endif
+
+enum {
+  RAW_STATE_IDLE      = 0, // Waiting for a command
+  RAW_STATE_SENDING   = 1, // Streaming a response (and its data) to the host
+  RAW_STATE_RECEIVING = 2, // Taking data from the host for a write
+  RAW_STATE_WAITING   = 3, // Waiting on the camera for a frame
+};
+
+/*  - Private Variables -  */
+uint8_t raw_state = RAW_STATE_IDLE;
+// Command being put together, it can show up split across packets
+struct RawCommand raw_cmd;
+uint8_t raw_cmd_fill = 0;
+// What is left of the command in progress
+uint32_t raw_addr = 0;
+uint32_t raw_remaining = 0;
+// Staging between the bus and the endpoint. Lives in SRAM5 so the bulk copies out of it don't
+// fight core 1 for the striped banks
+uint8_t __scratch_y("raw_stage") raw_stage[RAW_STAGE_SIZE] = {0};
+uint32_t raw_stage_len = 0;
+uint32_t raw_stage_pos = 0;
+// A FLASH_WRITE from 0 that hasn't started its new flash yet
+uint8_t raw_flash_fresh = 0;
+// What is being sent right now, either the stage or a packed frame
+uint8_t* raw_send = raw_stage;
+// Packed reads pull a whole bank in, then send it out as a frame
+uint8_t raw_frame_in[RAW_FRAME_MAX] = {0};
+uint8_t raw_frame_out[sizeof(struct RawFrame) + RAW_FRAME_MAX] = {0};
+// Banks get read through here to be hashed
+uint8_t raw_hash_chunk[RAW_STAGE_SIZE] = {0};
+// When the wait for a camera frame started
+uint64_t raw_wait_start_us = 0;
+
+/*  - Private Function Declarations -  */
+
+// Queue up the response to a finished flash write, with the stats as its data
+void raw_queue_flash_result();
+// Queue up the newest camera frame. Too big for the stage, so it goes out of raw_frame_out
+void raw_queue_cam_frame();
+
+// Check a command and set up to answer it
+void raw_start_command();
+// Queue up the response header for the current command
+void raw_queue_response(uint8_t status, uint32_t data_len);
+// Refill the stage with the next piece of the response data
+void raw_fill_stage();
+// Read the next bank's worth of a packed read and pack it into a frame
+void raw_fill_frame();
+// Read part of a space into a buffer
+void raw_read_space(uint8_t* dest, uint8_t space, uint32_t addr, uint32_t len);
+// CRC32 of a whole ROM bank
+uint32_t raw_hash_bank(uint16_t bank);
+// Size of a space, for range checking
+uint32_t raw_space_size(uint8_t space);
+
+/*  - Private Function Definitions -  */
+
+uint32_t raw_space_size(uint8_t space){
+  switch(space){
+    case RAW_SPACE_ROM: return the_cart.rom_memcpy_func ? the_cart.rom_size_bytes : 0;
+    case RAW_SPACE_RAM: return the_cart.ram_memcpy_func ? the_cart.ram_size_bytes : 0;
+    case RAW_SPACE_BUS: return 0x10000;
+    default: return 0;
+  }
+}
+
+void raw_queue_response(uint8_t status, uint32_t data_len){
+  struct RawResponse resp = {RAW_MAGIC, raw_cmd.opcode, status, 0, data_len};
+  memcpy(raw_stage, &resp, sizeof(resp));
+  raw_send = raw_stage;
+  raw_stage_len = sizeof(resp);
+  raw_stage_pos = 0;
+  raw_state = RAW_STATE_SENDING;
+}
+
+void raw_queue_flash_result(){
+  struct RawFlashResult result = {0};
+  result.bytes = flash_cart_stats.bytes;
+  result.sectors_erased = flash_cart_stats.sectors_erased;
+  result.erase_us = flash_cart_stats.erase_us;
+  result.program_us = flash_cart_stats.program_us;
+  result.data_crc = ~flash_cart_stats.data_crc;
+  result.readback_crc = ~flash_cart_stats.readback_crc;
+  raw_queue_response(flash_cart_stats.failed ? RAW_STATUS_FLASH_FAILED : RAW_STATUS_OK, sizeof(result));
+  memcpy(raw_stage + raw_stage_len, &result, sizeof(result));
+  raw_stage_len += sizeof(result);
+}
+
+void raw_queue_cam_frame(){
+  struct RawCamFrame frame = {0};
+  raw_remaining = 0;
+  raw_queue_response(RAW_STATUS_OK, sizeof(frame) + RAW_CAM_FRAME_SIZE);
+  memcpy(raw_frame_out, raw_stage, raw_stage_len);
+  frame.frame = live_cam_decode(raw_frame_out + raw_stage_len + sizeof(frame));
+  frame.fps_tenths = live_cam_fps_tenths();
+  memcpy(raw_frame_out + raw_stage_len, &frame, sizeof(frame));
+  raw_send = raw_frame_out;
+  raw_stage_len += sizeof(frame) + RAW_CAM_FRAME_SIZE;
+}
+
+void raw_start_command(){
+  raw_addr = raw_cmd.addr;
+  raw_remaining = 0;
+  if(raw_cmd.magic != RAW_MAGIC){
+    raw_queue_response(RAW_STATUS_BAD_COMMAND, 0);
+    return;
+  }
+  switch(raw_cmd.opcode){
+    case RAW_OP_GET_HEADER: {
+      struct RawHeader header = {0};
+      header.cart_type = the_cart.cart_type;
+      header.mapper_type = the_cart.mapper_type;
+      header.rom_banks = the_cart.rom_banks;
+      header.rom_size_bytes = the_cart.rom_size_bytes;
+      header.ram_size_bytes = the_cart.ram_size_bytes;
+      memcpy(header.title, the_cart.title, sizeof(header.title));
+      readbuf(0x100, header.header, sizeof(header.header));
+      raw_queue_response(RAW_STATUS_OK, sizeof(header));
+      memcpy(raw_stage + raw_stage_len, &header, sizeof(header));
+      raw_stage_len += sizeof(header);
+      return;
+    }
+    case RAW_OP_READ:
+    case RAW_OP_READ_PACKED:
+    case RAW_OP_WRITE: {
+      uint32_t size = raw_space_size(raw_cmd.space);
+      if(!size){
+        raw_queue_response(RAW_STATUS_NO_MAPPER, 0);
+        return;
+      }
+      if((raw_cmd.addr >= size) || (raw_cmd.len > (size - raw_cmd.addr)) || (raw_cmd.len > RAW_MAX_SPAN)){
+        raw_queue_response(RAW_STATUS_BAD_RANGE, 0);
+        return;
+      }
+      raw_remaining = raw_cmd.len;
+      if(raw_cmd.opcode != RAW_OP_WRITE){
+        raw_queue_response(RAW_STATUS_OK, raw_cmd.len);
+      }
+      // Only the save can be written, and the response waits until all the data is in. An empty
+      // write would still start a write session, and maybe a snapshot, for nothing
+      else if((raw_cmd.space != RAW_SPACE_RAM) || !raw_cmd.len){
+        raw_remaining = 0;
+        raw_queue_response(RAW_STATUS_BAD_COMMAND, 0);
+      }
+      else{
+        raw_stage_len = 0;
+        raw_state = RAW_STATE_RECEIVING;
+      }
+      return;
+    }
+    case RAW_OP_SET_BANK: {
+      void (*banksw_func)(uint16_t) = NULL;
+      if(raw_cmd.space == RAW_SPACE_ROM){
+        banksw_func = the_cart.rom_banksw_func;
+      }
+      else if(raw_cmd.space == RAW_SPACE_RAM){
+        banksw_func = the_cart.ram_banksw_func;
+      }
+      if(!banksw_func){
+        raw_queue_response(RAW_STATUS_NO_MAPPER, 0);
+        return;
+      }
+      (*banksw_func)(raw_cmd.bank);
+      raw_queue_response(RAW_STATUS_OK, 0);
+      return;
+    }
+    case RAW_OP_GET_HASHES: {
+      if(!the_cart.rom_memcpy_func){
+        raw_queue_response(RAW_STATUS_NO_MAPPER, 0);
+        return;
+      }
+      if((raw_cmd.bank >= the_cart.rom_banks) || (raw_cmd.len > (uint32_t) (the_cart.rom_banks - raw_cmd.bank))){
+        raw_queue_response(RAW_STATUS_BAD_RANGE, 0);
+        return;
+      }
+      // Address counts banks here
+      raw_addr = raw_cmd.bank;
+      raw_remaining = raw_cmd.len * sizeof(uint32_t);
+      raw_queue_response(RAW_STATUS_OK, raw_remaining);
+      return;
+    }
+    case RAW_OP_FLASH_INFO: {
+      struct RawFlashInfo info = {0};
+      info.command_set = flash_cart_info.command_set;
+      info.program_mode = flash_cart_info.program_mode;
+      info.manufacturer = flash_cart_info.manufacturer;
+      info.swap_d0d1 = flash_cart_info.swap_d0d1;
+      info.device = flash_cart_info.device;
+      info.buffer_size = flash_cart_info.buffer_size;
+      info.size_bytes = flash_cart_info.size_bytes;
+      raw_queue_response(RAW_STATUS_OK, sizeof(info));
+      memcpy(raw_stage + raw_stage_len, &info, sizeof(info));
+      raw_stage_len += sizeof(info);
+      return;
+    }
+    case RAW_OP_FLASH_WRITE: {
+      if(flash_cart_info.command_set == FLASH_CMD_NONE){
+        raw_queue_response(RAW_STATUS_NO_FLASH, 0);
+        return;
+      }
+      if(!raw_cmd.len || (raw_cmd.addr >= flash_cart_info.size_bytes) || (raw_cmd.len > (flash_cart_info.size_bytes - raw_cmd.addr))){
+        raw_queue_response(RAW_STATUS_BAD_RANGE, 0);
+        return;
+      }
+      // Starts a new flash once nothing else is going into the chip
+      raw_flash_fresh = !raw_cmd.addr;
+      raw_remaining = raw_cmd.len;
+      raw_stage_len = 0;
+      raw_state = RAW_STATE_RECEIVING;
+      return;
+    }
+    case RAW_OP_CAM_FRAME:
+    case RAW_OP_CAM_REGS: {
+      if(the_cart.mapper_type != MAPPER_GBCAM){
+        raw_queue_response(RAW_STATUS_NO_MAPPER, 0);
+        return;
+      }
+      if(raw_cmd.opcode == RAW_OP_CAM_FRAME){
+        // Address is the last frame the host has, so wait until there's a newer one
+        live_cam_request();
+        raw_wait_start_us = time_us_64();
+        raw_state = RAW_STATE_WAITING;
+        return;
+      }
+      if(raw_cmd.len != RAW_CAM_REG_COUNT){
+        raw_queue_response(RAW_STATUS_BAD_RANGE, 0);
+        return;
+      }
+      raw_remaining = raw_cmd.len;
+      raw_stage_len = 0;
+      raw_state = RAW_STATE_RECEIVING;
+      return;
+    }
+    default:
+      raw_queue_response(RAW_STATUS_BAD_COMMAND, 0);
+      return;
+  }
+}
+
+void raw_read_space(uint8_t* dest, uint8_t space, uint32_t addr, uint32_t len){
+  if(space == RAW_SPACE_ROM){
+    // Same as the disk, serve from flash if we can and record it if we can't
+    if(!rom_cache_read(dest, addr, len)){
+      bus_read(BUS_SPACE_ROM, addr, dest, len);
+      rom_cache_capture(dest, addr, len);
+    }
+  }
+  else if(space == RAW_SPACE_RAM){
+    bus_read(BUS_SPACE_RAM, addr, dest, len);
+  }
+  else{
+    readbuf(addr, dest, len);
+  }
+}
+
+uint32_t raw_hash_bank(uint16_t bank){
+  uint32_t crc = CRC32_SEED;
+  for(uint32_t offset = 0; offset < ROM_BANK_SIZE; offset += RAW_STAGE_SIZE){
+    raw_read_space(raw_hash_chunk, RAW_SPACE_ROM, (bank * ROM_BANK_SIZE) + offset, RAW_STAGE_SIZE);
+    crc = crc32_update(raw_hash_chunk, RAW_STAGE_SIZE, crc);
+  }
+  return ~crc;
+}
+
+void raw_fill_frame(){
+  // Frames end on bank boundaries so each one is a bank (or part of one)
+  uint32_t len = RAW_FRAME_MAX - (raw_addr % RAW_FRAME_MAX);
+  if(len > raw_remaining){
+    len = raw_remaining;
+  }
+  raw_read_space(raw_frame_in, raw_cmd.space, raw_addr, len);
+  struct RawFrame frame = {len, 0, 0};
+  // Only worth it if it comes out smaller, otherwise send it as is
+  uint64_t pack_start = time_us_64();
+  frame.packed_len = raw_codec_pack(raw_frame_in, len, raw_frame_out + sizeof(frame), len - 1);
+  frame.pack_us = time_us_64() - pack_start;
+  if(!frame.packed_len){
+    frame.packed_len = len;
+    memcpy(raw_frame_out + sizeof(frame), raw_frame_in, len);
+  }
+  memcpy(raw_frame_out, &frame, sizeof(frame));
+  raw_send = raw_frame_out;
+  raw_stage_len = sizeof(frame) + frame.packed_len;
+  raw_addr += len;
+  raw_remaining -= len;
+}
+
+void raw_fill_stage(){
+  raw_stage_pos = 0;
+  raw_send = raw_stage;
+  if(raw_cmd.opcode == RAW_OP_READ_PACKED){
+    raw_fill_frame();
+    return;
+  }
+  if(raw_cmd.opcode == RAW_OP_GET_HASHES){
+    // One bank at a time, so USB keeps getting serviced in between
+    uint32_t crc = raw_hash_bank(raw_addr);
+    memcpy(raw_stage, &crc, sizeof(crc));
+    raw_stage_len = sizeof(crc);
+    raw_addr++;
+  }
+  else{
+    raw_stage_len = raw_remaining;
+    if(raw_stage_len > RAW_STAGE_SIZE){
+      raw_stage_len = RAW_STAGE_SIZE;
+    }
+    raw_read_space(raw_stage, raw_cmd.space, raw_addr, raw_stage_len);
+    raw_addr += raw_stage_len;
+  }
+  raw_remaining -= raw_stage_len;
+}
+
+/*  - Public Function Definitions -  */
+
+void vendor_raw_task(){
+  if(!tud_vendor_mounted()){
+    raw_state = RAW_STATE_IDLE;
+    raw_cmd_fill = 0;
+    return;
+  }
+  if(raw_state == RAW_STATE_IDLE){
+    if(!tud_vendor_available()){
+      return;
+    }
+    raw_cmd_fill += tud_vendor_read(((uint8_t*) &raw_cmd) + raw_cmd_fill, sizeof(raw_cmd) - raw_cmd_fill);
+    if(raw_cmd_fill < sizeof(raw_cmd)){
+      return;
+    }
+    raw_cmd_fill = 0;
+    raw_start_command();
+  }
+  if(raw_state == RAW_STATE_RECEIVING){
+    uint32_t want = raw_remaining - raw_stage_len;
+    if(want > (RAW_STAGE_SIZE - raw_stage_len)){
+      want = RAW_STAGE_SIZE - raw_stage_len;
+    }
+    raw_stage_len += tud_vendor_read(raw_stage + raw_stage_len, want);
+    // Hand full stages (or the last bit) to the save, through the same path the disk uses,
+    // or to the flash chip
+    if(raw_stage_len && ((raw_stage_len == RAW_STAGE_SIZE) || (raw_stage_len == raw_remaining))){
+      if(raw_cmd.opcode == RAW_OP_FLASH_WRITE){
+        // Queued for flash_cart_task, the same as the disk's writes. While the last one is
+        // still going in, hang on to the stage and try again next pass
+        if(flash_cart_busy()){
+          return;
+        }
+        if(raw_flash_fresh){
+          flash_cart_begin();
+          raw_flash_fresh = 0;
+        }
+        // One that gets turned away marks the flash failed, and the result says so
+        flash_cart_queue_write(raw_stage, raw_addr, raw_stage_len);
+      }
+      else if(raw_cmd.opcode == RAW_OP_CAM_REGS){
+        live_cam_set_regs(raw_stage);
+      }
+      else{
+        sram_writeback(raw_stage, raw_addr, raw_stage_len);
+      }
+      raw_addr += raw_stage_len;
+      raw_remaining -= raw_stage_len;
+      raw_stage_len = 0;
+    }
+    if(!raw_remaining && (raw_cmd.opcode == RAW_OP_FLASH_WRITE)){
+      // The stats are for all of it, so answer once the chip has the last of it
+      if(flash_cart_busy()){
+        return;
+      }
+      raw_queue_flash_result();
+    }
+    else if(!raw_remaining){
+      raw_queue_response(RAW_STATUS_OK, 0);
+    }
+  }
+  if(raw_state == RAW_STATE_WAITING){
+    // Keep the camera going until it has something newer than what the host has
+    live_cam_request();
+    if(live_cam_frame_count() > raw_cmd.addr){
+      raw_queue_cam_frame();
+    }
+    else if((time_us_64() - raw_wait_start_us) > (2 * LIVE_CAM_TIMEOUT_US)){
+      raw_queue_response(RAW_STATUS_NO_FRAME, 0);
+    }
+  }
+  if(raw_state == RAW_STATE_SENDING){
+    // Keep the endpoint fed for as long as it has room
+    while(tud_vendor_write_available()){
+      if(raw_stage_pos == raw_stage_len){
+        if(!raw_remaining){
+          RAW_FLUSH();
+          raw_state = RAW_STATE_IDLE;
+          return;
+        }
+        raw_fill_stage();
+      }
+      raw_stage_pos += tud_vendor_write(raw_send + raw_stage_pos, raw_stage_len - raw_stage_pos);
+    }
+    RAW_FLUSH();
+  }
+}
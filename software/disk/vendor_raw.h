@@ -0,0 +1,16 @@
+#ifndef VENDOR_RAW_H_
+#define VENDOR_RAW_H_
+
+#include <stdint.h>
+#include "raw_protocol.h"
+
+// Raw access to the cart over the vendor bulk interface, next to the mass storage disk.
+// No filesystem and no SCSI on the way, so dumps go as fast as the bus can be read
+
+// How much gets read off the bus at a time while streaming to the host
+#define RAW_STAGE_SIZE 512
+
+// Keep any transfer in progress moving. Call from the main loop, right after tud_task()
+void vendor_raw_task();
+
+#endif
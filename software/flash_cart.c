@@ -0,0 +1,760 @@
+#include "flash_cart.h"
+#include "cart.h"
+#include "gb.h"
+#include "pins.h"
+#include "utils.h"
+#include "rom_cache.h"
+#include "bank_manifest.h"
+#include "mappers/mbc5.h"
+#include "disk/gb_disk.h"
+#include "pico/stdlib.h"
+
+#include <stdio.h>
+#include <string.h>
+
+/*  - Private #defines -  */
+// What to wait for when CFI doesn't say
+#define FLASH_DEFAULT_WRITE_TIMEOUT_US  10000
+#define FLASH_DEFAULT_ERASE_TIMEOUT_US  20000000
+// Sector size to assume for chips that only answer autoselect
+#define FLASH_DEFAULT_SECTOR_SIZE       0x10000
+// The CFI table is read up to here
+#define FLASH_CFI_LEN                   0x40
+// What flash_erase_poll comes back with
+#define FLASH_ERASE_BUSY                0x0
+#define FLASH_ERASE_DONE                0x1
+#define FLASH_ERASE_FAILED              0x2
+
+/*  - Public Variables -  */
+struct FlashCartInfo flash_cart_info = {0};
+struct FlashCartStats flash_cart_stats = {0};
+
+/*  - Private Variables -  */
+// One bit per sector, set once it has been erased in this flash
+uint8_t flash_erased[FLASH_CART_MAX_SECTORS / 8] = {0};
+// ROM bank the cart is on, so the MBC only gets written when it changes
+uint16_t flash_bank = 0xFFFF;
+// Everything gets read back through here after it is programmed
+uint8_t flash_verify_buf[FLASH_CART_CHUNK] = {0};
+// When the disk last wrote, to tell one flash from the next
+uint64_t flash_last_disk_write_us = 0;
+uint8_t flash_disk_session_started = 0;
+// Writes from the disk and the vendor interface wait here for flash_cart_task, so neither
+// sits through an erase
+uint8_t flash_queue_buf[FLASH_CART_QUEUE_BUF] = {0};
+uint32_t flash_queue_addr = 0;
+uint32_t flash_queue_len = 0;            // 0 when there's nothing waiting
+uint32_t flash_queue_done = 0;           // How much of it has been programmed
+// The erase flash_cart_task is waiting on
+uint8_t flash_erasing = 0;
+uint16_t flash_erase_index = 0;
+uint32_t flash_erase_addr = 0;
+uint64_t flash_erase_start_us = 0;
+// The sector being written through since its erase, and how far it has got
+int32_t flash_open_sector = -1;
+uint32_t flash_open_fill = 0;
+uint32_t flash_open_end = 0;
+// Where the stats line lives in the status file
+uint16_t flash_stats_line_offset = STATUS_LINE_NONE;
+
+/*  - Private Function Declarations -  */
+
+// Put D0 and D1 back the way the chip sees them, if the board swaps them
+uint8_t flash_swap(uint8_t value);
+// Send a command byte. Data to be programmed goes through writeb_fast as is
+void flash_cmd(uint16_t addr, uint8_t cmd);
+void flash_unlock();
+// Back to reading the array
+void flash_reset();
+// Read with RD toggling, which status reads need to see the chip change
+uint8_t flash_poll_read(uint16_t addr);
+// Switch to the bank a flash address is in, and return where it is on the bus
+uint16_t flash_bus_addr(uint32_t flash_addr);
+// Wait for an AMD chip to finish, with data polling
+uint8_t flash_amd_wait(uint16_t addr, uint8_t expected, uint32_t timeout_us);
+// Wait for an Intel chip to finish, with its status register
+uint8_t flash_intel_wait(uint16_t addr, uint32_t timeout_us);
+// Try to enter CFI with one layout of the chip. Fills in flash_cart_info if it answers
+uint8_t flash_try_cfi(uint16_t unlock1, uint16_t unlock2, uint8_t shift, uint8_t swap);
+// Fall back to autoselect for chips without CFI
+uint8_t flash_try_autoselect(uint16_t unlock1, uint16_t unlock2, uint8_t shift, uint8_t swap);
+// Which sector a flash address is in, and where that sector starts and how big it is
+uint16_t flash_sector_of(uint32_t flash_addr, uint32_t* sector_start, uint32_t* sector_size);
+// Start erasing a sector and come back to flash_erase_poll, which says how it went
+void flash_erase_begin(uint32_t flash_addr);
+uint8_t flash_erase_poll();
+uint8_t flash_erase_sector(uint32_t flash_addr);
+// Program up to one write buffer, which can't cross a buffer boundary
+uint8_t flash_program_buffer(const uint8_t* buf, uint32_t flash_addr, uint16_t num);
+// Program one byte at a time, single or unlock bypass
+uint8_t flash_program_bytes(const uint8_t* buf, uint32_t flash_addr, uint16_t num);
+// Program a chunk that stays inside one sector and one bank
+uint8_t flash_program_chunk(const uint8_t* buf, uint32_t flash_addr, uint32_t num);
+// Put the stats in the status file
+void flash_update_stats_line();
+// Check a write against the sectors it lands in, and take them if commit is set. Returns 0
+// if it would wipe bytes it doesn't cover
+uint8_t flash_claim_span(uint32_t flash_addr, uint32_t num, uint8_t commit);
+
+/*  - Private Function Definitions -  */
+
+uint8_t flash_swap(uint8_t value){
+    if(!flash_cart_info.swap_d0d1){
+        return value;
+    }
+    return (value & 0xFC) | ((value & 0x1) << 1) | ((value & 0x2) >> 1);
+}
+
+void flash_cmd(uint16_t addr, uint8_t cmd){
+    writeb_fast(flash_swap(cmd), addr);
+}
+
+void flash_unlock(){
+    flash_cmd(flash_cart_info.unlock1, 0xAA);
+    flash_cmd(flash_cart_info.unlock2, 0x55);
+}
+
+void flash_reset(){
+    if(flash_cart_info.command_set == FLASH_CMD_INTEL){
+        flash_cmd(0, 0x50);
+        flash_cmd(0, 0xFF);
+        return;
+    }
+    // Unlocked reset gets AMD chips out of a failed buffer write too
+    flash_unlock();
+    flash_cmd(flash_cart_info.unlock1, 0xF0);
+}
+
+uint8_t flash_poll_read(uint16_t addr){
+    gpio_put(RD, 1);
+    delay_wait(3);
+    return readb(addr);
+}
+
+uint16_t flash_bus_addr(uint32_t flash_addr){
+    uint16_t bank = flash_addr / ROM_BANK_SIZE;
+    if(!bank){
+        return flash_addr;
+    }
+    if(bank != flash_bank){
+        // Flash carts are all MBC5 or close enough, and this works before the header does.
+        // High byte first: Intel chips take every write as a command, and a low byte of 0x40
+        // followed by the high byte would program it
+        writeb_fast(bank >> 8, MBC5_HIGH_ROM_BANK_ADDR);
+        writeb_fast(bank & 0xFF, MBC5_LOW_ROM_BANK_ADDR);
+        if(flash_cart_info.command_set == FLASH_CMD_INTEL){
+            // The bank may have looked like a command. 0xFF finishes a program setup without
+            // changing anything, and clears out anything else
+            flash_cmd(0, 0xFF);
+            flash_reset();
+        }
+        flash_bank = bank;
+    }
+    return ROM_BANKN_START_ADDR + (flash_addr % ROM_BANK_SIZE);
+}
+
+uint8_t flash_amd_wait(uint16_t addr, uint8_t expected, uint32_t timeout_us){
+    uint64_t start = time_us_64();
+    for(;;){
+        uint8_t status = flash_poll_read(addr);
+        // DQ7 reads back inverted until the byte is in
+        if(!((status ^ expected) & 0x80)){
+            // The rest of the byte can come good a read after DQ7 does
+            if(flash_poll_read(addr) == expected){
+                return 1;
+            }
+            break;
+        }
+        // DQ5 goes high when the chip gives up on its own
+        if((status & 0x20) || ((time_us_64() - start) > timeout_us)){
+            // It could have finished right as DQ5 went up
+            if(flash_poll_read(addr) == expected){
+                return 1;
+            }
+            break;
+        }
+    }
+    flash_reset();
+    return 0;
+}
+
+uint8_t flash_intel_wait(uint16_t addr, uint32_t timeout_us){
+    uint64_t start = time_us_64();
+    uint8_t status = 0;
+    do{
+        status = flash_swap(flash_poll_read(addr));
+    } while(!(status & 0x80) && ((time_us_64() - start) <= timeout_us));
+    // Ready, and no erase, program, VPP or lock errors
+    uint8_t ok = (status & 0xBA) == 0x80;
+    flash_reset();
+    return ok;
+}
+
+uint8_t flash_try_cfi(uint16_t unlock1, uint16_t unlock2, uint8_t shift, uint8_t swap){
+    flash_cart_info.unlock1 = unlock1;
+    flash_cart_info.unlock2 = unlock2;
+    flash_cart_info.swap_d0d1 = swap;
+    flash_cmd(0, 0xF0);
+    flash_cmd(0, 0xFF);
+    // CFI query lives at 0x55 in the chip's own word addressing
+    flash_cmd(0x55 << shift, 0x98);
+    uint8_t cfi[FLASH_CFI_LEN] = {0};
+    for(uint8_t i = 0x10; i < FLASH_CFI_LEN; i++){
+        cfi[i] = flash_swap(readb(i << shift));
+    }
+    flash_cmd(0, 0xF0);
+    flash_cmd(0, 0xFF);
+    if((cfi[0x10] != 'Q') || (cfi[0x11] != 'R') || (cfi[0x12] != 'Y')){
+        return 0;
+    }
+    uint16_t algorithm = cfi[0x13] | (cfi[0x14] << 8);
+    if((algorithm == 0x0001) || (algorithm == 0x0003)){
+        flash_cart_info.command_set = FLASH_CMD_INTEL;
+    }
+    else if((algorithm == 0x0002) || (algorithm == 0x0004)){
+        flash_cart_info.command_set = FLASH_CMD_AMD;
+    }
+    else{
+        return 0;
+    }
+    // Anything past 64MB can't be reached through an MBC5 anyway
+    if((cfi[0x27] < 15) || (cfi[0x27] > 26)){
+        return 0;
+    }
+    flash_cart_info.size_bytes = 1UL << cfi[0x27];
+    uint16_t buffer_shift = cfi[0x2A] | (cfi[0x2B] << 8);
+    flash_cart_info.buffer_size = ((buffer_shift > 0) && (buffer_shift < 16)) ? (1 << buffer_shift) : 1;
+    if(flash_cart_info.buffer_size > FLASH_CART_CHUNK){
+        flash_cart_info.buffer_size = FLASH_CART_CHUNK;
+    }
+    // Typical times are 2^n, and the max is the typical time times 2^n again
+    uint8_t write_typ = flash_cart_info.buffer_size > 1 ? cfi[0x20] : cfi[0x1F];
+    uint8_t write_max = flash_cart_info.buffer_size > 1 ? cfi[0x24] : cfi[0x23];
+    flash_cart_info.write_timeout_us = (write_typ && (write_typ + write_max) < 24) ?
+        (1UL << (write_typ + write_max)) : FLASH_DEFAULT_WRITE_TIMEOUT_US;
+    flash_cart_info.erase_timeout_us = (cfi[0x21] && (cfi[0x21] + cfi[0x25]) < 16) ?
+        ((1UL << (cfi[0x21] + cfi[0x25])) * 1000) : FLASH_DEFAULT_ERASE_TIMEOUT_US;
+    flash_cart_info.region_count = 0;
+    for(uint8_t i = 0; (i < cfi[0x2C]) && (i < FLASH_CART_MAX_REGIONS); i++){
+        uint8_t* region = cfi + 0x2D + (i * 4);
+        uint32_t sector_size = (region[2] | (region[3] << 8)) * 256;
+        flash_cart_info.regions[i].sectors = (region[0] | (region[1] << 8)) + 1;
+        flash_cart_info.regions[i].sector_size = sector_size ? sector_size : 128;
+        flash_cart_info.region_count++;
+    }
+    if(!flash_cart_info.region_count){
+        return 0;
+    }
+    return 1;
+}
+
+uint8_t flash_try_autoselect(uint16_t unlock1, uint16_t unlock2, uint8_t shift, uint8_t swap){
+    uint8_t rom[2] = {readb(0), readb(1 << shift)};
+    flash_cart_info.unlock1 = unlock1;
+    flash_cart_info.unlock2 = unlock2;
+    flash_cart_info.swap_d0d1 = swap;
+    flash_cart_info.command_set = FLASH_CMD_AMD;
+    flash_unlock();
+    flash_cmd(unlock1, 0x90);
+    uint8_t manufacturer = readb(0);
+    uint8_t device = readb(1 << shift);
+    flash_reset();
+    // Nothing changed, so nothing is listening
+    if((manufacturer == rom[0]) && (device == rom[1])){
+        return 0;
+    }
+    manufacturer = flash_swap(manufacturer);
+    // AMD, Fujitsu, ST, Macronix, SST and Atmel, the ones that turn up on flash carts
+    if((manufacturer != 0x01) && (manufacturer != 0x04) && (manufacturer != 0x20) &&
+        (manufacturer != 0xC2) && (manufacturer != 0xBF) && (manufacturer != 0x1F)){
+        return 0;
+    }
+    // No geometry without CFI. Go with what the ROM says and uniform sectors, and let
+    // verify catch chips this is wrong for
+    flash_cart_info.size_bytes = the_cart.rom_size_bytes;
+    flash_cart_info.buffer_size = 1;
+    flash_cart_info.write_timeout_us = FLASH_DEFAULT_WRITE_TIMEOUT_US;
+    flash_cart_info.erase_timeout_us = FLASH_DEFAULT_ERASE_TIMEOUT_US;
+    flash_cart_info.region_count = 1;
+    flash_cart_info.regions[0].sector_size = FLASH_DEFAULT_SECTOR_SIZE;
+    flash_cart_info.regions[0].sectors = (flash_cart_info.size_bytes + FLASH_DEFAULT_SECTOR_SIZE - 1) / FLASH_DEFAULT_SECTOR_SIZE;
+    return 1;
+}
+
+uint16_t flash_sector_of(uint32_t flash_addr, uint32_t* sector_start, uint32_t* sector_size){
+    uint32_t region_start = 0;
+    uint16_t sector = 0;
+    for(uint8_t i = 0; i < flash_cart_info.region_count; i++){
+        const struct FlashEraseRegion* region = &flash_cart_info.regions[i];
+        uint32_t region_len = region->sectors * region->sector_size;
+        if(flash_addr < (region_start + region_len)){
+            uint32_t index = (flash_addr - region_start) / region->sector_size;
+            *sector_start = region_start + (index * region->sector_size);
+            *sector_size = region->sector_size;
+            return sector + index;
+        }
+        region_start += region_len;
+        sector += region->sectors;
+    }
+    // Past the regions CFI gave. Treat what's left as one sector, which verify will catch
+    *sector_start = region_start;
+    *sector_size = flash_cart_info.size_bytes - region_start;
+    return sector;
+}
+
+void flash_erase_begin(uint32_t flash_addr){
+    uint16_t addr = flash_bus_addr(flash_addr);
+    flash_erase_addr = flash_addr;
+    if(flash_cart_info.command_set == FLASH_CMD_INTEL){
+        // Some chips power up with every block locked. Unlocking is quick
+        flash_cmd(addr, 0x60);
+        flash_cmd(addr, 0xD0);
+        flash_intel_wait(addr, flash_cart_info.erase_timeout_us);
+        flash_erase_start_us = time_us_64();
+        flash_cmd(addr, 0x20);
+        flash_cmd(addr, 0xD0);
+        return;
+    }
+    flash_erase_start_us = time_us_64();
+    flash_unlock();
+    flash_cmd(flash_cart_info.unlock1, 0x80);
+    flash_unlock();
+    flash_cmd(addr, 0x30);
+}
+
+uint8_t flash_erase_poll(){
+    uint8_t timed_out = (time_us_64() - flash_erase_start_us) > flash_cart_info.erase_timeout_us;
+    if(flash_cart_info.command_set == FLASH_CMD_INTEL){
+        // The status register reads back from anywhere, so no bank switch. Those writes
+        // would look like commands to the chip
+        uint8_t status = flash_swap(flash_poll_read(0));
+        if(!(status & 0x80) && !timed_out){
+            return FLASH_ERASE_BUSY;
+        }
+        // Ready, and no erase, VPP or lock errors
+        uint8_t ok = (status & 0xBA) == 0x80;
+        flash_reset();
+        return ok ? FLASH_ERASE_DONE : FLASH_ERASE_FAILED;
+    }
+    // Anything could have moved the bank since last time, and polling has to be in the sector
+    flash_bank = 0xFFFF;
+    uint16_t addr = flash_bus_addr(flash_erase_addr);
+    uint8_t status = flash_poll_read(addr);
+    // Same as flash_amd_wait. Erased reads back as all ones
+    if(!(status & 0x80) && !(status & 0x20) && !timed_out){
+        return FLASH_ERASE_BUSY;
+    }
+    if(flash_poll_read(addr) == 0xFF){
+        return FLASH_ERASE_DONE;
+    }
+    flash_reset();
+    return FLASH_ERASE_FAILED;
+}
+
+uint8_t flash_erase_sector(uint32_t flash_addr){
+    flash_erase_begin(flash_addr);
+    uint8_t result = FLASH_ERASE_BUSY;
+    while(result == FLASH_ERASE_BUSY){
+        result = flash_erase_poll();
+    }
+    return result == FLASH_ERASE_DONE;
+}
+
+uint8_t flash_program_buffer(const uint8_t* buf, uint32_t flash_addr, uint16_t num){
+    uint16_t addr = flash_bus_addr(flash_addr);
+    if(flash_cart_info.command_set == FLASH_CMD_INTEL){
+        // Keep asking until a buffer is free
+        uint64_t start = time_us_64();
+        do{
+            flash_cmd(addr, 0xE8);
+        } while(!(flash_swap(flash_poll_read(addr)) & 0x80) && ((time_us_64() - start) <= flash_cart_info.write_timeout_us));
+        flash_cmd(addr, num - 1);
+        for(uint16_t i = 0; i < num; i++){
+            writeb_fast(buf[i], addr + i);
+        }
+        flash_cmd(addr, 0xD0);
+        return flash_intel_wait(addr, flash_cart_info.write_timeout_us);
+    }
+    flash_unlock();
+    flash_cmd(addr, 0x25);
+    flash_cmd(addr, num - 1);
+    for(uint16_t i = 0; i < num; i++){
+        writeb_fast(buf[i], addr + i);
+    }
+    flash_cmd(addr, 0x29);
+    // Polling goes on the last byte loaded
+    return flash_amd_wait(addr + num - 1, buf[num - 1], flash_cart_info.write_timeout_us);
+}
+
+uint8_t flash_program_bytes(const uint8_t* buf, uint32_t flash_addr, uint16_t num){
+    uint16_t addr = flash_bus_addr(flash_addr);
+    uint8_t bypass = (flash_cart_info.command_set == FLASH_CMD_AMD) && (flash_cart_info.program_mode == FLASH_PROG_BYPASS);
+    uint8_t ok = 1;
+    if(bypass){
+        flash_unlock();
+        flash_cmd(flash_cart_info.unlock1, 0x20);
+    }
+    for(uint16_t i = 0; (i < num) && ok; i++){
+        // Erased bytes are already there
+        if(buf[i] == 0xFF){
+            continue;
+        }
+        if(flash_cart_info.command_set == FLASH_CMD_INTEL){
+            flash_cmd(addr + i, 0x40);
+            writeb_fast(buf[i], addr + i);
+            ok = flash_intel_wait(addr + i, flash_cart_info.write_timeout_us);
+            continue;
+        }
+        if(!bypass){
+            flash_unlock();
+        }
+        flash_cmd(bypass ? (addr + i) : flash_cart_info.unlock1, 0xA0);
+        writeb_fast(buf[i], addr + i);
+        ok = flash_amd_wait(addr + i, buf[i], flash_cart_info.write_timeout_us);
+    }
+    if(bypass){
+        flash_cmd(addr, 0x90);
+        flash_cmd(addr, 0x00);
+    }
+    return ok;
+}
+
+uint8_t flash_program_chunk(const uint8_t* buf, uint32_t flash_addr, uint32_t num){
+    if(flash_cart_info.program_mode != FLASH_PROG_BUFFERED){
+        return flash_program_bytes(buf, flash_addr, num);
+    }
+    uint32_t done = 0;
+    while(done < num){
+        uint32_t len = flash_cart_info.buffer_size - ((flash_addr + done) % flash_cart_info.buffer_size);
+        if(len > (num - done)){
+            len = num - done;
+        }
+        // Leave out the ends of it that are already erased
+        uint32_t first = 0;
+        uint32_t last = len;
+        while((first < last) && (buf[done + first] == 0xFF)){
+            first++;
+        }
+        while((last > first) && (buf[done + last - 1] == 0xFF)){
+            last--;
+        }
+        if((last > first) && !flash_program_buffer(buf + done + first, flash_addr + done + first, last - first)){
+            return 0;
+        }
+        done += len;
+    }
+    return 1;
+}
+
+uint8_t flash_claim_span(uint32_t flash_addr, uint32_t num, uint8_t commit){
+    if((flash_addr >= flash_cart_info.size_bytes) || (num > (flash_cart_info.size_bytes - flash_addr))){
+        return 0;
+    }
+    int32_t open_sector = flash_open_sector;
+    uint32_t open_fill = flash_open_fill;
+    while(num){
+        uint32_t sector_start = 0;
+        uint32_t sector_size = 0;
+        uint16_t sector = flash_sector_of(flash_addr, &sector_start, &sector_size);
+        uint32_t len = sector_start + sector_size - flash_addr;
+        if(len > num){
+            len = num;
+        }
+        if(sector != open_sector){
+            // Erasing from anywhere else would lose the start of the sector
+            if(flash_addr != sector_start){
+                return 0;
+            }
+            if(commit){
+                // The one before got erased but not all written back
+                if((flash_open_sector >= 0) && (flash_open_fill < flash_open_end)){
+                    flash_cart_stats.partial = 1;
+                }
+                // Gets erased again even if it already was this flash
+                if(sector < FLASH_CART_MAX_SECTORS){
+                    flash_erased[sector / 8] &= ~(1 << (sector % 8));
+                }
+                flash_open_sector = sector;
+                flash_open_end = sector_start + sector_size;
+            }
+            open_sector = sector;
+        }
+        // Straight on from where it got to, the bytes behind have been programmed
+        else if(flash_addr != open_fill){
+            return 0;
+        }
+        open_fill = flash_addr + len;
+        if(commit){
+            flash_open_fill = open_fill;
+        }
+        flash_addr += len;
+        num -= len;
+    }
+    return 1;
+}
+
+void flash_update_stats_line(){
+    char line[STATUS_LINE_LEN + 1];
+    snprintf(line, sizeof(line), "FLASH: %5luK %4luKB/S %08lX %s\n",
+        (unsigned long) (flash_cart_stats.bytes / 1024), (unsigned long) flash_cart_kbps(),
+        (unsigned long) ~flash_cart_stats.readback_crc, flash_cart_stats.failed ? "FAIL" : (flash_cart_stats.partial ? "PART" : "OK  "));
+    update_status_line(flash_stats_line_offset, line);
+}
+
+/*  - Public Function Definitions -  */
+
+uint8_t flash_cart_detect(){
+    memset(&flash_cart_info, 0, sizeof(flash_cart_info));
+    flash_bank = 0xFFFF;
+    // x16 chips in byte mode and x8 chips, each with D0 and D1 straight or swapped
+    for(uint8_t swap = 0; swap < 2; swap++){
+        if(flash_try_cfi(0xAAA, 0x555, 1, swap) || flash_try_cfi(0x555, 0x2AA, 0, swap)){
+            break;
+        }
+        flash_cart_info.command_set = FLASH_CMD_NONE;
+    }
+    if(flash_cart_info.command_set == FLASH_CMD_NONE){
+        for(uint8_t swap = 0; swap < 2; swap++){
+            if(flash_try_autoselect(0xAAA, 0x555, 1, swap) || flash_try_autoselect(0x555, 0x2AA, 0, swap)){
+                break;
+            }
+            flash_cart_info.command_set = FLASH_CMD_NONE;
+        }
+    }
+    if(flash_cart_info.command_set == FLASH_CMD_NONE){
+        return 0;
+    }
+    // Now that it's known, get the IDs the way its command set does it
+    uint8_t shift = flash_cart_info.unlock1 == 0xAAA ? 1 : 0;
+    if(flash_cart_info.command_set == FLASH_CMD_INTEL){
+        flash_cmd(0, 0x90);
+    }
+    else{
+        flash_unlock();
+        flash_cmd(flash_cart_info.unlock1, 0x90);
+    }
+    flash_cart_info.manufacturer = flash_swap(readb(0));
+    flash_cart_info.device = flash_swap(readb(1 << shift));
+    flash_reset();
+    if(flash_cart_info.buffer_size > 1){
+        flash_cart_info.program_mode = FLASH_PROG_BUFFERED;
+    }
+    else if(flash_cart_info.command_set == FLASH_CMD_AMD){
+        flash_cart_info.program_mode = FLASH_PROG_BYPASS;
+    }
+    else{
+        flash_cart_info.program_mode = FLASH_PROG_SINGLE;
+    }
+    return 1;
+}
+
+void init_flash_cart(){
+    if(!flash_cart_detect()){
+        append_status_file("FLASH CART: NONE\n\0");
+        return;
+    }
+    const char* modes[] = {"SINGLE", "BYPASS", "BUFFERED"};
+    char line[64];
+    snprintf(line, sizeof(line), "FLASH CART: %02X:%02X %luK %s%s\n",
+        flash_cart_info.manufacturer, flash_cart_info.device, (unsigned long) (flash_cart_info.size_bytes / 1024),
+        modes[flash_cart_info.program_mode], flash_cart_info.swap_d0d1 ? " D0/D1 SWAPPED" : "");
+    append_status_file_buf(line);
+    // Fixed width so it can be rewritten in place as the stats change
+    flash_cart_begin();
+    snprintf(line, STATUS_LINE_LEN + 1, "FLASH: %5luK %4luKB/S %08lX %s\n", 0UL, 0UL, 0UL, "OK  ");
+    flash_stats_line_offset = reserve_status_line(line);
+}
+
+void flash_cart_begin(){
+    memset(flash_erased, 0, sizeof(flash_erased));
+    flash_open_sector = -1;
+    memset(&flash_cart_stats, 0, sizeof(flash_cart_stats));
+    flash_cart_stats.data_crc = CRC32_SEED;
+    flash_cart_stats.readback_crc = CRC32_SEED;
+    // Whatever is cached or hashed was the old ROM
+    rom_cache_state = ROM_CACHE_OFF;
+    bank_manifest_rom_changed();
+}
+
+uint8_t flash_cart_write(const uint8_t* buf, uint32_t flash_addr, uint32_t num){
+    if((flash_cart_info.command_set == FLASH_CMD_NONE) || (flash_addr >= flash_cart_info.size_bytes) ||
+        (num > (flash_cart_info.size_bytes - flash_addr))){
+        flash_cart_stats.failed = 1;
+        return 0;
+    }
+    flash_cart_stats.data_crc = crc32_update(buf, num, flash_cart_stats.data_crc);
+    // Once something didn't take, the rest isn't worth the time
+    if(flash_cart_stats.failed){
+        return 0;
+    }
+    // Anything could have moved the bank since last time
+    flash_bank = 0xFFFF;
+    while(num){
+        uint32_t sector_start = 0;
+        uint32_t sector_size = 0;
+        uint16_t sector = flash_sector_of(flash_addr, &sector_start, &sector_size);
+        if(sector >= FLASH_CART_MAX_SECTORS){
+            flash_cart_stats.failed = 1;
+            return 0;
+        }
+        // Erase on the way in, the first time a sector gets touched
+        if(!(flash_erased[sector / 8] & (1 << (sector % 8)))){
+            uint64_t start = time_us_64();
+            uint8_t erased = flash_erase_sector(sector_start);
+            flash_cart_stats.erase_us += time_us_64() - start;
+            flash_cart_stats.sectors_erased++;
+            if(!erased){
+                flash_cart_stats.failed = 1;
+                return 0;
+            }
+            flash_erased[sector / 8] |= 1 << (sector % 8);
+        }
+        // Stay inside the sector, the bank and one chunk
+        uint32_t len = sector_start + sector_size - flash_addr;
+        if(len > (ROM_BANK_SIZE - (flash_addr % ROM_BANK_SIZE))){
+            len = ROM_BANK_SIZE - (flash_addr % ROM_BANK_SIZE);
+        }
+        if(len > (FLASH_CART_CHUNK - (flash_addr % FLASH_CART_CHUNK))){
+            len = FLASH_CART_CHUNK - (flash_addr % FLASH_CART_CHUNK);
+        }
+        if(len > num){
+            len = num;
+        }
+        uint64_t start = time_us_64();
+        uint8_t ok = flash_program_chunk(buf, flash_addr, len);
+        if(!ok && (flash_cart_info.program_mode != FLASH_PROG_SINGLE)){
+            // Some chips claim more than they can do. Single bytes for the rest of this flash
+            flash_cart_info.program_mode = FLASH_PROG_SINGLE;
+            ok = flash_program_chunk(buf, flash_addr, len);
+        }
+        // Read it back through the same window it went in through
+        readbuf(flash_bus_addr(flash_addr), flash_verify_buf, len);
+        flash_cart_stats.readback_crc = crc32_update(flash_verify_buf, len, flash_cart_stats.readback_crc);
+        flash_cart_stats.program_us += time_us_64() - start;
+        if(!ok || !bufncmp(flash_verify_buf, (uint8_t*) buf, len)){
+            flash_cart_stats.failed = 1;
+            return 0;
+        }
+        flash_cart_stats.bytes += len;
+        buf += len;
+        flash_addr += len;
+        num -= len;
+    }
+    return 1;
+}
+
+uint32_t flash_cart_kbps(){
+    uint64_t us = (uint64_t) flash_cart_stats.erase_us + flash_cart_stats.program_us;
+    if(!us){
+        return 0;
+    }
+    return ((uint64_t) flash_cart_stats.bytes * 1000000) / (us * 1024);
+}
+
+int32_t flash_cart_queue_write(const uint8_t* buf, uint32_t flash_addr, uint32_t num){
+    if(flash_queue_len){
+        return 0;
+    }
+    if(num > sizeof(flash_queue_buf)){
+        num = sizeof(flash_queue_buf);
+    }
+    if(!flash_claim_span(flash_addr, num, 0)){
+        flash_cart_stats.failed = 1;
+        flash_update_stats_line();
+        return -1;
+    }
+    flash_claim_span(flash_addr, num, 1);
+    memcpy(flash_queue_buf, buf, num);
+    flash_queue_addr = flash_addr;
+    flash_queue_done = 0;
+    flash_queue_len = num;
+    return num;
+}
+
+int32_t flash_cart_disk_write(const uint8_t* buf, uint32_t flash_addr, uint32_t num){
+    if(flash_cart_info.command_set == FLASH_CMD_NONE){
+        return num;
+    }
+    if(flash_queue_len){
+        return 0;
+    }
+    // A gap between writes means the host is done with the last image and starting a new one
+    if(!flash_disk_session_started || ((time_us_64() - flash_last_disk_write_us) > FLASH_CART_SESSION_GAP_US)){
+        flash_cart_begin();
+        flash_disk_session_started = 1;
+    }
+    return flash_cart_queue_write(buf, flash_addr, num);
+}
+
+void flash_cart_task(){
+    if(!flash_queue_len){
+        return;
+    }
+    if(flash_erasing){
+        uint8_t result = flash_erase_poll();
+        if(result == FLASH_ERASE_BUSY){
+            return;
+        }
+        flash_erasing = 0;
+        flash_cart_stats.erase_us += time_us_64() - flash_erase_start_us;
+        flash_cart_stats.sectors_erased++;
+        if(result == FLASH_ERASE_DONE){
+            flash_erased[flash_erase_index / 8] |= 1 << (flash_erase_index % 8);
+        }
+        else{
+            flash_cart_stats.failed = 1;
+        }
+    }
+    uint32_t flash_addr = flash_queue_addr + flash_queue_done;
+    // Start the erase here rather than have flash_cart_write wait it out. Anything it can't
+    // cover (out of range, or too many sectors) goes to flash_cart_write to fail
+    if(!flash_cart_stats.failed && (flash_addr < flash_cart_info.size_bytes)){
+        uint32_t sector_start = 0;
+        uint32_t sector_size = 0;
+        uint16_t sector = flash_sector_of(flash_addr, &sector_start, &sector_size);
+        if((sector < FLASH_CART_MAX_SECTORS) && !(flash_erased[sector / 8] & (1 << (sector % 8)))){
+            flash_bank = 0xFFFF;
+            flash_erase_begin(sector_start);
+            flash_erase_index = sector;
+            flash_erasing = 1;
+            return;
+        }
+    }
+    // A chunk a pass
+    uint32_t len = FLASH_CART_CHUNK - (flash_addr % FLASH_CART_CHUNK);
+    if(len > (flash_queue_len - flash_queue_done)){
+        len = flash_queue_len - flash_queue_done;
+    }
+    flash_cart_write(flash_queue_buf + flash_queue_done, flash_addr, len);
+    flash_queue_done += len;
+    if(flash_queue_done < flash_queue_len){
+        return;
+    }
+    flash_queue_len = 0;
+    // From when this one finished, erases can take a while
+    flash_last_disk_write_us = time_us_64();
+    flash_update_stats_line();
+}
+
+uint8_t flash_cart_busy(){
+    return flash_queue_len != 0;
+}
+
+void flash_cart_blank_info(){
+    memset(&the_cart, 0, sizeof(the_cart));
+    // Flash carts are all MBC5 or close enough, same as flash_bus_addr goes with
+    the_cart.cart_type = 0x19;
+    the_cart.mapper_type = MAPPER_MBC5;
+    strncpy(the_cart.cart_type_str, "MBC5 (BLANK FLASH)", sizeof(the_cart.cart_type_str) - 1);
+    strncpy(the_cart.title, "BLANK FLASH", CART_TITLE_LEN);
+    the_cart.rom_banks = flash_cart_info.size_bytes / ROM_BANK_SIZE;
+    the_cart.rom_size_bytes = flash_cart_info.size_bytes;
+    // No RAM until something with a header goes in
+    the_cart.ram_end_address = SRAM_START_ADDR;
+    the_cart.rom_memcpy_func = &mbc5_memcpy_rom;
+    the_cart.ram_memcpy_func = &mbc5_memcpy_ram;
+    the_cart.ram_memset_func = &mbc5_memset_ram;
+    the_cart.ram_enable_func = &mbc5_set_ram_access;
+    the_cart.rom_banksw_func = &mbc5_set_rom_bank;
+    the_cart.ram_banksw_func = &mbc5_set_ram_bank;
+}
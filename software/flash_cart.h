@@ -0,0 +1,95 @@
+#ifndef FLASH_CART_H_
+#define FLASH_CART_H_
+
+#include <stdint.h>
+
+// Programming for repro and flash carts, where the ROM is a NOR flash chip with its WE on
+// the cart's WR line. The chip gets found with a CFI query (autoselect if that fails), and
+// its geometry and command set come from that, so nothing here is chip specific.
+// Sectors get erased by a write that starts at the start of them, then programmed with
+// buffered writes if the chip has them, unlock bypass or single bytes if it doesn't. There's
+// nowhere to keep the rest of a 64K sector, so a write that would need it kept is turned
+// away: one that starts partway into a sector, or skips ahead in the one being written.
+// Everything written gets read straight back and compared.
+
+// Command sets, from the CFI primary algorithm
+#define FLASH_CMD_NONE              0x0
+#define FLASH_CMD_AMD               0x1 // AMD/Fujitsu and everything compatible
+#define FLASH_CMD_INTEL             0x2 // Intel/Sharp
+
+// How bytes get programmed
+#define FLASH_PROG_SINGLE           0x0 // Full unlock for every byte
+#define FLASH_PROG_BYPASS           0x1 // AMD unlock bypass, two writes a byte
+#define FLASH_PROG_BUFFERED         0x2 // Whole write buffer at once
+
+#define FLASH_CART_MAX_REGIONS      4
+// Enough for a 64Mbit chip with 8K sectors
+#define FLASH_CART_MAX_SECTORS      1024
+// Most that gets programmed before being read back
+#define FLASH_CART_CHUNK            512
+// Writes closer together than this are the same flash, for the disk
+#define FLASH_CART_SESSION_GAP_US   2000000
+// Most a queued write hands over at once, the size of a write10
+#define FLASH_CART_QUEUE_BUF        4096
+
+struct FlashEraseRegion {
+    uint16_t sectors;
+    uint32_t sector_size;
+};
+
+struct FlashCartInfo {
+    uint8_t command_set;     // FLASH_CMD_NONE if there's no flash
+    uint8_t program_mode;
+    uint8_t swap_d0d1;       // Lots of repro boards swap D0 and D1 to make routing easier
+    uint8_t manufacturer;
+    uint16_t device;
+    uint16_t unlock1;        // 0x555/0x2AA for x8 chips, 0xAAA/0x555 for x16 ones in byte mode
+    uint16_t unlock2;
+    uint32_t size_bytes;
+    uint16_t buffer_size;    // Write buffer in bytes, 1 if there isn't one
+    uint32_t write_timeout_us;
+    uint32_t erase_timeout_us;
+    uint8_t region_count;
+    struct FlashEraseRegion regions[FLASH_CART_MAX_REGIONS];
+};
+
+// Stats for everything written since flash_cart_begin
+struct FlashCartStats {
+    uint32_t bytes;
+    uint32_t sectors_erased;
+    uint32_t erase_us;
+    uint32_t program_us;     // Programming and reading it back
+    uint32_t data_crc;       // CRC32 of what was sent, in the order it was sent
+    uint32_t readback_crc;   // CRC32 of what got read back afterwards. Matches data_crc if it all went in
+    uint8_t failed;
+    uint8_t partial;         // A sector got erased and then left before all of it was written
+};
+
+extern struct FlashCartInfo flash_cart_info;
+extern struct FlashCartStats flash_cart_stats;
+
+// Look for a flash chip and put a line about it in the status file
+void init_flash_cart();
+// Query the chip. Returns 1 if there is one, and fills in flash_cart_info
+uint8_t flash_cart_detect();
+// Start a new flash. Nothing is erased yet, that happens as sectors get written
+void flash_cart_begin();
+// Erase (if needed), program and verify part of the image. Returns 0 if anything didn't take
+uint8_t flash_cart_write(const uint8_t* buf, uint32_t flash_addr, uint32_t num);
+// Throughput of everything written so far, in KB/s
+uint32_t flash_cart_kbps();
+// Copy a write out for flash_cart_task. Returns how much it took, 0 while the last one is
+// still going in, or -1 if it would wipe part of a sector it doesn't cover
+int32_t flash_cart_queue_write(const uint8_t* buf, uint32_t flash_addr, uint32_t num);
+// flash_cart_queue_write for the disk, which starts a new flash after a gap
+int32_t flash_cart_disk_write(const uint8_t* buf, uint32_t flash_addr, uint32_t num);
+// Erase and program what got queued, a chunk or an erase poll a pass so USB keeps going.
+// Keeps the status file up to date. Call from the main loop
+void flash_cart_task();
+// 1 while a queued write is still going into the chip
+uint8_t flash_cart_busy();
+// Fill in the_cart for a flash cart whose header has been erased, as an MBC5 the size of the
+// chip, so it can be written. Needs flash_cart_detect first
+void flash_cart_blank_info();
+
+#endif
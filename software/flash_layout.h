@@ -0,0 +1,36 @@
+#ifndef FLASH_LAYOUT_H_
+#define FLASH_LAYOUT_H_
+
+#include "pico.h"
+#include "hardware/flash.h"
+
+// Where everything lives in the QSPI flash. All offsets are relative to the start of flash,
+// which is what flash_range_erase() and flash_range_program() want
+
+// Boards can have anywhere from 2 to 16 MB, override this if the board header gets it wrong
+#ifndef GBPUNK_FLASH_SIZE
+#define GBPUNK_FLASH_SIZE           PICO_FLASH_SIZE_BYTES
+#endif
+
+// Everything below this offset belongs to the firmware image. Fixed so that the stores
+// don't move around (and get corrupted) every time the firmware grows
+#define FLASH_FIRMWARE_RESERVED     (512 * 1024)
+
+// Save snapshots live at the very top of flash. The store is split in two halves so that
+// it can be compacted from one half into the other without losing anything on power loss
+#define FLASH_SAVE_STORE_HALF_SIZE  (256 * 1024)
+#define FLASH_SAVE_STORE_SIZE       (FLASH_SAVE_STORE_HALF_SIZE * 2)
+#define FLASH_SAVE_STORE_START      (GBPUNK_FLASH_SIZE - FLASH_SAVE_STORE_SIZE)
+
+// ROM cache takes everything from the end of the firmware to the save store
+#define FLASH_ROM_CACHE_START       FLASH_FIRMWARE_RESERVED
+#define FLASH_ROM_CACHE_END         FLASH_SAVE_STORE_START
+
+// Probed cart sizes get one sector. It sits in the spare sectors between the ROM cache
+// index and the first cached image, which starts a whole block in
+#define FLASH_CART_PROBE_START      (FLASH_ROM_CACHE_START + FLASH_SECTOR_SIZE)
+
+// Convert a flash offset to an address we can read it back from through XIP
+#define FLASH_OFFSET_TO_XIP(x)      ((const uint8_t*) (XIP_BASE + (x)))
+
+#endif
@@ -2,11 +2,22 @@
 #include <string.h>
 #include <math.h>
 #include "pico/stdlib.h"
+#include "hardware/sync.h"
 #include "gb.h"
 #include "pins.h"
 #include "utils.h"
+#include "bus_core.h"
+#include "metrics.h"
 
 uint8_t working_mem[0x8000] = {0};
+// How much longer than normal readb waits at each step, 0 is full speed
+uint8_t read_slowdown = 0;
+// How readbuf_rom walks a run, and how long it waits for the data after each address change
+uint8_t burst_mode = BURST_GRAY;
+uint8_t burst_settle = BURST_SETTLE_DEFAULT;
+// The address and data pins are wired backwards to the bits, this flips a byte around
+// Core 1 looks this up for every byte of a burst, so it sits in SRAM4 next to core 1's stack
+uint8_t __scratch_x("bit_reverse") bit_reverse[256] = {0};
 
 void pulse_clock(){
     gpio_put(CLK, 0);
@@ -95,6 +106,14 @@ void init_bus(){
     gpio_init(D7);
     set_dbus_direction(GPIO_IN);
 
+    for(uint16_t i = 0; i < 256; i++){
+        uint8_t r = 0;
+        for(uint8_t b = 0; b < 8; b++){
+            r |= ((i >> b) & 0x1) << (7 - b);
+        }
+        bit_reverse[i] = r;
+    }
+
     // Init the state of all the pins
     reset_pin_states();
 }
@@ -128,14 +147,23 @@ void reset_pin_states(){
     gpio_put(CLK, 1);
 }
 
-void writeb(uint8_t data, uint16_t addr){
+void __not_in_flash_func(writeb)(uint8_t data, uint16_t addr){
+    // Core 1 has the bus, send it over
+    if(bus_core_owns_bus()){
+        bus_write(BUS_SPACE_ADDR, addr, &data, 1);
+        return;
+    }
+    if((addr >= METRICS_BANK_REG_START) && (addr < METRICS_BANK_REG_END)){
+        METRICS_ADD(metrics.bank_switches, 1);
+    }
+    uint32_t irq_state = save_and_disable_interrupts();
     // TODO: ensure clock always starts low, ends low. First thing should be posedge clock
     // Set the clock high
     gpio_put(CLK, 1);
     // Set CS high. I know it seems wierd for this to go here, it's high from the previous transaction.
     gpio_put(CS, 1);
-    // 140 ns
-    sleep_us(1);
+    // 140 ns. Busy waits, as sleeping needs the timer interrupt
+    busy_wait_us_32(1);
     // Set read high
     gpio_put(RD, 1);
     // Set the address
@@ -156,14 +184,14 @@ void writeb(uint8_t data, uint16_t addr){
     gpio_put(A14, addr & (0x1 << 14));
     gpio_put(A15, addr & (0x1 << 15));
     // 240 ns
-    sleep_us(2);
+    busy_wait_us_32(2);
     // Set CS low if we are doing a RAM access
     // Revert back to always set low if everything breaks
     if(addr >= SRAM_START_ADDR){
         gpio_put(CS, 0);
     }
     // 480 ns
-    sleep_us(1);
+    busy_wait_us_32(1);
     // Set clock low
     gpio_put(CLK, 0);
     // Set WR low
@@ -179,11 +207,11 @@ void writeb(uint8_t data, uint16_t addr){
     gpio_put(D6, data & (0x1 << 6));
     gpio_put(D7, data & (0x1 << 7));
     // 840 ns
-    sleep_us(2);
+    busy_wait_us_32(2);
     // Set WR high
     gpio_put(WR, 1);
     // 960ns ns
-    sleep_us(1);
+    busy_wait_us_32(1);
     // Set CLK high
     gpio_put(CLK, 1);
     if(addr >= SRAM_START_ADDR){
@@ -192,9 +220,78 @@ void writeb(uint8_t data, uint16_t addr){
     // Stop driving bus
     set_dbus_direction(GPIO_IN);
     // Maybe put cs = 1 down here, if other things break. 
-    sleep_us(1);
+    busy_wait_us_32(1);
+    restore_interrupts(irq_state);
 }
-uint8_t readb(uint16_t addr){
+// Same as writeb, but with readb's timings. Mappers and flash chips latch on WR going high
+// and are happy with a lot less time than writeb gives them, which adds up when programming
+void __not_in_flash_func(writeb_fast)(uint8_t data, uint16_t addr){
+    if(bus_core_owns_bus()){
+        bus_write(BUS_SPACE_ADDR_FAST, addr, &data, 1);
+        return;
+    }
+    if((addr >= METRICS_BANK_REG_START) && (addr < METRICS_BANK_REG_END)){
+        METRICS_ADD(metrics.bank_switches, 1);
+    }
+    uint32_t irq_state = save_and_disable_interrupts();
+    // Clock high
+    gpio_put(CLK, 1);
+    // RD has to be high before anything gets driven
+    gpio_put(RD, 1);
+    // Put address on bus
+    gpio_put(A0, addr & (0x1 << 0));
+    gpio_put(A1, addr & (0x1 << 1));
+    gpio_put(A2, addr & (0x1 << 2));
+    gpio_put(A3, addr & (0x1 << 3));
+    gpio_put(A4, addr & (0x1 << 4));
+    gpio_put(A5, addr & (0x1 << 5));
+    gpio_put(A6, addr & (0x1 << 6));
+    gpio_put(A7, addr & (0x1 << 7));
+    gpio_put(A8, addr & (0x1 << 8));
+    gpio_put(A9, addr & (0x1 << 9));
+    gpio_put(A10, addr & (0x1 << 10));
+    gpio_put(A11, addr & (0x1 << 11));
+    gpio_put(A12, addr & (0x1 << 12));
+    gpio_put(A13, addr & (0x1 << 13));
+    gpio_put(A14, addr & (0x1 << 14));
+    gpio_put(A15, addr & (0x1 << 15));
+    // Sleep 125 ns
+    delay_wait(3);
+    // Set CS low if talking to RAM
+    if(addr >= SRAM_START_ADDR){
+        gpio_put(CS, 0);
+    }
+    // Sleep 250 ns
+    delay_wait(6);
+    // Clock low, WR low, and drive the data
+    gpio_put(CLK, 0);
+    gpio_put(WR, 0);
+    set_dbus_direction(GPIO_OUT);
+    gpio_put(D0, data & (0x1 << 0));
+    gpio_put(D1, data & (0x1 << 1));
+    gpio_put(D2, data & (0x1 << 2));
+    gpio_put(D3, data & (0x1 << 3));
+    gpio_put(D4, data & (0x1 << 4));
+    gpio_put(D5, data & (0x1 << 5));
+    gpio_put(D6, data & (0x1 << 6));
+    gpio_put(D7, data & (0x1 << 7));
+    // Sleep 250 ns
+    delay_wait(6);
+    // Data gets latched here
+    gpio_put(WR, 1);
+    // Sleep 125 ns, hold the data a little past WR
+    delay_wait(3);
+    if(addr >= SRAM_START_ADDR){
+        gpio_put(CS, 1);
+    }
+    // Stop driving bus
+    set_dbus_direction(GPIO_IN);
+    restore_interrupts(irq_state);
+}
+
+// readb's strobe, inlined into both copies of it so bus_bench can time one left in flash
+static __force_inline uint8_t readb_strobe(uint16_t addr){
+    uint32_t irq_state = save_and_disable_interrupts();
     // Please note that the timings here are the ideal ones from the datasheet and
     // my delays do not follow them exactly. It just gets close and works pretty well
     // Clock high
@@ -204,7 +301,7 @@ uint8_t readb(uint16_t addr){
     // Set RD low. Might still be low from previous transaction, which is fine
     gpio_put(RD, 0);
     // Sleep 125 ns
-    delay_wait(2);
+    delay_wait(3 * (1 + read_slowdown));
     // Put address on bus
     gpio_put(A0, addr & (0x1 << 0));
     gpio_put(A1, addr & (0x1 << 1));
@@ -225,16 +322,16 @@ uint8_t readb(uint16_t addr){
     // Set direction accordingly
     set_dbus_direction(GPIO_IN);
     // Sleep 125 ns
-    delay_wait(2);
+    delay_wait(3 * (1 + read_slowdown));
     // Set CS low if talking to RAM
     if(addr >= SRAM_START_ADDR){
         gpio_put(CS, 0);
     }    // Sleep 250 ns
-    delay_wait(6);
+    delay_wait(6 * (1 + read_slowdown));
     // Clock goes low 
     gpio_put(CLK, 0);
     // Sleep 250 ns
-    delay_wait(6);
+    delay_wait(6 * (1 + read_slowdown));
     // Sample data on bus
     uint8_t data =
         (gpio_get(D0) << 0) |
@@ -246,22 +343,110 @@ uint8_t readb(uint16_t addr){
         (gpio_get(D6) << 6) |
         (gpio_get(D7) << 7);
     // Sleep 250 ns
-    delay_wait(6);
+    delay_wait(6 * (1 + read_slowdown));
     // Clock should go high here, but next cycle will do that
     // Disable CS if we read from SRAM
     if(addr >= SRAM_START_ADDR){
         gpio_put(CS, 1);
     }
+    restore_interrupts(irq_state);
     return data;
 }
 
-void readbuf(uint16_t addr, uint8_t *buf, uint16_t len){
+uint8_t __not_in_flash_func(readb)(uint16_t addr){
+    if(bus_core_owns_bus()){
+        uint8_t data = 0;
+        bus_read(BUS_SPACE_ADDR, addr, &data, 1);
+        return data;
+    }
+    return readb_strobe(addr);
+}
+
+uint8_t readb_flash(uint16_t addr){
+    return readb_strobe(addr);
+}
+
+void set_read_slowdown(uint8_t level){
+    read_slowdown = level;
+}
+
+void __not_in_flash_func(readbuf)(uint16_t addr, uint8_t *buf, uint16_t len){
+    // One command for the lot rather than one a byte
+    if(bus_core_owns_bus()){
+        bus_read(BUS_SPACE_ADDR, addr, buf, len);
+        return;
+    }
     for(uint16_t i = 0; i < len; i++){
         buf[i] = readb(addr + i);
     }
 }
 
-void set_dbus_direction(uint8_t dir){
+// Pin values that put addr on the address bus, A0 is the highest pin
+uint32_t __not_in_flash_func(burst_addr_pins)(uint16_t addr){
+    return ((uint32_t) bit_reverse[addr & 0xFF] << A7) | ((uint32_t) bit_reverse[addr >> 8] << A15);
+}
+
+// D0 is the highest of the data pins too
+uint8_t __not_in_flash_func(burst_sample)(){
+    return bit_reverse[gpio_get_all() & 0xFF];
+}
+
+// Read an aligned, power of two sized run. Gray order flips the one address line that
+// changes with a single XOR, linear order rewrites all of them like readb does
+void __not_in_flash_func(burst_run)(uint16_t addr, uint8_t* buf, uint16_t len, uint8_t settle){
+    gpio_put_masked(BURST_ADDR_MASK, burst_addr_pins(addr));
+    delay_wait(settle);
+    buf[0] = burst_sample();
+    uint16_t offset = 0;
+    for(uint16_t i = 1; i < len; i++){
+        if(burst_mode == BURST_GRAY){
+            // Going from i - 1 to i in Gray code flips the lowest set bit of i
+            uint16_t flip = i & -i;
+            offset ^= flip;
+            gpio_xor_mask(burst_addr_pins(flip));
+        }
+        else{
+            offset = i;
+            gpio_put_masked(BURST_ADDR_MASK, burst_addr_pins(addr + i));
+        }
+        delay_wait(settle);
+        buf[offset] = burst_sample();
+    }
+}
+
+void __not_in_flash_func(readbuf_rom)(uint16_t addr, uint8_t* buf, uint16_t len){
+    if(bus_core_owns_bus() || (burst_mode == BURST_OFF) || ((addr + len) > ROM_BANKN_END_ADDR + 1)){
+        readbuf(addr, buf, len);
+        return;
+    }
+    uint8_t settle = ((burst_settle + 1) * (1 + read_slowdown)) - 1;
+    // ROM doesn't care about CLK or CS, RD stays low for the whole thing
+    gpio_put(CLK, 1);
+    gpio_put(WR, 1);
+    gpio_put(CS, 1);
+    set_dbus_direction(GPIO_IN);
+    gpio_put(RD, 0);
+    // Split into the biggest aligned power of two runs that fit
+    while(len){
+        uint16_t run = addr ? (addr & -addr) : 0x8000;
+        while((run > len) || (run > BURST_IRQ_OFF_MAX)){
+            run >>= 1;
+        }
+        uint32_t irq_state = save_and_disable_interrupts();
+        burst_run(addr, buf, run, settle);
+        restore_interrupts(irq_state);
+        addr += run;
+        buf += run;
+        len -= run;
+    }
+}
+
+void set_burst_mode(uint8_t mode, uint8_t settle){
+    burst_mode = mode;
+    burst_settle = settle;
+}
+
+void __not_in_flash_func(set_dbus_direction)(uint8_t dir){
     gpio_set_dir(D0, dir);
     gpio_set_dir(D1, dir);
     gpio_set_dir(D2, dir);
@@ -273,11 +458,11 @@ void set_dbus_direction(uint8_t dir){
 }
 
 
-uint16_t fs_get_rom_bank(uint32_t addr){
+uint16_t __not_in_flash_func(fs_get_rom_bank)(uint32_t addr){
     return addr / ROM_BANK_SIZE; 
 }
 
-uint16_t fs_get_ram_bank(uint32_t addr){
+uint16_t __not_in_flash_func(fs_get_ram_bank)(uint32_t addr){
     return addr / SRAM_BANK_SIZE; 
 }
 
@@ -14,6 +14,20 @@
 #define SRAM_HALF_BANK_SIZE   (SRAM_BANK_SIZE / 2)
 extern uint8_t working_mem[ROM_BANK_SIZE * 2];
 
+// How readbuf_rom walks ROM. Gray order changes one address line a byte, so lines settle
+// faster and it can get away with less waiting
+#define BURST_OFF             0 // Byte at a time through readb
+#define BURST_LINEAR          1
+#define BURST_GRAY            2
+// Wait after each address change, in delay_wait steps. Starts out as long as readb waits
+// between putting the address out and sampling, 600 ns, until bus_bench finds out what
+// the cart can take
+#define BURST_SETTLE_DEFAULT  15
+#define BURST_ADDR_MASK       (0xFFFF << 9) // A15 is GPIO 9, up to A0 on 24
+// Interrupts are off for each burst, so bursts are kept to this many bytes to bound how
+// long anything else has to wait
+#define BURST_IRQ_OFF_MAX     256
+
 // TODO: inline or #define these. They should go somewhere else
 // Get the ROM bank from the perspective of the FAT16 filesystem
 // Ex: addr 0x0 = ROM bank 0. addr 0x4112 = ROM bank 1. Addr 0x8334 = ROM bank 2
@@ -24,9 +38,21 @@ uint16_t fs_get_rom_bank(uint32_t addr);
 uint16_t fs_get_ram_bank(uint32_t addr);
 
 
+// Each transaction runs with interrupts off on this core, so nothing can stretch a strobe
 uint8_t readb(uint16_t addr);
+// The same strobe as readb but run out of flash, for bus_bench to compare against. Straight
+// to the bus, so only before init_bus_core
+uint8_t readb_flash(uint16_t addr);
 void writeb(uint8_t data, uint16_t addr);
+// writeb with readb's timings, for mappers and flash chips
+void writeb_fast(uint8_t data, uint16_t addr);
 void readbuf(uint16_t addr, uint8_t *buf, uint16_t len);
+// Stretch every wait in readb to (1 + level) times as long, for carts that can't keep up
+void set_read_slowdown(uint8_t level);
+// Read a run of ROM (below 0x8000) with RD held low, walking it in the order set_burst_mode
+// picked. Bytes land at their own offset in buf whatever the order
+void readbuf_rom(uint16_t addr, uint8_t* buf, uint16_t len);
+void set_burst_mode(uint8_t mode, uint8_t settle);
 void set_dbus_direction(uint8_t dir);
 void init_bus();
 void reset_pin_states();
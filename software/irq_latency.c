@@ -0,0 +1,107 @@
+#include "irq_latency.h"
+#include "disk/gb_disk.h"
+#include "pico/stdlib.h"
+#include "pico/platform.h"
+#include "hardware/timer.h"
+#include "hardware/irq.h"
+
+#include <stdio.h>
+
+/*  - Private Variables -  */
+volatile uint32_t irq_latency_counts[IRQ_LATENCY_PHASES][IRQ_LATENCY_BUCKETS] = {0};
+volatile uint32_t irq_latency_max_us[IRQ_LATENCY_PHASES] = {0};
+volatile uint8_t irq_latency_phase = IRQ_LATENCY_BOOT;
+// Set once init_irq_latency has it going, and once core 1 has taken it over
+uint8_t irq_latency_started = 0;
+volatile uint8_t irq_latency_on_core1 = 0;
+// When the alarm was set to go off
+uint32_t irq_latency_target = 0;
+uint16_t irq_latency_line_offsets[IRQ_LATENCY_BUCKETS + 1] = {0};
+uint64_t irq_latency_last_us = 0;
+
+/*  - Private Function Declarations -  */
+
+// Runs from RAM, a flash fetch here would get counted as latency
+void irq_latency_handler();
+void irq_latency_format_line(uint8_t bucket, char* line);
+
+/*  - Private Function Definitions -  */
+
+void __not_in_flash_func(irq_latency_handler)(){
+    // Core 1 has it now. The handler is shared, so core 0 turns its own side off here
+    if(irq_latency_on_core1 && !get_core_num()){
+        irq_set_enabled(IRQ_LATENCY_IRQ, false);
+        return;
+    }
+    uint32_t late = timer_hw->timerawl - irq_latency_target;
+    hw_clear_bits(&timer_hw->intr, 1u << IRQ_LATENCY_ALARM);
+    uint8_t bucket = 0;
+    while((bucket < (IRQ_LATENCY_BUCKETS - 1)) && (late >= (2u << bucket))){
+        bucket++;
+    }
+    irq_latency_counts[irq_latency_phase][bucket]++;
+    if(late > irq_latency_max_us[irq_latency_phase]){
+        irq_latency_max_us[irq_latency_phase] = late;
+    }
+    // Keep to the schedule, unless this one was so late the next one has gone by too
+    irq_latency_target += IRQ_LATENCY_PERIOD_US;
+    if((int32_t) (irq_latency_target - timer_hw->timerawl) <= 0){
+        irq_latency_target = timer_hw->timerawl + IRQ_LATENCY_PERIOD_US;
+    }
+    timer_hw->alarm[IRQ_LATENCY_ALARM] = irq_latency_target;
+}
+
+void irq_latency_format_line(uint8_t bucket, char* line){
+    if(bucket == IRQ_LATENCY_BUCKETS){
+        snprintf(line, STATUS_LINE_LEN + 1, "IRQ MAX BOOT %6luus RUN %10luus\n",
+            (unsigned long) irq_latency_max_us[IRQ_LATENCY_BOOT], (unsigned long) irq_latency_max_us[IRQ_LATENCY_RUN]);
+    }
+    else{
+        snprintf(line, STATUS_LINE_LEN + 1, "IRQ %s%3uus BOOT %6lu RUN %10lu\n",
+            bucket == (IRQ_LATENCY_BUCKETS - 1) ? ">=" : " <", bucket == (IRQ_LATENCY_BUCKETS - 1) ? (1u << bucket) : (2u << bucket),
+            (unsigned long) irq_latency_counts[IRQ_LATENCY_BOOT][bucket], (unsigned long) irq_latency_counts[IRQ_LATENCY_RUN][bucket]);
+    }
+}
+
+/*  - Public Function Definitions -  */
+
+void init_irq_latency(){
+    // Fixed width so they can be rewritten in place
+    char line[STATUS_LINE_LEN + 1];
+    for(uint8_t i = 0; i <= IRQ_LATENCY_BUCKETS; i++){
+        irq_latency_format_line(i, line);
+        irq_latency_line_offsets[i] = reserve_status_line(line);
+    }
+    hardware_alarm_claim(IRQ_LATENCY_ALARM);
+    hw_set_bits(&timer_hw->inte, 1u << IRQ_LATENCY_ALARM);
+    irq_set_exclusive_handler(IRQ_LATENCY_IRQ, irq_latency_handler);
+    irq_set_enabled(IRQ_LATENCY_IRQ, true);
+    irq_latency_target = timer_hw->timerawl + IRQ_LATENCY_PERIOD_US;
+    timer_hw->alarm[IRQ_LATENCY_ALARM] = irq_latency_target;
+    irq_latency_started = 1;
+}
+
+void irq_latency_boot_done(){
+    irq_latency_phase = IRQ_LATENCY_RUN;
+}
+
+void irq_latency_core1_start(){
+    if(!irq_latency_started){
+        return;
+    }
+    irq_latency_on_core1 = 1;
+    irq_set_enabled(IRQ_LATENCY_IRQ, true);
+}
+
+void irq_latency_task(){
+    uint64_t now = time_us_64();
+    if((now - irq_latency_last_us) < 1000000){
+        return;
+    }
+    irq_latency_last_us = now;
+    char line[STATUS_LINE_LEN + 1];
+    for(uint8_t i = 0; i <= IRQ_LATENCY_BUCKETS; i++){
+        irq_latency_format_line(i, line);
+        update_status_line(irq_latency_line_offsets[i], line);
+    }
+}
@@ -0,0 +1,32 @@
+#ifndef IRQ_LATENCY_H_
+#define IRQ_LATENCY_H_
+
+#include <stdint.h>
+
+// Histogram of how late a timer interrupt gets serviced on the core doing bus work. An
+// alarm is set for a known time every IRQ_LATENCY_PERIOD_US, and the handler looks at how
+// far past it the clock is. Anything running with interrupts off, like a bus transaction,
+// shows up here as the time it held them off for. It starts out on core 0 and moves to
+// core 1 when that takes over the bus. Boot (probing, tests, filling caches) and steady
+// state are counted apart. Goes in the status file, a line per bucket with both
+
+#define IRQ_LATENCY_PERIOD_US   1000
+// Buckets are powers of two, <2us up to <128us, and one for everything past that
+#define IRQ_LATENCY_BUCKETS     8
+#define IRQ_LATENCY_ALARM       0
+#define IRQ_LATENCY_IRQ         TIMER_IRQ_0
+// Which histogram samples go in
+#define IRQ_LATENCY_BOOT        0
+#define IRQ_LATENCY_RUN         1
+#define IRQ_LATENCY_PHASES      2
+
+// Start sampling on this core. Needs the status file, so call after init_disk_mem
+void init_irq_latency();
+// Count from here on as steady state. Call once startup is done
+void irq_latency_boot_done();
+// Move sampling to core 1. Call on core 1 as it starts, does nothing if sampling isn't on
+void irq_latency_core1_start();
+// Rewrite the histogram in the status file, once a second
+void irq_latency_task();
+
+#endif
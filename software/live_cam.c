@@ -0,0 +1,220 @@
+#include "live_cam.h"
+#include "cart.h"
+#include "gb.h"
+#include "pins.h"
+#include "mappers/gbcam.h"
+#include "disk/gb_disk.h"
+#include "pico/stdlib.h"
+#include "hardware/pwm.h"
+#include "hardware/clocks.h"
+
+#include <stdio.h>
+#include <string.h>
+
+/*  - Private #defines -  */
+// Sensor output gets spread between these for the dither matrix
+#define LIVE_CAM_DITHER_LOW     0x60
+#define LIVE_CAM_DITHER_HIGH    0xE0
+
+enum {
+    LIVE_CAM_IDLE      = 0, // Not capturing
+    LIVE_CAM_CAPTURING = 1, // Sensor is busy, PWM has CLK
+};
+
+/*  - Private Variables -  */
+uint8_t live_state = LIVE_CAM_IDLE;
+// Registers written before every capture. The first one gets the capture bit added.
+// A middling gain and exposure to start from, tune them from the host with CAM_REGS
+uint8_t live_regs[GBCAM_REG_COUNT] = {
+    0x00,       // Trigger
+    0x08,       // No edge enhancement, gain 8
+    0x03, 0x00, // Exposure, in 16us steps
+    0x07,       // Edge ratio, no invert, reference voltage
+    0xBF,       // Zero point, output voltage
+    // Dither matrix, filled in by init_live_cam
+};
+// Tiles of the newest frame
+uint8_t live_tiles[GBCAM_TILE_DATA_SIZE] = {0};
+uint32_t live_frames = 0;
+// When someone last asked for a frame
+uint64_t live_last_request_us = 0;
+uint64_t live_capture_start_us = 0;
+uint64_t live_last_poll_us = 0;
+// Frames in the current one second window, for the frame rate
+uint64_t live_window_start_us = 0;
+uint32_t live_window_frames = 0;
+uint32_t live_fps_tenths = 0;
+// LIVE.BMP is decoded here when the host starts reading it
+uint8_t live_bmp[GBCAM_BMP_PHOTO_SIZE] = {0};
+// Where the frame rate lives in the status file
+uint16_t live_stats_line_offset = STATUS_LINE_NONE;
+
+/*  - Private Function Declarations -  */
+
+// Hand CLK to PWM so the sensor keeps getting a clock while the CPU does other things
+void live_clock_start();
+// Give CLK back to the bus
+void live_clock_stop();
+// Enable RAM and switch to the camera registers or SRAM bank 0
+void live_select_bank(uint8_t bank);
+// Write the registers and start a capture
+void live_start_capture();
+// Pull the finished capture out of SRAM
+void live_read_capture();
+// Put the frame rate in the status file
+void live_update_stats_line();
+
+/*  - Private Function Definitions -  */
+
+void live_clock_start(){
+    uint32_t wrap = clock_get_hz(clk_sys) / LIVE_CAM_CLOCK_HZ;
+    uint32_t slice = pwm_gpio_to_slice_num(CLK);
+    pwm_config config = pwm_get_default_config();
+    pwm_config_set_wrap(&config, wrap - 1);
+    pwm_init(slice, &config, false);
+    pwm_set_gpio_level(CLK, wrap / 2);
+    gpio_set_function(CLK, GPIO_FUNC_PWM);
+    pwm_set_enabled(slice, true);
+}
+
+void live_clock_stop(){
+    pwm_set_enabled(pwm_gpio_to_slice_num(CLK), false);
+    // SIO still has it as an output from init_bus
+    gpio_set_function(CLK, GPIO_FUNC_SIO);
+    gpio_put(CLK, 1);
+}
+
+void live_select_bank(uint8_t bank){
+    // Anything could have been at the cart since last time
+    writeb_fast(GBCAM_ENABLE_RAM_WRITE_DATA, GBCAM_ENABLE_RAM_WRITE_ADDR);
+    writeb_fast(bank, GBCAM_RAM_BANK_ADDR);
+}
+
+void live_start_capture(){
+    live_select_bank(GBCAM_CAM_REG_BANK);
+    for(uint8_t i = 1; i < GBCAM_REG_COUNT; i++){
+        writeb_fast(live_regs[i], GBCAM_REG_TRIGGER_ADDR + i);
+    }
+    writeb_fast(live_regs[0] | GBCAM_TRIGGER_CAPTURE, GBCAM_REG_TRIGGER_ADDR);
+    live_clock_start();
+    live_capture_start_us = time_us_64();
+    live_last_poll_us = live_capture_start_us;
+    live_state = LIVE_CAM_CAPTURING;
+}
+
+void live_read_capture(){
+    live_select_bank(0);
+    readbuf(GBCAM_CAPTURE_ADDR, live_tiles, GBCAM_TILE_DATA_SIZE);
+    writeb_fast(0x0, GBCAM_ENABLE_RAM_WRITE_ADDR);
+    live_frames++;
+    live_window_frames++;
+}
+
+void live_update_stats_line(){
+    char line[STATUS_LINE_LEN + 1];
+    snprintf(line, sizeof(line), "LIVE CAM: %3lu.%lu FPS %8lu FRAMES\n",
+        (unsigned long) (live_fps_tenths / 10), (unsigned long) (live_fps_tenths % 10), (unsigned long) live_frames);
+    update_status_line(live_stats_line_offset, line);
+}
+
+/*  - Public Function Definitions -  */
+
+void init_live_cam(){
+    if(the_cart.mapper_type != MAPPER_GBCAM){
+        return;
+    }
+    // Ordered dither, the same idea as the camera's own contrast tables. Each of the 16
+    // spots gets three thresholds, one per shade, spread out by its place in a Bayer matrix
+    const uint8_t bayer[16] = {0, 8, 2, 10, 12, 4, 14, 6, 3, 11, 1, 9, 15, 7, 13, 5};
+    for(uint8_t i = 0; i < 16; i++){
+        for(uint8_t shade = 0; shade < 3; shade++){
+            live_regs[6 + (i * 3) + shade] = LIVE_CAM_DITHER_LOW +
+                (((LIVE_CAM_DITHER_HIGH - LIVE_CAM_DITHER_LOW) * ((shade * 16) + bayer[i])) / 48);
+        }
+    }
+    // Fixed width so it can be rewritten in place as the frame rate changes
+    char line[STATUS_LINE_LEN + 1];
+    snprintf(line, sizeof(line), "LIVE CAM: %3lu.%lu FPS %8lu FRAMES\n", 0UL, 0UL, 0UL);
+    live_stats_line_offset = reserve_status_line(line);
+}
+
+void live_cam_task(){
+    if(the_cart.mapper_type != MAPPER_GBCAM){
+        return;
+    }
+    uint64_t now = time_us_64();
+    uint8_t wanted = (now - live_last_request_us) < LIVE_CAM_IDLE_US;
+    if(live_state == LIVE_CAM_IDLE){
+        if(wanted){
+            live_window_start_us = now;
+            live_window_frames = 0;
+            live_start_capture();
+        }
+        return;
+    }
+    if((now - live_last_poll_us) < LIVE_CAM_POLL_US){
+        return;
+    }
+    live_last_poll_us = now;
+    live_select_bank(GBCAM_CAM_REG_BANK);
+    uint8_t busy = readb(GBCAM_REG_TRIGGER_ADDR) & GBCAM_TRIGGER_CAPTURE;
+    uint8_t timed_out = (now - live_capture_start_us) > LIVE_CAM_TIMEOUT_US;
+    if(busy && !timed_out){
+        return;
+    }
+    live_clock_stop();
+    if(!busy){
+        live_read_capture();
+    }
+    // Start the next one straight away, readers decode this one while it runs
+    if(wanted){
+        live_start_capture();
+    }
+    else{
+        live_state = LIVE_CAM_IDLE;
+        live_window_frames = 0;
+    }
+    if(!wanted || ((now - live_window_start_us) >= 1000000)){
+        live_fps_tenths = wanted ? (((uint64_t) live_window_frames * 10000000) / (now - live_window_start_us)) : 0;
+        live_window_start_us = now;
+        live_window_frames = 0;
+        live_update_stats_line();
+    }
+}
+
+void live_cam_request(){
+    live_last_request_us = time_us_64();
+}
+
+uint32_t live_cam_frame_count(){
+    return live_frames;
+}
+
+uint32_t live_cam_fps_tenths(){
+    return live_fps_tenths;
+}
+
+uint32_t live_cam_decode(uint8_t* bmp){
+    gbcam_decode_photo(live_tiles, bmp);
+    return live_frames;
+}
+
+void live_cam_read_bmp(uint8_t* dest, uint32_t offset, uint32_t num){
+    live_cam_request();
+    if(!offset){
+        // Whatever is newest, never wait for a capture in read10. The first look since
+        // startup gets a blank frame, and the one after that has live_cam_task's first capture
+        live_cam_decode(live_bmp);
+    }
+    memset(dest, 0, num);
+    if(offset < GBCAM_BMP_PHOTO_SIZE){
+        uint32_t len = GBCAM_BMP_PHOTO_SIZE - offset;
+        memcpy(dest, live_bmp + offset, len < num ? len : num);
+    }
+}
+
+void live_cam_set_regs(const uint8_t* regs){
+    memcpy(live_regs, regs, GBCAM_REG_COUNT);
+    // The capture bit goes on when it's time
+    live_regs[0] &= ~GBCAM_TRIGGER_CAPTURE;
+}
@@ -0,0 +1,38 @@
+#ifndef LIVE_CAM_H_
+#define LIVE_CAM_H_
+
+#include <stdint.h>
+
+// Live view for the Game Boy Camera. Captures run back to back for as long as someone keeps
+// asking for frames, through LIVE.BMP on the disk or the vendor interface. The sensor works
+// on its own while the next capture runs, so frames get decoded and sent in the meantime.
+// Only the raw tiles of the newest frame are kept, and each reader decodes its own copy
+
+// Stop capturing when nobody has asked for a frame in this long
+#define LIVE_CAM_IDLE_US        1000000
+// Give up on a capture after this long. The longest exposure is about a second
+#define LIVE_CAM_TIMEOUT_US     2000000
+// How often to check whether a capture is done
+#define LIVE_CAM_POLL_US        500
+// The sensor runs off PHI, which is 1MHz in a console
+#define LIVE_CAM_CLOCK_HZ       1000000
+
+// Set up the status file line for the frame rate
+void init_live_cam();
+// Start, finish and restart captures. Call from the main loop
+void live_cam_task();
+// Keep capturing for at least another LIVE_CAM_IDLE_US
+void live_cam_request();
+// Number of the newest frame, 0 if there hasn't been one
+uint32_t live_cam_frame_count();
+// Frames per second over the last second, in tenths
+uint32_t live_cam_fps_tenths();
+// Decode the newest frame into a GBCAM_BMP_PHOTO_SIZE byte BMP. Returns its number
+uint32_t live_cam_decode(uint8_t* bmp);
+// Serve LIVE.BMP. Reading the start of the file picks up the newest frame, blank if there
+// hasn't been one yet. Never waits on the camera
+void live_cam_read_bmp(uint8_t* dest, uint32_t offset, uint32_t num);
+// Replace the camera registers (GBCAM_REG_COUNT of them) used from the next capture on
+void live_cam_set_regs(const uint8_t* regs);
+
+#endif
@@ -0,0 +1,88 @@
+#include "log_ring.h"
+#include "pico/stdlib.h"
+#include "pico/platform.h"
+#include "pico/stdio/driver.h"
+#include "hardware/sync.h"
+
+#include <string.h>
+
+/*  - Private Variables -  */
+uint8_t log_ring[LOG_RING_SIZE] = {0};
+// Bytes ever claimed. Where a byte goes in the ring is its position in the log, masked
+volatile uint32_t log_head = 0;
+// log_head when LOG.TXT was last sized, reads render up to here
+uint32_t log_snapshot_head = 0;
+spin_lock_t* log_lock = NULL;
+
+/*  - Private Function Declarations -  */
+
+void log_ring_out_chars(const char* buf, int len);
+
+/*  - Private Function Definitions -  */
+
+void log_ring_out_chars(const char* buf, int len){
+    log_ring_write(buf, len);
+}
+
+stdio_driver_t log_ring_stdio = {
+    .out_chars = log_ring_out_chars,
+#if PICO_STDIO_ENABLE_CRLF_SUPPORT
+    .crlf_enabled = false,
+#endif
+};
+
+/*  - Public Function Definitions -  */
+
+void init_log_ring(){
+    log_lock = spin_lock_instance(spin_lock_claim_unused(true));
+    stdio_set_driver_enabled(&log_ring_stdio, true);
+}
+
+void __not_in_flash_func(log_ring_write)(const char* buf, uint32_t len){
+    if(!log_lock){
+        return;
+    }
+    // Only the end of something this long would survive anyway
+    if(len > LOG_RING_SIZE){
+        buf += len - LOG_RING_SIZE;
+        len = LOG_RING_SIZE;
+    }
+    // Claim the bytes. The spinlock masks interrupts too, so an IRQ on this core can't get in
+    // between the read and the write of the head
+    uint32_t irq_state = spin_lock_blocking(log_lock);
+    uint32_t head = log_head;
+    log_head = head + len;
+    spin_unlock(log_lock, irq_state);
+    uint32_t pos = head & (LOG_RING_SIZE - 1);
+    uint32_t first = LOG_RING_SIZE - pos;
+    if(first > len){
+        first = len;
+    }
+    memcpy(log_ring + pos, buf, first);
+    memcpy(log_ring, buf + first, len - first);
+}
+
+uint32_t log_ring_snapshot(){
+    log_snapshot_head = log_head;
+    return log_snapshot_head < LOG_RING_SIZE ? log_snapshot_head : LOG_RING_SIZE;
+}
+
+void log_ring_read(uint8_t* dest, uint32_t offset, uint32_t num){
+    uint32_t len = log_snapshot_head < LOG_RING_SIZE ? log_snapshot_head : LOG_RING_SIZE;
+    uint32_t start = log_snapshot_head - len;
+    // Anything logged since the snapshot has gone over the oldest part of it
+    uint32_t head = log_head;
+    uint32_t oldest = head > LOG_RING_SIZE ? head - LOG_RING_SIZE : 0;
+    for(uint32_t i = 0; i < num; i++){
+        uint32_t pos = offset + i;
+        if(pos >= len){
+            dest[i] = 0;
+        }
+        else if((start + pos) < oldest){
+            dest[i] = ' ';
+        }
+        else{
+            dest[i] = log_ring[(start + pos) & (LOG_RING_SIZE - 1)];
+        }
+    }
+}
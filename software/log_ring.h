@@ -0,0 +1,25 @@
+#ifndef LOG_RING_H_
+#define LOG_RING_H_
+
+#include <stdint.h>
+
+// LOG.TXT on the drive, the last LOG_RING_SIZE bytes of everything logged. printf ends up
+// here too. Writing is safe from either core and from interrupts: the only lock is a hardware
+// spinlock held while the write claims its bytes, the copy happens after it's let go.
+// The file is rendered when it's read, oldest first, and its size in the root directory gets
+// brought up to date whenever the host reads the directory, so it reads back as long as the
+// log was then. Remount (or drop the host's cache) to see what got logged since
+
+// Has to be a power of two
+#define LOG_RING_SIZE 8192
+
+// Claim the spinlock and send stdio here. Anything logged before this is dropped
+void init_log_ring();
+// Add to the log. Doesn't add a newline
+void log_ring_write(const char* buf, uint32_t len);
+// Freeze what LOG.TXT reads back as, and return its size
+uint32_t log_ring_snapshot();
+// Copy part of LOG.TXT into dest, as of the last snapshot
+void log_ring_read(uint8_t* dest, uint32_t offset, uint32_t num);
+
+#endif
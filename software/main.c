@@ -20,37 +20,147 @@
 #include "unit_tests.h"
 #include "disk/msc_disk.h"
 #include "disk/gb_disk.h"
+#include "disk/vendor_raw.h"
 #include "status_led.h"
 #include "scratch.h"
+#include "rom_cache.h"
+#include "cart_probe.h"
+#include "save_snapshots.h"
+#include "sram_writeback.h"
+#include "cart_emu.h"
+#include "flash_cart.h"
+#include "live_cam.h"
+#include "bus_core.h"
+#include "read_verify.h"
+#include "bus_bench.h"
+#include "bank_manifest.h"
+#include "irq_latency.h"
+#include "sched.h"
+#include "log_ring.h"
 
 #define DO_UNIT_TEST
+#define DO_CART_PROBE
+#define DO_BUS_BENCH
+#define DO_ROM_CACHE
+#define DO_SAVE_SNAPSHOTS
+#define DO_FLASH_CART
+#define DO_LIVE_CAM
+#define DO_BUS_CORE
+// Time how late a 1kHz timer interrupt gets serviced, into the status file
+#define DO_IRQ_LATENCY
+// Read everything twice and slow down where they disagree. Halves dump speed, for dirty carts
+// #define DO_READ_VERIFY
 // #define DO_SCRATCH_CODE
+// Pretend to be a cart in a console instead of reading one. Needs a 32K ROM with at most 8K of cart RAM in the ROM cache
+// #define DO_CART_EMU
 
 int main() {
-    init_led_irq();
+    // First, so printf from here on lands in LOG.TXT
+    init_log_ring();
+    init_status_led();
     init_disk_mem();
     stdio_init_all();
+    #ifdef DO_CART_EMU
+    // The console owns the bus, so this has to happen before init_bus()
+    cart_emu_run();
+    #endif
+    #ifdef DO_IRQ_LATENCY
+    init_irq_latency();
+    #endif
     init_bus();
     uint16_t cart_check_result = 0;
-    while(!cart_check_result){
+    // A flash cart with its header erased fails the check, but can still be written
+    uint8_t blank_flash = 0;
+    while(!cart_check_result && !blank_flash){
         cart_check_result = cart_check(working_mem);
+        #ifdef DO_FLASH_CART
+        // Chips that only answer autoselect get their size from the header, so they can't do this
+        blank_flash = !cart_check_result && flash_cart_detect() && flash_cart_info.size_bytes;
+        #endif
         sleep_ms(1000);
         set_led_speed(LED_SPEED_ERR);
     }
     set_led_speed(LED_SPEED_TESTING);
-    populate_cart_info();
+    if(blank_flash){
+        flash_cart_blank_info();
+    }
+    else{
+        populate_cart_info();
+    }
+    // Nothing to probe, bench or test on a blank chip
+    #ifdef DO_CART_PROBE
+    if(!blank_flash){
+        probe_cart_sizes();
+    }
+    #endif
     dump_cart_info();
+    #ifdef DO_BUS_BENCH
+    if(!blank_flash){
+        bus_bench();
+    }
+    #endif
     #ifdef DO_SCRATCH_CODE
     scratch_workspace();
     #endif
     #ifdef DO_UNIT_TEST
-    unit_test_cart();
+    if(!blank_flash){
+        unit_test_cart();
+    }
+    #endif
+    #ifdef DO_ROM_CACHE
+    if(!blank_flash){
+        init_rom_cache();
+    }
+    #endif
+    #ifdef DO_SAVE_SNAPSHOTS
+    init_save_snapshots();
+    #endif
+    init_sram_writeback();
+    #ifdef DO_FLASH_CART
+    init_flash_cart();
+    #endif
+    #ifdef DO_LIVE_CAM
+    init_live_cam();
+    #endif
+    #ifdef DO_READ_VERIFY
+    init_read_verify();
+    #endif
+    #ifdef DO_BUS_CORE
+    // Everything after this gets to the cart through core 1
+    init_bus_core();
+    #endif
+    #ifdef DO_IRQ_LATENCY
+    // Everything sampled up to here was startup
+    irq_latency_boot_done();
+    #endif
+    init_msc_latency();
+    init_bank_manifest();
+    // Every pass, after tud_task
+    sched_add_task(msc_latency_task);
+    sched_add_task(vendor_raw_task);
+    #ifdef DO_FLASH_CART
+    sched_add_task(flash_cart_task);
+    #endif
+    #ifdef DO_LIVE_CAM
+    sched_add_task(live_cam_task);
+    #endif
+    #ifdef DO_BUS_CORE
+    sched_add_task(bus_core_task);
+    #endif
+    #ifdef DO_READ_VERIFY
+    sched_add_task(read_verify_task);
+    #endif
+    #ifdef DO_IRQ_LATENCY
+    sched_add_task(irq_latency_task);
+    #endif
+    // Only while USB is quiet
+    sched_add_job("HASH", bank_manifest_task, bank_manifest_progress);
+    #ifdef DO_ROM_CACHE
+    sched_add_job("WARM", rom_cache_warm_step, rom_cache_progress);
     #endif
     uint8_t buf[16] = {0};
     init_disk();
     tusb_init();
     set_led_speed(LED_SPEED_HEALTHY);
-    while(1){
-        tud_task();
-    }
+    sched_run();
 }
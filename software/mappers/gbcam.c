@@ -1,7 +1,10 @@
 #include "gbcam.h"
+#include "pico/platform.h"
 #include "gb.h"
 #include "utils.h"
+#include "disk/png_stream.h"
 #include "stdio.h"
+#include <string.h>
 uint8_t bmp_header[0x76] = {
     0x42, 0x4D, 0x76, 0x1C, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x76, 0x00, 0x00, 0x00, 0x28, 0x00, 0x00, 0x00, 0x80, 
     0x00, 0x00, 0x00, 0x70, 0x00, 0x00, 0x00, 0x01, 0x00, 0x04, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x1C, 0x00, 0x00, 
@@ -12,7 +15,53 @@ uint8_t bmp_header[0x76] = {
     0xFF, 0xFF, 0xFF, 0x00
 };
 
-void gbcam_memcpy_rom(uint8_t* dest, uint32_t rom_addr, uint32_t num){
+// Photos get read off the cart into here before they are decoded
+uint8_t gbcam_tiles[GBCAM_TILE_DATA_SIZE] = {0};
+// The PNG being read, and which photo is in gbcam_tiles for it
+struct PngStream gbcam_png = {0};
+int16_t gbcam_png_photo = -1;
+
+// BMP being written over a photo. Only the row being put together is kept, already in
+// the camera's tile format, so a whole image never has to fit anywhere
+struct GbcamBmpWrite {
+    int16_t photo;                          // -1 if there's nothing to take
+    uint8_t header[54];
+    uint32_t palette_start;
+    uint32_t data_start;
+    uint32_t stride;                        // Bytes per row in the file, padded out to 4
+    uint16_t bpp;
+    uint8_t top_down;
+    uint8_t lut[16];                        // Palette index to shade, 3 is white
+    uint8_t color[4];                       // Palette entry so far, BGRA
+    int16_t row_y;                          // Row being put together
+    uint8_t row_pixels;
+    uint8_t row[GBCAM_PHOTO_WIDTH / 4];     // Two bytes per tile, like a line of the tile data
+    uint8_t rows_done[GBCAM_PHOTO_HEIGHT / 8];
+    uint8_t rows_left;
+};
+struct GbcamBmpWrite gbcam_bmp = {.photo = -1};
+
+// Read a photo's tiles off the cart
+void gbcam_pull_tiles(uint8_t num);
+// One row of a photo in gbcam_tiles as 2 bit pixels, for png_stream
+void gbcam_png_row(void* ctx, uint16_t y, uint8_t* row);
+// Quantize a color to one of the 4 shades. The cut offs sit between the BMP palette's greys
+uint8_t gbcam_shade(uint8_t r, uint8_t g, uint8_t b);
+// Check the BMP header once it's all there. Only 128x112, uncompressed, 1 or 4 bit, and all
+// of it inside the photo's own GBCAM_BMP_SPAN_SIZE
+void gbcam_bmp_parse_header();
+// Take one byte of the BMP, at offset off in the file
+void gbcam_bmp_byte(uint32_t off, uint8_t b);
+// Put a pixel in the row, and send the row to the cart when it fills up
+void gbcam_bmp_put_pixel(uint8_t x, uint8_t shade);
+// Send the finished row to the cart, with its line of the thumbnail
+void gbcam_bmp_flush_row();
+// Only write SRAM that actually changes
+void gbcam_write_changed(uint16_t addr, uint8_t data);
+// Put the photo in the album, if its slot was empty
+void gbcam_bmp_fill_slot();
+
+void __not_in_flash_func(gbcam_memcpy_rom)(uint8_t* dest, uint32_t rom_addr, uint32_t num){
     // Determine the current bank
     uint16_t current_bank = fs_get_rom_bank(rom_addr);
     uint32_t rom_cursor = 0;
@@ -20,7 +69,7 @@ void gbcam_memcpy_rom(uint8_t* dest, uint32_t rom_addr, uint32_t num){
     rom_cursor = rom_addr % ROM_BANK_SIZE;
     // Set up the bank for transfer
     gbcam_set_rom_bank(current_bank);
-    for(uint32_t buf_cursor = 0; buf_cursor < num; buf_cursor++){
+    for(uint32_t buf_cursor = 0; buf_cursor < num;){
         // Determine if we need to bankswitch or not
         if(rom_cursor >= ROM_BANK_SIZE){
             // Switch banks if we cross a boundary
@@ -29,13 +78,19 @@ void gbcam_memcpy_rom(uint8_t* dest, uint32_t rom_addr, uint32_t num){
             // If we bankswitch, we start over again at the beginning of the the bank
             rom_cursor = 0;
         }
+        // The rest of this bank, or as much as is wanted, in one go
+        uint32_t run = ROM_BANK_SIZE - rom_cursor;
+        if(run > (num - buf_cursor)){
+            run = num - buf_cursor;
+        }
         // Read everything out of banked ROM, even bank 0. Easier that way
-        dest[buf_cursor] = readb(rom_cursor + ROM_BANKN_START_ADDR); 
-        rom_cursor++;
+        readbuf_rom(rom_cursor + ROM_BANKN_START_ADDR, dest + buf_cursor, run);
+        rom_cursor += run;
+        buf_cursor += run;
     }
 }
 
-void gbcam_memcpy_ram(uint8_t* dest, uint32_t ram_addr, uint32_t num){
+void __not_in_flash_func(gbcam_memcpy_ram)(uint8_t* dest, uint32_t ram_addr, uint32_t num){
     // Enable RAM reads
     gbcam_set_ram_access(1);
     // Determine current bank
@@ -62,7 +117,7 @@ void gbcam_memcpy_ram(uint8_t* dest, uint32_t ram_addr, uint32_t num){
 }
 
 
-void gbcam_memset_ram(uint8_t* buf, uint32_t ram_addr, uint32_t num){
+void __not_in_flash_func(gbcam_memset_ram)(uint8_t* buf, uint32_t ram_addr, uint32_t num){
     // Determine current bank
     uint16_t current_bank = fs_get_ram_bank(ram_addr);
     uint32_t ram_cursor = 0;
@@ -121,14 +176,14 @@ void gbcam_ram_dump(uint8_t *buf, uint8_t start_bank, uint8_t end_bank){
     gbcam_set_ram_access(0);
 }
 
-void gbcam_set_rom_bank(uint16_t bank){
+void __not_in_flash_func(gbcam_set_rom_bank)(uint16_t bank){
     writeb(bank & 0x3F, GBCAM_ROM_BANK_ADDR);
 }
-void gbcam_set_ram_bank(uint16_t bank){
+void __not_in_flash_func(gbcam_set_ram_bank)(uint16_t bank){
     writeb(bank, GBCAM_RAM_BANK_ADDR);
 }
 
-void gbcam_set_ram_access(uint8_t on_off){
+void __not_in_flash_func(gbcam_set_ram_access)(uint8_t on_off){
     if(on_off){
         writeb(GBCAM_ENABLE_RAM_WRITE_DATA, GBCAM_ENABLE_RAM_WRITE_ADDR);
         return;
@@ -137,64 +192,287 @@ void gbcam_set_ram_access(uint8_t on_off){
 
 }
 
-void gbcam_pull_photo(uint8_t num){
+void gbcam_decode_photo(const uint8_t* tiles, uint8_t* bmp){
     // Copy the bitmap header
-    bufncpy(working_mem, bmp_header, 0x76);
+    bufncpy(bmp, bmp_header, 0x76);
     uint16_t buf_head = 0x76;
-    // Two photos per bank, starting at bank 1
-    gbcam_set_ram_bank((num / 2) + 1);
-    // First photo at 0xAD0E in bank, second at 0xBD0E
-    uint16_t sram_offset = ((num % 2) * 0x1000) + GBCAM_IMAGE_START_ADDR + SRAM_START_ADDR;
-    // printf("Pulling photo %i from bank %i at starting address 0x%x\n", num, num/2, sram_offset);
-    // 13 vertical blocks of 8 x 8 pixels
-	for (uint8_t v = 0; v < 14; v++) {
-		// 8 Lines
-		for (uint8_t l = 0; l < 8; l++) {
-			// One line
-			for (uint8_t x = 0; x < 16; x++) {
-				// 1st byte stores whether the pixel is white (0) or silver (1)
-				// 2nd byte stores whether the pixel is white (0), grey (1, if the bit in the first byte is 0) and black (1, if the bit in the first byte is 1).
-				uint8_t pixels_white_silver = readb(sram_offset);
-				uint8_t pixels_grey_black = readb(sram_offset+1);
-				
-				uint8_t eight_pixels[4];
-				uint8_t ep_counter = 0;
-				uint8_t temp_byte = 0;
-				
-				for (int8_t p = 7; p >= 0; p--) {
-					// 8 bit BMP colour depth, each nibble is 1 pixel
-					if ((pixels_white_silver & 1<<p) && (pixels_grey_black & 1<<p)) {
-						temp_byte |= 0x00; // Black
-					}
-					else if (pixels_white_silver & 1<<p) {
-						temp_byte |= 0x08; // Silver
-					}
-					else if (pixels_grey_black & 1<<p) {
-						temp_byte |= 0x07; // Grey
-					}
-					else {
-						temp_byte |= 0x0F; // White
-					}
-					
-					// For odd bits, shift the result left by 4 and save the result to our buffer on even bits
-					if (p % 2 == 0) {
-						eight_pixels[ep_counter] = temp_byte;
-						ep_counter++;
-						temp_byte = 0; // Reset byte
-					}
-					else {
-						temp_byte <<= 4;
-					}
-				}
-                for(uint8_t i = 0; i < 4; i++){
-                    working_mem[buf_head] = eight_pixels[i];
+    // BMPs go bottom up. Tiles are 16 across, 16 bytes each, two bytes per line
+    for (int16_t y = GBCAM_PHOTO_HEIGHT - 1; y >= 0; y--) {
+        for (uint8_t x = 0; x < GBCAM_PHOTO_WIDTH / 8; x++) {
+            const uint8_t* line = tiles + ((y / 8) * 0x100) + (x * 0x10) + ((y % 8) * 2);
+            // 1st byte stores whether the pixel is white (0) or silver (1)
+            // 2nd byte stores whether the pixel is white (0), grey (1, if the bit in the first byte is 0) and black (1, if the bit in the first byte is 1).
+            uint8_t pixels_white_silver = line[0];
+            uint8_t pixels_grey_black = line[1];
+            uint8_t temp_byte = 0;
+            for (int8_t p = 7; p >= 0; p--) {
+                // 8 bit BMP colour depth, each nibble is 1 pixel
+                if ((pixels_white_silver & 1<<p) && (pixels_grey_black & 1<<p)) {
+                    temp_byte |= 0x00; // Black
+                }
+                else if (pixels_white_silver & 1<<p) {
+                    temp_byte |= 0x08; // Silver
+                }
+                else if (pixels_grey_black & 1<<p) {
+                    temp_byte |= 0x07; // Grey
+                }
+                else {
+                    temp_byte |= 0x0F; // White
+                }
+                // For odd bits, shift the result left by 4 and save the result to our buffer on even bits
+                if (p % 2 == 0) {
+                    bmp[buf_head] = temp_byte;
                     buf_head++;
+                    temp_byte = 0; // Reset byte
+                }
+                else {
+                    temp_byte <<= 4;
                 }
-				//fwrite(eight_pixels, 1, 4, bmpFile);
-				sram_offset += 0x10;
-			}
-			sram_offset -= 0x102;
-		}
-		sram_offset -= 0xF0;
-	}
-}
\ No newline at end of file
+            }
+        }
+    }
+}
+
+void gbcam_pull_tiles(uint8_t num){
+    // Two photos per bank, starting at bank 1
+    gbcam_set_ram_bank((num / 2) + 1);
+    // First photo at 0xA000 in bank, second at 0xB000
+    readbuf(((num % 2) * 0x1000) + SRAM_START_ADDR, gbcam_tiles, GBCAM_TILE_DATA_SIZE);
+}
+
+void gbcam_pull_photo(uint8_t num){
+    gbcam_pull_tiles(num);
+    // Whatever the PNG had in there is gone now
+    gbcam_png_photo = -1;
+    gbcam_decode_photo(gbcam_tiles, working_mem);
+}
+
+void gbcam_png_row(void* ctx, uint16_t y, uint8_t* row){
+    const uint8_t* tiles = (const uint8_t*) ctx;
+    for (uint8_t x = 0; x < GBCAM_PHOTO_WIDTH / 8; x++) {
+        const uint8_t* line = tiles + ((y / 8) * 0x100) + (x * 0x10) + ((y % 8) * 2);
+        uint16_t pixels = 0;
+        for (int8_t p = 7; p >= 0; p--) {
+            // Same shades as the BMPs, silver is the lighter grey
+            uint8_t shade = 3 - (((line[0] >> p) & 1) | (((line[1] >> p) & 1) << 1));
+            pixels = (pixels << 2) | shade;
+        }
+        row[x * 2] = pixels >> 8;
+        row[(x * 2) + 1] = pixels & 0xFF;
+    }
+}
+
+uint32_t gbcam_png_photo_size(){
+    return png_stream_size(GBCAM_PHOTO_WIDTH, GBCAM_PHOTO_HEIGHT, GBCAM_PNG_SCALE);
+}
+
+void gbcam_read_png(uint8_t num, uint8_t* dest, uint32_t offset, uint32_t len){
+    // The start of the file is a fresh read, the photo could have been retaken since
+    if((num != gbcam_png_photo) || !offset){
+        gbcam_pull_tiles(num);
+        gbcam_png_photo = num;
+        png_stream_init(&gbcam_png, GBCAM_PHOTO_WIDTH, GBCAM_PHOTO_HEIGHT, GBCAM_PNG_SCALE, gbcam_png_row, gbcam_tiles);
+    }
+    png_stream_read(&gbcam_png, dest, offset, len);
+}
+
+uint8_t gbcam_shade(uint8_t r, uint8_t g, uint8_t b){
+    uint8_t luma = ((r * 77) + (g * 150) + (b * 29)) >> 8;
+    if(luma < 0x40){
+        return 0;
+    }
+    if(luma < 0xA0){
+        return 1;
+    }
+    return luma < 0xE0 ? 2 : 3;
+}
+
+void gbcam_bmp_parse_header(){
+    uint8_t* h = gbcam_bmp.header;
+    int32_t width = h[18] | (h[19] << 8) | (h[20] << 16) | (h[21] << 24);
+    int32_t height = h[22] | (h[23] << 8) | (h[24] << 16) | (h[25] << 24);
+    uint32_t compression = h[30] | (h[31] << 8) | (h[32] << 16) | (h[33] << 24);
+    gbcam_bmp.bpp = h[28] | (h[29] << 8);
+    gbcam_bmp.palette_start = 14 + (h[14] | (h[15] << 8) | (h[16] << 16) | (h[17] << 24));
+    gbcam_bmp.data_start = h[10] | (h[11] << 8) | (h[12] << 16) | (h[13] << 24);
+    // Negative height is top down
+    gbcam_bmp.top_down = height < 0;
+    if(height < 0){
+        height = -height;
+    }
+    // Deeper BMPs are bigger than the photo's clusters. Only the start of them would land
+    // here, and half a photo would get written over the old one
+    uint8_t bpp_ok = (gbcam_bmp.bpp == 1) || (gbcam_bmp.bpp == 4);
+    gbcam_bmp.stride = (((GBCAM_PHOTO_WIDTH * gbcam_bmp.bpp) + 31) / 32) * 4;
+    uint8_t fits = (gbcam_bmp.data_start + (GBCAM_PHOTO_HEIGHT * gbcam_bmp.stride)) <= GBCAM_BMP_SPAN_SIZE;
+    if((h[0] != 'B') || (h[1] != 'M') || (width != GBCAM_PHOTO_WIDTH) || (height != GBCAM_PHOTO_HEIGHT) || !bpp_ok || !fits || compression){
+        printf("Not a %ix%i 1 or 4 bit BMP that fits in place, ignoring it\n", GBCAM_PHOTO_WIDTH, GBCAM_PHOTO_HEIGHT);
+        gbcam_bmp.photo = -1;
+        return;
+    }
+    // Anything missing from the palette is white
+    memset(gbcam_bmp.lut, 3, sizeof(gbcam_bmp.lut));
+}
+
+void gbcam_write_changed(uint16_t addr, uint8_t data){
+    if(readb(addr) != data){
+        writeb(data, addr);
+    }
+}
+
+void gbcam_bmp_flush_row(){
+    uint8_t y = gbcam_bmp.row_y;
+    uint16_t base = SRAM_START_ADDR + ((gbcam_bmp.photo % 2) * 0x1000);
+    gbcam_set_ram_access(1);
+    gbcam_set_ram_bank((gbcam_bmp.photo / 2) + 1);
+    for(uint8_t t = 0; t < GBCAM_PHOTO_WIDTH / 8; t++){
+        uint16_t addr = base + ((y / 8) * 0x100) + (t * 0x10) + ((y % 8) * 2);
+        gbcam_write_changed(addr, gbcam_bmp.row[t * 2]);
+        gbcam_write_changed(addr + 1, gbcam_bmp.row[(t * 2) + 1]);
+    }
+    // Every 4th pixel of every 4th row goes in the thumbnail, with 2 blank rows above and below
+    if(!(y % 4)){
+        uint8_t ty = (y / 4) + 2;
+        for(uint8_t t = 0; t < GBCAM_THUMB_SIZE / 8; t++){
+            uint8_t lo = 0;
+            uint8_t hi = 0;
+            for(uint8_t p = 0; p < 8; p++){
+                uint8_t x = ((t * 8) + p) * 4;
+                uint8_t bit = 7 - (x % 8);
+                lo = (lo << 1) | ((gbcam_bmp.row[(x / 8) * 2] >> bit) & 1);
+                hi = (hi << 1) | ((gbcam_bmp.row[((x / 8) * 2) + 1] >> bit) & 1);
+            }
+            uint16_t addr = base + GBCAM_THUMB_OFFSET + ((ty / 8) * 0x40) + (t * 0x10) + ((ty % 8) * 2);
+            gbcam_write_changed(addr, lo);
+            gbcam_write_changed(addr + 1, hi);
+        }
+    }
+    gbcam_set_ram_access(0);
+    // Whatever was read of this photo is stale now
+    gbcam_png_photo = -1;
+    if(!(gbcam_bmp.rows_done[y / 8] & (1 << (y % 8)))){
+        gbcam_bmp.rows_done[y / 8] |= 1 << (y % 8);
+        gbcam_bmp.rows_left--;
+        if(!gbcam_bmp.rows_left){
+            gbcam_bmp_fill_slot();
+        }
+    }
+}
+
+void gbcam_bmp_put_pixel(uint8_t x, uint8_t shade){
+    // Inverse of the decode. Black is both bits, silver the first, grey the second
+    uint8_t code = 3 - shade;
+    uint8_t bit = 1 << (7 - (x % 8));
+    uint8_t* line = gbcam_bmp.row + ((x / 8) * 2);
+    line[0] = (code & 0x1) ? (line[0] | bit) : (line[0] & ~bit);
+    line[1] = (code & 0x2) ? (line[1] | bit) : (line[1] & ~bit);
+    gbcam_bmp.row_pixels++;
+    if(gbcam_bmp.row_pixels == GBCAM_PHOTO_WIDTH){
+        gbcam_bmp_flush_row();
+        gbcam_bmp.row_pixels = 0;
+    }
+}
+
+void gbcam_bmp_byte(uint32_t off, uint8_t b){
+    if(off < sizeof(gbcam_bmp.header)){
+        gbcam_bmp.header[off] = b;
+        if(off == sizeof(gbcam_bmp.header) - 1){
+            gbcam_bmp_parse_header();
+        }
+        return;
+    }
+    // Palette entries are BGRA
+    if(off < gbcam_bmp.data_start){
+        uint32_t entry = (off - gbcam_bmp.palette_start) / 4;
+        uint8_t k = (off - gbcam_bmp.palette_start) % 4;
+        if((off >= gbcam_bmp.palette_start) && (entry < sizeof(gbcam_bmp.lut))){
+            gbcam_bmp.color[k] = b;
+            if(k == 2){
+                gbcam_bmp.lut[entry] = gbcam_shade(gbcam_bmp.color[2], gbcam_bmp.color[1], gbcam_bmp.color[0]);
+            }
+        }
+        return;
+    }
+    uint32_t file_row = (off - gbcam_bmp.data_start) / gbcam_bmp.stride;
+    uint32_t col = (off - gbcam_bmp.data_start) % gbcam_bmp.stride;
+    if(file_row >= GBCAM_PHOTO_HEIGHT){
+        return;
+    }
+    int16_t y = gbcam_bmp.top_down ? file_row : (GBCAM_PHOTO_HEIGHT - 1 - file_row);
+    if(y != gbcam_bmp.row_y){
+        // Anything left of the last row never got finished, it gets dropped
+        gbcam_bmp.row_y = y;
+        gbcam_bmp.row_pixels = 0;
+    }
+    // Leftmost pixel is in the top bits
+    uint8_t per_byte = 8 / gbcam_bmp.bpp;
+    uint8_t mask = (1 << gbcam_bmp.bpp) - 1;
+    for(uint8_t p = 0; p < per_byte; p++){
+        uint32_t x = (col * per_byte) + p;
+        if(x < GBCAM_PHOTO_WIDTH){
+            gbcam_bmp_put_pixel(x, gbcam_bmp.lut[(b >> (8 - (gbcam_bmp.bpp * (p + 1)))) & mask]);
+        }
+    }
+}
+
+void gbcam_bmp_fill_slot(){
+    uint16_t base = SRAM_START_ADDR + ((gbcam_bmp.photo % 2) * 0x1000);
+    gbcam_set_ram_access(1);
+    gbcam_set_ram_bank((gbcam_bmp.photo / 2) + 1);
+    // Blank rows above and below the thumbnail
+    const uint8_t blank_rows[4] = {0, 1, GBCAM_THUMB_SIZE - 2, GBCAM_THUMB_SIZE - 1};
+    for(uint8_t r = 0; r < 4; r++){
+        for(uint8_t t = 0; t < GBCAM_THUMB_SIZE / 8; t++){
+            uint16_t addr = base + GBCAM_THUMB_OFFSET + ((blank_rows[r] / 8) * 0x40) + (t * 0x10) + ((blank_rows[r] % 8) * 2);
+            gbcam_write_changed(addr, 0);
+            gbcam_write_changed(addr + 1, 0);
+        }
+    }
+    gbcam_set_ram_bank(0);
+    // Leave the album alone if the camera hasn't set it up
+    const char magic[] = "Magic";
+    for(uint8_t i = 0; i < 5; i++){
+        if(readb(GBCAM_SLOT_MAGIC_ADDR + i) != magic[i]){
+            gbcam_set_ram_access(0);
+            return;
+        }
+    }
+    uint8_t old = readb(GBCAM_SLOT_TABLE_ADDR + gbcam_bmp.photo);
+    if(old == GBCAM_SLOT_EMPTY){
+        // It goes after the highest numbered photo already there
+        uint8_t next = 0;
+        for(uint8_t i = 0; i < GBCAM_NUM_PHOTOS; i++){
+            uint8_t n = readb(GBCAM_SLOT_TABLE_ADDR + i);
+            if((n != GBCAM_SLOT_EMPTY) && (n >= next)){
+                next = n + 1;
+            }
+        }
+        // Only one byte changes, so the checksum gets adjusted for it rather than redone
+        uint8_t sum = readb(GBCAM_SLOT_CHECKSUM_ADDR) + next - old;
+        uint8_t x = readb(GBCAM_SLOT_CHECKSUM_ADDR + 1) ^ next ^ old;
+        for(uint8_t copy = 0; copy < 2; copy++){
+            uint16_t echo = copy * GBCAM_SLOT_ECHO_OFFSET;
+            writeb(next, GBCAM_SLOT_TABLE_ADDR + gbcam_bmp.photo + echo);
+            writeb(sum, GBCAM_SLOT_CHECKSUM_ADDR + echo);
+            writeb(x, GBCAM_SLOT_CHECKSUM_ADDR + 1 + echo);
+        }
+        printf("Photo %i is number %i in the album\n", gbcam_bmp.photo, next);
+    }
+    gbcam_set_ram_access(0);
+}
+
+void gbcam_write_bmp(uint8_t num, uint32_t offset, const uint8_t* buf, uint32_t len){
+    if(!offset){
+        gbcam_bmp.photo = num;
+        gbcam_bmp.row_y = -1;
+        gbcam_bmp.row_pixels = 0;
+        gbcam_bmp.rows_left = GBCAM_PHOTO_HEIGHT;
+        memset(gbcam_bmp.rows_done, 0, sizeof(gbcam_bmp.rows_done));
+    }
+    if(gbcam_bmp.photo != num){
+        return;
+    }
+    for(uint32_t i = 0; (i < len) && (gbcam_bmp.photo >= 0); i++){
+        gbcam_bmp_byte(offset + i, buf[i]);
+    }
+}
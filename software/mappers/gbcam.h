@@ -14,6 +14,33 @@
 
 #define GBCAM_IMAGE_START_ADDR          0xD0E  // this do be lookin srs d0e
 #define GBCAM_BMP_PHOTO_SIZE            7286
+#define GBCAM_PHOTO_WIDTH               128
+#define GBCAM_PHOTO_HEIGHT              112
+// 2bpp tiles, 16 across and 14 down
+#define GBCAM_TILE_DATA_SIZE            0xE00
+// Where a fresh capture lands, in SRAM bank 0
+#define GBCAM_CAPTURE_ADDR              0xA100
+// Camera registers, in GBCAM_CAM_REG_BANK. Only the first one can be read back
+#define GBCAM_REG_TRIGGER_ADDR          0xA000
+#define GBCAM_REG_COUNT                 0x36
+#define GBCAM_TRIGGER_CAPTURE           0x01 // Write to start a capture, reads back set until it's done
+// Photos also go on the disk as 2 bit PNGs, this many times bigger each way. The FAT has
+// room for PNGs up to 2
+#define GBCAM_PNG_SCALE                 1
+#define GBCAM_NUM_PHOTOS                30
+// 32x32 thumbnail for the album, right after each photo's tiles
+#define GBCAM_THUMB_OFFSET              0xE00
+#define GBCAM_THUMB_SIZE                32
+// Album slots in SRAM bank 0. Each photo's byte is its number in the album, or empty.
+// "Magic" and a sum/xor checksum of it all follow, then a second copy of everything
+#define GBCAM_SLOT_TABLE_ADDR           0xB1B2
+#define GBCAM_SLOT_MAGIC_ADDR           0xB1D0
+#define GBCAM_SLOT_CHECKSUM_ADDR        0xB1D5
+#define GBCAM_SLOT_ECHO_OFFSET          0x25
+#define GBCAM_SLOT_EMPTY                0xFF
+
+// Disk space each photo's BMP gets, 16 blocks. A BMP written over a photo has to fit in it
+#define GBCAM_BMP_SPAN_SIZE             0x2000
 
 #define LBA2PHOTO(x) ((x)/16)
 #define LBA2PHOTOOFFSET(x) ((x)%16)
@@ -28,6 +55,17 @@ void gbcam_set_rom_bank(uint16_t bank);
 void gbcam_set_ram_bank(uint16_t bank);
 void gbcam_set_ram_access(uint8_t on_off);
 void gbcam_pull_photo(uint8_t num);
+// Turn GBCAM_TILE_DATA_SIZE bytes of tiles into a GBCAM_BMP_PHOTO_SIZE byte BMP
+void gbcam_decode_photo(const uint8_t* tiles, uint8_t* bmp);
+// Size of a photo as a PNG
+uint32_t gbcam_png_photo_size();
+// Copy part of photo num as a PNG. Reading on from the last read carries on where it left off
+void gbcam_read_png(uint8_t num, uint8_t* dest, uint32_t offset, uint32_t len);
+// Take part of a BMP written over photo num. Writing offset 0 starts a new one. Rows go into
+// the cart as they finish, and the photo gets its album slot once all of them are in.
+// Only 1 and 4 bit BMPs fit in GBCAM_BMP_SPAN_SIZE. The host puts anything bigger partly
+// somewhere else, so those get turned away before a row is written
+void gbcam_write_bmp(uint8_t num, uint32_t offset, const uint8_t* buf, uint32_t len);
 
 // DEPRECATED
 void gbcam_rom_dump(uint8_t *buf, uint8_t start_bank, uint8_t end_bank);
@@ -1,6 +1,7 @@
 #include "huc1.h"
+#include "pico/platform.h"
 
-void huc1_memcpy_rom(uint8_t* dest, uint32_t rom_addr, uint32_t num){
+void __not_in_flash_func(huc1_memcpy_rom)(uint8_t* dest, uint32_t rom_addr, uint32_t num){
     // Determine the current bank
     uint16_t current_bank = fs_get_rom_bank(rom_addr);
     uint32_t rom_cursor = 0;
@@ -8,7 +9,7 @@ void huc1_memcpy_rom(uint8_t* dest, uint32_t rom_addr, uint32_t num){
     rom_cursor = rom_addr % ROM_BANK_SIZE;
     // Set up the bank for transfer
     huc1_set_rom_bank(current_bank);
-    for(uint32_t buf_cursor = 0; buf_cursor < num; buf_cursor++){
+    for(uint32_t buf_cursor = 0; buf_cursor < num;){
         // Determine if we need to bankswitch or not
         if(rom_cursor >= ROM_BANK_SIZE){
             // Switch banks if we cross a boundary
@@ -17,13 +18,19 @@ void huc1_memcpy_rom(uint8_t* dest, uint32_t rom_addr, uint32_t num){
             // If we bankswitch, we start over again at the beginning of the the bank
             rom_cursor = 0;
         }
+        // The rest of this bank, or as much as is wanted, in one go
+        uint32_t run = ROM_BANK_SIZE - rom_cursor;
+        if(run > (num - buf_cursor)){
+            run = num - buf_cursor;
+        }
         // Read everything out of banked ROM, even bank 0. Easier that way
-        dest[buf_cursor] = readb(rom_cursor + ROM_BANKN_START_ADDR); 
-        rom_cursor++;
+        readbuf_rom(rom_cursor + ROM_BANKN_START_ADDR, dest + buf_cursor, run);
+        rom_cursor += run;
+        buf_cursor += run;
     }
 }
 
-void huc1_memcpy_ram(uint8_t* dest, uint32_t ram_addr, uint32_t num){
+void __not_in_flash_func(huc1_memcpy_ram)(uint8_t* dest, uint32_t ram_addr, uint32_t num){
     // Enable RAM reads
     huc1_set_ram_access(1);
     // Determine current bank
@@ -49,7 +56,7 @@ void huc1_memcpy_ram(uint8_t* dest, uint32_t ram_addr, uint32_t num){
     huc1_set_ram_access(0);
 }
 
-void huc1_memset_ram(uint8_t* buf, uint32_t ram_addr, uint32_t num){
+void __not_in_flash_func(huc1_memset_ram)(uint8_t* buf, uint32_t ram_addr, uint32_t num){
     // Determine current bank
     uint16_t current_bank = fs_get_ram_bank(ram_addr);
     uint32_t ram_cursor = 0;
@@ -75,15 +82,15 @@ void huc1_memset_ram(uint8_t* buf, uint32_t ram_addr, uint32_t num){
     huc1_set_ram_access(0);
 }
 
-void huc1_set_rom_bank(uint16_t bank){
+void __not_in_flash_func(huc1_set_rom_bank)(uint16_t bank){
     writeb(bank, HUC1_ROM_BANK_ADDR);
 }
 
-void huc1_set_ram_bank(uint16_t bank){
+void __not_in_flash_func(huc1_set_ram_bank)(uint16_t bank){
     writeb(bank, HUC1_RAM_BANK_ADDR);
 }
 
-void huc1_set_ram_access(uint8_t on_off){
+void __not_in_flash_func(huc1_set_ram_access)(uint8_t on_off){
     // RAM is enabled by default, and IR is disabled. Still, good idea to set this here
     if(on_off){
         writeb(HUC1_IR_SRAM_SELECT_SRAM, HUC1_IR_SRAM_SELECT_ADDR);
@@ -1,10 +1,13 @@
 #include "mbc1.h"
+#include "pico/platform.h"
 #include "gb.h"
 
+#include <string.h>
+
 // Best docs on this mapper https://gbdev.gg8.se/wiki/articles/MBC1
 
 // Public functions
-void mbc1_memcpy_rom(uint8_t* dest, uint32_t rom_addr, uint32_t num){
+void __not_in_flash_func(mbc1_memcpy_rom)(uint8_t* dest, uint32_t rom_addr, uint32_t num){
     // Annoyingly, Bank 0 cannot be mapped with this mapper, so we need to 
     // special case this. Assume we are not reading from Bank 0
     uint16_t bank_offset = ROM_BANKN_START_ADDR;
@@ -23,7 +26,7 @@ void mbc1_memcpy_rom(uint8_t* dest, uint32_t rom_addr, uint32_t num){
     else{
         mbc1_set_rom_bank(current_bank);
     }    
-    for(uint32_t buf_cursor = 0; buf_cursor < num; buf_cursor++){
+    for(uint32_t buf_cursor = 0; buf_cursor < num;){
         // Determine if we need to bankswitch or not
         if(rom_cursor >= ROM_BANK_SIZE){
             // Switch banks if we cross a boundary
@@ -34,21 +37,27 @@ void mbc1_memcpy_rom(uint8_t* dest, uint32_t rom_addr, uint32_t num){
             // Bankswitching will always imply that we have left Bank 0
             bank_offset = ROM_BANKN_START_ADDR;
         }
+        // The rest of this bank, or as much as is wanted, in one go
+        uint32_t run = ROM_BANK_SIZE - rom_cursor;
+        if(run > (num - buf_cursor)){
+            run = num - buf_cursor;
+        }
         if(mbc1_check_invalid_bank(current_bank)){
             // This bank does not exist.
             // Looks like modern emulators just put 0's here
             // TODO: Make it back to the redirected one instead
-            dest[buf_cursor] = 0x0; 
+            memset(dest + buf_cursor, 0x0, run);
         }
         else{
             // Read back data from the appropriate bank
-            dest[buf_cursor] = readb(rom_cursor + bank_offset); 
+            readbuf_rom(rom_cursor + bank_offset, dest + buf_cursor, run);
         }
-        rom_cursor++;
+        rom_cursor += run;
+        buf_cursor += run;
     }
 }
 
-void mbc1_memcpy_ram(uint8_t* dest, uint32_t ram_addr, uint32_t num){
+void __not_in_flash_func(mbc1_memcpy_ram)(uint8_t* dest, uint32_t ram_addr, uint32_t num){
     // Enable RAM reads
     mbc1_set_ram_access(1);
     // Determine current bank
@@ -74,7 +83,7 @@ void mbc1_memcpy_ram(uint8_t* dest, uint32_t ram_addr, uint32_t num){
     mbc1_set_ram_access(0);
 }
 
-void mbc1_memset_ram(uint8_t* buf, uint32_t ram_addr, uint32_t num){
+void __not_in_flash_func(mbc1_memset_ram)(uint8_t* buf, uint32_t ram_addr, uint32_t num){
     // Determine current bank
     uint16_t current_bank = fs_get_ram_bank(ram_addr);
     uint32_t ram_cursor = 0;
@@ -102,7 +111,7 @@ void mbc1_memset_ram(uint8_t* buf, uint32_t ram_addr, uint32_t num){
 
 
 // Private
-void mbc1_set_rom_bank(uint16_t bank){
+void __not_in_flash_func(mbc1_set_rom_bank)(uint16_t bank){
     // You cannot select bank 0x0, 0x20, 0x40, 0x60 with this
     // Those default to bank  0x0, 0x21, 0x41, 0x61
     // Bank 0x0 must be accessed via addresses 0x0 - 0x3FFF. 
@@ -116,14 +125,14 @@ void mbc1_set_rom_bank(uint16_t bank){
     writeb((bank & 0x60) >> 5, MBC1_RAM_ROM_SHARED_BANK);
 }
 
-void mbc1_set_ram_bank(uint16_t bank){
+void __not_in_flash_func(mbc1_set_ram_bank)(uint16_t bank){
     // Set the ROM/RAM mode select bit for RAM access
     writeb(0x1, MBC1_ROM_RAM_SELECT);
     // Set the two bits for the RAM bank
     writeb(bank & 0x3, MBC1_RAM_ROM_SHARED_BANK);
 }
 
-void mbc1_set_ram_access(uint8_t on_off){
+void __not_in_flash_func(mbc1_set_ram_access)(uint8_t on_off){
     // This is required for reads and writes
     if(on_off){
         writeb(MBC1_ENABLE_RAM_ACCESS_DATA, MBC1_ENABLE_RAM_ACCESS_ADDR);
@@ -133,7 +142,7 @@ void mbc1_set_ram_access(uint8_t on_off){
     }
 }
 
-uint8_t mbc1_check_invalid_bank(uint16_t bank){
+uint8_t __not_in_flash_func(mbc1_check_invalid_bank)(uint16_t bank){
     // In MBC1, some banks just don't exist due to how the mapper works
     // Why did they make it this way. I swear they could have done better
     // Did they design this with graph paper and pencils? (maybe)
@@ -1,10 +1,11 @@
 #include "mbc2.h"
+#include "pico/platform.h"
 #include "gb.h"
 
 // Best docs on this mapper https://gbdev.gg8.se/wiki/articles/Memory_Bank_Controllers#MBC2_.28max_256KByte_ROM_and_512x4_bits_RAM.29
 
 // Public functions
-void mbc2_memcpy_rom(uint8_t* dest, uint32_t rom_addr, uint32_t num){
+void __not_in_flash_func(mbc2_memcpy_rom)(uint8_t* dest, uint32_t rom_addr, uint32_t num){
     // Annoyingly, Bank 0 cannot be mapped with this mapper, so we need to 
     // special case this. Assume we are not reading from Bank 0
     uint16_t bank_offset = ROM_BANKN_START_ADDR;
@@ -23,7 +24,7 @@ void mbc2_memcpy_rom(uint8_t* dest, uint32_t rom_addr, uint32_t num){
     else{
         mbc2_set_rom_bank(current_bank);
     }    
-    for(uint32_t buf_cursor = 0; buf_cursor < num; buf_cursor++){
+    for(uint32_t buf_cursor = 0; buf_cursor < num;){
         // Determine if we need to bankswitch or not
         if(rom_cursor >= ROM_BANK_SIZE){
             // Switch banks if we cross a boundary
@@ -34,13 +35,19 @@ void mbc2_memcpy_rom(uint8_t* dest, uint32_t rom_addr, uint32_t num){
             // Bankswitching will always imply that we have left Bank 0
             bank_offset = ROM_BANKN_START_ADDR;
         }
+        // The rest of this bank, or as much as is wanted, in one go
+        uint32_t run = ROM_BANK_SIZE - rom_cursor;
+        if(run > (num - buf_cursor)){
+            run = num - buf_cursor;
+        }
         // Read everything out of banked ROM, even bank 0. Easier that way
-        dest[buf_cursor] = readb(rom_cursor + bank_offset); 
-        rom_cursor++;
+        readbuf_rom(rom_cursor + bank_offset, dest + buf_cursor, run);
+        rom_cursor += run;
+        buf_cursor += run;
     }
 }
 
-void mbc2_memcpy_ram(uint8_t* dest, uint32_t ram_addr, uint32_t num){
+void __not_in_flash_func(mbc2_memcpy_ram)(uint8_t* dest, uint32_t ram_addr, uint32_t num){
     // Enable RAM access
     mbc2_set_ram_access(1);
     // There is only one memory bank in MBC2
@@ -55,7 +62,7 @@ void mbc2_memcpy_ram(uint8_t* dest, uint32_t ram_addr, uint32_t num){
     mbc2_set_ram_access(0);
 }
 
-void mbc2_memset_ram(uint8_t* buf, uint32_t ram_addr, uint32_t num){
+void __not_in_flash_func(mbc2_memset_ram)(uint8_t* buf, uint32_t ram_addr, uint32_t num){
     // Enable RAM access
     mbc2_set_ram_access(1);
     // There is only one memory bank in MBC2
@@ -72,7 +79,7 @@ void mbc2_memset_ram(uint8_t* buf, uint32_t ram_addr, uint32_t num){
         // MBC2 SRAM is smaller than one block of filesystem data, so the host computer
         // may try and write into memory that does not exist. Prevent that from happening.
         if(ram_addr >= MBC2_MAX_RAM_SIZE){
-            return;
+            break;
         }
     }
     mbc2_set_ram_access(0);
@@ -80,12 +87,12 @@ void mbc2_memset_ram(uint8_t* buf, uint32_t ram_addr, uint32_t num){
 
 
 // Private
-void mbc2_set_rom_bank(uint16_t bank){
+void __not_in_flash_func(mbc2_set_rom_bank)(uint16_t bank){
     // Only 16 banks (4 bits) allowed here
     writeb(bank & 0xF, MBC2_ROM_BANK_ADDR);
 }
 
-void mbc2_set_ram_access(uint8_t on_off){
+void __not_in_flash_func(mbc2_set_ram_access)(uint8_t on_off){
     // This is required for reads and writes
     if(on_off){
         writeb(MBC2_ENABLE_RAM_ACCESS_DATA, MBC2_ENABLE_RAM_ACCESS_ADDR);
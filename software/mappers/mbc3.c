@@ -1,16 +1,17 @@
 #include "mbc3.h"
+#include "pico/platform.h"
 #include "gb.h"
 #include <stdio.h>
 
-void mbc3_set_rom_bank(uint16_t bank){
+void __not_in_flash_func(mbc3_set_rom_bank)(uint16_t bank){
     writeb(bank, MBC3_ROM_BANK_ADDR);
 }
 
-void mbc3_set_ram_bank(uint16_t bank){
+void __not_in_flash_func(mbc3_set_ram_bank)(uint16_t bank){
     writeb(bank, MBC3_RAM_BANK_ADDR);
 }
 
-void mbc3_set_ram_access(uint8_t on_off){
+void __not_in_flash_func(mbc3_set_ram_access)(uint8_t on_off){
     if(on_off){
         writeb(MBC3_ENABLE_RAM_ACCESS_DATA, MBC3_ENABLE_RAM_ACCESS_ADDR);
     }
@@ -19,7 +20,7 @@ void mbc3_set_ram_access(uint8_t on_off){
     }
 }
 
-void mbc3_memcpy_rom(uint8_t* dest, uint32_t rom_addr, uint32_t num){
+void __not_in_flash_func(mbc3_memcpy_rom)(uint8_t* dest, uint32_t rom_addr, uint32_t num){
     // Annoyingly, Bank 0 cannot be mapped with this mapper, so we need to 
     // special case this. Assume we are not reading from Bank 0
     uint16_t bank_offset = ROM_BANKN_START_ADDR;
@@ -38,7 +39,7 @@ void mbc3_memcpy_rom(uint8_t* dest, uint32_t rom_addr, uint32_t num){
     else{
         mbc3_set_rom_bank(current_bank);
     }    
-    for(uint32_t buf_cursor = 0; buf_cursor < num; buf_cursor++){
+    for(uint32_t buf_cursor = 0; buf_cursor < num;){
         // Determine if we need to bankswitch or not
         if(rom_cursor >= ROM_BANK_SIZE){
             // Switch banks if we cross a boundary
@@ -49,32 +50,36 @@ void mbc3_memcpy_rom(uint8_t* dest, uint32_t rom_addr, uint32_t num){
             // Bankswitching will always imply that we have left Bank 0
             bank_offset = ROM_BANKN_START_ADDR;
         }
+        // The rest of this bank, or as much as is wanted, in one go
+        uint32_t run = ROM_BANK_SIZE - rom_cursor;
+        if(run > (num - buf_cursor)){
+            run = num - buf_cursor;
+        }
         // Read back data from the appropriate bank
-        dest[buf_cursor] = readb(rom_cursor + bank_offset); 
-        rom_cursor++;
+        readbuf_rom(rom_cursor + bank_offset, dest + buf_cursor, run);
+        rom_cursor += run;
+        buf_cursor += run;
     }
 }
 
-void mbc3_memcpy_ram(uint8_t* dest, uint32_t ram_addr, uint32_t num){
+void __not_in_flash_func(mbc3_memcpy_ram)(uint8_t* dest, uint32_t ram_addr, uint32_t num){
     // Enable RAM access
     mbc3_set_ram_access(1);
-    // Keep track of where we are in RAM
-    uint32_t ram_cursor = ram_addr;
     // Keep track of our current bank
-    uint16_t current_bank = fs_get_ram_bank(ram_cursor);
+    uint16_t current_bank = fs_get_ram_bank(ram_addr);
+    // Keep track of where we are in RAM
+    uint32_t ram_cursor = ram_addr % SRAM_BANK_SIZE;
     // Set up the bank for transfer
     mbc3_set_ram_bank(current_bank);
     for(uint32_t buf_cursor = 0; buf_cursor < num; buf_cursor++){
         // Determine if we need to bankswitch or not
-        uint16_t new_bank = fs_get_rom_bank(ram_cursor);
-        if(new_bank != current_bank){
+        if(ram_cursor >= SRAM_BANK_SIZE){
             // Switch banks if we cross a boundary
-            current_bank = new_bank;
+            current_bank++;
             mbc3_set_ram_bank(current_bank);
             // If we bankswitch, we start over again at the beginning of the the bank
             ram_cursor = 0;
         }
-        // Read everything out of banked ROM, even bank 0. Easier that way
         dest[buf_cursor] = readb(ram_cursor + SRAM_START_ADDR); 
         ram_cursor++;
     }
@@ -114,7 +119,7 @@ void mbc3_memcpy_ram(uint8_t* dest, uint32_t ram_addr, uint32_t num){
 //     mbc3_set_ram_access(0);
 // }
 
-void mbc3_memset_ram(uint8_t* buf, uint32_t ram_addr, uint32_t num){
+void __not_in_flash_func(mbc3_memset_ram)(uint8_t* buf, uint32_t ram_addr, uint32_t num){
     // Determine current bank
     uint16_t current_bank = fs_get_ram_bank(ram_addr);
     uint32_t ram_cursor = 0;
@@ -1,21 +1,22 @@
 #include "mbc5.h"
+#include "pico/platform.h"
 #include "gb.h"
 #include "utils.h"
 #include "stdio.h"
 #include "stdlib.h"
 
-void mbc5_set_rom_bank(uint16_t bank){
+void __not_in_flash_func(mbc5_set_rom_bank)(uint16_t bank){
     // Set the full 16 bits of the SRAM bank
     writeb(bank & 0xFF, MBC5_LOW_ROM_BANK_ADDR);
-    writeb(bank & 0xFF00 >> 8, MBC5_HIGH_ROM_BANK_ADDR);
+    writeb((bank & 0xFF00) >> 8, MBC5_HIGH_ROM_BANK_ADDR);
 }
 
-void mbc5_set_ram_bank(uint16_t bank){
+void __not_in_flash_func(mbc5_set_ram_bank)(uint16_t bank){
     // Remember to enable RAM access first!
     writeb(bank, MBC5_RAM_BANK_ADDR);
 }
 
-void mbc5_set_ram_access(uint8_t on_off){
+void __not_in_flash_func(mbc5_set_ram_access)(uint8_t on_off){
     if(on_off){
         writeb(MBC5_ENABLE_RAM_ACCESS_DATA, MBC5_ENABLE_RAM_ACCESS_ADDR);
         return;
@@ -24,7 +25,7 @@ void mbc5_set_ram_access(uint8_t on_off){
 
 }
 
-void mbc5_memcpy_rom(uint8_t* dest, uint32_t rom_addr, uint32_t num){
+void __not_in_flash_func(mbc5_memcpy_rom)(uint8_t* dest, uint32_t rom_addr, uint32_t num){
     // Determine the current bank
     uint16_t current_bank = fs_get_rom_bank(rom_addr);
     uint32_t rom_cursor = 0;
@@ -32,7 +33,7 @@ void mbc5_memcpy_rom(uint8_t* dest, uint32_t rom_addr, uint32_t num){
     rom_cursor = rom_addr % ROM_BANK_SIZE;
     // Set up the bank for transfer
     mbc5_set_rom_bank(current_bank);
-    for(uint32_t buf_cursor = 0; buf_cursor < num; buf_cursor++){
+    for(uint32_t buf_cursor = 0; buf_cursor < num;){
         // Determine if we need to bankswitch or not
         if(rom_cursor >= ROM_BANK_SIZE){
             // Switch banks if we cross a boundary
@@ -41,13 +42,19 @@ void mbc5_memcpy_rom(uint8_t* dest, uint32_t rom_addr, uint32_t num){
             // If we bankswitch, we start over again at the beginning of the the bank
             rom_cursor = 0;
         }
+        // The rest of this bank, or as much as is wanted, in one go
+        uint32_t run = ROM_BANK_SIZE - rom_cursor;
+        if(run > (num - buf_cursor)){
+            run = num - buf_cursor;
+        }
         // Read everything out of banked ROM, even bank 0. Easier that way
-        dest[buf_cursor] = readb(rom_cursor + ROM_BANKN_START_ADDR); 
-        rom_cursor++;
+        readbuf_rom(rom_cursor + ROM_BANKN_START_ADDR, dest + buf_cursor, run);
+        rom_cursor += run;
+        buf_cursor += run;
     }
 }
 // Note: This gets memory relative to RAM, not the cart. So 0x0 means start of RAM
-void mbc5_memcpy_ram(uint8_t* dest, uint32_t ram_addr, uint32_t num){
+void __not_in_flash_func(mbc5_memcpy_ram)(uint8_t* dest, uint32_t ram_addr, uint32_t num){
     // Enable RAM reads
     mbc5_set_ram_access(1);
     // Determine current bank
@@ -73,7 +80,7 @@ void mbc5_memcpy_ram(uint8_t* dest, uint32_t ram_addr, uint32_t num){
     mbc5_set_ram_access(0);
 }
 
-void mbc5_memset_ram(uint8_t* buf, uint32_t ram_addr, uint32_t num){
+void __not_in_flash_func(mbc5_memset_ram)(uint8_t* buf, uint32_t ram_addr, uint32_t num){
     // Determine current bank
     uint16_t current_bank = fs_get_ram_bank(ram_addr);
     uint32_t ram_cursor = 0;
@@ -118,7 +125,7 @@ void mbc5_rom_dump(uint8_t *buf, uint16_t start_bank, uint16_t end_bank){
     }
 }
 
-void simple_memset_ram(uint8_t* the_buf, uint32_t ram_addr, uint32_t num){
+void __not_in_flash_func(simple_memset_ram)(uint8_t* the_buf, uint32_t ram_addr, uint32_t num){
     mbc5_set_ram_access(1);
     mbc5_set_ram_bank(0);
     for(uint32_t i = 0; i < 16; i++){
@@ -0,0 +1,134 @@
+#include "mbc_regs.h"
+#include "cart.h"
+
+// Core 1 calls the write and bank lookups on every console write while emulating a cart, so
+// on the Pico they run from RAM. The cartsim build has no flash to keep them out of
+#if PICO_ON_DEVICE
+#include "pico/platform.h"
+#else
+#define __not_in_flash_func(func_name) func_name
+#endif
+
+uint8_t mbc_regs_mapper_type(uint8_t cart_type){
+    switch(cart_type){
+        case 0x00: return MAPPER_ROM_ONLY;
+        case 0x08: case 0x09: return MAPPER_ROM_RAM;
+        case 0x01: case 0x02: case 0x03: return MAPPER_MBC1;
+        case 0x0F: case 0x10: case 0x11: case 0x12: case 0x13: return MAPPER_MBC3;
+        case 0x19: case 0x1A: case 0x1B: case 0x1C: case 0x1D: case 0x1E: return MAPPER_MBC5;
+        default: return MAPPER_UNKNOWN;
+    }
+}
+
+uint8_t mbc_regs_ram_banks(uint8_t ram_size){
+    switch(ram_size){
+        case 0x01: case 0x02: return 1; // 2K carts just see it mirrored
+        case 0x03: return 4;
+        case 0x04: return 16;
+        case 0x05: return 8;
+        default: return 0;
+    }
+}
+
+void mbc_regs_init(struct MbcRegs* regs, uint8_t mapper_type, uint16_t rom_banks, uint8_t ram_banks){
+    regs->mapper_type = mapper_type;
+    regs->rom_banks = rom_banks;
+    regs->ram_banks = ram_banks;
+    regs->low = 1;
+    regs->high = 0;
+    regs->ram_select = 0;
+    // Without a mapper there is nothing to turn the RAM on, so it always is
+    regs->ram_enabled = mapper_type == MAPPER_ROM_RAM;
+    regs->mode = 0;
+}
+
+uint8_t __not_in_flash_func(mbc_regs_write)(struct MbcRegs* regs, uint16_t addr, uint8_t data){
+    uint16_t old_bank = mbc_regs_bank(regs);
+    int16_t old_ram_bank = mbc_regs_ram_bank(regs);
+    uint16_t reg = addr & MBC_REGS_BANK_ADDR_MASK;
+    if(reg == MBC_REGS_RAM_ENABLE_ADDR && regs->mapper_type != MAPPER_ROM_RAM){
+        regs->ram_enabled = (data & 0xF) == MBC_REGS_RAM_ENABLE_VALUE;
+    }
+    switch(regs->mapper_type){
+        case MAPPER_MBC1:
+            if(reg == MBC_REGS_LOW_BANK_ADDR){
+                regs->low = data & 0x1F;
+            }
+            else if(reg == MBC_REGS_HIGH_BANK_ADDR){
+                regs->high = data & 0x3;
+            }
+            else if(reg == MBC_REGS_MODE_ADDR){
+                regs->mode = data & 0x1;
+            }
+            break;
+        case MAPPER_MBC3:
+            if(reg == MBC_REGS_LOW_BANK_ADDR){
+                regs->low = data & 0x7F;
+            }
+            else if(reg == MBC_REGS_HIGH_BANK_ADDR){
+                regs->ram_select = data;
+            }
+            break;
+        case MAPPER_MBC5:
+            if((addr & 0xF000) == MBC_REGS_LOW_BANK_ADDR){
+                regs->low = data;
+            }
+            else if((addr & 0xF000) == MBC5_REGS_BANK_BIT8_ADDR){
+                regs->high = data & 0x1;
+            }
+            else if(reg == MBC_REGS_HIGH_BANK_ADDR){
+                regs->ram_select = data & 0xF;
+            }
+            break;
+        default:
+            break;
+    }
+    return ((mbc_regs_bank(regs) != old_bank) ? MBC_REGS_ROM_CHANGED : 0) |
+           ((mbc_regs_ram_bank(regs) != old_ram_bank) ? MBC_REGS_RAM_CHANGED : 0);
+}
+
+uint16_t mbc_regs_bank0(const struct MbcRegs* regs){
+    // Mode 1 puts the upper bits on bank 0 as well, which only matters for 1 MB and up
+    if(regs->mapper_type == MAPPER_MBC1 && regs->mode){
+        return (regs->high << 5) & (regs->rom_banks - 1);
+    }
+    return 0;
+}
+
+uint16_t __not_in_flash_func(mbc_regs_bank)(const struct MbcRegs* regs){
+    uint16_t bank = 1;
+    switch(regs->mapper_type){
+        case MAPPER_MBC1:
+            // Bank 0 can't be picked, it turns into 1. This is also why 0x20, 0x40 and 0x60 can't be reached
+            bank = (regs->high << 5) | (regs->low ? regs->low : 1);
+            break;
+        case MAPPER_MBC3:
+            bank = regs->low ? regs->low : 1;
+            break;
+        case MAPPER_MBC5:
+            // MBC5 is the one that lets bank 0 show up up here
+            bank = (regs->high << 8) | regs->low;
+            break;
+        default:
+            break;
+    }
+    return bank & (regs->rom_banks - 1);
+}
+
+int16_t __not_in_flash_func(mbc_regs_ram_bank)(const struct MbcRegs* regs){
+    if(!regs->ram_banks || !regs->ram_enabled){
+        return MBC_REGS_RAM_OFF;
+    }
+    switch(regs->mapper_type){
+        case MAPPER_MBC1:
+            // Mode 0 pins RAM to bank 0 and gives the upper bits to the ROM
+            return regs->mode ? regs->high & (regs->ram_banks - 1) : 0;
+        case MAPPER_MBC3:
+            // 0x08-0x0C pick an RTC register instead
+            return regs->ram_select <= 0x03 ? regs->ram_select & (regs->ram_banks - 1) : MBC_REGS_RAM_OFF;
+        case MAPPER_MBC5:
+            return regs->ram_select & (regs->ram_banks - 1);
+        default:
+            return 0;
+    }
+}
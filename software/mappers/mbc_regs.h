@@ -0,0 +1,50 @@
+#ifndef MBC_REGS_H_
+#define MBC_REGS_H_
+
+#include <stdint.h>
+
+// Keeps track of the bank registers of a mapper we are pretending to be, from the writes a
+// console makes to them. Nothing from the Pico SDK in here beyond pico/platform.h on the
+// Pico itself, so the cart emulation bench in utils/cartsim builds it too
+
+#define MBC_REGS_BANK_ADDR_MASK     0xE000 // Which register a write is for
+#define MBC_REGS_RAM_ENABLE_ADDR    0x0000
+#define MBC_REGS_LOW_BANK_ADDR      0x2000
+#define MBC_REGS_HIGH_BANK_ADDR     0x4000 // Also the RAM bank
+#define MBC_REGS_MODE_ADDR          0x6000 // MBC1 only
+#define MBC5_REGS_BANK_BIT8_ADDR    0x3000 // MBC5 splits 0x2000-0x3FFF in two
+#define MBC_REGS_RAM_ENABLE_VALUE   0x0A   // Low nibble that turns cart RAM on
+
+// What a write changed, from mbc_regs_write()
+#define MBC_REGS_ROM_CHANGED        0x1
+#define MBC_REGS_RAM_CHANGED        0x2
+
+#define MBC_REGS_RAM_BANK_SIZE      0x2000
+#define MBC_REGS_RAM_OFF            -1
+
+struct MbcRegs {
+    uint8_t  mapper_type; // MAPPER_* from cart.h
+    uint16_t rom_banks;   // Power of two
+    uint8_t  ram_banks;   // 8K banks of cart RAM, 0 if there isn't any
+    uint16_t low;         // Low bank register, as written
+    uint16_t high;        // MBC1 bank bits 5-6 or RAM bank, MBC5 bank bit 8
+    uint8_t  ram_select;  // MBC3/MBC5 RAM bank register, as written
+    uint8_t  ram_enabled;
+    uint8_t  mode;        // MBC1 banking mode
+};
+
+// Pick the mapper to emulate for a cart type byte from the header. MAPPER_UNKNOWN if we can't
+uint8_t mbc_regs_mapper_type(uint8_t cart_type);
+// 8K banks of cart RAM for the RAM size byte from the header
+uint8_t mbc_regs_ram_banks(uint8_t ram_size);
+void mbc_regs_init(struct MbcRegs* regs, uint8_t mapper_type, uint16_t rom_banks, uint8_t ram_banks);
+// Feed in a write to 0x0000-0x7FFF. Returns MBC_REGS_*_CHANGED for whatever it moved
+uint8_t mbc_regs_write(struct MbcRegs* regs, uint16_t addr, uint8_t data);
+// The bank showing at 0x0000-0x3FFF right now. Only MBC1 mode 1 moves it off bank 0
+uint16_t mbc_regs_bank0(const struct MbcRegs* regs);
+// The bank showing at 0x4000-0x7FFF right now
+uint16_t mbc_regs_bank(const struct MbcRegs* regs);
+// The RAM bank showing at 0xA000-0xBFFF, or MBC_REGS_RAM_OFF if reads there float. That
+// covers RAM being disabled and MBC3 RTC registers, which aren't emulated
+int16_t mbc_regs_ram_bank(const struct MbcRegs* regs);
+#endif
@@ -1,19 +1,18 @@
 #include "no_mapper.h"
+#include "pico/platform.h"
 
-void no_mapper_memcpy_rom(uint8_t* dest, uint32_t rom_addr, uint32_t num){
-    for(uint16_t i = 0; i < num; i++){
-        dest[i] = readb(i + rom_addr);
-    }
+void __not_in_flash_func(no_mapper_memcpy_rom)(uint8_t* dest, uint32_t rom_addr, uint32_t num){
+    readbuf_rom(rom_addr, dest, num);
 }
 
-void no_mapper_memcpy_ram(uint8_t* dest, uint32_t ram_addr, uint32_t num){
+void __not_in_flash_func(no_mapper_memcpy_ram)(uint8_t* dest, uint32_t ram_addr, uint32_t num){
     for(uint32_t i = 0; i < num; i++){
-        dest[i] = readb(i + SRAM_START_ADDR); 
+        dest[i] = readb(ram_addr + i + SRAM_START_ADDR); 
     }
 }
 
-void no_mapper_memset_ram(uint8_t* buf, uint32_t ram_addr, uint32_t num){
+void __not_in_flash_func(no_mapper_memset_ram)(uint8_t* buf, uint32_t ram_addr, uint32_t num){
     for(uint32_t i = 0; i < num; i++){
-        writeb(buf[i], i + SRAM_START_ADDR);
+        writeb(buf[i], ram_addr + i + SRAM_START_ADDR);
     }
 }
\ No newline at end of file
@@ -0,0 +1,106 @@
+#include "metrics.h"
+#include "pico/stdlib.h"
+
+#include <stdio.h>
+#include <string.h>
+
+/*  - Private Variables -  */
+struct Metrics metrics = {0};
+char metrics_text[METRICS_FILE_MAX] = {0};
+uint32_t metrics_text_len = 0;
+// For the bus rate, which is over the time since the last render
+uint64_t metrics_last_render_us = 0;
+uint32_t metrics_last_bus_bytes = 0;
+
+/*  - Private Function Declarations -  */
+
+// Upper edge of the bucket pct percent of READ10s came in under
+uint32_t metrics_percentile(uint8_t pct);
+void metrics_render();
+
+/*  - Private Function Definitions -  */
+
+uint32_t metrics_percentile(uint8_t pct){
+    uint32_t count = metrics.read10_count;
+    if(!count){
+        return 0;
+    }
+    uint32_t target = ((count * pct) + 99) / 100;
+    uint32_t seen = 0;
+    for(uint8_t bucket = 0; bucket < (METRICS_LATENCY_BUCKETS - 1); bucket++){
+        seen += metrics.read10_latency[bucket];
+        // The bucket edge can be past the slowest one there's been
+        if(seen >= target){
+            return (2u << bucket) < metrics.read10_max_us ? (2u << bucket) : metrics.read10_max_us;
+        }
+    }
+    return metrics.read10_max_us;
+}
+
+void metrics_render(){
+    uint64_t now = time_us_64();
+    uint32_t bus_bytes = metrics.bus_bytes;
+    uint64_t elapsed = now - metrics_last_render_us;
+    uint32_t kbps = elapsed ? (((uint64_t) (bus_bytes - metrics_last_bus_bytes) * 1000000) / (elapsed * 1024)) : 0;
+    metrics_last_render_us = now;
+    metrics_last_bus_bytes = bus_bytes;
+    uint32_t lookups = metrics.cache_hits + metrics.cache_misses;
+    uint32_t hit_pct = lookups ? (((uint64_t) metrics.cache_hits * 100) / lookups) : 0;
+    // Fixed width throughout, so the length never changes
+    int len = snprintf(metrics_text, sizeof(metrics_text),
+        "{\n"
+        "  \"uptime_s\": %10lu,\n"
+        "  \"rom\": {\"read\": %10lu, \"written\": %10lu},\n"
+        "  \"ram\": {\"read\": %10lu, \"written\": %10lu},\n"
+        "  \"other\": {\"read\": %10lu, \"written\": %10lu},\n"
+        "  \"bus\": {\"bytes\": %10lu, \"kbps\": %10lu},\n"
+        "  \"bank_switches\": {\"issued\": %10lu, \"avoided\": %10lu},\n"
+        "  \"read10\": {\"count\": %10lu, \"p50_us\": %10lu, \"p90_us\": %10lu, \"p99_us\": %10lu, \"max_us\": %10lu},\n"
+        "  \"rom_cache\": {\"hits\": %10lu, \"misses\": %10lu, \"hit_pct\": %3lu},\n"
+        "  \"retries\": %10lu\n"
+        "}\n",
+        (unsigned long) (now / 1000000),
+        (unsigned long) metrics.read_bytes[METRICS_REGION_ROM], (unsigned long) metrics.write_bytes[METRICS_REGION_ROM],
+        (unsigned long) metrics.read_bytes[METRICS_REGION_RAM], (unsigned long) metrics.write_bytes[METRICS_REGION_RAM],
+        (unsigned long) metrics.read_bytes[METRICS_REGION_OTHER], (unsigned long) metrics.write_bytes[METRICS_REGION_OTHER],
+        (unsigned long) bus_bytes, (unsigned long) kbps,
+        (unsigned long) metrics.bank_switches, (unsigned long) metrics.bank_switches_avoided,
+        (unsigned long) metrics.read10_count, (unsigned long) metrics_percentile(50), (unsigned long) metrics_percentile(90),
+        (unsigned long) metrics_percentile(99), (unsigned long) metrics.read10_max_us,
+        (unsigned long) metrics.cache_hits, (unsigned long) metrics.cache_misses, (unsigned long) hit_pct,
+        (unsigned long) metrics.retries);
+    if(len < 0){
+        len = 0;
+    }
+    metrics_text_len = ((uint32_t) len < sizeof(metrics_text)) ? (uint32_t) len : sizeof(metrics_text) - 1;
+}
+
+/*  - Public Function Definitions -  */
+
+void metrics_read10_done(uint32_t latency_us){
+    uint8_t bucket = 0;
+    while((bucket < (METRICS_LATENCY_BUCKETS - 1)) && (latency_us >= (2u << bucket))){
+        bucket++;
+    }
+    METRICS_ADD(metrics.read10_latency[bucket], 1);
+    METRICS_ADD(metrics.read10_count, 1);
+    if(latency_us > metrics.read10_max_us){
+        metrics.read10_max_us = latency_us;
+    }
+}
+
+uint32_t metrics_file_size(){
+    if(!metrics_text_len){
+        metrics_render();
+    }
+    return metrics_text_len;
+}
+
+void metrics_read(uint8_t* dest, uint32_t offset, uint32_t num){
+    if(!offset || !metrics_text_len){
+        metrics_render();
+    }
+    for(uint32_t i = 0; i < num; i++){
+        dest[i] = (offset + i) < metrics_text_len ? metrics_text[offset + i] : 0;
+    }
+}
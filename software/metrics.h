@@ -0,0 +1,52 @@
+#ifndef METRICS_H_
+#define METRICS_H_
+
+#include <stdint.h>
+
+// METRICS.JSN on the drive, live counters rendered as JSON every time the host reads it from
+// the top. Every number is padded to the same width, so the file never changes size and the
+// root directory can be left alone. Poll it during a dump, reading around the page cache
+// (O_DIRECT, or drop it first like banksync.py does)
+
+// Which part of the drive a transfer was for
+#define METRICS_REGION_ROM      0 // ROM file or the raw ROM LUN
+#define METRICS_REGION_RAM      1 // Save file or the raw SRAM LUN
+#define METRICS_REGION_OTHER    2 // FAT, directory and the rest of the files
+#define METRICS_REGION_COUNT    3
+// READ10 latency buckets are powers of two, <2us up to <32768us, and one for everything past that
+#define METRICS_LATENCY_BUCKETS 15
+// Writes here are to the ROM and RAM bank registers on every mapper we know
+#define METRICS_BANK_REG_START  0x2000
+#define METRICS_BANK_REG_END    0x6000
+// Room for the rendered file, it's well under this
+#define METRICS_FILE_MAX        1024
+
+struct Metrics {
+    uint32_t read_bytes[METRICS_REGION_COUNT];
+    uint32_t write_bytes[METRICS_REGION_COUNT];
+    uint32_t bus_bytes;                     // Moved over the cart bus, either direction
+    uint32_t bank_switches;                 // ROM or RAM bank register writes
+    uint32_t bank_switches_avoided;         // Banks a ROM read would have switched to, had the cache not had it
+    uint32_t read10_count;
+    uint32_t read10_latency[METRICS_LATENCY_BUCKETS];
+    uint32_t read10_max_us;
+    uint32_t cache_hits;
+    uint32_t cache_misses;
+    uint32_t retries;                       // Reads read_verify had to do over
+};
+
+extern struct Metrics metrics;
+
+// Every counter has one writer: core 0 for the USB side, whichever core has the bus for the
+// bus side. So a relaxed load and store is enough, and on the M0+ that's a plain ldr and str
+// with no lock and no barrier. The host only ever sees a count a little behind
+#define METRICS_ADD(counter, n) __atomic_store_n(&(counter), __atomic_load_n(&(counter), __ATOMIC_RELAXED) + (n), __ATOMIC_RELAXED)
+
+// A READ10 finished, latency_us after its first callback
+void metrics_read10_done(uint32_t latency_us);
+// Size of METRICS.JSN
+uint32_t metrics_file_size();
+// Copy part of METRICS.JSN into dest. Reading from the start renders it fresh
+void metrics_read(uint8_t* dest, uint32_t offset, uint32_t num);
+
+#endif
@@ -0,0 +1,163 @@
+#include "read_verify.h"
+#include "bus_core.h"
+#include "cart.h"
+#include "gb.h"
+#include "disk/gb_disk.h"
+#include "metrics.h"
+#include "pico/platform.h"
+
+#include <stdio.h>
+#include <string.h>
+
+/*  - Private Variables -  */
+uint8_t read_verify_enabled = 0;
+// Second read of the block, to hold up against the first
+uint8_t __scratch_x("read_verify_buf") read_verify_buf[READ_VERIFY_BLOCK] = {0};
+// Where reads start from, raised by bad blocks and eased back by good ones
+uint8_t read_verify_slowdown = 0;
+uint32_t read_verify_clean_run = 0;
+uint32_t read_verify_blocks = 0;
+uint32_t read_verify_retried = 0;
+uint32_t read_verify_bad = 0;
+// A character a ROM bank, see read_verify.h
+char read_verify_map[READ_VERIFY_MAP_LINES * READ_VERIFY_MAP_BANKS] = {0};
+uint16_t read_verify_map_lines = 0;
+// Core 1 does the reads, core 0 owns the status file
+volatile uint8_t read_verify_dirty = 0;
+uint16_t read_verify_summary_offset = STATUS_LINE_NONE;
+uint16_t read_verify_map_offsets[READ_VERIFY_MAP_LINES] = {0};
+
+/*  - Private Function Declarations -  */
+
+// One read through the mapper, no checking
+void read_verify_raw(uint8_t space, uint8_t* dest, uint32_t addr, uint32_t num);
+// Read a block until two reads agree or there's no slower to go. Returns the slowdown it
+// took, or READ_VERIFY_MAX_SLOWDOWN + 1 if they never did
+uint8_t read_verify_block(uint8_t space, uint8_t* dest, uint32_t addr, uint32_t num);
+// Record how a ROM bank went, keeping the worst
+void read_verify_mark(uint32_t bank, uint8_t level);
+void read_verify_format_summary(char* line);
+void read_verify_format_map(uint16_t n, char* line);
+
+/*  - Private Function Definitions -  */
+
+void __not_in_flash_func(read_verify_raw)(uint8_t space, uint8_t* dest, uint32_t addr, uint32_t num){
+    if(space == BUS_SPACE_ROM){
+        (*the_cart.rom_memcpy_func)(dest, addr, num);
+    }
+    else{
+        (*the_cart.ram_memcpy_func)(dest, addr, num);
+    }
+}
+
+uint8_t __not_in_flash_func(read_verify_block)(uint8_t space, uint8_t* dest, uint32_t addr, uint32_t num){
+    uint8_t level = read_verify_slowdown;
+    while(1){
+        set_read_slowdown(level);
+        read_verify_raw(space, dest, addr, num);
+        read_verify_raw(space, read_verify_buf, addr, num);
+        if(!memcmp(dest, read_verify_buf, num)){
+            return level;
+        }
+        if(level >= READ_VERIFY_MAX_SLOWDOWN){
+            return READ_VERIFY_MAX_SLOWDOWN + 1;
+        }
+        level++;
+    }
+}
+
+void read_verify_mark(uint32_t bank, uint8_t level){
+    if(bank >= sizeof(read_verify_map)){
+        return;
+    }
+    char mark = level > READ_VERIFY_MAX_SLOWDOWN ? 'X' : ('0' + level);
+    // '.' < digits < 'X', so the worst one sticks
+    if(mark > read_verify_map[bank]){
+        read_verify_map[bank] = mark;
+    }
+}
+
+void read_verify_format_summary(char* line){
+    snprintf(line, STATUS_LINE_LEN + 1, "VERIFY %7lu BLK %5lu RTY %4lu BAD\n",
+        (unsigned long) read_verify_blocks, (unsigned long) read_verify_retried, (unsigned long) read_verify_bad);
+}
+
+void read_verify_format_map(uint16_t n, char* line){
+    snprintf(line, STATUS_LINE_LEN + 1, "VF %03u %.*s\n", n * READ_VERIFY_MAP_BANKS,
+        READ_VERIFY_MAP_BANKS, read_verify_map + (n * READ_VERIFY_MAP_BANKS));
+}
+
+/*  - Public Function Definitions -  */
+
+void init_read_verify(){
+    if(!the_cart.rom_memcpy_func){
+        return;
+    }
+    uint32_t banks = the_cart.rom_size_bytes / ROM_BANK_SIZE;
+    read_verify_map_lines = (banks + READ_VERIFY_MAP_BANKS - 1) / READ_VERIFY_MAP_BANKS;
+    if(read_verify_map_lines > READ_VERIFY_MAP_LINES){
+        read_verify_map_lines = READ_VERIFY_MAP_LINES;
+    }
+    // Banks the cart doesn't have stay blank
+    memset(read_verify_map, ' ', sizeof(read_verify_map));
+    memset(read_verify_map, '.', banks < sizeof(read_verify_map) ? banks : sizeof(read_verify_map));
+    char line[STATUS_LINE_LEN + 1];
+    read_verify_format_summary(line);
+    read_verify_summary_offset = reserve_status_line(line);
+    for(uint16_t n = 0; n < read_verify_map_lines; n++){
+        read_verify_format_map(n, line);
+        read_verify_map_offsets[n] = reserve_status_line(line);
+    }
+    read_verify_enabled = 1;
+}
+
+void read_verify_task(){
+    if(!read_verify_dirty){
+        return;
+    }
+    read_verify_dirty = 0;
+    char line[STATUS_LINE_LEN + 1];
+    read_verify_format_summary(line);
+    update_status_line(read_verify_summary_offset, line);
+    for(uint16_t n = 0; n < read_verify_map_lines; n++){
+        read_verify_format_map(n, line);
+        update_status_line(read_verify_map_offsets[n], line);
+    }
+}
+
+void __not_in_flash_func(read_verify_memcpy)(uint8_t space, uint8_t* dest, uint32_t addr, uint32_t num){
+    if(!read_verify_enabled){
+        read_verify_raw(space, dest, addr, num);
+        return;
+    }
+    while(num){
+        // Keep blocks aligned, so a block never spans two banks
+        uint32_t len = READ_VERIFY_BLOCK - (addr % READ_VERIFY_BLOCK);
+        if(len > num){
+            len = num;
+        }
+        uint8_t level = read_verify_block(space, dest, addr, len);
+        read_verify_blocks++;
+        if(level != read_verify_slowdown){
+            read_verify_retried++;
+            METRICS_ADD(metrics.retries, 1);
+            read_verify_bad += level > READ_VERIFY_MAX_SLOWDOWN;
+            if(space == BUS_SPACE_ROM){
+                read_verify_mark(addr / ROM_BANK_SIZE, level);
+            }
+            // Start from here for a while, bad spots tend to come together
+            read_verify_slowdown = level > READ_VERIFY_MAX_SLOWDOWN ? READ_VERIFY_MAX_SLOWDOWN : level;
+            read_verify_clean_run = 0;
+        }
+        else if(read_verify_slowdown && (++read_verify_clean_run >= READ_VERIFY_EASE_BLOCKS)){
+            read_verify_slowdown--;
+            read_verify_clean_run = 0;
+        }
+        read_verify_dirty = 1;
+        dest += len;
+        addr += len;
+        num -= len;
+    }
+    // Everything else on the bus goes full speed
+    set_read_slowdown(0);
+}
@@ -0,0 +1,32 @@
+#ifndef READ_VERIFY_H_
+#define READ_VERIFY_H_
+
+#include <stdint.h>
+
+// Verified reads for dirty carts. Every block of ROM or SRAM gets read twice, and if the two
+// don't agree it's read again with readb slowed down a step at a time until they do. The
+// slowdown sticks for a while after a bad block, then eases back off, so a cart with one
+// bad spot still dumps at full speed everywhere else.
+//
+// Which ROM banks needed it goes in the status file, a character a bank: '.' read fine the
+// first time, a digit is the slowdown it took, 'X' never agreed and has the last read in it.
+
+// Bytes compared at once. A mismatch only costs a re-read of this much
+#define READ_VERIFY_BLOCK           512
+// Slowest readb gets, in set_read_slowdown steps
+#define READ_VERIFY_MAX_SLOWDOWN    7
+// Clean blocks in a row before the slowdown drops back a step
+#define READ_VERIFY_EASE_BLOCKS     64
+// Banks a line of the map covers, and the most lines it can take
+#define READ_VERIFY_MAP_BANKS       32
+#define READ_VERIFY_MAP_LINES       16
+
+// Turn verified reads on and reserve the status file lines for the retry map
+void init_read_verify();
+// Copy the status lines over if anything changed. Call from the main loop on core 0
+void read_verify_task();
+// Read ROM or SRAM through the mapper like rom_memcpy_func and ram_memcpy_func, checking
+// every block once init_read_verify has run. space is BUS_SPACE_ROM or BUS_SPACE_RAM
+void read_verify_memcpy(uint8_t space, uint8_t* dest, uint32_t addr, uint32_t num);
+
+#endif
@@ -0,0 +1,377 @@
+#include "flash_layout.h"
+#include "rom_cache.h"
+#include "cart.h"
+#include "gb.h"
+#include "utils.h"
+#include "disk/gb_disk.h"
+#include "bus_core.h"
+#include "sched.h"
+#include "tusb.h"
+#include "pico/stdlib.h"
+#include "hardware/flash.h"
+#include "hardware/sync.h"
+
+#include <string.h>
+#include <stdio.h>
+
+// End of the firmware image, from the linker script
+extern char __flash_binary_end;
+
+/*  - Private Variables -  */
+uint8_t rom_cache_state = ROM_CACHE_OFF;
+// The entry we are serving from, or the one we are building during a capture
+struct RomCacheEntry rom_cache_entry = {0};
+// The cart header, kept around to check the global checksum at the end of a capture
+uint8_t rom_header[ROM_HEADER_LEN] = {0};
+// Where the next byte of the capture has to come from for it to stay sequential
+uint32_t capture_next_addr = 0;
+// Everything in the image below this has already been erased
+uint32_t capture_erased_bytes = 0;
+// Running totals over the captured image
+uint32_t capture_crc = CRC32_SEED;
+uint16_t capture_checksum = 0;
+// Flash can only be programmed in pages, so stage one sector worth of capture at a time
+uint8_t capture_sector_buf[FLASH_SECTOR_SIZE] = {0};
+// What the warm job reads into, and when it's allowed to start
+uint8_t warm_buf[ROM_CACHE_WARM_STEP] = {0};
+uint64_t warm_start_us = 0;
+
+/*  - Private Function Declarations -  */
+
+// Get an entry out of the index sector
+const struct RomCacheEntry* index_entry(uint32_t slot);
+// Write an entry to a slot in the index sector
+void index_program_entry(uint32_t slot, const struct RomCacheEntry* entry);
+// Mark an image as evicted. Only clears bits, so no erase is needed
+void index_invalidate(uint32_t slot);
+// Find a slot that has never been written, compacting the index if they are all used and
+// evicting the oldest image if they're all live
+uint32_t index_free_slot();
+// Pick a spot for a new image, evicting whatever is in the way
+uint32_t allocate_image(uint32_t size);
+// Compare a few lines from a few banks of the real cart against the cached image
+uint8_t spot_check(const struct RomCacheEntry* entry);
+// Find somewhere to put the image and start the capture over from the top
+void capture_begin();
+// Erase the next sector of the image. Each one holds interrupts off for tens of ms, so they
+// go one at a time
+void capture_erase_sector();
+// Flush the staged sector of the capture out to flash
+void capture_flush_sector(uint32_t image_offset, uint32_t len);
+// Finish up a capture, commit it to the index if it checks out
+void capture_finish();
+
+/*  - Private Function Definitions -  */
+
+const struct RomCacheEntry* index_entry(uint32_t slot){
+  return ((const struct RomCacheEntry*) FLASH_OFFSET_TO_XIP(ROM_CACHE_INDEX_OFFSET)) + slot;
+}
+
+void index_program_entry(uint32_t slot, const struct RomCacheEntry* entry){
+  uint8_t page[FLASH_PAGE_SIZE];
+  uint32_t entry_offset = ROM_CACHE_INDEX_OFFSET + (slot * sizeof(struct RomCacheEntry));
+  uint32_t page_offset = entry_offset & ~(FLASH_PAGE_SIZE - 1);
+  // Reprogram the whole page. Bytes we don't touch get programmed to what they already are
+  memcpy(page, FLASH_OFFSET_TO_XIP(page_offset), FLASH_PAGE_SIZE);
+  memcpy(page + (entry_offset - page_offset), entry, sizeof(struct RomCacheEntry));
+  bus_core_pause();
+  uint32_t ints = save_and_disable_interrupts();
+  flash_range_program(page_offset, page, FLASH_PAGE_SIZE);
+  restore_interrupts(ints);
+  bus_core_resume();
+}
+
+void index_invalidate(uint32_t slot){
+  struct RomCacheEntry entry = *index_entry(slot);
+  entry.state = 0;
+  index_program_entry(slot, &entry);
+}
+
+uint32_t index_free_slot(){
+  for(uint32_t slot = 0; slot < ROM_CACHE_INDEX_ENTRIES; slot++){
+    if(index_entry(slot)->magic != ROM_CACHE_MAGIC){
+      return slot;
+    }
+  }
+  // Every slot has been used at some point. Squash the live ones down to the start of the index
+  struct RomCacheEntry* live = (struct RomCacheEntry*) capture_sector_buf;
+  uint32_t num_live = 0;
+  for(uint32_t slot = 0; slot < ROM_CACHE_INDEX_ENTRIES; slot++){
+    if(index_entry(slot)->state == ROM_CACHE_STATE_VALID){
+      live[num_live] = *index_entry(slot);
+      num_live++;
+    }
+  }
+  // Every one of them is still live, so there'd be no slot left over. Evict the oldest
+  if(num_live == ROM_CACHE_INDEX_ENTRIES){
+    uint32_t oldest = 0;
+    for(uint32_t i = 1; i < num_live; i++){
+      if(live[i].sequence < live[oldest].sequence){
+        oldest = i;
+      }
+    }
+    num_live--;
+    live[oldest] = live[num_live];
+  }
+  memset(live + num_live, 0xFF, FLASH_SECTOR_SIZE - (num_live * sizeof(struct RomCacheEntry)));
+  bus_core_pause();
+  uint32_t ints = save_and_disable_interrupts();
+  flash_range_erase(ROM_CACHE_INDEX_OFFSET, FLASH_SECTOR_SIZE);
+  flash_range_program(ROM_CACHE_INDEX_OFFSET, capture_sector_buf, FLASH_SECTOR_SIZE);
+  restore_interrupts(ints);
+  bus_core_resume();
+  return num_live;
+}
+
+uint32_t allocate_image(uint32_t size){
+  // Images are written like a ring buffer, the new one goes right after the newest one
+  uint32_t offset = ROM_CACHE_DATA_START;
+  uint32_t newest_sequence = 0;
+  for(uint32_t slot = 0; slot < ROM_CACHE_INDEX_ENTRIES; slot++){
+    const struct RomCacheEntry* entry = index_entry(slot);
+    if((entry->magic == ROM_CACHE_MAGIC) && (entry->sequence >= newest_sequence)){
+      newest_sequence = entry->sequence;
+      offset = entry->offset + entry->size;
+    }
+  }
+  rom_cache_entry.sequence = newest_sequence + 1;
+  // Keep images block aligned so they can be erased a block at a time
+  offset = (offset + FLASH_BLOCK_SIZE - 1) & ~(FLASH_BLOCK_SIZE - 1);
+  // Wrap back around to the start once we run off the end of flash
+  if((offset + size) > FLASH_ROM_CACHE_END){
+    offset = ROM_CACHE_DATA_START;
+  }
+  // Evict anything that we are about to write over. Since we always write after the newest
+  // image, this is always the oldest stuff in the cache
+  for(uint32_t slot = 0; slot < ROM_CACHE_INDEX_ENTRIES; slot++){
+    const struct RomCacheEntry* entry = index_entry(slot);
+    if((entry->magic == ROM_CACHE_MAGIC) && (entry->state == ROM_CACHE_STATE_VALID) &&
+      (entry->offset < (offset + size)) && ((entry->offset + entry->size) > offset)){
+      index_invalidate(slot);
+    }
+  }
+  return offset;
+}
+
+uint8_t spot_check(const struct RomCacheEntry* entry){
+  uint8_t line[ROM_CACHE_SPOT_CHECK_LEN];
+  uint32_t num_banks = entry->size / ROM_BANK_SIZE;
+  for(uint32_t i = 0; i < ROM_CACHE_SPOT_CHECK_BANKS; i++){
+    // Spread the banks out over the whole ROM, always including the last one
+    uint32_t bank = ((i + 1) * (num_banks - 1)) / ROM_CACHE_SPOT_CHECK_BANKS;
+    for(uint32_t l = 0; l < ROM_CACHE_SPOT_CHECK_LINES; l++){
+      // Stagger the lines too, so different banks get checked in different spots
+      uint32_t rom_addr = (bank * ROM_BANK_SIZE) + ((((l * 2) + 1) * ROM_BANK_SIZE) / (ROM_CACHE_SPOT_CHECK_LINES * 2)) + (bank & 0xFF);
+      bus_read(BUS_SPACE_ROM, rom_addr, line, ROM_CACHE_SPOT_CHECK_LEN);
+      if(memcmp(line, FLASH_OFFSET_TO_XIP(entry->offset + rom_addr), ROM_CACHE_SPOT_CHECK_LEN)){
+        return 0;
+      }
+    }
+  }
+  return 1;
+}
+
+void capture_begin(){
+  rom_cache_entry.offset = allocate_image(rom_cache_entry.size);
+  capture_next_addr = 0;
+  capture_erased_bytes = 0;
+  capture_crc = CRC32_SEED;
+  capture_checksum = 0;
+}
+
+void capture_erase_sector(){
+  bus_core_pause();
+  uint32_t ints = save_and_disable_interrupts();
+  flash_range_erase(rom_cache_entry.offset + capture_erased_bytes, FLASH_SECTOR_SIZE);
+  restore_interrupts(ints);
+  bus_core_resume();
+  capture_erased_bytes += FLASH_SECTOR_SIZE;
+}
+
+void capture_flush_sector(uint32_t image_offset, uint32_t len){
+  uint32_t flash_offset = rom_cache_entry.offset + image_offset;
+  // The warm job erases ahead while USB is quiet. Only a host dump that gets here first
+  // has to erase on the spot
+  if(image_offset >= capture_erased_bytes){
+    capture_erase_sector();
+  }
+  // A page at a time, so interrupts never wait on more than one page program
+  len = (len + FLASH_PAGE_SIZE - 1) & ~(FLASH_PAGE_SIZE - 1);
+  bus_core_pause();
+  for(uint32_t page = 0; page < len; page += FLASH_PAGE_SIZE){
+    uint32_t ints = save_and_disable_interrupts();
+    flash_range_program(flash_offset + page, capture_sector_buf + page, FLASH_PAGE_SIZE);
+    restore_interrupts(ints);
+  }
+  bus_core_resume();
+}
+
+void capture_finish(){
+  rom_cache_entry.crc = capture_crc ^ 0xFFFFFFFF;
+  // The global checksum is the sum of every byte in the ROM except itself. If the dump
+  // adds up, every byte of it came off the cart right
+  uint16_t expected = (rom_header[ROM_GLOBAL_CHECKSUM_ADDR - ROM_HEADER_START_ADDR] << 8) |
+    rom_header[ROM_GLOBAL_CHECKSUM_ADDR - ROM_HEADER_START_ADDR + 1];
+  capture_checksum -= rom_header[ROM_GLOBAL_CHECKSUM_ADDR - ROM_HEADER_START_ADDR];
+  capture_checksum -= rom_header[ROM_GLOBAL_CHECKSUM_ADDR - ROM_HEADER_START_ADDR + 1];
+  if(capture_checksum != expected){
+    rom_cache_state = ROM_CACHE_IDLE;
+    return;
+  }
+  index_program_entry(index_free_slot(), &rom_cache_entry);
+  // The rest of this session can come straight from flash
+  rom_cache_state = ROM_CACHE_HIT;
+}
+
+/*  - Public Function Definitions -  */
+
+uint32_t rom_cache_fingerprint(){
+  readbuf(ROM_HEADER_START_ADDR, rom_header, ROM_HEADER_LEN);
+  return fnv1a_hash(rom_header, ROM_HEADER_LEN, FNV1A_SEED);
+}
+
+void init_rom_cache(){
+  rom_cache_state = ROM_CACHE_OFF;
+  if(!the_cart.rom_memcpy_func || !the_cart.rom_size_bytes){
+    append_status_file("ROM CACHE: SKIPPED\n\0");
+    return;
+  }
+  // Never write over the firmware if it ever outgrows its reserved space
+  if(((uint32_t) &__flash_binary_end - XIP_BASE) > FLASH_FIRMWARE_RESERVED){
+    append_status_file("ROM CACHE: NO SPACE\n\0");
+    return;
+  }
+  if((ROM_CACHE_DATA_START + the_cart.rom_size_bytes) > FLASH_ROM_CACHE_END){
+    append_status_file("ROM CACHE: TOO LARGE\n\0");
+    return;
+  }
+  uint32_t fingerprint = rom_cache_fingerprint();
+  for(uint32_t slot = 0; slot < ROM_CACHE_INDEX_ENTRIES; slot++){
+    const struct RomCacheEntry* entry = index_entry(slot);
+    if((entry->magic != ROM_CACHE_MAGIC) || (entry->state != ROM_CACHE_STATE_VALID) ||
+      (entry->fingerprint != fingerprint) || (entry->size != the_cart.rom_size_bytes)){
+      continue;
+    }
+    // Same header doesn't have to mean same ROM (bootlegs, hacks, repros). Make sure
+    if(spot_check(entry)){
+      rom_cache_entry = *entry;
+      rom_cache_state = ROM_CACHE_HIT;
+      append_status_file("ROM CACHE: HIT\n\0");
+      return;
+    }
+    index_invalidate(slot);
+    append_status_file("ROM CACHE: STALE, EVICTED\n\0");
+  }
+  // Not cached, set up to record the host's dump. Nothing gets touched until it starts
+  memset(&rom_cache_entry, 0xFF, sizeof(struct RomCacheEntry));
+  rom_cache_entry.magic = ROM_CACHE_MAGIC;
+  rom_cache_entry.state = ROM_CACHE_STATE_VALID;
+  rom_cache_entry.fingerprint = fingerprint;
+  rom_cache_entry.size = the_cart.rom_size_bytes;
+  rom_cache_entry.offset = 0;
+  capture_next_addr = 0;
+  rom_cache_state = ROM_CACHE_CAPTURING;
+  warm_start_us = time_us_64() + ROM_CACHE_WARM_DELAY_US;
+  append_status_file("ROM CACHE: MISS\n\0");
+}
+
+uint8_t rom_cache_read(uint8_t* dest, uint32_t rom_addr, uint32_t num){
+  if((rom_cache_state != ROM_CACHE_HIT) || ((rom_addr + num) > rom_cache_entry.size)){
+    return 0;
+  }
+  memcpy(dest, FLASH_OFFSET_TO_XIP(rom_cache_entry.offset + rom_addr), num);
+  return 1;
+}
+
+void rom_cache_capture(const uint8_t* buf, uint32_t rom_addr, uint32_t num){
+  if(rom_cache_state != ROM_CACHE_CAPTURING){
+    return;
+  }
+  // First read from the start, find somewhere to put the image
+  if((rom_addr == 0) && !rom_cache_entry.offset){
+    capture_begin();
+  }
+  // Already have this part, from the warm job or an earlier pass. Keep whatever is new
+  if(rom_addr < capture_next_addr){
+    if((rom_addr + num) <= capture_next_addr){
+      return;
+    }
+    buf += capture_next_addr - rom_addr;
+    num -= capture_next_addr - rom_addr;
+    rom_addr = capture_next_addr;
+  }
+  // Ahead of the capture. It only goes in order, the warm job will get here
+  if((rom_addr != capture_next_addr) || !rom_cache_entry.offset){
+    return;
+  }
+  for(uint32_t i = 0; i < num; i++){
+    capture_checksum += buf[i];
+  }
+  capture_crc = crc32_update(buf, num, capture_crc);
+  while(num){
+    uint32_t sector_offset = capture_next_addr % FLASH_SECTOR_SIZE;
+    uint32_t chunk = FLASH_SECTOR_SIZE - sector_offset;
+    if(chunk > num){
+      chunk = num;
+    }
+    memcpy(capture_sector_buf + sector_offset, buf, chunk);
+    capture_next_addr += chunk;
+    buf += chunk;
+    num -= chunk;
+    // Write out a full sector, or whatever is left at the end of the ROM
+    if(!(capture_next_addr % FLASH_SECTOR_SIZE) || (capture_next_addr >= rom_cache_entry.size)){
+      capture_flush_sector(capture_next_addr - (sector_offset + chunk), sector_offset + chunk);
+    }
+  }
+  if(capture_next_addr >= rom_cache_entry.size){
+    capture_finish();
+  }
+}
+
+uint8_t rom_cache_warm_step(){
+  if((rom_cache_state != ROM_CACHE_CAPTURING) || (time_us_64() < warm_start_us)){
+    return 0;
+  }
+  if(!rom_cache_entry.offset){
+    capture_begin();
+  }
+  // Erasing the sector this step lands in is a step of its own, and only happens if the
+  // host isn't already waiting
+  if(capture_next_addr >= capture_erased_bytes){
+    if(tud_task_event_ready()){
+      return 0;
+    }
+    capture_erase_sector();
+    return 1;
+  }
+  uint32_t len = rom_cache_entry.size - capture_next_addr;
+  if(len > ROM_CACHE_WARM_STEP){
+    len = ROM_CACHE_WARM_STEP;
+  }
+  uint32_t addr = capture_next_addr;
+  bus_read(BUS_SPACE_ROM, addr, warm_buf, len);
+  rom_cache_capture(warm_buf, addr, len);
+  return 1;
+}
+
+uint8_t rom_cache_progress(){
+  if(rom_cache_state == ROM_CACHE_HIT){
+    return 100;
+  }
+  if((rom_cache_state != ROM_CACHE_CAPTURING) || !rom_cache_entry.size){
+    return SCHED_PROGRESS_NONE;
+  }
+  return ((uint64_t) capture_next_addr * 100) / rom_cache_entry.size;
+}
+
+const struct RomCacheEntry* rom_cache_newest(){
+  const struct RomCacheEntry* newest = NULL;
+  for(uint32_t slot = 0; slot < ROM_CACHE_INDEX_ENTRIES; slot++){
+    const struct RomCacheEntry* entry = index_entry(slot);
+    if((entry->magic == ROM_CACHE_MAGIC) && (entry->state == ROM_CACHE_STATE_VALID) &&
+      (!newest || (entry->sequence > newest->sequence))){
+      newest = entry;
+    }
+  }
+  return newest;
+}
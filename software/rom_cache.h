@@ -0,0 +1,66 @@
+#ifndef ROM_CACHE_H_
+#define ROM_CACHE_H_
+
+#include <stdint.h>
+
+// Keeps verified ROM dumps in the spare QSPI flash so a cart that has been dumped once
+// gets served straight out of XIP flash the next time it is plugged in
+
+#define ROM_CACHE_MAGIC             0x43524247 // "GBRC"
+#define ROM_CACHE_STATE_VALID       0x0000FFFF // Cleared to 0 when the image gets evicted
+// The index takes the first sector of the cache, images are block aligned after that
+#define ROM_CACHE_INDEX_OFFSET      FLASH_ROM_CACHE_START
+#define ROM_CACHE_DATA_START        (FLASH_ROM_CACHE_START + FLASH_BLOCK_SIZE)
+#define ROM_CACHE_INDEX_ENTRIES     (FLASH_SECTOR_SIZE / sizeof(struct RomCacheEntry))
+// The cart header that gets hashed into the fingerprint
+#define ROM_HEADER_START_ADDR       0x100
+#define ROM_HEADER_LEN              0x50
+#define ROM_GLOBAL_CHECKSUM_ADDR    0x14E
+// How much of the real cart to compare against a cached image before trusting it
+#define ROM_CACHE_SPOT_CHECK_BANKS  4
+#define ROM_CACHE_SPOT_CHECK_LINES  4
+#define ROM_CACHE_SPOT_CHECK_LEN    16
+// Bytes the warm job reads off the cart a step
+#define ROM_CACHE_WARM_STEP         1024
+// The warm job holds off this long after init, so it isn't erasing flash while the host enumerates
+#define ROM_CACHE_WARM_DELAY_US     5000000
+
+enum {
+  ROM_CACHE_OFF       = 0, // Cache can't be used for this cart
+  ROM_CACHE_HIT       = 1, // Serving the ROM out of flash
+  ROM_CACHE_CAPTURING = 2, // Recording the host's dump, or the warm job's reads, into flash
+  ROM_CACHE_IDLE      = 3  // Miss, and the capture was abandoned
+};
+
+// One slot in the index sector. 32 bytes so entries never straddle a flash page
+struct RomCacheEntry {
+   uint32_t magic;       // ROM_CACHE_MAGIC once this slot has been written
+   uint32_t state;       // ROM_CACHE_STATE_VALID until evicted
+   uint32_t fingerprint; // Hash of the cart header
+   uint32_t offset;      // Flash offset of the image
+   uint32_t size;        // Size of the image in bytes
+   uint32_t crc;         // CRC32 of the whole image
+   uint32_t sequence;    // Goes up with every image stored. Oldest image gets evicted first
+   uint32_t reserved;
+};
+
+extern uint8_t rom_cache_state;
+
+// Hash the cart header into something we can look the cart up by
+uint32_t rom_cache_fingerprint();
+// Look the current cart up in the cache and spot check it against the real cart
+void init_rom_cache();
+// Copy ROM out of the cache. Returns 0 if the cache can't serve this read
+uint8_t rom_cache_read(uint8_t* dest, uint32_t rom_addr, uint32_t num);
+// Feed data the host just read off the cart into the cache
+void rom_cache_capture(const uint8_t* buf, uint32_t rom_addr, uint32_t num);
+// Background job for sched. On a miss, reads the cart into the cache a step at a time, so
+// the next time it is plugged in it's a hit even if the host never dumped it. Returns 1 if
+// it read something
+uint8_t rom_cache_warm_step();
+// How much of the ROM is in the cache, 0-100
+uint8_t rom_cache_progress();
+// The image cached most recently, NULL if there aren't any
+const struct RomCacheEntry* rom_cache_newest();
+
+#endif
@@ -0,0 +1,359 @@
+#include "save_snapshots.h"
+#include "rom_cache.h"
+#include "cart.h"
+#include "gb.h"
+#include "utils.h"
+#include "disk/gb_disk.h"
+#include "bus_core.h"
+#include "pico/stdlib.h"
+#include "hardware/flash.h"
+#include "hardware/sync.h"
+
+#include <assert.h>
+#include <string.h>
+#include <stdio.h>
+
+static_assert(sizeof(struct SaveManifest) <= SAVE_MANIFEST_PROGRAM_SIZE, "SaveManifest does not fit in its program size");
+static_assert((SAVE_CHUNKS_PER_HALF * sizeof(uint32_t)) <= FLASH_SECTOR_SIZE, "Chunk hashes do not fit in one sector");
+
+/*  - Private Variables -  */
+// Which half of the store is live
+uint8_t active_half = 0;
+uint32_t active_generation = 0;
+// Fingerprint of the cart that is plugged in
+uint32_t cart_fingerprint = 0;
+// Manifest slots in the live half that belong to this cart, oldest first
+uint8_t cart_manifests[SAVE_MANIFESTS_PER_HALF] = {0};
+uint8_t num_cart_manifests = 0;
+// Chunks need to be in RAM while flash is being programmed, since XIP is off during that
+uint8_t chunk_buf[SAVE_CHUNK_SIZE] = {0};
+// Manifest being built, padded out so it can be programmed in whole pages
+uint8_t manifest_buf[SAVE_MANIFEST_PROGRAM_SIZE] = {0};
+
+/*  - Private Function Declarations -  */
+
+// Flash offset of one half of the store
+uint32_t half_offset(uint8_t half);
+const struct SaveHalfHeader* half_header(uint8_t half);
+const uint32_t* half_hashes(uint8_t half);
+const struct SaveManifest* half_manifest(uint8_t half, uint8_t slot);
+const uint8_t* half_chunk(uint8_t half, uint16_t slot);
+// Erase a half, leaving its header blank so it can't be taken for the live half
+void erase_half(uint8_t half);
+// Stamp a half with a generation, which makes it the live half
+void stamp_half(uint8_t half, uint32_t generation);
+// Program a few bytes without disturbing the rest of their page
+void program_bytes(uint32_t offset, const void* data, uint32_t len);
+// Store a chunk in a half, reusing an identical chunk if there is one. Returns the slot
+uint16_t store_chunk(uint8_t half, const uint8_t* data, uint32_t hash);
+// Store a manifest in the next free slot of a half. Returns 0 if the half is full
+uint8_t store_manifest(uint8_t half, const struct SaveManifest* manifest);
+// How many chunk slots and manifest slots are still free in a half
+uint16_t free_chunk_slots(uint8_t half);
+uint8_t free_manifest_slots(uint8_t half);
+// Copy the newest snapshots into the other half and make it the live one, leaving room for some chunks
+void compact_store(uint16_t chunks_needed);
+// Rebuild the list of snapshots that belong to this cart
+void find_cart_manifests();
+
+/*  - Private Function Definitions -  */
+
+uint32_t half_offset(uint8_t half){
+  return FLASH_SAVE_STORE_START + (half * FLASH_SAVE_STORE_HALF_SIZE);
+}
+
+const struct SaveHalfHeader* half_header(uint8_t half){
+  return (const struct SaveHalfHeader*) FLASH_OFFSET_TO_XIP(half_offset(half) + SAVE_HALF_HEADER_OFFSET);
+}
+
+const uint32_t* half_hashes(uint8_t half){
+  return (const uint32_t*) FLASH_OFFSET_TO_XIP(half_offset(half) + SAVE_HALF_HASHES_OFFSET);
+}
+
+const struct SaveManifest* half_manifest(uint8_t half, uint8_t slot){
+  return (const struct SaveManifest*) FLASH_OFFSET_TO_XIP(half_offset(half) + SAVE_HALF_MANIFESTS_OFFSET + (slot * SAVE_MANIFEST_SIZE));
+}
+
+const uint8_t* half_chunk(uint8_t half, uint16_t slot){
+  return FLASH_OFFSET_TO_XIP(half_offset(half) + SAVE_HALF_CHUNKS_OFFSET + (slot * SAVE_CHUNK_SIZE));
+}
+
+void erase_half(uint8_t half){
+  bus_core_pause();
+  uint32_t ints = save_and_disable_interrupts();
+  flash_range_erase(half_offset(half), FLASH_SAVE_STORE_HALF_SIZE);
+  restore_interrupts(ints);
+  bus_core_resume();
+}
+
+void stamp_half(uint8_t half, uint32_t generation){
+  struct SaveHalfHeader header = {SAVE_STORE_MAGIC, generation};
+  program_bytes(half_offset(half) + SAVE_HALF_HEADER_OFFSET, &header, sizeof(header));
+}
+
+void program_bytes(uint32_t offset, const void* data, uint32_t len){
+  uint8_t page[FLASH_PAGE_SIZE];
+  uint32_t page_offset = offset & ~(FLASH_PAGE_SIZE - 1);
+  // Everything else in the page gets programmed to what it already is, which changes nothing
+  memcpy(page, FLASH_OFFSET_TO_XIP(page_offset), FLASH_PAGE_SIZE);
+  memcpy(page + (offset - page_offset), data, len);
+  bus_core_pause();
+  uint32_t ints = save_and_disable_interrupts();
+  flash_range_program(page_offset, page, FLASH_PAGE_SIZE);
+  restore_interrupts(ints);
+  bus_core_resume();
+}
+
+uint16_t store_chunk(uint8_t half, const uint8_t* data, uint32_t hash){
+  const uint32_t* hashes = half_hashes(half);
+  uint16_t slot = 0;
+  // Slots fill up in order, so the first empty one is the end of the used ones
+  for(; slot < SAVE_CHUNKS_PER_HALF; slot++){
+    if(hashes[slot] == SAVE_EMPTY_HASH){
+      break;
+    }
+    // Already have this exact chunk, point at it instead of writing it again
+    if((hashes[slot] == hash) && !memcmp(half_chunk(half, slot), data, SAVE_CHUNK_SIZE)){
+      return slot;
+    }
+  }
+  if(slot >= SAVE_CHUNKS_PER_HALF){
+    return SAVE_NO_SLOT;
+  }
+  // Data first, then the hash that marks the slot as used
+  bus_core_pause();
+  uint32_t ints = save_and_disable_interrupts();
+  flash_range_program(half_offset(half) + SAVE_HALF_CHUNKS_OFFSET + (slot * SAVE_CHUNK_SIZE), data, SAVE_CHUNK_SIZE);
+  restore_interrupts(ints);
+  bus_core_resume();
+  program_bytes(half_offset(half) + SAVE_HALF_HASHES_OFFSET + (slot * sizeof(uint32_t)), &hash, sizeof(uint32_t));
+  return slot;
+}
+
+uint8_t store_manifest(uint8_t half, const struct SaveManifest* manifest){
+  for(uint8_t slot = 0; slot < SAVE_MANIFESTS_PER_HALF; slot++){
+    if(half_manifest(half, slot)->magic != SAVE_STORE_MAGIC){
+      memset(manifest_buf, 0xFF, SAVE_MANIFEST_PROGRAM_SIZE);
+      memcpy(manifest_buf, manifest, sizeof(struct SaveManifest));
+      bus_core_pause();
+      uint32_t ints = save_and_disable_interrupts();
+      flash_range_program(half_offset(half) + SAVE_HALF_MANIFESTS_OFFSET + (slot * SAVE_MANIFEST_SIZE), manifest_buf, SAVE_MANIFEST_PROGRAM_SIZE);
+      restore_interrupts(ints);
+      bus_core_resume();
+      return 1;
+    }
+  }
+  return 0;
+}
+
+uint16_t free_chunk_slots(uint8_t half){
+  const uint32_t* hashes = half_hashes(half);
+  for(uint16_t slot = 0; slot < SAVE_CHUNKS_PER_HALF; slot++){
+    if(hashes[slot] == SAVE_EMPTY_HASH){
+      return SAVE_CHUNKS_PER_HALF - slot;
+    }
+  }
+  return 0;
+}
+
+uint8_t free_manifest_slots(uint8_t half){
+  uint8_t num_free = 0;
+  for(uint8_t slot = 0; slot < SAVE_MANIFESTS_PER_HALF; slot++){
+    if(half_manifest(half, slot)->magic != SAVE_STORE_MAGIC){
+      num_free++;
+    }
+  }
+  return num_free;
+}
+
+void compact_store(uint16_t chunks_needed){
+  uint8_t old_half = active_half;
+  uint8_t new_half = !active_half;
+  // Work out which snapshots to keep, newest first, as long as they still fit
+  uint8_t keep[SAVE_MANIFESTS_PER_HALF];
+  uint8_t num_keep = 0;
+  // Chunks shared between snapshots only get copied once, so keep track of which ones are taken
+  static uint8_t kept_slots[(SAVE_CHUNKS_PER_HALF + 7) / 8];
+  memset(kept_slots, 0, sizeof(kept_slots));
+  uint32_t kept_chunks = 0;
+  uint32_t newer_than = 0xFFFFFFFF;
+  while(num_keep < SAVE_GC_KEEP_MANIFESTS){
+    uint8_t newest = SAVE_MANIFESTS_PER_HALF;
+    for(uint8_t slot = 0; slot < SAVE_MANIFESTS_PER_HALF; slot++){
+      const struct SaveManifest* manifest = half_manifest(old_half, slot);
+      if((manifest->magic == SAVE_STORE_MAGIC) && (manifest->sequence < newer_than) &&
+        ((newest == SAVE_MANIFESTS_PER_HALF) || (manifest->sequence > half_manifest(old_half, newest)->sequence))){
+        newest = slot;
+      }
+    }
+    if(newest == SAVE_MANIFESTS_PER_HALF){
+      break;
+    }
+    const struct SaveManifest* candidate = half_manifest(old_half, newest);
+    uint32_t new_chunks = 0;
+    for(uint16_t c = 0; c < candidate->num_chunks; c++){
+      uint16_t slot = candidate->chunks[c];
+      if(!(kept_slots[slot / 8] & (1 << (slot % 8)))){
+        new_chunks++;
+      }
+    }
+    // Stop once keeping any more would not leave room for the snapshot being taken
+    if((kept_chunks + new_chunks + chunks_needed) > SAVE_CHUNKS_PER_HALF){
+      break;
+    }
+    for(uint16_t c = 0; c < candidate->num_chunks; c++){
+      uint16_t slot = candidate->chunks[c];
+      kept_slots[slot / 8] |= (1 << (slot % 8));
+    }
+    kept_chunks += new_chunks;
+    newer_than = half_manifest(old_half, newest)->sequence;
+    keep[num_keep] = newest;
+    num_keep++;
+  }
+  // The new half stays unstamped until everything is in it. Lose power part way and the old
+  // half is still the live one, with all of its history
+  erase_half(new_half);
+  // Copy them over oldest first so the new half stays in sequence order
+  static struct SaveManifest copy;
+  while(num_keep){
+    num_keep--;
+    copy = *half_manifest(old_half, keep[num_keep]);
+    for(uint16_t c = 0; c < copy.num_chunks; c++){
+      uint16_t old_slot = copy.chunks[c];
+      memcpy(chunk_buf, half_chunk(old_half, old_slot), SAVE_CHUNK_SIZE);
+      copy.chunks[c] = store_chunk(new_half, chunk_buf, half_hashes(old_half)[old_slot]);
+    }
+    store_manifest(new_half, &copy);
+  }
+  stamp_half(new_half, active_generation + 1);
+  active_half = new_half;
+  active_generation++;
+  find_cart_manifests();
+}
+
+void find_cart_manifests(){
+  num_cart_manifests = 0;
+  // Manifests are always stored in sequence order within a half, so slot order is age order
+  for(uint8_t slot = 0; slot < SAVE_MANIFESTS_PER_HALF; slot++){
+    const struct SaveManifest* manifest = half_manifest(active_half, slot);
+    if((manifest->magic == SAVE_STORE_MAGIC) && (manifest->fingerprint == cart_fingerprint)){
+      cart_manifests[num_cart_manifests] = slot;
+      num_cart_manifests++;
+    }
+  }
+}
+
+/*  - Public Function Definitions -  */
+
+void init_save_snapshots(){
+  // The live half is whichever one has the newest generation
+  active_half = 0;
+  active_generation = 0;
+  for(uint8_t half = 0; half < 2; half++){
+    const struct SaveHalfHeader* header = half_header(half);
+    if((header->magic == SAVE_STORE_MAGIC) && (header->generation >= active_generation)){
+      active_half = half;
+      active_generation = header->generation;
+    }
+  }
+  // Fresh flash, set up the first half
+  if(!active_generation){
+    active_generation = 1;
+    erase_half(active_half);
+    stamp_half(active_half, active_generation);
+  }
+  cart_fingerprint = rom_cache_fingerprint();
+  find_cart_manifests();
+  char line[32];
+  snprintf(line, sizeof(line), "SAVE SNAPSHOTS: %i\n", num_cart_manifests);
+  append_status_file_buf(line);
+}
+
+uint8_t save_snapshot_take(){
+  // Store was never set up
+  if(!active_generation){
+    return 0;
+  }
+  if(!the_cart.ram_memcpy_func || !the_cart.ram_size_bytes || (the_cart.ram_size_bytes > SAVE_MAX_SIZE)){
+    return 0;
+  }
+  uint16_t num_chunks = (the_cart.ram_size_bytes + SAVE_CHUNK_SIZE - 1) / SAVE_CHUNK_SIZE;
+  // Make room up front, assuming every chunk is new. Compaction copies flash to flash,
+  // so it's slow, but it only happens once in a long while
+  if((free_chunk_slots(active_half) < num_chunks) || !free_manifest_slots(active_half)){
+    compact_store(num_chunks);
+    if((free_chunk_slots(active_half) < num_chunks) || !free_manifest_slots(active_half)){
+      return 0;
+    }
+  }
+  static struct SaveManifest manifest;
+  memset(&manifest, 0xFF, sizeof(manifest));
+  manifest.magic = SAVE_STORE_MAGIC;
+  manifest.fingerprint = cart_fingerprint;
+  manifest.size = the_cart.ram_size_bytes;
+  manifest.num_chunks = num_chunks;
+  memcpy(manifest.title, the_cart.title, sizeof(manifest.title));
+  manifest.version = 1;
+  manifest.sequence = 1;
+  // Count up from the newest snapshot in the store, and the newest one of this cart
+  for(uint8_t slot = 0; slot < SAVE_MANIFESTS_PER_HALF; slot++){
+    const struct SaveManifest* other = half_manifest(active_half, slot);
+    if((other->magic == SAVE_STORE_MAGIC) && (other->sequence >= manifest.sequence)){
+      manifest.sequence = other->sequence + 1;
+    }
+  }
+  const struct SaveManifest* newest = NULL;
+  if(num_cart_manifests){
+    newest = half_manifest(active_half, cart_manifests[num_cart_manifests - 1]);
+    manifest.version = newest->version + 1;
+  }
+  uint8_t changed = !newest || (newest->size != manifest.size);
+  for(uint16_t c = 0; c < num_chunks; c++){
+    uint32_t save_addr = c * SAVE_CHUNK_SIZE;
+    uint32_t len = the_cart.ram_size_bytes - save_addr;
+    if(len > SAVE_CHUNK_SIZE){
+      len = SAVE_CHUNK_SIZE;
+    }
+    // The tail of a short last chunk is always zeros so it hashes the same every time
+    memset(chunk_buf, 0, SAVE_CHUNK_SIZE);
+    bus_read(BUS_SPACE_RAM, save_addr, chunk_buf, len);
+    uint32_t hash = fnv1a_hash(chunk_buf, SAVE_CHUNK_SIZE, FNV1A_SEED);
+    if(hash == SAVE_EMPTY_HASH){
+      hash--;
+    }
+    manifest.chunks[c] = store_chunk(active_half, chunk_buf, hash);
+    if(!changed && (newest->chunks[c] != manifest.chunks[c])){
+      changed = 1;
+    }
+  }
+  // Same save as last time, no need for another copy of it
+  if(!changed){
+    return 0;
+  }
+  store_manifest(active_half, &manifest);
+  find_cart_manifests();
+  return 1;
+}
+
+uint8_t save_snapshot_count(){
+  return num_cart_manifests;
+}
+
+const struct SaveManifest* save_snapshot_get(uint8_t index){
+  if(index >= num_cart_manifests){
+    return NULL;
+  }
+  return half_manifest(active_half, cart_manifests[index]);
+}
+
+void save_snapshot_read(uint8_t* dest, uint8_t index, uint32_t save_addr, uint32_t num){
+  const struct SaveManifest* manifest = save_snapshot_get(index);
+  for(uint32_t i = 0; i < num; i++){
+    uint32_t addr = save_addr + i;
+    if(!manifest || (addr >= manifest->size)){
+      dest[i] = 0;
+      continue;
+    }
+    dest[i] = half_chunk(active_half, manifest->chunks[addr / SAVE_CHUNK_SIZE])[addr % SAVE_CHUNK_SIZE];
+  }
+}
@@ -0,0 +1,61 @@
+#ifndef SAVE_SNAPSHOTS_H_
+#define SAVE_SNAPSHOTS_H_
+
+#include <stdint.h>
+#include "flash_layout.h"
+
+// Keeps a history of the cart's save in flash so that restoring a save over USB can
+// always be undone. Saves are split into chunks and only chunks that have not been
+// seen before get written, so a snapshot costs about as much as the bytes that changed
+
+#define SAVE_STORE_MAGIC            0x53564247 // "GBVS"
+#define SAVE_CHUNK_SIZE             512
+#define SAVE_MAX_SIZE               (128 * 1024)
+#define SAVE_MAX_CHUNKS             (SAVE_MAX_SIZE / SAVE_CHUNK_SIZE)
+#define SAVE_NO_SLOT                0xFFFF
+// Hashes that are all 1s look like an empty slot, so they get nudged
+#define SAVE_EMPTY_HASH             0xFFFFFFFF
+
+// Each half of the store: a header sector, a sector of chunk hashes, the manifests, then chunks
+#define SAVE_MANIFEST_SIZE          1024
+#define SAVE_MANIFEST_PROGRAM_SIZE  768 // sizeof(struct SaveManifest) rounded up to a page
+#define SAVE_MANIFESTS_PER_HALF     32
+#define SAVE_HALF_HEADER_OFFSET     0
+#define SAVE_HALF_HASHES_OFFSET     FLASH_SECTOR_SIZE
+#define SAVE_HALF_MANIFESTS_OFFSET  (FLASH_SECTOR_SIZE * 2)
+#define SAVE_HALF_CHUNKS_OFFSET     (SAVE_HALF_MANIFESTS_OFFSET + (SAVE_MANIFESTS_PER_HALF * SAVE_MANIFEST_SIZE))
+#define SAVE_CHUNKS_PER_HALF        ((FLASH_SAVE_STORE_HALF_SIZE - SAVE_HALF_CHUNKS_OFFSET) / SAVE_CHUNK_SIZE)
+// How many snapshots survive a compaction
+#define SAVE_GC_KEEP_MANIFESTS      (SAVE_MANIFESTS_PER_HALF / 2)
+
+// Snapshot files are named <first 4 chars of title>_NNN.SAV
+#define SAVE_SNAPSHOT_TITLE_LEN     4
+
+struct SaveManifest {
+   uint32_t magic;       // SAVE_STORE_MAGIC once written
+   uint32_t fingerprint; // Cart header fingerprint, same one the ROM cache uses
+   uint32_t size;        // Size of the save in bytes
+   uint32_t sequence;    // Goes up with every snapshot in the store
+   uint16_t version;     // Goes up with every snapshot of this cart, the NNN in the file name
+   uint16_t num_chunks;
+   char title[12];
+   uint16_t chunks[SAVE_MAX_CHUNKS]; // Chunk slot for every SAVE_CHUNK_SIZE bytes of the save
+};
+
+struct SaveHalfHeader {
+   uint32_t magic;
+   uint32_t generation; // Half with the highest generation is the live one
+};
+
+// Find the live half of the store and the snapshots that belong to this cart
+void init_save_snapshots();
+// Snapshot whatever is in SRAM right now. Returns 1 if a new snapshot was stored
+uint8_t save_snapshot_take();
+// How many snapshots there are of this cart
+uint8_t save_snapshot_count();
+// Get a snapshot of this cart, oldest first
+const struct SaveManifest* save_snapshot_get(uint8_t index);
+// Rebuild part of a snapshot from its chunks
+void save_snapshot_read(uint8_t* dest, uint8_t index, uint32_t save_addr, uint32_t num);
+
+#endif
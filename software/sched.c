@@ -0,0 +1,115 @@
+#include "sched.h"
+#include "disk/gb_disk.h"
+#include "disk/msc_disk.h"
+#include "pico/stdlib.h"
+#include "tusb.h"
+
+#include <stdio.h>
+
+struct SchedJob {
+    const char* name;
+    sched_step_func step;
+    sched_progress_func progress;
+    uint32_t busy_us;   // Time spent in its steps, all told
+    uint16_t line_offset;
+};
+
+/*  - Private Variables -  */
+sched_task_func sched_tasks[SCHED_MAX_TASKS] = {0};
+uint8_t sched_task_count = 0;
+struct SchedJob sched_jobs[SCHED_MAX_JOBS] = {0};
+uint8_t sched_job_count = 0;
+// Job that gets first go next pass, so one that always has work can't starve the rest
+uint8_t sched_next_job = 0;
+uint64_t sched_stats_last_us = 0;
+
+/*  - Private Function Declarations -  */
+
+// Give one job with work a slice. Returns 1 if any job did something
+uint8_t sched_run_jobs();
+void sched_format_line(struct SchedJob* job, char* line);
+void sched_update_lines();
+
+/*  - Private Function Definitions -  */
+
+uint8_t sched_run_jobs(){
+    for(uint8_t i = 0; i < sched_job_count; i++){
+        struct SchedJob* job = &sched_jobs[(sched_next_job + i) % sched_job_count];
+        uint64_t start = time_us_64();
+        if(!job->step()){
+            continue;
+        }
+        // Keep going until the slice is up, the job runs dry, or the host wants something
+        while(((time_us_64() - start) < SCHED_SLICE_US) && !tud_task_event_ready() && job->step()){
+        }
+        job->busy_us += time_us_64() - start;
+        sched_next_job = (sched_next_job + i + 1) % sched_job_count;
+        return 1;
+    }
+    return 0;
+}
+
+void sched_format_line(struct SchedJob* job, char* line){
+    uint8_t progress = job->progress ? job->progress() : SCHED_PROGRESS_NONE;
+    if(progress == SCHED_PROGRESS_NONE){
+        snprintf(line, STATUS_LINE_LEN + 1, "JOB %-5s  --%% %10luus\n", job->name, (unsigned long) job->busy_us);
+    }
+    else{
+        snprintf(line, STATUS_LINE_LEN + 1, "JOB %-5s %3u%% %10luus\n", job->name, progress, (unsigned long) job->busy_us);
+    }
+}
+
+void sched_update_lines(){
+    uint64_t now = time_us_64();
+    if((now - sched_stats_last_us) < 1000000){
+        return;
+    }
+    sched_stats_last_us = now;
+    char line[STATUS_LINE_LEN + 1];
+    for(uint8_t i = 0; i < sched_job_count; i++){
+        sched_format_line(&sched_jobs[i], line);
+        update_status_line(sched_jobs[i].line_offset, line);
+    }
+}
+
+/*  - Public Function Definitions -  */
+
+void sched_add_task(sched_task_func task){
+    if(sched_task_count < SCHED_MAX_TASKS){
+        sched_tasks[sched_task_count++] = task;
+    }
+}
+
+void sched_add_job(const char* name, sched_step_func step, sched_progress_func progress){
+    if(sched_job_count >= SCHED_MAX_JOBS){
+        return;
+    }
+    struct SchedJob* job = &sched_jobs[sched_job_count++];
+    job->name = name;
+    job->step = step;
+    job->progress = progress;
+    job->busy_us = 0;
+    // Fixed width so it can be rewritten in place
+    char line[STATUS_LINE_LEN + 1];
+    sched_format_line(job, line);
+    job->line_offset = reserve_status_line(line);
+}
+
+void sched_run(){
+    while(1){
+        tud_task();
+        for(uint8_t i = 0; i < sched_task_count; i++){
+            sched_tasks[i]();
+        }
+        sched_update_lines();
+        if(tud_task_event_ready()){
+            continue;
+        }
+        if(sched_run_jobs()){
+            continue;
+        }
+        best_effort_wfe_or_timeout(make_timeout_time_us(SCHED_IDLE_US));
+        // tud_task would have run as soon as USB wanted it, so the sleep isn't latency
+        msc_latency_idle();
+    }
+}
@@ -0,0 +1,35 @@
+#ifndef SCHED_H_
+#define SCHED_H_
+
+#include <stdint.h>
+
+// The main loop. USB comes first: tud_task runs at the top of every pass, then the tasks,
+// which are short and run every pass. Background jobs only get a turn when TinyUSB has
+// nothing queued, one job a pass, and give the core back after SCHED_SLICE_US or as soon
+// as USB wants it. With nothing to do the core sleeps in WFE until an interrupt, core 1
+// finishing a command, or SCHED_IDLE_US, whichever is first.
+// Each job gets a status file line with its progress and how much time it has had
+
+#define SCHED_MAX_TASKS     8
+#define SCHED_MAX_JOBS      4
+// Longest a background job keeps the core in one go. A single step can go over
+#define SCHED_SLICE_US      1000
+// Longest the core sleeps with nothing pending, so the tasks that poll on a timer still get to
+#define SCHED_IDLE_US       1000
+// Progress a job returns when it can't say
+#define SCHED_PROGRESS_NONE 0xFF
+
+// Run once a pass, right after tud_task
+typedef void (*sched_task_func)();
+// Do one step of a background job. Returns 1 if it got something done and might have more
+typedef uint8_t (*sched_step_func)();
+// How far along a job is, 0-100 or SCHED_PROGRESS_NONE
+typedef uint8_t (*sched_progress_func)();
+
+void sched_add_task(sched_task_func task);
+// name is up to 5 characters, it goes in the status file
+void sched_add_job(const char* name, sched_step_func step, sched_progress_func progress);
+// Never returns
+void sched_run();
+
+#endif
@@ -0,0 +1,117 @@
+#include "sram_writeback.h"
+#include "save_snapshots.h"
+#include "cart.h"
+#include "disk/gb_disk.h"
+#include "bus_core.h"
+#include "pico/stdlib.h"
+
+#include <stdio.h>
+
+/*  - Private Variables -  */
+// When SRAM was last written, to tell one restore from the next
+uint64_t last_write_us = 0;
+uint8_t write_session_started = 0;
+// Bytes written and skipped in this session
+uint32_t session_bytes_written = 0;
+uint32_t session_bytes_skipped = 0;
+// Where the stats line lives in the status file
+uint16_t stats_line_offset = STATUS_LINE_NONE;
+// What is in SRAM right now, to compare against
+uint8_t current_sram[SRAM_WRITEBACK_CHUNK] = {0};
+
+/*  - Private Function Declarations -  */
+
+// Snapshot the save and reset the stats if this write starts a new restore
+void start_session_if_needed();
+// Compare one chunk against SRAM and write the runs that changed
+void writeback_chunk(uint8_t* buf, uint32_t ram_addr, uint32_t num);
+// Put the stats in the status file
+void update_stats_line();
+
+/*  - Private Function Definitions -  */
+
+void start_session_if_needed(){
+  uint64_t now = time_us_64();
+  // A gap between writes means the host is done with the last restore and starting a new one
+  if(!write_session_started || ((now - last_write_us) > SRAM_SESSION_GAP_US)){
+    // Keep a copy of what was there before so the restore can be undone
+    save_snapshot_take();
+    session_bytes_written = 0;
+    session_bytes_skipped = 0;
+    write_session_started = 1;
+  }
+  last_write_us = now;
+}
+
+void writeback_chunk(uint8_t* buf, uint32_t ram_addr, uint32_t num){
+  bus_read(BUS_SPACE_RAM, ram_addr, current_sram, num);
+  uint32_t written = 0;
+  uint32_t i = 0;
+  while(i < num){
+    // Skip over whatever is already right
+    if(buf[i] == current_sram[i]){
+      i++;
+      continue;
+    }
+    // Found a change, see how far it goes. Small gaps of unchanged bytes get swallowed up
+    uint32_t run_start = i;
+    uint32_t run_end = i + 1;
+    uint32_t scan = run_end;
+    while(scan < num && (scan - run_end) <= SRAM_WRITEBACK_MERGE_GAP){
+      if(buf[scan] != current_sram[scan]){
+        run_end = scan + 1;
+      }
+      scan++;
+    }
+    // One RAM enable and bankswitch for the whole run
+    bus_write(BUS_SPACE_RAM, ram_addr + run_start, buf + run_start, run_end - run_start);
+    written += run_end - run_start;
+    i = run_end;
+  }
+  session_bytes_written += written;
+  session_bytes_skipped += num - written;
+}
+
+void update_stats_line(){
+  char line[STATUS_LINE_LEN + 1];
+  snprintf(line, sizeof(line), "SAVE WR %6lu WRITTEN %6lu SKIPPED\n", (unsigned long) session_bytes_written, (unsigned long) session_bytes_skipped);
+  update_status_line(stats_line_offset, line);
+}
+
+/*  - Public Function Definitions -  */
+
+void init_sram_writeback(){
+  if(!the_cart.ram_size_bytes){
+    return;
+  }
+  // Fixed width so it can be rewritten in place as the stats change
+  char line[STATUS_LINE_LEN + 1];
+  snprintf(line, sizeof(line), "SAVE WR %6lu WRITTEN %6lu SKIPPED\n", 0UL, 0UL);
+  stats_line_offset = reserve_status_line(line);
+}
+
+void sram_writeback(uint8_t* buf, uint32_t ram_addr, uint32_t num){
+  if(!the_cart.ram_memset_func || (ram_addr >= the_cart.ram_size_bytes)){
+    return;
+  }
+  // The host writes whole blocks, which can run past the end of a small save
+  if(num > (the_cart.ram_size_bytes - ram_addr)){
+    num = the_cart.ram_size_bytes - ram_addr;
+  }
+  start_session_if_needed();
+  // Without a way to read SRAM back there is nothing to compare against
+  if(!the_cart.ram_memcpy_func){
+    bus_write(BUS_SPACE_RAM, ram_addr, buf, num);
+    session_bytes_written += num;
+  }
+  else{
+    for(uint32_t done = 0; done < num; done += SRAM_WRITEBACK_CHUNK){
+      uint32_t len = num - done;
+      if(len > SRAM_WRITEBACK_CHUNK){
+        len = SRAM_WRITEBACK_CHUNK;
+      }
+      writeback_chunk(buf + done, ram_addr + done, len);
+    }
+  }
+  update_stats_line();
+}
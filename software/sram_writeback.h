@@ -0,0 +1,23 @@
+#ifndef SRAM_WRITEBACK_H_
+#define SRAM_WRITEBACK_H_
+
+#include <stdint.h>
+
+// Writes coming from the host go through here instead of straight to the mapper. What is
+// already in SRAM gets read first, and only the bytes that actually changed get written,
+// since writeb is a lot slower than readb and hosts like to rewrite the whole save
+
+// Writes closer together than this are the same restore
+#define SRAM_SESSION_GAP_US         2000000
+// How much SRAM gets compared at once
+#define SRAM_WRITEBACK_CHUNK        512
+// Runs of changed bytes this close together get written as one run. Rewriting a few
+// bytes that didn't change is cheaper than enabling RAM and bankswitching again
+#define SRAM_WRITEBACK_MERGE_GAP    4
+
+// Set up the status file line for write stats
+void init_sram_writeback();
+// Write a buffer from the host into SRAM, skipping anything that is already there
+void sram_writeback(uint8_t* buf, uint32_t ram_addr, uint32_t num);
+
+#endif
@@ -1,61 +1,70 @@
 #include "status_led.h"
 #include "pico/stdlib.h"
+#include "hardware/pio.h"
+#include "hardware/clocks.h"
 #include "pins.h"
+#include "status_led.pio.h"
 
-#define ALARM_NUM 0
-#define ALARM_IRQ TIMER_IRQ_0
+// Cart emulation fills both PIOs, so it has this give pio0 back with release_status_led()
+#define LED_PIO pio0
+// The SM counts in microseconds, so a blink speed goes straight into the FIFO
+#define LED_SM_HZ 1000000
 
-static volatile bool led_status = 0;
-static volatile uint32_t led_blink_speed = 0;
+static int led_sm = -1;
+static uint led_offset = 0;
+static bool led_blinking = false;
 
-// Set the blinking speed of the LED via an IRQ. Disable the LED and set it solid if passed in no delay
+// Set the blinking speed of the LED. Disable the blinking and set it solid if passed in no delay
 void set_led_speed(uint32_t delay_us){
-    // Enable if we pass in some delay
-    led_blink_speed = delay_us;
-    if(led_blink_speed){
-        // Enable the alarm irq
-        irq_set_enabled(ALARM_IRQ, true);
-        // Enable interrupt in block and at processor
-
-        // Alarm is only 32 bits so if trying to delay more
-        // than that need to be careful and keep track of the upper
-        // bits
-        uint64_t target = timer_hw->timerawl + led_blink_speed;
-
-        // Write the lower 32 bits of the target time to the alarm which
-        // will arm it
-        timer_hw->alarm[ALARM_NUM] = (uint32_t) target;
+    if(delay_us && (led_sm >= 0)){
+        // Already going, it picks the new speed up at the start of its next period
+        if(led_blinking){
+            if(!pio_sm_is_tx_fifo_full(LED_PIO, led_sm)){
+                pio_sm_put(LED_PIO, led_sm, delay_us);
+            }
+            return;
+        }
+        pio_sm_set_enabled(LED_PIO, led_sm, false);
+        pio_sm_clear_fifos(LED_PIO, led_sm);
+        pio_sm_restart(LED_PIO, led_sm);
+        pio_sm_exec(LED_PIO, led_sm, pio_encode_jmp(led_offset));
+        pio_sm_put(LED_PIO, led_sm, delay_us);
+        gpio_set_function(STATUS_LED, GPIO_FUNC_PIO0);
+        pio_sm_set_enabled(LED_PIO, led_sm, true);
+        led_blinking = true;
     }
-    // Disable if no delay given
+    // Disable if no delay given, or if there is nothing left to blink it with
     else{
-        // Disable the alarm irq
-        irq_set_enabled(ALARM_IRQ, false);
+        if(led_sm >= 0){
+            pio_sm_set_enabled(LED_PIO, led_sm, false);
+        }
+        led_blinking = false;
         // Set the LED on and solid
-        led_status = 0;
-        gpio_put(STATUS_LED, led_status);
+        gpio_set_function(STATUS_LED, GPIO_FUNC_SIO);
+        gpio_put(STATUS_LED, 0);
     }
 }
 
-void toggle_led_irq(){
-    // Clear the irq
-    hw_clear_bits(&timer_hw->intr, 1u << ALARM_NUM);
-    // Toggle the LED
-    led_status = !led_status;
-    // Write the new status of the LED
-    gpio_put(STATUS_LED, led_status);
-    // Re-enable the timer
-    set_led_speed(led_blink_speed);
-}
-
-// Initialize the LED and the IRQ that controls it. By default, the LED will be off
-void init_led_irq(){
+// Initialize the LED and the state machine that blinks it. By default, the LED will be off
+void init_status_led(){
     gpio_init(STATUS_LED);
     gpio_set_dir(STATUS_LED, GPIO_OUT);
     // Micros are usually better at sourcing current rather than sinking it, so
     // the LED is toggled on by giving it a path to ground. This disables it
     gpio_put(STATUS_LED, 1);
-    // Enable the interrupt for our alarm (the timer outputs 4 alarm irqs)
-    hw_set_bits(&timer_hw->inte, 1u << ALARM_NUM);
-    // Set irq handler for alarm irq
-    irq_set_exclusive_handler(ALARM_IRQ, toggle_led_irq);
-}
\ No newline at end of file
+    led_sm = pio_claim_unused_sm(LED_PIO, true);
+    led_offset = pio_add_program(LED_PIO, &status_led_program);
+    pio_sm_config c = status_led_program_get_default_config(led_offset);
+    sm_config_set_set_pins(&c, STATUS_LED, 1);
+    sm_config_set_clkdiv(&c, (float) clock_get_hz(clk_sys) / LED_SM_HZ);
+    pio_sm_init(LED_PIO, led_sm, led_offset, &c);
+    pio_sm_set_pins_with_mask(LED_PIO, led_sm, 1u << STATUS_LED, 1u << STATUS_LED);
+    pio_sm_set_consecutive_pindirs(LED_PIO, led_sm, STATUS_LED, 1, true);
+}
+
+void release_status_led(){
+    set_led_speed(0);
+    pio_remove_program(LED_PIO, &status_led_program, led_offset);
+    pio_sm_unclaim(LED_PIO, led_sm);
+    led_sm = -1;
+}
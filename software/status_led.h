@@ -6,7 +6,10 @@
 #define LED_SPEED_TESTING   50000
 #define LED_SPEED_HEALTHY   0
 
-void init_led_irq();
+// The LED blinks from a PIO state machine, so it never interrupts the CPU
+void init_status_led();
 void set_led_speed(uint32_t speed);
+// Give the blink program's PIO space back. The LED stays solid from here on
+void release_status_led();
 
-#endif
\ No newline at end of file
+#endif
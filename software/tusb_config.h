@@ -74,11 +74,16 @@
 #define CFG_TUD_CDC               0
 #define CFG_TUD_MSC               1
 #define CFG_TUD_MIDI              0
-#define CFG_TUD_VENDOR            0
+#define CFG_TUD_VENDOR            1
 
 // HID buffer size Should be sufficient to hold ID (if any) + Data
 #define CFG_TUD_HID_EP_BUFSIZE    16
-#define CFG_TUD_MSC_EP_BUFSIZE   512
+// Eight blocks a callback. The RP2040 driver double buffers transfers longer than a packet,
+// so a bigger buffer keeps the bulk endpoint full instead of stopping every 512 bytes
+#define CFG_TUD_MSC_EP_BUFSIZE   4096
+// Vendor TX FIFO is deep so the endpoint keeps going while the next stage is read off the bus
+#define CFG_TUD_VENDOR_RX_BUFSIZE 512
+#define CFG_TUD_VENDOR_TX_BUFSIZE 2048
 
 #ifdef __cplusplus
  }
@@ -5,13 +5,29 @@
 #include "mappers/gbcam.h"
 #include "disk/msc_disk.h"
 #include "utils.h"
+#include "pico/stdlib.h"
 
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
-#include <time.h>
+
+// How many banks get fingerprinted per bankswitch test
+#define BANKSW_MAX_TEST_BANKS       16
+// Fingerprints hash one line out of every FINGERPRINT_LINE_STRIDE lines in a bank
+#define FINGERPRINT_LINE_SIZE       16
+#define FINGERPRINT_LINE_STRIDE     10
 
 // Private functions
+uint32_t bank_fingerprint(uint32_t start_addr, uint32_t bank_size);
+
+uint8_t banks_identical(
+    void (*bankswitch_func)(uint16_t),
+    uint32_t start_addr,
+    uint32_t bank_size,
+    uint16_t bank_a,
+    uint16_t bank_b,
+    int32_t* cached_bank);
+
 uint8_t memory_coherency_test(
     void (*memcpy_func)(uint8_t*, uint32_t, uint32_t), 
     uint32_t num);
@@ -29,11 +45,13 @@ uint8_t sram_rd_wr_test(
     void (*memset_func)(uint8_t*, uint32_t, uint32_t),
     uint32_t max_sram_addr);
 
+void report_test_result(const char* name, const char* result, uint64_t start_us);
+
 // Unit tests should follow the following structure
 // - ROM coherency. Read the same ROM bank over and over, make sure it never changes
 // - SRAM coherency. Read the same SRAM bank over and over, make sure it never changes
-// - ROM bankswitching. Read a whole bank of ROM, then the next, make sure it always switches
-// - SRAM bankswitching. Read a whole bank of SRAM, then the next, make sure it always switches
+// - ROM bankswitching. Fingerprint a sample of each ROM bank, make sure the banks all differ
+// - SRAM bankswitching. Fingerprint a sample of each SRAM bank, make sure the banks all differ
 // - SRAM writes. Save a byte from SRAM, write a new one, make sure it got written, write back old
 // - Run all these, then if any of them failed, return a fail
 
@@ -63,7 +81,44 @@ uint8_t memory_coherency_test(
     return 1;
 }
 
-// Bankswitch to every bank, make sure the bankswitches actually occurred
+// Hash a strided sample of lines out of whatever bank is currently mapped in
+uint32_t bank_fingerprint(uint32_t start_addr, uint32_t bank_size){
+    uint8_t line[FINGERPRINT_LINE_SIZE];
+    uint32_t hash = FNV1A_SEED;
+    // Only every FINGERPRINT_LINE_STRIDE'th line is read, which is roughly a tenth of the bank
+    for(uint32_t offset = 0; (offset + FINGERPRINT_LINE_SIZE) <= bank_size; offset += FINGERPRINT_LINE_SIZE * FINGERPRINT_LINE_STRIDE){
+        readbuf(start_addr + offset, line, FINGERPRINT_LINE_SIZE);
+        hash = fnv1a_hash(line, FINGERPRINT_LINE_SIZE, hash);
+    }
+    return hash;
+}
+
+// Read two banks in full and see if they really are the same. Only used when two fingerprints match.
+// bank_a is kept in the first half of working_mem and *cached_bank says which one is there, so
+// comparing several banks against the same one reads it once
+uint8_t banks_identical(
+    void (*bankswitch_func)(uint16_t),
+    uint32_t start_addr,
+    uint32_t bank_size,
+    uint16_t bank_a,
+    uint16_t bank_b,
+    int32_t* cached_bank){
+        uint8_t* bank_a_buf = working_mem;
+        uint8_t* bank_b_buf = working_mem + bank_size;
+        // Do not use the memcpy functions! Those will mess with the banks
+        // We need a raw buf read 
+        if(*cached_bank != bank_a){
+            (*bankswitch_func)(bank_a);
+            readbuf(start_addr, bank_a_buf, bank_size);
+            *cached_bank = bank_a;
+        }
+        (*bankswitch_func)(bank_b);
+        readbuf(start_addr, bank_b_buf, bank_size);
+        return bufncmp(bank_a_buf, bank_b_buf, bank_size);
+    }
+
+// Bankswitch across the whole bank range, make sure the bankswitches actually occurred
+// Returns the number of banks that were proven unique, 0 on failure
 uint8_t bankswitch_test(
     void (*bankswitch_func)(uint16_t),
     void (*mem_enable_func)(uint8_t), 
@@ -71,54 +126,65 @@ uint8_t bankswitch_test(
     uint32_t bank_size,
     uint16_t start_bank,
     uint16_t end_bank){
-        // The amount of banks to test
-        uint16_t num_banks_test = 16;
-        uint8_t pass = 0;
-        uint16_t current_bank = start_bank;
+        uint16_t banks[BANKSW_MAX_TEST_BANKS];
+        uint32_t fingerprints[BANKSW_MAX_TEST_BANKS];
+        // Index of the first bank found with the same contents, itself if there wasn't one
+        uint8_t same_as[BANKSW_MAX_TEST_BANKS];
+        int32_t cached_bank = -1;
+        // Nothing to switch between, so nothing to prove
+        if(end_bank <= start_bank + 1){
+            return 1;
+        }
+        // For sake of time, only test this many banks, even if there are more
+        uint16_t num_banks_test = end_bank - start_bank;
+        if(num_banks_test > BANKSW_MAX_TEST_BANKS){
+            num_banks_test = BANKSW_MAX_TEST_BANKS;
+        }
+        // Spread the banks under test evenly over the whole range so every bank select line gets exercised
+        for(uint16_t i = 0; i < num_banks_test; i++){
+            banks[i] = start_bank + (((uint32_t) i * (end_bank - start_bank)) / num_banks_test);
+        }
         // Enable memory, if applicable
         // Some memory (RAM) needs to be enabled before it can be used at all
         if(mem_enable_func){
             (*mem_enable_func)(1);
         }
-        // Set up memory so we can hold what we read from the cart
-        uint8_t* written_buf = working_mem;
-        uint8_t* comparison_buf = working_mem + bank_size;
-        // Read the first chunk of memory from the starting bank
-        (*bankswitch_func)(current_bank);
-        // Do not use the memcpy functions! Those will mess with the banks
-        // We need a raw buf read 
-        readbuf(start_addr, written_buf, bank_size);
-        // Test the amount of banks we are told to
-        while(num_banks_test){
-            // Pick a valid random bank to test
-            current_bank = rand() % end_bank;
-            if(current_bank < start_bank){
-                current_bank = start_bank;
-            }
-            // Read the new bank into comparison memory
-            (*bankswitch_func)(current_bank);
-            readbuf(start_addr, comparison_buf, bank_size);
-            // Compare the two banks, see if they differ
-            if(bufncmp(written_buf, comparison_buf, bank_size)){
-                // Increment each time we can prove a bankswitch occurred
-                pass++;
+        // Fingerprint every bank under test
+        for(uint16_t i = 0; i < num_banks_test; i++){
+            (*bankswitch_func)(banks[i]);
+            fingerprints[i] = bank_fingerprint(start_addr, bank_size);
+        }
+        // Every bank should have a fingerprint nobody else has. Matching ones only get the full
+        // read against the first bank of each set of identical banks, so a run of blank padding
+        // banks costs one read each rather than two per earlier match. Identical banks can't be
+        // told apart from a switch that silently failed, so they just don't count as unique
+        uint8_t unique_banks = 0;
+        for(uint16_t i = 0; i < num_banks_test; i++){
+            same_as[i] = i;
+            for(uint16_t j = 0; j < i; j++){
+                if((same_as[j] == j) && (fingerprints[i] == fingerprints[j]) &&
+                    banks_identical(bankswitch_func, start_addr, bank_size, banks[j], banks[i], &cached_bank)){
+                    same_as[i] = j;
+                    break;
+                }
             }
-            // Swap the two buffers. Old comparison buf is now the written buf
-            // It is much less likely that two banks in a row will have the exact same memory
-            // compared to the first bank and any other bank in memory
-            // at least I think, I feel like I may be wrong but I suck at math
-            uint8_t* temp = comparison_buf;
-            comparison_buf = written_buf;
-            written_buf = comparison_buf;
-            // For sake of time, only test this many banks, even if there are more
-            num_banks_test--;
+            unique_banks += same_as[i] == i;
+        }
+        // Go back to the first bank and make sure it reads the same after all that switching
+        (*bankswitch_func)(banks[0]);
+        if(bank_fingerprint(start_addr, bank_size) != fingerprints[0]){
+            unique_banks = 0;
         }
         // Cleanup, disable memory if applicable
         if(mem_enable_func){
             (*mem_enable_func)(0);
         }
-    return pass;
-}
+        // A single unique bank means we never actually switched
+        if(unique_banks < 2){
+            return 0;
+        }
+        return unique_banks;
+    }
 
 // Read and write to SRAM, make sure the memory is working properly
 uint8_t sram_rd_wr_test(
@@ -150,6 +216,13 @@ uint8_t sram_rd_wr_test(
     }
 
 
+// Write the result of one test and how long it took to the status file
+void report_test_result(const char* name, const char* result, uint64_t start_us){
+    char line[48];
+    snprintf(line, sizeof(line), "%s: %s (%lu MS)\n", name, result, (uint32_t) ((time_us_64() - start_us) / 1000));
+    append_status_file_buf(line);
+}
+
 // Full unit tests
 // Fully test SRAM read and write functionality, report result to filesystem
 uint8_t unit_test_sram_rd_wr(
@@ -158,12 +231,13 @@ uint8_t unit_test_sram_rd_wr(
     uint32_t ram_size){
         uint8_t ret = 1;
         if(memcpy_func && memset_func && ram_size){
+            uint64_t start_us = time_us_64();
             if(sram_rd_wr_test(memcpy_func, memset_func, ram_size)){
-                append_status_file("SRAM RD/WR: PASS\n\0");
+                report_test_result("SRAM RD/WR", "PASS", start_us);
             }
             else{
                 ret = 0;
-                append_status_file("SRAM RD/WR: FAIL\n\0");
+                report_test_result("SRAM RD/WR", "FAIL", start_us);
             }
         }
         else{
@@ -185,6 +259,7 @@ uint8_t unit_test_rom_ram_bankswitching(
 
 ){
     uint8_t ret = 1;
+    uint64_t start_us = time_us_64();
     // First test ROM
     // Not all carts have banked ROM
     if(rom_bankswitch_func){
@@ -196,10 +271,10 @@ uint8_t unit_test_rom_ram_bankswitching(
             rom_start_bank, 
             rom_end_bank)){
             ret = 0;
-            append_status_file("ROM BANKSW: FAIL\n\0");
+            report_test_result("ROM BANKSW", "FAIL", start_us);
         }
         else{
-            append_status_file("ROM BANKSW: PASS\n\0");
+            report_test_result("ROM BANKSW", "PASS", start_us);
         }
     }
     else{
@@ -207,6 +282,7 @@ uint8_t unit_test_rom_ram_bankswitching(
     }
     // Next test banked RAM
     // Not all carts have banked RAM
+    start_us = time_us_64();
     if(ram_bankswitch_func && ram_bank_size){
         if(!bankswitch_test(
             ram_bankswitch_func, 
@@ -216,15 +292,16 @@ uint8_t unit_test_rom_ram_bankswitching(
             ram_start_bank, 
             ram_end_bank)){
             ret = 0;
-            append_status_file("SRAM BANKSW: FAIL\n\0");
+            report_test_result("SRAM BANKSW", "FAIL", start_us);
         }
         else{
-            append_status_file("SRAM BANKSW: PASS\n\0");
+            report_test_result("SRAM BANKSW", "PASS", start_us);
         }
     }
     else{
         append_status_file("SRAM BANKSW: SKIPPED\n\0");
     }
+    return ret;
 }
 
 // Fully rest ROM and SRAM coherency, report result to filesystem
@@ -234,38 +311,39 @@ uint8_t unit_test_rom_ram_coherency(
     uint32_t ram_bank_size
 ){
     uint8_t ret = 1;
+    uint64_t start_us = time_us_64();
     // First test ROM
     if(rom_memcpy_func){
         if(!memory_coherency_test(rom_memcpy_func, ROM_BANK_SIZE)){
             ret = 0;
-            append_status_file("ROM COHERENCY: FAIL\n\0");
+            report_test_result("ROM COHERENCY", "FAIL", start_us);
         }
         else{
-            append_status_file("ROM COHERENCY: PASS\n\0");
+            report_test_result("ROM COHERENCY", "PASS", start_us);
         }
     }
     else{
         append_status_file("ROM COHERENCY: SKIPPED\n\0");
     }
+    start_us = time_us_64();
     if(ram_memcpy_func && ram_bank_size){
         if(!memory_coherency_test(ram_memcpy_func, ram_bank_size)){
             ret = 0;
-            append_status_file("SRAM COHERENCY: FAIL\n\0");
+            report_test_result("SRAM COHERENCY", "FAIL", start_us);
         }
         else{
-            append_status_file("SRAM COHERENCY: PASS\n\0");
+            report_test_result("SRAM COHERENCY", "PASS", start_us);
         }
     }
     else{
         append_status_file("SRAM COHERENCY: SKIPPED\n\0");
     }
+    return ret;
 }
 
 // Completely unit test the whole cartridge
 uint8_t unit_test_cart(){
-    time_t start, end;
-    double time_delta;
-    time(&start);
+    uint64_t start_us = time_us_64();
     sprintf(working_mem, 
     "UNIT TESTS FOR %s\n"
     "CART TYPE: %s\n"
@@ -301,11 +379,12 @@ uint8_t unit_test_cart(){
         ret = 0;
     }
     // Test ROM/RAM bankswitching
+    // ROM starts at bank 1, not every mapper can put bank 0 in the switchable region
     if(!unit_test_rom_ram_bankswitching(
         the_cart.rom_banksw_func,
         the_cart.ram_banksw_func,
         the_cart.ram_enable_func,
-        0,
+        1,
         the_cart.rom_banks,
         0,
         the_cart.ram_banks,
@@ -321,8 +400,7 @@ uint8_t unit_test_cart(){
     )){
         ret = 0;
     }
-    time(&end);
-    sprintf(working_mem, "UNIT TESTS COMPLETED IN %.2f SECONDS\n\0", difftime(end,start));
+    sprintf(working_mem, "UNIT TESTS COMPLETED IN %lu MS\n\0", (uint32_t) ((time_us_64() - start_us) / 1000));
     append_status_file_buf(working_mem);
     if(!ret){
         append_status_file("Unit tests failed! You probably just need to take our your "
@@ -1,4 +1,12 @@
 #include "utils.h"
+#include "pico/platform.h"
+#include "hardware/clocks.h"
+
+// The clock the SDK sets up, older SDKs don't say
+#ifndef SYS_CLK_KHZ
+#define SYS_CLK_KHZ 125000
+#endif
+#define DELAY_WAIT_STEP_CYCLES ((SYS_CLK_KHZ * DELAY_WAIT_STEP_NS) / 1000000)
 
 void hexdump(uint8_t *data, uint16_t len, uint16_t start_address){
     for(uint16_t i = 0; i < len; i++){
@@ -20,15 +28,12 @@ char byte_to_printable(uint8_t byte_in){
 
 // Compare two buffers. If they are the same, return 1
 uint8_t bufncmp(uint8_t *b1, uint8_t *b2, uint32_t len){
-    uint32_t samechars = 0;
     for(uint32_t i = 0; i < len; i++){
-        if(b1[i] == b2[i]){
-            samechars++;
+        // No point looking any further once one byte differs
+        if(b1[i] != b2[i]){
+            return 0;
         }
     }
-    if(samechars < len){
-        return 0;
-    }
     return 1;
 }
 
@@ -38,9 +43,32 @@ void bufncpy(uint8_t *dest, uint8_t *src, uint16_t len){
     }
 }
 
-void delay_wait(uint32_t cycles){
-    // Each cycle is roughly 7 ns when running at default speed???
-    while(cycles){
-        cycles--;
+uint32_t fnv1a_hash(const uint8_t *buf, uint32_t len, uint32_t hash){
+    // The M0+ has a single cycle multiplier, so this is about as cheap as a hash gets
+    for(uint32_t i = 0; i < len; i++){
+        hash ^= buf[i];
+        hash *= 0x01000193;
+    }
+    return hash;
+}
+
+// Nibble at a time CRC32 table. 64 bytes instead of the usual 1K, still cheap enough
+static const uint32_t crc32_nibble_table[16] = {
+    0x00000000, 0x1DB71064, 0x3B6E20C8, 0x26D930AC, 0x76DC4190, 0x6B6B51F4, 0x4DB26158, 0x5005713C,
+    0xEDB88320, 0xF00F9344, 0xD6D6A3E8, 0xCB61B38C, 0x9B64C2B0, 0x86D3D2D4, 0xA00AE278, 0xBDBDF21C
+};
+
+uint32_t crc32_update(const uint8_t *buf, uint32_t len, uint32_t crc){
+    for(uint32_t i = 0; i < len; i++){
+        crc ^= buf[i];
+        crc = (crc >> 4) ^ crc32_nibble_table[crc & 0xF];
+        crc = (crc >> 4) ^ crc32_nibble_table[crc & 0xF];
     }
+    return crc;
+}
+
+void __not_in_flash_func(delay_wait)(uint32_t steps){
+    // A plain countdown loop does nothing the compiler has to keep, and Release builds drop
+    // it. This one is asm, 3 cycles a loop
+    busy_wait_at_least_cycles(steps * DELAY_WAIT_STEP_CYCLES);
 }
\ No newline at end of file
@@ -8,10 +8,20 @@
 void hexdump(uint8_t *data, uint16_t len, uint16_t start_address);
 // Convert a byte to an ascii printable char. Replace nonprintables with '.'
 char byte_to_printable(uint8_t byte_in);
-// Return 0 if the bufs of size len are the same, 1 otherwise
+// Return 1 if the bufs of size len are the same, 0 otherwise. Stops at the first difference
 uint8_t bufncmp(uint8_t *b1, uint8_t *b2, uint32_t len);
 // Copy one buf to another of size len
 void bufncpy(uint8_t *dest, uint8_t *src, uint16_t len);
-// Just sit and wait
-void delay_wait(uint32_t cycles);
+// Starting value for a fresh FNV-1a hash
+#define FNV1A_SEED 0x811C9DC5
+// Fold len bytes of buf into a running 32 bit FNV-1a hash. Start with FNV1A_SEED
+uint32_t fnv1a_hash(const uint8_t *buf, uint32_t len, uint32_t hash);
+// Starting value for a fresh CRC32
+#define CRC32_SEED 0xFFFFFFFF
+// Fold len bytes of buf into a running CRC32. Start with CRC32_SEED, invert the result when done
+uint32_t crc32_update(const uint8_t *buf, uint32_t len, uint32_t crc);
+// delay_wait counts in steps of about this long, at the default 125MHz clock
+#define DELAY_WAIT_STEP_NS 40
+// Just sit and wait, for at least steps * DELAY_WAIT_STEP_NS
+void delay_wait(uint32_t steps);
 #endif
\ No newline at end of file
@@ -0,0 +1,115 @@
+#!/usr/bin/python3
+
+# Bring a local ROM dump and save up to date with the cart, copying only the banks that differ.
+# Compares against BANKS.TXT on the drive, so an interrupted dump picks up where it stopped and
+# an unchanged save doesn't get read at all.
+#
+#   banksync.py /media/gbpunk game.gb [game.sav]
+
+import glob
+import os
+import sys
+import time
+import zlib
+
+ROM_BANK_SIZE = 0x4000
+SRAM_BANK_SIZE = 0x2000
+# BANKS.TXT fills in as the cart gets hashed, keep rereading until it's all there
+POLL_SECONDS = 1
+POLL_TRIES = 120
+
+
+def read_fresh(path, offset=0, size=-1):
+    # The cart can change what's behind a file, don't let the page cache hand back an old copy
+    fd = os.open(path, os.O_RDONLY)
+    try:
+        if hasattr(os, "posix_fadvise"):
+            os.posix_fadvise(fd, 0, 0, os.POSIX_FADV_DONTNEED)
+        os.lseek(fd, offset, os.SEEK_SET)
+        out = b""
+        while size < 0 or len(out) < size:
+            chunk = os.read(fd, 0x10000 if size < 0 else size - len(out))
+            if not chunk:
+                break
+            out += chunk
+        return out
+    finally:
+        os.close(fd)
+
+
+def read_manifest(mount):
+    path = os.path.join(mount, "BANKS.TXT")
+    for _ in range(POLL_TRIES):
+        banks = {"ROM": [], "RAM": []}
+        pending = 0
+        for line in read_fresh(path).decode("ascii", "replace").splitlines():
+            parts = line.split()
+            if len(parts) != 3 or parts[0] not in banks:
+                continue
+            if parts[2].startswith("-"):
+                pending += 1
+                banks[parts[0]].append(None)
+            else:
+                banks[parts[0]].append(int(parts[2], 16))
+        if not pending:
+            return banks
+        print(f"{pending} banks still hashing...")
+        time.sleep(POLL_SECONDS)
+    sys.exit("BANKS.TXT never finished")
+
+
+def find_one(mount, ext):
+    found = [p for p in glob.glob(os.path.join(mount, "*")) if p.lower().endswith(ext)]
+    return found[0] if len(found) == 1 else None
+
+
+def sync(kind, hashes, bank_size, drive_path, local_path):
+    size = os.path.getsize(drive_path)
+    if size < bank_size:
+        bank_size = size
+    local = bytearray()
+    if os.path.exists(local_path):
+        with open(local_path, "rb") as f:
+            local = bytearray(f.read())
+    local = local[:size]
+    fetched = 0
+    for bank, crc in enumerate(hashes):
+        start = bank * bank_size
+        have = bytes(local[start:start + bank_size])
+        if len(have) == bank_size and (zlib.crc32(have) & 0xFFFFFFFF) == crc:
+            continue
+        data = read_fresh(drive_path, start, bank_size)
+        if (zlib.crc32(data) & 0xFFFFFFFF) != crc:
+            print(f"{kind} {bank:03} read back doesn't match BANKS.TXT, the cart changed or read dirty")
+        if len(local) < start:
+            local += bytes(start - len(local))
+        local[start:start + bank_size] = data
+        fetched += 1
+    if fetched:
+        with open(local_path, "wb") as f:
+            f.write(local)
+    print(f"{kind}: {fetched} of {len(hashes)} banks fetched into {local_path}")
+    return fetched
+
+
+def main():
+    if len(sys.argv) < 3:
+        sys.exit(f"usage: {sys.argv[0]} MOUNT LOCAL_ROM [LOCAL_SAV]")
+    mount = sys.argv[1]
+    banks = read_manifest(mount)
+    rom = find_one(mount, ".bin")
+    if not rom:
+        sys.exit("no ROM .bin on the drive")
+    sync("ROM", banks["ROM"], ROM_BANK_SIZE, rom, sys.argv[2])
+    if len(sys.argv) < 4:
+        return
+    sav = find_one(mount, ".sav")
+    if not sav or not banks["RAM"]:
+        print("cart has no save")
+        return
+    if not sync("RAM", banks["RAM"], SRAM_BANK_SIZE, sav, sys.argv[3]):
+        print("save unchanged since last sync")
+
+
+if __name__ == "__main__":
+    main()
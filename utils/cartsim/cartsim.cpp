@@ -0,0 +1,881 @@
+// Cart emulation bench. Runs gbbus.pio in a cycle level PIO model, hooked up the same way
+// cart_emu.c hooks it up, and replays bus traces recorded off a real console at it. Every ROM
+// and cart RAM read is checked for the right byte showing up on the data bus in time, and
+// every other cycle for GBPunk keeping off the bus.
+//
+// The captures only have a few of the address and data lines, so the rest get made up every
+// cycle, at the time the recorded lines change (or ADDR_DELAY after CLK rises if none of them
+// do). Writes go to the MBC registers or RAM at random, reads to bank 0, the switchable bank,
+// cart RAM and the rest of the map, so all three lookup SMs, the A15 and CS checks, bank
+// switching and turning cart RAM on and off all get used.
+//
+// Response times count from when the address settles, but never from before ADDR_DELAY after
+// CLK rises, which is as early as a real console has it. A capture only sees an edge at the
+// sample after it, so address edges within a sample of that get moved back to it. Cycles that
+// still settle later than a real console does, or where RD glitches, are left out and counted
+// as unchecked.
+//
+// Build: gcc -O2 -I ../../software -c ../../software/mappers/mbc_regs.c
+//        g++ -O2 -std=c++17 cartsim.cpp pio_sim.cpp sal_reader.cpp mbc_regs.o -o cartsim
+//
+// Usage: cartsim [options] capture.sal|extracted_dir ...
+//   --pio file         Program to run, default ../../software/gbbus.pio
+//   --rom file         ROM to serve, default a made up 32K MBC5 ROM with 8K of cart RAM.
+//                      Has to fit in CART_EMU_MAX_BANKS like cart_emu.c wants
+//   --deadline ns      Time a byte has to show up in after the address settles, default 250
+//   --core1 ns         Time core 1 takes to handle a write, default 240
+//   --bank-gap n       Cycles after a bank switch without switchable bank reads, default 2
+//   --max-ms ms        Only replay this much of each capture
+//   --seed n           For the made up address bits
+//   --list             Print the assembled programs
+// Exits with 1 if a read is late or wrong, or anything drives the bus when it shouldn't
+
+#include "pio_sim.h"
+#include "sal_reader.h"
+
+extern "C" {
+#include "../../software/cart.h"
+#include "../../software/cart_emu.h"
+#include "../../software/mappers/mbc_regs.h"
+}
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <deque>
+#include <fstream>
+#include <random>
+#include <string>
+#include <vector>
+
+// Pin map from pins.h. Both buses are wired backwards
+#define GPIO_D7             0
+#define GPIO_A15            9
+#define GPIO_A14            10
+#define GPIO_A0             24
+#define GPIO_CS             25
+#define GPIO_RD             26
+#define GPIO_WR             27
+#define GPIO_CLK            28
+
+#define PIO_CYCLE_NS        8 // 125 MHz
+#define BANK_SIZE           0x4000
+#define ADDR_DELAY_NS       160 // From the captures, when the console's address settles
+#define ADDR_SLACK_NS       40  // One sample at 25 MS/s, settling later than this is unresolved
+#define ADDR_WINDOW_NS      400 // Address lines that change after this belong to the next cycle
+// Made up memory map for the lookup, only the bits above A13 (A12 for cart RAM) matter
+#define SIM_ROM_BASE        0x20000000
+#define SIM_CART_RAM_BASE   0x20030000
+// DMA timing, in PIO cycles
+#define DMA_ADDR_CYCLES     3 // DREQ, read the RX FIFO, write the trigger
+#define DMA_RAM_CYCLES      2 // Read SRAM, write the TX FIFO
+#define DMA_CHAIN_CYCLES    1
+#define MOV_Y_STATUS        0xa045
+
+struct Options {
+    std::string pio_path = "../../software/gbbus.pio";
+    std::string rom_path;
+    uint32_t deadline_ns = 250;
+    uint32_t core1_ns = 240;
+    uint32_t bank_gap = 2;
+    uint64_t max_ns = 0;
+    uint32_t seed = 1;
+    bool list = false;
+};
+
+/*  - ROM and memory -  */
+
+struct Rom {
+    std::vector<uint8_t> data;
+    uint16_t banks = 0;
+    uint8_t ram_banks = 0;
+    uint8_t mapper_type = MAPPER_UNKNOWN;
+};
+
+static bool load_rom(const std::string& path, Rom& rom){
+    if(path.empty()){
+        rom.data.resize(CART_EMU_MAX_BANKS * BANK_SIZE);
+        for(uint32_t i = 0; i < rom.data.size(); i++){
+            // Every byte different enough that a read from the wrong bank shows up
+            rom.data[i] = ((i * 2654435761u) >> 24) ^ (i >> 14);
+        }
+        rom.data[CART_TYPE_ADDR] = 0x1B; // MBC5+RAM+BATTERY
+        rom.data[RAM_BANK_COUNT_ADDR] = 0x02; // 8K
+    }
+    else{
+        std::ifstream file(path, std::ios::binary);
+        if(!file){
+            return false;
+        }
+        rom.data.assign((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+    }
+    rom.banks = rom.data.size() / BANK_SIZE;
+    if(rom.data.size() <= RAM_BANK_COUNT_ADDR){
+        return false;
+    }
+    rom.mapper_type = mbc_regs_mapper_type(rom.data[CART_TYPE_ADDR]);
+    // Same as cart_emu_run()
+    rom.ram_banks = rom.mapper_type == MAPPER_ROM_ONLY ? 0 : mbc_regs_ram_banks(rom.data[RAM_BANK_COUNT_ADDR]);
+    return rom.banks >= 2 && !(rom.banks & (rom.banks - 1)) && rom.banks <= CART_EMU_MAX_BANKS &&
+           rom.ram_banks <= CART_EMU_MAX_RAM_BANKS;
+}
+
+// Where cart_emu.c keeps the image and cart RAM, all of it in RAM
+struct Memory {
+    const Rom* rom;
+    std::vector<uint8_t> cart_ram;
+
+    Memory(const Rom& r) : rom(&r), cart_ram(r.ram_banks * MBC_REGS_RAM_BANK_SIZE, 0xFF){}
+    static uint32_t bank_base(uint32_t bank){
+        return (SIM_ROM_BASE + (bank * BANK_SIZE)) >> 14;
+    }
+    static uint32_t ram_base(uint32_t bank){
+        return (SIM_CART_RAM_BASE + (bank * MBC_REGS_RAM_BANK_SIZE)) >> 13;
+    }
+    // The byte at a lookup address, and whether it came from cart RAM
+    bool read(uint32_t addr, uint8_t& value, bool& from_cart_ram){
+        if(addr >= SIM_ROM_BASE && addr < SIM_ROM_BASE + rom->data.size()){
+            value = rom->data[addr - SIM_ROM_BASE];
+            from_cart_ram = false;
+        }
+        else if(addr >= SIM_CART_RAM_BASE && addr < SIM_CART_RAM_BASE + cart_ram.size()){
+            value = cart_ram[addr - SIM_CART_RAM_BASE];
+            from_cart_ram = true;
+        }
+        else{
+            return false;
+        }
+        return true;
+    }
+};
+
+/*  - Trace -  */
+
+enum SigIndex {
+    SIG_CLK = 0, SIG_RD, SIG_WR, SIG_CS, SIG_A0, SIG_D0 = SIG_A0 + 16, SIG_COUNT = SIG_D0 + 8
+};
+
+struct TraceEvent {
+    uint64_t t;
+    uint8_t sig;
+    uint8_t level;
+};
+
+enum CycleKind {
+    CYCLE_ROM_READ,   // Has to get the right byte in time
+    CYCLE_RAM_READ,   // Same, from cart RAM
+    CYCLE_OTHER_READ, // Something else is reading, so keep off the bus
+    CYCLE_WRITE,      // The console is driving the bus, keep off it
+    CYCLE_UNCHECKED   // RD glitches, or the capture can't say when the address settled
+};
+
+struct Cycle {
+    uint64_t rise;
+    uint64_t addr_at;    // When the made up address bits change
+    uint64_t settle;     // When the whole address is there
+    uint64_t ref;        // What response times count from
+    uint16_t synth_addr;
+    uint8_t synth_data;
+    bool cs_low;         // Only used when the capture has no CS
+    CycleKind kind;
+    uint16_t addr;       // Full address once settled
+    uint8_t data;        // What the console writes
+    uint16_t bank;       // Bank a ROM read comes from
+    uint8_t expected;    // What a ROM or cart RAM read has to get
+};
+
+struct Trace {
+    const SalChannel* sig[SIG_COUNT] = {};
+    uint16_t addr_mask = 0; // Address lines the capture has
+    uint8_t data_mask = 0;
+    std::vector<TraceEvent> events;
+    std::vector<Cycle> cycles;
+};
+
+static int signal_index(std::string name){
+    // Active low lines are named !rd, ~rd or just rd. All of them are the pin level
+    while(!name.empty() && (name[0] == '!' || name[0] == '~')){
+        name = name.substr(1);
+    }
+    for(char& c : name){
+        c = tolower(c);
+    }
+    if(name == "clk") return SIG_CLK;
+    if(name == "rd") return SIG_RD;
+    if(name == "wr") return SIG_WR;
+    if(name == "cs") return SIG_CS;
+    if(name.size() >= 2 && (name[0] == 'a' || name[0] == 'd') && isdigit(name[1])){
+        int n = atoi(name.c_str() + 1);
+        if(name[0] == 'a' && n < 16) return SIG_A0 + n;
+        if(name[0] == 'd' && n < 8) return SIG_D0 + n;
+    }
+    return -1;
+}
+
+static uint8_t level_at(const SalChannel* ch, uint64_t t, uint8_t missing){
+    if(!ch){
+        return missing;
+    }
+    auto it = std::upper_bound(ch->edges.begin(), ch->edges.end(), t,
+                               [](uint64_t v, const SalEdge& e){ return v < e.time_ns; });
+    return it == ch->edges.begin() ? ch->initial : std::prev(it)->level;
+}
+
+static uint16_t recorded_addr(const Trace& tr, uint64_t t){
+    uint16_t addr = 0;
+    for(int i = 0; i < 16; i++){
+        addr |= level_at(tr.sig[SIG_A0 + i], t, 0) << i;
+    }
+    return addr;
+}
+
+static uint8_t recorded_data(const Trace& tr, uint64_t t){
+    uint8_t data = 0;
+    for(int i = 0; i < 8; i++){
+        data |= level_at(tr.sig[SIG_D0 + i], t, 0) << i;
+    }
+    return data;
+}
+
+// Make up the rest of every cycle, and work out what the console should see
+static void build_cycles(Trace& tr, const SalCapture& cap, const Rom& rom, const Options& opt){
+    std::mt19937 rng(opt.seed);
+    for(const SalEdge& e : tr.sig[SIG_CLK]->edges){
+        if(e.level && (!opt.max_ns || e.time_ns < cap.start_ns + opt.max_ns)){
+            Cycle c = {};
+            c.rise = e.time_ns;
+            tr.cycles.push_back(c);
+        }
+    }
+    struct MbcRegs ref;
+    mbc_regs_init(&ref, rom.mapper_type, rom.banks, rom.ram_banks);
+    std::vector<uint8_t> ref_ram(rom.ram_banks * MBC_REGS_RAM_BANK_SIZE, 0xFF);
+    uint32_t since_switch = opt.bank_gap;
+    for(size_t i = 0; i + 1 < tr.cycles.size(); i++){
+        Cycle& c = tr.cycles[i];
+        uint64_t end = tr.cycles[i + 1].rise;
+        uint64_t window = std::min<uint64_t>(c.rise + ADDR_WINDOW_NS, end);
+        // The made up bits change with the first recorded one, the address is there with the last
+        c.addr_at = c.rise + ADDR_DELAY_NS;
+        c.settle = 0;
+        for(int a = 0; a < 16; a++){
+            const SalChannel* ch = tr.sig[SIG_A0 + a];
+            if(!ch){
+                continue;
+            }
+            auto it = std::lower_bound(ch->edges.begin(), ch->edges.end(), c.rise,
+                                       [](const SalEdge& e, uint64_t v){ return e.time_ns < v; });
+            for(; it != ch->edges.end() && it->time_ns < window; ++it){
+                c.settle = std::max(c.settle, it->time_ns);
+                if(c.settle == it->time_ns && it->time_ns < c.addr_at){
+                    c.addr_at = it->time_ns;
+                }
+            }
+        }
+        c.settle = std::max(c.settle, c.addr_at);
+        c.ref = std::max(c.settle, c.rise + ADDR_DELAY_NS);
+        bool unresolved = c.settle > c.rise + ADDR_DELAY_NS + ADDR_SLACK_NS;
+        uint64_t mid = std::min(c.ref + 100, end - 1);
+        bool write = false;
+        uint64_t wr_fall = 0;
+        if(tr.sig[SIG_WR]){
+            const SalChannel* wr = tr.sig[SIG_WR];
+            auto it = std::lower_bound(wr->edges.begin(), wr->edges.end(), c.rise,
+                                       [](const SalEdge& e, uint64_t v){ return e.time_ns < v; });
+            write = !level_at(wr, c.rise, 1);
+            wr_fall = c.rise;
+            for(; !write && it != wr->edges.end() && it->time_ns < end; ++it){
+                if(!it->level){
+                    write = true;
+                    wr_fall = it->time_ns;
+                }
+            }
+        }
+        // RD has to stay low from the address to the end of the cycle for it to be a read
+        const SalChannel* rd = tr.sig[SIG_RD];
+        bool rd_low = !level_at(rd, c.ref, 0);
+        auto rd_edge = std::upper_bound(rd->edges.begin(), rd->edges.end(), c.ref,
+                                        [](uint64_t v, const SalEdge& e){ return v < e.time_ns; });
+        bool rd_steady = rd_edge == rd->edges.end() || rd_edge->time_ns >= end;
+        bool cs_low = tr.sig[SIG_CS] ? !level_at(tr.sig[SIG_CS], mid, 1) : (rng() % 10) == 0;
+        c.cs_low = cs_low;
+        // CS only goes low for 0xA000-0xFDFF, so that much has to fit what was recorded
+        uint16_t synth;
+        if(cs_low){
+            synth = 0xA000 + (rng() % 0x5E00);
+        }
+        else if(write){
+            synth = rng() % 4 ? rng() % 0x8000 : 0x8000 + (rng() % 0x2000);
+        }
+        else{
+            uint32_t r = rng() % 20;
+            if(r < 3){
+                synth = r ? 0x8000 + (rng() % 0x2000) : 0xFF80 + (rng() % 0x7F);
+            }
+            else if(since_switch < opt.bank_gap || (r & 1)){
+                synth = rng() % 0x4000;
+            }
+            else{
+                synth = 0x4000 + (rng() % 0x4000);
+            }
+        }
+        c.synth_addr = synth & ~tr.addr_mask;
+        c.synth_data = rng() & ~tr.data_mask;
+        c.addr = c.synth_addr | recorded_addr(tr, mid);
+        // Random data hardly ever turns cart RAM on, so write the real value half the time
+        if(write && (c.addr & MBC_REGS_BANK_ADDR_MASK) == MBC_REGS_RAM_ENABLE_ADDR && (rng() & 1)){
+            c.synth_data = MBC_REGS_RAM_ENABLE_VALUE & ~tr.data_mask;
+        }
+        since_switch++;
+        if(write){
+            c.kind = CYCLE_WRITE;
+            uint64_t sample = std::min(wr_fall + 250, end - 1);
+            c.data = c.synth_data | recorded_data(tr, sample);
+            int16_t ram_bank = mbc_regs_ram_bank(&ref);
+            if(!(c.addr & 0x8000) && (mbc_regs_write(&ref, c.addr, c.data) & MBC_REGS_ROM_CHANGED)){
+                since_switch = 0;
+            }
+            else if((c.addr & 0xE000) == CART_EMU_RAM_ADDR && ram_bank != MBC_REGS_RAM_OFF){
+                ref_ram[(ram_bank * MBC_REGS_RAM_BANK_SIZE) + (c.addr & (MBC_REGS_RAM_BANK_SIZE - 1))] = c.data;
+            }
+        }
+        else if(unresolved || !rd_steady || (!rd_low && !(c.addr & 0x8000))){
+            c.kind = CYCLE_UNCHECKED;
+        }
+        else if(rd_low && !(c.addr & 0x8000)){
+            c.kind = CYCLE_ROM_READ;
+            c.bank = c.addr & 0x4000 ? mbc_regs_bank(&ref) : mbc_regs_bank0(&ref);
+            c.expected = rom.data[(c.bank * BANK_SIZE) + (c.addr & 0x3FFF)];
+        }
+        else if(rd_low && (c.addr & 0xE000) == CART_EMU_RAM_ADDR && mbc_regs_ram_bank(&ref) != MBC_REGS_RAM_OFF){
+            c.kind = CYCLE_RAM_READ;
+            c.bank = mbc_regs_ram_bank(&ref);
+            c.expected = ref_ram[(c.bank * MBC_REGS_RAM_BANK_SIZE) + (c.addr & (MBC_REGS_RAM_BANK_SIZE - 1))];
+        }
+        else{
+            c.kind = CYCLE_OTHER_READ;
+        }
+    }
+    if(!tr.cycles.empty()){
+        tr.cycles.pop_back();
+    }
+}
+
+// An edge only shows up in the capture at the first sample after it. Address edges that land
+// within one sample of where the console settles the address get moved back to it, otherwise
+// at 10 MS/s a good share of addresses look like they settle after the PIO samples them
+static void snap_address_edges(SalCapture& cap){
+    const SalChannel* clk = nullptr;
+    for(const SalChannel& ch : cap.channels){
+        if(signal_index(ch.name) == SIG_CLK){
+            clk = &ch;
+        }
+    }
+    if(!clk || !cap.sample_rate){
+        return;
+    }
+    uint64_t period = 1000000000ull / cap.sample_rate;
+    for(SalChannel& ch : cap.channels){
+        int idx = signal_index(ch.name);
+        if(idx < SIG_A0 || idx >= SIG_D0){
+            continue;
+        }
+        for(SalEdge& e : ch.edges){
+            // Last time CLK went high before this edge
+            auto rise = std::upper_bound(clk->edges.begin(), clk->edges.end(), e.time_ns,
+                                         [](uint64_t v, const SalEdge& c){ return v < c.time_ns; });
+            while(rise != clk->edges.begin()){
+                if((--rise)->level){
+                    break;
+                }
+            }
+            if(rise == clk->edges.end() || !rise->level || rise->time_ns > e.time_ns){
+                continue;
+            }
+            uint64_t settle = rise->time_ns + ADDR_DELAY_NS;
+            if(e.time_ns > settle && e.time_ns <= settle + period){
+                e.time_ns = settle;
+            }
+        }
+    }
+}
+
+static bool load_trace(const SalCapture& cap, Trace& tr, std::string& names){
+    for(const SalChannel& ch : cap.channels){
+        int idx = signal_index(ch.name);
+        names += " " + ch.name;
+        if(idx < 0){
+            continue;
+        }
+        tr.sig[idx] = &ch;
+        if(idx >= SIG_A0 && idx < SIG_D0){
+            tr.addr_mask |= 1 << (idx - SIG_A0);
+        }
+        else if(idx >= SIG_D0){
+            tr.data_mask |= 1 << (idx - SIG_D0);
+        }
+        for(const SalEdge& e : ch.edges){
+            tr.events.push_back({e.time_ns, static_cast<uint8_t>(idx), e.level});
+        }
+    }
+    std::stable_sort(tr.events.begin(), tr.events.end(),
+                     [](const TraceEvent& a, const TraceEvent& b){ return a.t < b.t; });
+    return tr.sig[SIG_CLK] && tr.sig[SIG_RD];
+}
+
+/*  - The firmware side, as cart_emu.c sets it up -  */
+
+struct LookupDma {
+    enum { ARMED, ADDR, DATA, CHAIN } state = ARMED;
+    uint32_t sm;
+    uint32_t addr = 0;
+    uint8_t value = 0;
+    uint64_t ready = 0;
+};
+
+struct Results {
+    uint64_t cycles = 0;
+    uint64_t writes = 0;
+    uint64_t bank_switches = 0;
+    uint64_t ram_switches = 0;
+    uint64_t unchecked = 0;
+    uint64_t late_rom = 0;
+    uint64_t late_ram = 0;
+    uint64_t missing_rom = 0;
+    uint64_t missing_ram = 0;
+    uint64_t stale = 0;
+    uint64_t contention = 0;
+    uint64_t bad_lookups = 0;
+    uint64_t dropped = 0;
+    std::vector<uint32_t> rom_response;
+    std::vector<uint32_t> ram_response;
+};
+
+static void run_capture(const std::string& path, const PioFile& pf, const Rom& rom, const Options& opt, bool& failed){
+    SalCapture cap;
+    std::string error;
+    if(!sal_load(path, cap, error)){
+        fprintf(stderr, "%s\n", error.c_str());
+        failed = true;
+        return;
+    }
+    Trace tr;
+    std::string names;
+    snap_address_edges(cap);
+    if(!load_trace(cap, tr, names)){
+        fprintf(stderr, "%s: needs at least clk and rd\n", path.c_str());
+        failed = true;
+        return;
+    }
+    Memory mem(rom);
+    build_cycles(tr, cap, rom, opt);
+    printf("%s: %llu MS/s,%s\n", path.c_str(), static_cast<unsigned long long>(cap.sample_rate / 1000000), names.c_str());
+    if(tr.cycles.empty()){
+        printf("  no clock in this capture\n");
+        return;
+    }
+
+    Pio pio0;
+    Pio pio1;
+    const PioProgram& rom_prog = pf.programs.at("gbcart_rom");
+    const PioProgram& data_prog = pf.programs.at("gbcart_data");
+    const PioProgram& write_prog = pf.programs.at("gbcart_write");
+    // Claimed in the same order cart_emu_run() does. Lookup SMs on pio0, data and write on pio1
+    enum { SM_LO = 0, SM_HI = 1, SM_RAM = 2, SM_DATA = 0, SM_WRITE = 1 };
+    uint8_t data_offset = pio1.add_program(data_prog);
+    PioSm& data_sm = pio1.sm[SM_DATA];
+    data_sm.config.out_base = GPIO_D7;
+    data_sm.config.out_count = 8;
+    data_sm.config.wrap_target = data_offset + data_prog.wrap_target;
+    data_sm.config.wrap = data_offset + data_prog.wrap;
+    data_sm.config.jmp_pin = GPIO_CLK;
+    data_sm.config.status_n = 1;
+    data_sm.pc = data_offset;
+    uint8_t rom_offset = pio0.add_program(rom_prog);
+    struct MbcRegs emu;
+    mbc_regs_init(&emu, rom.mapper_type, rom.banks, rom.ram_banks);
+    int16_t emu_ram_bank = mbc_regs_ram_bank(&emu);
+    uint8_t ram_entry = rom_offset + rom_prog.public_labels.at("ram_entry");
+    for(int sm : {SM_LO, SM_HI, SM_RAM}){
+        PioSm& s = pio0.sm[sm];
+        uint8_t entry = sm == SM_RAM ? ram_entry : rom_offset + rom_prog.public_labels.at(sm == SM_LO ? "lo_entry" : "hi_entry");
+        s.config.in_base = GPIO_A15;
+        s.config.jmp_pin = GPIO_A14;
+        s.config.wrap_target = entry;
+        s.config.wrap = rom_offset + rom_prog.wrap;
+        s.pc = entry;
+        s.tx.push_back(sm == SM_RAM ? Memory::ram_base(0) : Memory::bank_base(sm == SM_LO ? 0 : mbc_regs_bank(&emu)));
+        s.exec(pio0, 0x80a0); // pull block
+        s.exec(pio0, 0xa027); // mov x, osr
+    }
+    uint8_t write_offset = pio1.add_program(write_prog);
+    PioSm& write_sm = pio1.sm[SM_WRITE];
+    write_sm.config.wrap_target = write_offset + write_prog.wrap_target;
+    write_sm.config.wrap = write_offset + write_prog.wrap;
+    write_sm.pc = write_offset;
+    for(PioSm* s : {&data_sm, &pio0.sm[SM_LO], &pio0.sm[SM_HI], &write_sm}){
+        s->enabled = true;
+    }
+    pio0.sm[SM_RAM].enabled = emu_ram_bank != MBC_REGS_RAM_OFF;
+
+    LookupDma dma[3];
+    dma[0].sm = SM_LO;
+    dma[1].sm = SM_HI;
+    dma[2].sm = SM_RAM;
+    uint64_t core1_busy = 0;
+    // Writes core 1 has picked up, and when it is done with each
+    std::deque<std::pair<uint64_t, uint32_t>> core1_pending;
+
+    uint8_t level[SIG_COUNT] = {0};
+    for(int i = 0; i < SIG_COUNT; i++){
+        level[i] = tr.sig[i] ? tr.sig[i]->initial : (i == SIG_WR || i == SIG_CS);
+    }
+    Results res;
+    size_t ev = 0;
+    size_t ci = 0;
+    int64_t valid_since = -1;
+    bool flagged = false;
+    uint32_t last_gpio = 0;
+    uint32_t same_gpio = 0;
+    uint64_t t = tr.cycles[0].rise - 1000;
+    uint64_t t_end = tr.cycles.back().rise;
+    auto finish_cycle = [&](const Cycle& c){
+        res.cycles++;
+        if(c.kind == CYCLE_WRITE){
+            res.writes++;
+            return;
+        }
+        if(c.kind == CYCLE_UNCHECKED){
+            res.unchecked++;
+            return;
+        }
+        if(c.kind != CYCLE_ROM_READ && c.kind != CYCLE_RAM_READ){
+            return;
+        }
+        bool from_ram = c.kind == CYCLE_RAM_READ;
+        if(valid_since < 0){
+            (from_ram ? res.missing_ram : res.missing_rom)++;
+            return;
+        }
+        uint32_t response = valid_since - c.ref;
+        (from_ram ? res.ram_response : res.rom_response).push_back(response);
+        if(response > opt.deadline_ns){
+            (from_ram ? res.late_ram : res.late_rom)++;
+        }
+    };
+    // Same as switch_ram_bank() in cart_emu.c
+    auto switch_ram_bank = [&](int16_t bank){
+        PioSm& s = pio0.sm[SM_RAM];
+        if(bank == MBC_REGS_RAM_OFF){
+            s.enabled = false;
+        }
+        else if(emu_ram_bank == MBC_REGS_RAM_OFF){
+            s.tx.clear();
+            s.rx.clear();
+            s.isr_count = 0;
+            s.osr_count = 32;
+            s.delay = 0;
+            s.pc = ram_entry;
+            s.tx.push_back(Memory::ram_base(bank));
+            s.enabled = true;
+        }
+        else{
+            s.tx.push_back(Memory::ram_base(bank));
+        }
+        emu_ram_bank = bank;
+    };
+    while(t < t_end){
+        while(ev < tr.events.size() && tr.events[ev].t <= t){
+            level[tr.events[ev].sig] = tr.events[ev].level;
+            ev++;
+        }
+        while(ci + 1 < tr.cycles.size() && tr.cycles[ci + 1].rise <= t){
+            finish_cycle(tr.cycles[ci]);
+            ci++;
+            valid_since = -1;
+            flagged = false;
+        }
+        const Cycle& c = tr.cycles[ci];
+        bool in_cycle = t >= c.rise;
+        const Cycle* addr_cycle = !in_cycle ? nullptr : t >= c.addr_at ? &c : ci ? &tr.cycles[ci - 1] : nullptr;
+
+        // What the console drives
+        uint16_t addr = addr_cycle ? addr_cycle->synth_addr : 0;
+        uint8_t console_data = addr_cycle ? addr_cycle->synth_data : 0;
+        for(int i = 0; i < 16; i++){
+            addr |= level[SIG_A0 + i] << i;
+        }
+        for(int i = 0; i < 8; i++){
+            console_data |= level[SIG_D0 + i] << i;
+        }
+        uint32_t gpio = 0;
+        for(int i = 0; i < 16; i++){
+            gpio |= ((addr >> i) & 1u) << (GPIO_A0 - i);
+        }
+        bool cs = tr.sig[SIG_CS] ? level[SIG_CS] : !(addr_cycle && addr_cycle->cs_low);
+        gpio |= cs << GPIO_CS;
+        gpio |= level[SIG_RD] << GPIO_RD;
+        gpio |= level[SIG_WR] << GPIO_WR;
+        gpio |= level[SIG_CLK] << GPIO_CLK;
+        // Data bus, GBPunk where it drives, the console during writes, pulled up otherwise
+        bool console_drives = !level[SIG_WR];
+        uint8_t driven = pio1.pindirs & 0xFF;
+        for(int i = 0; i < 8; i++){
+            uint8_t pin = GPIO_D7 + (7 - i);
+            uint32_t bit = (driven >> pin) & 1 ? (pio1.pins_out >> pin) & 1 : console_drives ? (console_data >> i) & 1 : 1;
+            gpio |= bit << pin;
+        }
+
+        // Checks
+        if(in_cycle && t >= c.ref){
+            if(c.kind == CYCLE_ROM_READ || c.kind == CYCLE_RAM_READ){
+                uint8_t value = 0;
+                for(int i = 0; i < 8; i++){
+                    value |= ((gpio >> (GPIO_D7 + (7 - i))) & 1) << i;
+                }
+                bool ok = driven == 0xFF && value == c.expected;
+                if(ok && valid_since < 0){
+                    valid_since = t;
+                }
+                else if(!ok){
+                    if(driven == 0xFF && t + PIO_CYCLE_NS >= tr.cycles[ci + 1 < tr.cycles.size() ? ci + 1 : ci].rise &&
+                       (c.addr & 0x4000) && !flagged){
+                        res.stale++;
+                        flagged = true;
+                    }
+                    valid_since = -1;
+                }
+            }
+            else if(driven && !flagged && (c.kind == CYCLE_WRITE || (c.kind == CYCLE_OTHER_READ && (c.addr & 0x8000)))){
+                res.contention++;
+                flagged = true;
+            }
+        }
+        if(driven && console_drives && !flagged){
+            res.contention++;
+            flagged = true;
+        }
+
+        uint32_t pins_before = pio1.pins_out;
+        uint32_t dirs_before = pio1.pindirs;
+        pio0.step(gpio);
+        pio1.step(gpio);
+        bool pio_changed = pio1.pins_out != pins_before || pio1.pindirs != dirs_before;
+
+        // Lookup DMA, one chain per lookup SM
+        for(LookupDma& d : dma){
+            switch(d.state){
+                case LookupDma::ARMED:
+                    if(!pio0.sm[d.sm].rx.empty()){
+                        d.addr = pio0.sm[d.sm].rx.front();
+                        pio0.sm[d.sm].rx.pop_front();
+                        d.state = LookupDma::ADDR;
+                        d.ready = t + (DMA_ADDR_CYCLES * PIO_CYCLE_NS);
+                    }
+                    break;
+                case LookupDma::ADDR:
+                    if(t >= d.ready){
+                        bool from_cart_ram = false;
+                        if(!mem.read(d.addr, d.value, from_cart_ram)){
+                            res.bad_lookups++;
+                            d.value = 0xEE;
+                        }
+                        d.state = LookupDma::DATA;
+                        d.ready = t + (DMA_RAM_CYCLES * PIO_CYCLE_NS);
+                    }
+                    break;
+                case LookupDma::DATA:
+                    if(t >= d.ready){
+                        if(data_sm.tx.size() < PIO_FIFO_DEPTH){
+                            data_sm.tx.push_back(d.value * 0x01010101u);
+                        }
+                        else{
+                            res.dropped++;
+                        }
+                        d.state = LookupDma::CHAIN;
+                        d.ready = t + (DMA_CHAIN_CYCLES * PIO_CYCLE_NS);
+                    }
+                    break;
+                case LookupDma::CHAIN:
+                    if(t >= d.ready){
+                        d.state = LookupDma::ARMED;
+                    }
+                    break;
+            }
+        }
+
+        // Core 1, one write at a time
+        if(!write_sm.rx.empty()){
+            core1_busy = std::max(core1_busy, t) + opt.core1_ns;
+            core1_pending.push_back({core1_busy, write_sm.rx.front()});
+            write_sm.rx.pop_front();
+        }
+        if(!core1_pending.empty() && t >= core1_pending.front().first){
+            uint32_t w = core1_pending.front().second;
+            core1_pending.pop_front();
+            uint16_t waddr = (w >> 7) & 0xFFFF;
+            uint8_t wdata = w >> 24;
+            if(!(waddr & 0x8000)){
+                uint8_t changed = mbc_regs_write(&emu, waddr, wdata);
+                if(changed & MBC_REGS_ROM_CHANGED){
+                    res.bank_switches++;
+                    pio0.sm[SM_HI].tx.push_back(Memory::bank_base(mbc_regs_bank(&emu)));
+                }
+                if(changed & MBC_REGS_RAM_CHANGED){
+                    res.ram_switches++;
+                    switch_ram_bank(mbc_regs_ram_bank(&emu));
+                }
+            }
+            else if((waddr & 0xE000) == CART_EMU_RAM_ADDR && emu_ram_bank != MBC_REGS_RAM_OFF){
+                mem.cart_ram[(emu_ram_bank * MBC_REGS_RAM_BANK_SIZE) + (waddr & (MBC_REGS_RAM_BANK_SIZE - 1))] = wdata;
+            }
+        }
+
+        // Skip ahead through stretches where nothing can happen
+        same_gpio = gpio == last_gpio ? same_gpio + 1 : 0;
+        last_gpio = gpio;
+        bool idle = same_gpio > 3 && !pio_changed && core1_pending.empty() && write_sm.rx.empty();
+        for(const LookupDma& d : dma){
+            idle = idle && d.state == LookupDma::ARMED && pio0.sm[d.sm].rx.empty();
+        }
+        for(PioSm* s : {&pio0.sm[SM_LO], &pio0.sm[SM_HI], &pio0.sm[SM_RAM]}){
+            idle = idle && (!s->enabled || s->waiting_on_pins(pio0));
+        }
+        idle = idle && write_sm.waiting_on_pins(pio1);
+        // The data SM spins on its FIFO rather than waiting, which is as good as idle while
+        // the FIFO stays empty
+        uint16_t data_instr = pio1.mem[data_sm.pc];
+        bool data_polling = data_sm.tx.empty() && ((data_instr >> 13) == 0 || data_instr == MOV_Y_STATUS);
+        idle = idle && (data_polling || data_sm.waiting_on_pins(pio1));
+        uint64_t next = t_end;
+        if(ev < tr.events.size()){
+            next = std::min(next, tr.events[ev].t);
+        }
+        if(ci + 1 < tr.cycles.size()){
+            next = std::min(next, tr.cycles[ci + 1].rise);
+        }
+        for(uint64_t at : {c.addr_at, c.settle, c.ref}){
+            if(at > t){
+                next = std::min(next, at);
+            }
+        }
+        if(idle && next > t + (4 * PIO_CYCLE_NS)){
+            t += ((next - t) / PIO_CYCLE_NS - 1) * PIO_CYCLE_NS;
+        }
+        else{
+            t += PIO_CYCLE_NS;
+        }
+    }
+    finish_cycle(tr.cycles[ci]);
+
+    auto summary = [&](const char* what, std::vector<uint32_t>& v, uint64_t late, uint64_t missing){
+        if(v.empty() && !missing){
+            printf("  %-6s no reads\n", what);
+            return;
+        }
+        std::sort(v.begin(), v.end());
+        uint64_t sum = 0;
+        for(uint32_t r : v){
+            sum += r;
+        }
+        uint32_t worst = v.empty() ? 0 : v.back();
+        printf("  %-6s %8zu reads, response min %u avg %llu p99 %u max %u ns, margin %d ns, late %llu, missing %llu\n",
+               what, v.size(), v.empty() ? 0 : v.front(), static_cast<unsigned long long>(v.empty() ? 0 : sum / v.size()),
+               v.empty() ? 0 : v[(v.size() * 99) / 100], worst, static_cast<int>(opt.deadline_ns) - static_cast<int>(worst),
+               static_cast<unsigned long long>(late), static_cast<unsigned long long>(missing));
+    };
+    printf("  %llu cycles, %llu writes, %llu bank switches, %llu cart RAM switches, %llu unchecked\n",
+           static_cast<unsigned long long>(res.cycles), static_cast<unsigned long long>(res.writes),
+           static_cast<unsigned long long>(res.bank_switches), static_cast<unsigned long long>(res.ram_switches),
+           static_cast<unsigned long long>(res.unchecked));
+    summary("ROM", res.rom_response, res.late_rom, res.missing_rom);
+    summary("RAM", res.ram_response, res.late_ram, res.missing_ram);
+    printf("  stale bank %llu, bus contention %llu, bad lookups %llu, dropped bytes %llu, dropped writes %u\n",
+           static_cast<unsigned long long>(res.stale), static_cast<unsigned long long>(res.contention),
+           static_cast<unsigned long long>(res.bad_lookups), static_cast<unsigned long long>(res.dropped),
+           write_sm.rx_dropped);
+    if(res.late_rom || res.missing_rom || res.late_ram || res.missing_ram || res.contention ||
+       res.bad_lookups || res.dropped){
+        failed = true;
+    }
+}
+
+int main(int argc, char** argv){
+    Options opt;
+    std::vector<std::string> captures;
+    for(int i = 1; i < argc; i++){
+        std::string arg = argv[i];
+        bool has_value = i + 1 < argc;
+        if(arg == "--pio" && has_value){
+            opt.pio_path = argv[++i];
+        }
+        else if(arg == "--rom" && has_value){
+            opt.rom_path = argv[++i];
+        }
+        else if(arg == "--deadline" && has_value){
+            opt.deadline_ns = atoi(argv[++i]);
+        }
+        else if(arg == "--core1" && has_value){
+            opt.core1_ns = atoi(argv[++i]);
+        }
+        else if(arg == "--bank-gap" && has_value){
+            opt.bank_gap = atoi(argv[++i]);
+        }
+        else if(arg == "--max-ms" && has_value){
+            opt.max_ns = static_cast<uint64_t>(atof(argv[++i]) * 1e6);
+        }
+        else if(arg == "--seed" && has_value){
+            opt.seed = atoi(argv[++i]);
+        }
+        else if(arg == "--list"){
+            opt.list = true;
+        }
+        else{
+            captures.push_back(arg);
+        }
+    }
+    PioFile pf;
+    std::string error;
+    if(!pio_assemble(opt.pio_path, pf, error)){
+        fprintf(stderr, "%s\n", error.c_str());
+        return 1;
+    }
+    for(const char* name : {"gbcart_rom", "gbcart_data", "gbcart_write"}){
+        if(!pf.programs.count(name)){
+            fprintf(stderr, "%s has no %s program\n", opt.pio_path.c_str(), name);
+            return 1;
+        }
+    }
+    if(pf.programs.at("gbcart_data").code.size() + pf.programs.at("gbcart_write").code.size() > PIO_INSTR_MEM_SIZE){
+        fprintf(stderr, "gbcart_data and gbcart_write don't fit in one PIO together\n");
+        return 1;
+    }
+    if(opt.list){
+        for(const auto& [name, program] : pf.programs){
+            printf("%s: wrap %u-%u\n", name.c_str(), program.wrap_target, program.wrap);
+            for(size_t i = 0; i < program.code.size(); i++){
+                printf("  %2zu: 0x%04x\n", i, program.code[i]);
+            }
+        }
+    }
+    Rom rom;
+    if(!load_rom(opt.rom_path, rom)){
+        fprintf(stderr, "Need a ROM that is a power of two number of banks, up to %u, with up to %u RAM banks\n",
+                CART_EMU_MAX_BANKS, CART_EMU_MAX_RAM_BANKS);
+        return 1;
+    }
+    if(rom.mapper_type == MAPPER_UNKNOWN){
+        fprintf(stderr, "cart_emu.c can't emulate cart type 0x%02x\n", rom.data[CART_TYPE_ADDR]);
+        return 1;
+    }
+    printf("%u banks, %u cart RAM banks, deadline %u ns\n", rom.banks, rom.ram_banks, opt.deadline_ns);
+    bool failed = false;
+    for(const std::string& path : captures){
+        run_capture(path, pf, rom, opt, failed);
+    }
+    if(captures.empty()){
+        fprintf(stderr, "No captures given, try ../../logic2-caps/*.sal\n");
+        return 1;
+    }
+    return failed ? 1 : 0;
+}
@@ -0,0 +1,656 @@
+#include "pio_sim.h"
+
+#include <cctype>
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+
+enum {
+    OP_JMP = 0, OP_WAIT, OP_IN, OP_OUT, OP_PUSH_PULL, OP_MOV, OP_IRQ, OP_SET
+};
+
+static uint32_t rotr(uint32_t v, uint8_t n){
+    n &= 31;
+    return n ? (v >> n) | (v << (32 - n)) : v;
+}
+
+static uint32_t reverse_bits(uint32_t v){
+    uint32_t r = 0;
+    for(int i = 0; i < 32; i++){
+        r = (r << 1) | ((v >> i) & 1);
+    }
+    return r;
+}
+
+static uint32_t low_mask(uint8_t n){
+    return n >= 32 ? 0xFFFFFFFF : (1u << n) - 1;
+}
+
+/*  - Assembler -  */
+
+namespace {
+
+struct AsmError : std::runtime_error {
+    using std::runtime_error::runtime_error;
+};
+
+// Evaluates the integer expressions pioasm allows in delays and operands
+class ExprParser {
+public:
+    ExprParser(const std::string& text, const std::map<std::string, int>& symbols)
+        : s(text), syms(symbols) {}
+    int parse(){
+        int v = expr();
+        skip_space();
+        if(pos != s.size()){
+            throw AsmError("bad expression '" + s + "'");
+        }
+        return v;
+    }
+private:
+    const std::string& s;
+    const std::map<std::string, int>& syms;
+    size_t pos = 0;
+
+    void skip_space(){
+        while(pos < s.size() && isspace(static_cast<unsigned char>(s[pos]))){
+            pos++;
+        }
+    }
+    int expr(){
+        int v = term();
+        while(true){
+            skip_space();
+            if(pos < s.size() && (s[pos] == '+' || s[pos] == '-')){
+                char op = s[pos++];
+                int rhs = term();
+                v = op == '+' ? v + rhs : v - rhs;
+            }
+            else{
+                return v;
+            }
+        }
+    }
+    int term(){
+        int v = factor();
+        while(true){
+            skip_space();
+            if(pos < s.size() && (s[pos] == '*' || s[pos] == '/')){
+                char op = s[pos++];
+                int rhs = factor();
+                if(op == '/' && !rhs){
+                    throw AsmError("divide by zero in '" + s + "'");
+                }
+                v = op == '*' ? v * rhs : v / rhs;
+            }
+            else{
+                return v;
+            }
+        }
+    }
+    int factor(){
+        skip_space();
+        if(pos >= s.size()){
+            throw AsmError("bad expression '" + s + "'");
+        }
+        if(s[pos] == '-'){
+            pos++;
+            return -factor();
+        }
+        if(s[pos] == '('){
+            pos++;
+            int v = expr();
+            skip_space();
+            if(pos >= s.size() || s[pos] != ')'){
+                throw AsmError("missing ) in '" + s + "'");
+            }
+            pos++;
+            return v;
+        }
+        size_t start = pos;
+        while(pos < s.size() && (isalnum(static_cast<unsigned char>(s[pos])) || s[pos] == '_')){
+            pos++;
+        }
+        std::string tok = s.substr(start, pos - start);
+        if(tok.empty()){
+            throw AsmError("bad expression '" + s + "'");
+        }
+        if(isdigit(static_cast<unsigned char>(tok[0]))){
+            if(tok.size() > 2 && tok[1] == 'b'){
+                return std::stoi(tok.substr(2), nullptr, 2);
+            }
+            return std::stoi(tok, nullptr, 0);
+        }
+        auto it = syms.find(tok);
+        if(it == syms.end()){
+            throw AsmError("unknown symbol '" + tok + "'");
+        }
+        return it->second;
+    }
+};
+
+std::string trim(const std::string& s){
+    size_t a = s.find_first_not_of(" \t\r");
+    size_t b = s.find_last_not_of(" \t\r");
+    return a == std::string::npos ? "" : s.substr(a, b - a + 1);
+}
+
+std::string strip_comment(const std::string& line){
+    size_t cut = line.find(';');
+    size_t slashes = line.find("//");
+    if(slashes < cut){
+        cut = slashes;
+    }
+    return cut == std::string::npos ? line : line.substr(0, cut);
+}
+
+// Split operands on commas and spaces, keeping "x != y" style conditions together
+std::vector<std::string> split_operands(const std::string& s){
+    std::vector<std::string> out;
+    std::string cur;
+    for(char c : s){
+        if(c == ',' || isspace(static_cast<unsigned char>(c))){
+            if(!cur.empty()){
+                out.push_back(cur);
+                cur.clear();
+            }
+        }
+        else{
+            cur += c;
+        }
+    }
+    if(!cur.empty()){
+        out.push_back(cur);
+    }
+    return out;
+}
+
+int lookup(const std::map<std::string, int>& table, const std::string& name, const char* what){
+    auto it = table.find(name);
+    if(it == table.end()){
+        throw AsmError(std::string("bad ") + what + " '" + name + "'");
+    }
+    return it->second;
+}
+
+const std::map<std::string, int> jmp_conds = {
+    {"!x", 1}, {"x--", 2}, {"!y", 3}, {"y--", 4}, {"x!=y", 5}, {"pin", 6}, {"!osre", 7}
+};
+const std::map<std::string, int> wait_srcs = {{"gpio", 0}, {"pin", 1}, {"irq", 2}};
+const std::map<std::string, int> in_srcs = {
+    {"pins", 0}, {"x", 1}, {"y", 2}, {"null", 3}, {"isr", 6}, {"osr", 7}
+};
+const std::map<std::string, int> out_dests = {
+    {"pins", 0}, {"x", 1}, {"y", 2}, {"null", 3}, {"pindirs", 4}, {"pc", 5}, {"isr", 6}, {"exec", 7}
+};
+const std::map<std::string, int> mov_dests = {
+    {"pins", 0}, {"x", 1}, {"y", 2}, {"exec", 4}, {"pc", 5}, {"isr", 6}, {"osr", 7}
+};
+const std::map<std::string, int> mov_srcs = {
+    {"pins", 0}, {"x", 1}, {"y", 2}, {"null", 3}, {"status", 5}, {"isr", 6}, {"osr", 7}
+};
+const std::map<std::string, int> set_dests = {{"pins", 0}, {"x", 1}, {"y", 2}, {"pindirs", 4}};
+
+struct SourceLine {
+    int number;
+    std::string text;
+};
+
+uint16_t encode(const std::string& mnemonic, const std::vector<std::string>& ops,
+                const std::map<std::string, int>& syms, const std::map<std::string, int>& labels){
+    auto value = [&](const std::string& s){
+        return ExprParser(s, syms).parse();
+    };
+    auto need = [&](size_t n){
+        if(ops.size() != n){
+            throw AsmError("wrong number of operands for " + mnemonic);
+        }
+    };
+    auto bit_count = [&](const std::string& s){
+        int n = value(s);
+        if(n < 1 || n > 32){
+            throw AsmError("bit count out of range");
+        }
+        return n & 31;
+    };
+    if(mnemonic == "nop"){
+        need(0);
+        return (OP_MOV << 13) | (2 << 5) | 2;
+    }
+    if(mnemonic == "jmp"){
+        if(ops.empty() || ops.size() > 2){
+            throw AsmError("wrong number of operands for jmp");
+        }
+        int cond = ops.size() == 2 ? lookup(jmp_conds, ops[0], "condition") : 0;
+        const std::string& target = ops.back();
+        auto it = labels.find(target);
+        int addr = it != labels.end() ? it->second : value(target);
+        return (OP_JMP << 13) | (cond << 5) | (addr & 31);
+    }
+    if(mnemonic == "wait"){
+        need(3);
+        int pol = value(ops[0]);
+        int src = lookup(wait_srcs, ops[1], "wait source");
+        return (OP_WAIT << 13) | ((pol & 1) << 7) | (src << 5) | (value(ops[2]) & 31);
+    }
+    if(mnemonic == "in"){
+        need(2);
+        return (OP_IN << 13) | (lookup(in_srcs, ops[0], "in source") << 5) | bit_count(ops[1]);
+    }
+    if(mnemonic == "out"){
+        need(2);
+        return (OP_OUT << 13) | (lookup(out_dests, ops[0], "out destination") << 5) | bit_count(ops[1]);
+    }
+    if(mnemonic == "push" || mnemonic == "pull"){
+        bool pull = mnemonic == "pull";
+        int if_flag = 0;
+        int block = 1;
+        for(const std::string& op : ops){
+            if(op == (pull ? "ifempty" : "iffull")){
+                if_flag = 1;
+            }
+            else if(op == "block"){
+                block = 1;
+            }
+            else if(op == "noblock"){
+                block = 0;
+            }
+            else{
+                throw AsmError("bad " + mnemonic + " option '" + op + "'");
+            }
+        }
+        return (OP_PUSH_PULL << 13) | (pull << 7) | (if_flag << 6) | (block << 5);
+    }
+    if(mnemonic == "mov"){
+        need(2);
+        std::string src = ops[1];
+        int op = 0;
+        if(src[0] == '!' || src[0] == '~'){
+            op = 1;
+            src = src.substr(1);
+        }
+        else if(src.compare(0, 2, "::") == 0){
+            op = 2;
+            src = src.substr(2);
+        }
+        return (OP_MOV << 13) | (lookup(mov_dests, ops[0], "mov destination") << 5) | (op << 3) |
+               lookup(mov_srcs, src, "mov source");
+    }
+    if(mnemonic == "set"){
+        need(2);
+        return (OP_SET << 13) | (lookup(set_dests, ops[0], "set destination") << 5) | (value(ops[1]) & 31);
+    }
+    throw AsmError("unsupported instruction '" + mnemonic + "'");
+}
+
+}
+
+bool pio_assemble(const std::string& path, PioFile& out, std::string& error){
+    std::ifstream file(path);
+    if(!file){
+        error = "could not open " + path;
+        return false;
+    }
+    std::map<std::string, int> global_syms;
+    // Instructions of each program in order, labels and directives already taken out
+    std::map<std::string, std::vector<SourceLine>> bodies;
+    std::map<std::string, std::map<std::string, int>> labels;
+    std::string current;
+    std::string raw;
+    int number = 0;
+    try{
+        while(std::getline(file, raw)){
+            number++;
+            std::string line = trim(strip_comment(raw));
+            if(line.empty()){
+                continue;
+            }
+            std::vector<std::string> words = split_operands(line);
+            if(words[0] == ".program"){
+                current = words.at(1);
+                out.programs[current] = PioProgram();
+                bodies[current];
+                continue;
+            }
+            if(words[0] == ".define"){
+                bool pub = words.size() > 1 && words[1] == "PUBLIC";
+                size_t name_at = pub ? 2 : 1;
+                if(words.size() <= name_at + 1){
+                    throw AsmError("bad .define");
+                }
+                size_t expr_at = line.find(words[name_at]) + words[name_at].size();
+                int v = ExprParser(line.substr(expr_at), global_syms).parse();
+                global_syms[words[name_at]] = v;
+                if(pub){
+                    out.defines[words[name_at]] = v;
+                }
+                continue;
+            }
+            if(current.empty()){
+                throw AsmError("'" + line + "' outside of a program");
+            }
+            PioProgram& program = out.programs[current];
+            uint8_t here = bodies[current].size();
+            if(words[0] == ".wrap_target"){
+                program.wrap_target = here;
+                continue;
+            }
+            if(words[0] == ".wrap"){
+                if(!here){
+                    throw AsmError(".wrap before any instructions");
+                }
+                program.wrap = here - 1;
+                labels[current]["__wrap_set"] = 1;
+                continue;
+            }
+            if(words[0][0] == '.'){
+                throw AsmError("unsupported directive " + words[0]);
+            }
+            if(line.back() == ':'){
+                bool pub = words[0] == "public";
+                std::string name = words[pub ? 1 : 0];
+                name.pop_back();
+                labels[current][name] = here;
+                if(pub){
+                    program.public_labels[name] = here;
+                }
+                continue;
+            }
+            bodies[current].push_back({number, line});
+        }
+        for(auto& [name, body] : bodies){
+            PioProgram& program = out.programs[name];
+            std::map<std::string, int>& program_labels = labels[name];
+            if(!program_labels.count("__wrap_set")){
+                program.wrap = body.empty() ? 0 : body.size() - 1;
+            }
+            for(const SourceLine& src : body){
+                number = src.number;
+                std::string text = src.text;
+                int delay = 0;
+                size_t open = text.find('[');
+                if(open != std::string::npos){
+                    size_t close = text.find(']', open);
+                    if(close == std::string::npos){
+                        throw AsmError("missing ]");
+                    }
+                    delay = ExprParser(text.substr(open + 1, close - open - 1), global_syms).parse();
+                    if(delay < 0 || delay > 31){
+                        throw AsmError("delay out of range");
+                    }
+                    text = trim(text.substr(0, open));
+                }
+                std::vector<std::string> words = split_operands(text);
+                // "x != y" is the only condition with spaces in it
+                std::string joined;
+                for(size_t i = 1; i < words.size(); i++){
+                    joined += (i > 1 ? " " : "") + words[i];
+                }
+                size_t ne = joined.find(" != ");
+                if(ne != std::string::npos){
+                    joined.replace(ne, 4, "!=");
+                }
+                std::vector<std::string> ops = split_operands(joined);
+                program.code.push_back(encode(words[0], ops, global_syms, program_labels) | (delay << 8));
+            }
+            if(program.code.size() > PIO_INSTR_MEM_SIZE){
+                throw AsmError("program " + name + " is too big");
+            }
+        }
+    }
+    catch(const std::exception& e){
+        error = path + ":" + std::to_string(number) + ": " + e.what();
+        return false;
+    }
+    return true;
+}
+
+/*  - State machines -  */
+
+uint8_t Pio::add_program(const PioProgram& program){
+    if(next_free + program.code.size() > PIO_INSTR_MEM_SIZE){
+        throw std::runtime_error("PIO instruction memory is full");
+    }
+    uint8_t offset = next_free;
+    for(size_t i = 0; i < program.code.size(); i++){
+        uint16_t instr = program.code[i];
+        // Jumps are relative to the program, pio_add_program() moves them
+        if((instr >> 13) == OP_JMP){
+            instr = (instr & ~31) | ((instr + offset) & 31);
+        }
+        mem[offset + i] = instr;
+    }
+    next_free += program.code.size();
+    return offset;
+}
+
+void Pio::step(uint32_t gpio){
+    for(PioSm& s : sm){
+        s.step(*this);
+    }
+    sync[1] = sync[0];
+    sync[0] = gpio;
+}
+
+void PioSm::exec(Pio& pio, uint16_t instr){
+    bool jumped = false;
+    if(!run(pio, instr, jumped)){
+        throw std::runtime_error("exec'd instruction stalled");
+    }
+}
+
+bool PioSm::waiting_on_pins(const Pio& pio) const {
+    if(!enabled){
+        return true;
+    }
+    if(delay){
+        return false;
+    }
+    uint16_t instr = pio.mem[pc];
+    uint8_t op = instr >> 13;
+    uint32_t pins = pio.pins_in();
+    if(op == OP_WAIT){
+        uint8_t pol = (instr >> 7) & 1;
+        uint8_t src = (instr >> 5) & 3;
+        uint8_t index = instr & 31;
+        uint8_t pin = src == 0 ? index : (config.in_base + index) & 31;
+        return src < 2 && ((pins >> pin) & 1) != pol;
+    }
+    if(op == OP_PUSH_PULL){
+        bool pull = (instr >> 7) & 1;
+        bool block = (instr >> 5) & 1;
+        return block && (pull ? tx.empty() : rx.size() >= PIO_FIFO_DEPTH);
+    }
+    return false;
+}
+
+void PioSm::step(Pio& pio){
+    if(!enabled){
+        return;
+    }
+    if(delay){
+        delay--;
+        return;
+    }
+    uint16_t instr = pio.mem[pc];
+    bool jumped = false;
+    if(!run(pio, instr, jumped)){
+        return;
+    }
+    delay = (instr >> 8) & 31;
+    if(!jumped){
+        pc = pc == config.wrap ? config.wrap_target : (pc + 1) & 31;
+    }
+}
+
+bool PioSm::run(Pio& pio, uint16_t instr, bool& jumped){
+    uint8_t op = instr >> 13;
+    uint8_t arg1 = (instr >> 5) & 7;
+    uint8_t arg2 = instr & 31;
+    uint32_t pins = rotr(pio.pins_in(), config.in_base);
+    auto write_pins = [&](uint32_t& target, uint32_t data, uint8_t count){
+        for(uint8_t i = 0; i < count; i++){
+            uint8_t pin = (config.out_base + i) & 31;
+            target = (target & ~(1u << pin)) | (((data >> i) & 1) << pin);
+        }
+    };
+    switch(op){
+        case OP_JMP: {
+            bool take = false;
+            switch(arg1){
+                case 0: take = true; break;
+                case 1: take = !x; break;
+                case 2: take = x != 0; x--; break;
+                case 3: take = !y; break;
+                case 4: take = y != 0; y--; break;
+                case 5: take = x != y; break;
+                case 6: take = (pio.pins_in() >> config.jmp_pin) & 1; break;
+                case 7: take = osr_count < 32; break;
+            }
+            if(take){
+                pc = arg2;
+                jumped = true;
+            }
+            return true;
+        }
+        case OP_WAIT: {
+            uint8_t pol = (instr >> 7) & 1;
+            uint8_t src = (instr >> 5) & 3;
+            if(src == 2){
+                throw std::runtime_error("wait irq isn't simulated");
+            }
+            uint8_t pin = src == 0 ? arg2 : (config.in_base + arg2) & 31;
+            return ((pio.pins_in() >> pin) & 1) == pol;
+        }
+        case OP_IN: {
+            uint8_t n = arg2 ? arg2 : 32;
+            uint32_t data = 0;
+            switch(arg1){
+                case 0: data = pins; break;
+                case 1: data = x; break;
+                case 2: data = y; break;
+                case 3: data = 0; break;
+                case 6: data = isr; break;
+                case 7: data = osr; break;
+                default: throw std::runtime_error("bad in source");
+            }
+            data &= low_mask(n);
+            if(config.in_shift_right){
+                isr = n == 32 ? data : (isr >> n) | (data << (32 - n));
+            }
+            else{
+                isr = n == 32 ? data : (isr << n) | data;
+            }
+            isr_count = isr_count + n > 32 ? 32 : isr_count + n;
+            return true;
+        }
+        case OP_OUT: {
+            uint8_t n = arg2 ? arg2 : 32;
+            uint32_t data;
+            if(config.out_shift_right){
+                data = osr & low_mask(n);
+                osr = n == 32 ? 0 : osr >> n;
+            }
+            else{
+                data = n == 32 ? osr : osr >> (32 - n);
+                osr = n == 32 ? 0 : osr << n;
+            }
+            osr_count = osr_count + n > 32 ? 32 : osr_count + n;
+            switch(arg1){
+                case 0: write_pins(pio.pins_out, data, n); break;
+                case 1: x = data; break;
+                case 2: y = data; break;
+                case 3: break;
+                case 4: write_pins(pio.pindirs, data, n); break;
+                case 5: pc = data & 31; jumped = true; break;
+                case 6: isr = data; isr_count = n; break;
+                default: throw std::runtime_error("out exec isn't simulated");
+            }
+            return true;
+        }
+        case OP_PUSH_PULL: {
+            bool pull = (instr >> 7) & 1;
+            bool if_flag = (instr >> 6) & 1;
+            bool block = (instr >> 5) & 1;
+            if(pull){
+                if(if_flag && osr_count < 32){
+                    return true;
+                }
+                if(tx.empty()){
+                    if(block){
+                        return false;
+                    }
+                    osr = x;
+                }
+                else{
+                    osr = tx.front();
+                    tx.pop_front();
+                }
+                osr_count = 0;
+            }
+            else{
+                if(if_flag && isr_count < 32){
+                    return true;
+                }
+                if(rx.size() >= PIO_FIFO_DEPTH){
+                    if(block){
+                        return false;
+                    }
+                    rx_dropped++;
+                }
+                else{
+                    rx.push_back(isr);
+                }
+                isr = 0;
+                isr_count = 0;
+            }
+            return true;
+        }
+        case OP_MOV: {
+            uint8_t src = instr & 7;
+            uint8_t mov_op = (instr >> 3) & 3;
+            uint32_t data = 0;
+            switch(src){
+                case 0: data = pins; break;
+                case 1: data = x; break;
+                case 2: data = y; break;
+                case 3: data = 0; break;
+                case 5: {
+                    // All ones while the chosen FIFO has fewer than status_n entries
+                    size_t level = config.status_rx ? rx.size() : tx.size();
+                    data = level < config.status_n ? 0xFFFFFFFFu : 0;
+                    break;
+                }
+                case 6: data = isr; break;
+                case 7: data = osr; break;
+                default: throw std::runtime_error("bad mov source");
+            }
+            if(mov_op == 1){
+                data = ~data;
+            }
+            else if(mov_op == 2){
+                data = reverse_bits(data);
+            }
+            switch(arg1){
+                case 0: write_pins(pio.pins_out, data, config.out_count); break;
+                case 1: x = data; break;
+                case 2: y = data; break;
+                case 5: pc = data & 31; jumped = true; break;
+                case 6: isr = data; isr_count = 0; break;
+                case 7: osr = data; osr_count = 0; break;
+                default: throw std::runtime_error("mov exec isn't simulated");
+            }
+            return true;
+        }
+        case OP_SET:
+            // gbbus.pio never sets pins, so there is no set_base to worry about
+            switch(arg1){
+                case 1: x = arg2; break;
+                case 2: y = arg2; break;
+                default: throw std::runtime_error("set pins isn't simulated");
+            }
+            return true;
+        default:
+            throw std::runtime_error("irq isn't simulated");
+    }
+}
@@ -0,0 +1,94 @@
+#ifndef CARTSIM_PIO_SIM_H_
+#define CARTSIM_PIO_SIM_H_
+
+#include <cstdint>
+#include <deque>
+#include <map>
+#include <string>
+#include <vector>
+
+// Just enough of pioasm and an RP2040 PIO block to run the programs in gbbus.pio cycle by
+// cycle. Programs get assembled to the same 16 bit instructions the real pioasm makes, and
+// the state machines run those, so a typo in the .pio file breaks the sim the same way it
+// would break the hardware
+
+#define PIO_INSTR_MEM_SIZE  32
+#define PIO_FIFO_DEPTH      4
+
+struct PioProgram {
+    std::vector<uint16_t> code;
+    uint8_t wrap_target = 0;
+    uint8_t wrap = 0;
+    std::map<std::string, uint8_t> public_labels;
+};
+
+struct PioFile {
+    std::map<std::string, int> defines; // Only the PUBLIC ones, like pioasm puts in the header
+    std::map<std::string, PioProgram> programs;
+};
+
+// Assemble a .pio file. Returns false and fills in error if it can't
+bool pio_assemble(const std::string& path, PioFile& out, std::string& error);
+
+struct PioSmConfig {
+    uint8_t in_base = 0;
+    uint8_t out_base = 0;
+    uint8_t out_count = 0;
+    uint8_t jmp_pin = 0;
+    bool in_shift_right = false;
+    bool out_shift_right = false;
+    uint8_t wrap_target = 0;
+    uint8_t wrap = PIO_INSTR_MEM_SIZE - 1;
+    // What mov x, status compares against, like sm_config_set_mov_status()
+    bool status_rx = false;
+    uint8_t status_n = 0;
+};
+
+class Pio;
+
+class PioSm {
+public:
+    PioSmConfig config;
+    bool enabled = false;
+    uint8_t pc = 0;
+    uint32_t x = 0;
+    uint32_t y = 0;
+    uint32_t isr = 0;
+    uint32_t osr = 0;
+    uint8_t isr_count = 0;
+    uint8_t osr_count = 32;
+    uint8_t delay = 0;
+    std::deque<uint32_t> tx;
+    std::deque<uint32_t> rx;
+    uint32_t rx_dropped = 0;
+
+    // Run one instruction right now, like pio_sm_exec()
+    void exec(Pio& pio, uint16_t instr);
+    // True if the SM is stuck on an instruction that won't finish until the pins change
+    bool waiting_on_pins(const Pio& pio) const;
+private:
+    friend class Pio;
+    // Returns false if the instruction stalled
+    bool run(Pio& pio, uint16_t instr, bool& jumped);
+    void step(Pio& pio);
+};
+
+class Pio {
+public:
+    PioSm sm[4];
+    uint16_t mem[PIO_INSTR_MEM_SIZE] = {0};
+    uint32_t pins_out = 0;
+    uint32_t pindirs = 0;
+
+    // Load a program at the next free spot, fixing up jumps. Returns the offset
+    uint8_t add_program(const PioProgram& program);
+    // Pins as the SMs see them, two cycles late like the input synchronisers make them
+    uint32_t pins_in() const { return sync[1]; }
+    // Advance one system clock cycle with the pins as they are right now
+    void step(uint32_t gpio);
+private:
+    uint8_t next_free = 0;
+    uint32_t sync[2] = {0, 0};
+};
+
+#endif
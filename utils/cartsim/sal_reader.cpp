@@ -0,0 +1,171 @@
+#include "sal_reader.h"
+
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <regex>
+#include <sys/stat.h>
+
+#define SAL_MAGIC           "<SALEAE>"
+#define SAL_TYPE_DIGITAL    100
+// Everything before the chunk count. The times in there are in the chunks too
+#define SAL_HEADER_LEN      0x3B
+#define SAL_INDEX_ENTRY_LEN 20
+
+static bool read_member(const std::string& path, const std::string& member, std::vector<uint8_t>& out){
+    struct stat st;
+    out.clear();
+    if(stat(path.c_str(), &st) == 0 && S_ISDIR(st.st_mode)){
+        std::ifstream file(path + "/" + member, std::ios::binary);
+        if(!file){
+            return false;
+        }
+        out.assign((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+        return true;
+    }
+    std::string cmd = "unzip -p '" + path + "' '" + member + "' 2>/dev/null";
+    FILE* pipe = popen(cmd.c_str(), "r");
+    if(!pipe){
+        return false;
+    }
+    uint8_t buf[65536];
+    size_t n;
+    while((n = fread(buf, 1, sizeof(buf), pipe)) > 0){
+        out.insert(out.end(), buf, buf + n);
+    }
+    return pclose(pipe) == 0 && !out.empty();
+}
+
+static uint64_t get_u64(const std::vector<uint8_t>& b, size_t at){
+    uint64_t v = 0;
+    for(int i = 7; i >= 0; i--){
+        v = (v << 8) | b.at(at + i);
+    }
+    return v;
+}
+
+static uint32_t get_u32(const std::vector<uint8_t>& b, size_t at){
+    return b.at(at) | (b.at(at + 1) << 8) | (b.at(at + 2) << 16) | (static_cast<uint32_t>(b.at(at + 3)) << 24);
+}
+
+// Big endian varint. The first byte has 6 bits of count and uses 0x40 for "more", the rest
+// have 7 and use 0x80. Counts are stored one less than they are
+static uint64_t get_count(const std::vector<uint8_t>& b, size_t& at, size_t end){
+    uint8_t byte = b.at(at++);
+    uint64_t v = byte & 0x3F;
+    if(byte & 0x40){
+        do{
+            if(at >= end){
+                throw std::out_of_range("count runs off the end of the chunk");
+            }
+            byte = b[at++];
+            v = (v << 7) | (byte & 0x7F);
+        } while(byte & 0x80);
+    }
+    return v + 1;
+}
+
+static bool parse_channel(const std::vector<uint8_t>& b, SalChannel& ch, SalCapture& cap, std::string& error){
+    if(b.size() < SAL_HEADER_LEN + 8 || memcmp(b.data(), SAL_MAGIC, 8) || get_u32(b, 12) != SAL_TYPE_DIGITAL){
+        error = "not a digital channel";
+        return false;
+    }
+    size_t at = SAL_HEADER_LEN;
+    uint64_t num_chunks = get_u64(b, at);
+    at += 8;
+    bool first = true;
+    uint8_t state = 0;
+    for(uint64_t c = 0; c < num_chunks; c++){
+        uint64_t begin = get_u64(b, at);
+        uint64_t end = get_u64(b, at + 8);
+        uint64_t rate = get_u64(b, at + 24);
+        uint64_t data_len = get_u64(b, at + 40);
+        at += 48;
+        size_t data_at = at;
+        at += data_len;
+        uint64_t index_len = get_u64(b, at);
+        at += 8;
+        if(!rate || 1000000000 % rate || !index_len){
+            error = "unexpected chunk layout";
+            return false;
+        }
+        uint64_t ns_per_sample = 1000000000 / rate;
+        uint8_t chunk_state = get_u32(b, at + 16) & 1;
+        at += index_len * SAL_INDEX_ENTRY_LEN;
+        if(first){
+            ch.initial = chunk_state;
+            if(!cap.sample_rate){
+                cap.sample_rate = rate;
+                cap.start_ns = begin * ns_per_sample;
+            }
+            first = false;
+        }
+        else if(chunk_state != state){
+            // Chunks pick up where the last left off, but don't count on it
+            ch.edges.push_back({begin * ns_per_sample, chunk_state});
+        }
+        state = chunk_state;
+        uint64_t t = begin;
+        size_t pos = data_at;
+        while(pos < data_at + data_len){
+            t += get_count(b, pos, data_at + data_len);
+            if(pos < data_at + data_len){
+                state ^= 1;
+                ch.edges.push_back({t * ns_per_sample, state});
+            }
+        }
+        if(end * ns_per_sample > cap.end_ns){
+            cap.end_ns = end * ns_per_sample;
+        }
+    }
+    return true;
+}
+
+const SalChannel* SalCapture::find(const std::string& name) const {
+    for(const SalChannel& ch : channels){
+        if(ch.name == name){
+            return &ch;
+        }
+    }
+    return nullptr;
+}
+
+bool sal_load(const std::string& path, SalCapture& out, std::string& error){
+    std::vector<uint8_t> meta;
+    if(!read_member(path, "meta.json", meta)){
+        error = "could not read meta.json from " + path;
+        return false;
+    }
+    std::string text(meta.begin(), meta.end());
+    std::regex row("\"name\"\\s*:\\s*\"([^\"]*)\"\\s*,\\s*\"channel\"\\s*:\\s*\\{[^}]*\"type\"\\s*:\\s*\"Digital\"\\s*,\\s*\"deviceChannel\"\\s*:\\s*(\\d+)");
+    std::vector<std::pair<int, std::string>> names;
+    for(auto it = std::sregex_iterator(text.begin(), text.end(), row); it != std::sregex_iterator(); ++it){
+        names.push_back({std::stoi((*it)[2]), (*it)[1]});
+    }
+    for(const auto& [index, name] : names){
+        std::vector<uint8_t> bin;
+        // Channels that never changed can be left out of the capture
+        if(!read_member(path, "digital-" + std::to_string(index) + ".bin", bin)){
+            continue;
+        }
+        SalChannel ch;
+        ch.name = name;
+        try{
+            if(!parse_channel(bin, ch, out, error)){
+                error = name + ": " + error;
+                return false;
+            }
+        }
+        catch(const std::out_of_range&){
+            error = name + ": truncated";
+            return false;
+        }
+        out.channels.push_back(std::move(ch));
+    }
+    if(out.channels.empty()){
+        error = "no digital channels in " + path;
+        return false;
+    }
+    return true;
+}
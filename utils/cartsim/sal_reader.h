@@ -0,0 +1,40 @@
+#ifndef CARTSIM_SAL_READER_H_
+#define CARTSIM_SAL_READER_H_
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Reads the digital channels out of a Saleae Logic 2 capture (.sal). A .sal is a zip of
+// meta.json, which names the channels, and one digital-N.bin per channel. Either the .sal
+// itself (needs unzip on the PATH) or a directory it was extracted to will do.
+//
+// Each digital-N.bin is a list of chunks. A chunk has its start and end in samples and a
+// run of varint encoded sample counts between transitions, starting from the state in the
+// chunk's first index entry. The last count runs to the end of the chunk and isn't a transition
+
+struct SalEdge {
+    uint64_t time_ns;
+    uint8_t level;
+};
+
+struct SalChannel {
+    std::string name;
+    uint8_t initial = 0;
+    std::vector<SalEdge> edges;
+};
+
+struct SalCapture {
+    uint64_t sample_rate = 0;
+    uint64_t start_ns = 0;
+    uint64_t end_ns = 0;
+    std::vector<SalChannel> channels;
+
+    // nullptr if there's no channel by that name
+    const SalChannel* find(const std::string& name) const;
+};
+
+// Returns false and fills in error if the capture can't be read
+bool sal_load(const std::string& path, SalCapture& out, std::string& error);
+
+#endif
@@ -0,0 +1,276 @@
+// Estimates what packed raw reads buy over the ROM size mix in all_games.csv. Every ROM gets
+// framed and packed the same way vendor_raw.c does it, and the totals are turned into an
+// effective throughput for a given USB link speed, cart bus speed and device pack speed.
+// Only real ROM images give a packed throughput, synthetic ones just get a ratio to go on.
+//
+// Build: gcc -O2 -c ../../software/disk/raw_codec.c -o raw_codec.o
+//        g++ -O2 -std=c++17 codec_bench.cpp raw_codec.o -o codec_bench
+//
+// Usage: codec_bench [--csv ../all_games.csv] [--roms dir] [--link MB/s] [--bus MB/s] [--pack MB/s]
+//   --roms   Directory with the ROMs named as in the Filename column. Any that are missing
+//            get synthetic contents instead, and are counted separately in the output
+//   --link   What the raw path moves over USB, default 1.0
+//   --bus    How fast the cart can be read, default 1.5
+//   --pack   How fast the device packs, from the "Device packing" line of gbraw --packed bench.
+//            The device reads a frame then packs it, so this adds to the bus time. Without it
+//            there's no packed throughput, since the host's pack speed says nothing about the device
+
+#include "../../software/disk/raw_codec.h"
+#include "../../software/disk/raw_protocol.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <map>
+#include <random>
+#include <string>
+#include <vector>
+
+struct SizeBucket {
+    uint32_t roms = 0;
+    uint32_t synthetic = 0;
+    uint64_t raw_bytes = 0;
+    uint64_t sent_bytes = 0;
+    // Just the synthetic ROMs, kept apart so they never make it into a throughput
+    uint64_t synth_raw_bytes = 0;
+    uint64_t synth_sent_bytes = 0;
+};
+
+// Split a line of the CSV, which quotes titles that have commas in them
+static std::vector<std::string> split_csv(const std::string& line){
+    std::vector<std::string> fields(1);
+    bool quoted = false;
+    for(char c : line){
+        if(c == '"'){
+            quoted = !quoted;
+        }
+        else if(c == ',' && !quoted){
+            fields.emplace_back();
+        }
+        else if(c != '\r'){
+            fields.back() += c;
+        }
+    }
+    return fields;
+}
+
+static bool load_rom(const std::string& path, uint32_t size, std::vector<uint8_t>& out){
+    std::ifstream file(path, std::ios::binary);
+    if(!file){
+        return false;
+    }
+    out.assign((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+    out.resize(size, 0xFF);
+    return true;
+}
+
+// Stand in for a ROM that isn't on hand. Code and data with a skewed byte mix, some tables
+// that repeat, and the unused tail of each bank filled with 0xFF like a real build leaves it
+static void synth_rom(uint32_t size, uint32_t seed, std::vector<uint8_t>& out){
+    std::mt19937 rng(seed);
+    out.assign(size, 0xFF);
+    for(uint32_t bank = 0; bank < size / 0x4000; bank++){
+        uint8_t* data = out.data() + (bank * 0x4000);
+        uint32_t used = 0x1000 + (rng() % 0x3000);
+        uint32_t i = 0;
+        while(i < used){
+            uint32_t kind = rng() % 8;
+            uint32_t n = 4 + (rng() % 60);
+            if(i + n > used){
+                n = used - i;
+            }
+            if(kind == 0 && i > 256){
+                // Repeat something from earlier in the bank
+                uint32_t from = rng() % i;
+                for(uint32_t k = 0; k < n; k++){
+                    data[i + k] = data[from + k];
+                }
+            }
+            else if(kind == 1){
+                uint8_t fill = rng() % 2 ? 0x00 : 0xFF;
+                for(uint32_t k = 0; k < n; k++){
+                    data[i + k] = fill;
+                }
+            }
+            else{
+                for(uint32_t k = 0; k < n; k++){
+                    // Low bytes and a handful of common opcodes turn up far more than the rest
+                    uint32_t r = rng() % 4;
+                    data[i + k] = r == 0 ? rng() % 0x10 : r == 1 ? "\x3E\x21\xCD\xC9\x18\x20\xEA\xFA"[rng() % 8] : rng() % 0x100;
+                }
+            }
+            i += n;
+        }
+    }
+}
+
+// Bytes that go over USB for one ROM, frame headers included
+static uint64_t packed_size(const std::vector<uint8_t>& rom){
+    std::vector<uint8_t> packed(RAW_FRAME_MAX);
+    uint64_t sent = 0;
+    for(uint32_t pos = 0; pos < rom.size(); pos += RAW_FRAME_MAX){
+        uint32_t n = rom.size() - pos < RAW_FRAME_MAX ? rom.size() - pos : RAW_FRAME_MAX;
+        uint32_t packed_len = raw_codec_pack(rom.data() + pos, n, packed.data(), n - 1);
+        if(packed_len){
+            std::vector<uint8_t> check(n);
+            if(raw_codec_unpack(packed.data(), packed_len, check.data(), n) != n ||
+               !std::equal(check.begin(), check.end(), rom.begin() + pos)){
+                fprintf(stderr, "Frame at 0x%x did not round trip\n", pos);
+                exit(1);
+            }
+        }
+        sent += sizeof(RawFrame) + (packed_len ? packed_len : n);
+    }
+    return sent;
+}
+
+int main(int argc, char** argv){
+    std::string csv_path = "../all_games.csv";
+    std::string rom_dir;
+    double link_mbps = 1.0;
+    double bus_mbps = 1.5;
+    double pack_mbps = 0;
+    for(int i = 1; i + 1 < argc; i += 2){
+        std::string arg = argv[i];
+        if(arg == "--csv"){
+            csv_path = argv[i + 1];
+        }
+        else if(arg == "--roms"){
+            rom_dir = argv[i + 1];
+        }
+        else if(arg == "--link"){
+            link_mbps = atof(argv[i + 1]);
+        }
+        else if(arg == "--bus"){
+            bus_mbps = atof(argv[i + 1]);
+        }
+        else if(arg == "--pack"){
+            pack_mbps = atof(argv[i + 1]);
+        }
+    }
+    std::ifstream csv(csv_path);
+    if(!csv){
+        fprintf(stderr, "Could not open %s\n", csv_path.c_str());
+        return 1;
+    }
+    std::string line;
+    std::getline(csv, line);
+    std::vector<std::string> columns = split_csv(line);
+    int filename_col = -1;
+    int size_col = -1;
+    for(size_t i = 0; i < columns.size(); i++){
+        if(columns[i] == "Filename"){
+            filename_col = i;
+        }
+        else if(columns[i] == "ROM Size"){
+            size_col = i;
+        }
+    }
+    if(filename_col < 0 || size_col < 0){
+        fprintf(stderr, "%s has no Filename or ROM Size column\n", csv_path.c_str());
+        return 1;
+    }
+
+    std::map<uint32_t, SizeBucket> buckets;
+    std::vector<uint8_t> rom;
+    double pack_s = 0;
+    uint32_t seed = 0;
+    while(std::getline(csv, line)){
+        std::vector<std::string> fields = split_csv(line);
+        if(fields.size() <= static_cast<size_t>(size_col)){
+            continue;
+        }
+        uint32_t size = strtoul(fields[size_col].c_str(), nullptr, 16);
+        // Skip the odd entries with sizes a real cart can't have
+        if(size < 0x8000 || size > 0x800000 || (size & (size - 1))){
+            continue;
+        }
+        SizeBucket& bucket = buckets[size];
+        bool synthetic = rom_dir.empty() || !load_rom(rom_dir + "/" + fields[filename_col], size, rom);
+        if(synthetic){
+            synth_rom(size, seed, rom);
+            bucket.synthetic++;
+        }
+        seed++;
+        auto start = std::chrono::steady_clock::now();
+        uint64_t sent = packed_size(rom);
+        pack_s += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        bucket.roms++;
+        if(synthetic){
+            bucket.synth_raw_bytes += size;
+            bucket.synth_sent_bytes += sent;
+        }
+        else{
+            bucket.raw_bytes += size;
+            bucket.sent_bytes += sent;
+        }
+    }
+
+    // Unpacked, whichever of the link or bus is slower. Packed, the device reads then packs
+    // each frame before it goes out, so the pack time stacks on top of the bus time
+    auto effective = [&](uint64_t raw, uint64_t sent, double pack){
+        double link_s = (sent / 1e6) / link_mbps;
+        double device_s = (raw / 1e6) / bus_mbps + (pack ? (raw / 1e6) / pack : 0);
+        return (raw / 1e6) / (link_s > device_s ? link_s : device_s);
+    };
+    auto print_row = [&](const char* label, const SizeBucket& bucket){
+        printf("%9s %6u %6u ", label, bucket.roms, bucket.synthetic);
+        if(bucket.raw_bytes){
+            printf("%7.1f%% ", 100.0 * bucket.sent_bytes / bucket.raw_bytes);
+        }
+        else{
+            printf("%8s ", "-");
+        }
+        if(bucket.synth_raw_bytes){
+            printf("%7.1f%% ", 100.0 * bucket.synth_sent_bytes / bucket.synth_raw_bytes);
+        }
+        else{
+            printf("%8s ", "-");
+        }
+        uint64_t all_raw = bucket.raw_bytes + bucket.synth_raw_bytes;
+        printf("%10.3f ", effective(all_raw, all_raw, 0));
+        if(bucket.raw_bytes && pack_mbps > 0){
+            printf("%11.3f\n", effective(bucket.raw_bytes, bucket.sent_bytes, pack_mbps));
+        }
+        else{
+            printf("%11s\n", "-");
+        }
+    };
+    printf("Link %.2f MB/s, bus %.2f MB/s, ", link_mbps, bus_mbps);
+    if(pack_mbps > 0){
+        printf("device packs at %.2f MB/s\n", pack_mbps);
+    }
+    else{
+        printf("device pack speed not given\n");
+    }
+    printf("%9s %6s %6s %8s %8s %10s %11s\n", "ROM size", "ROMs", "Synth", "Ratio", "Synth", "Raw MB/s", "Packed MB/s");
+    SizeBucket total;
+    char label[16];
+    for(const auto& [size, bucket] : buckets){
+        snprintf(label, sizeof(label), "%uK", size / 1024);
+        print_row(label, bucket);
+        total.roms += bucket.roms;
+        total.synthetic += bucket.synthetic;
+        total.raw_bytes += bucket.raw_bytes;
+        total.sent_bytes += bucket.sent_bytes;
+        total.synth_raw_bytes += bucket.synth_raw_bytes;
+        total.synth_sent_bytes += bucket.synth_sent_bytes;
+    }
+    if(!total.roms){
+        fprintf(stderr, "No ROMs in %s\n", csv_path.c_str());
+        return 1;
+    }
+    print_row("All", total);
+    printf("Host packs at %.1f MB/s, which is no guide to the device\n",
+           ((total.raw_bytes + total.synth_raw_bytes) / 1e6) / pack_s);
+    if(total.synthetic){
+        printf("%u of %u ROMs were synthetic and only get a ratio, pass --roms for real numbers\n",
+               total.synthetic, total.roms);
+    }
+    if(pack_mbps <= 0){
+        printf("Pass --pack with the device's pack speed from gbraw --packed bench for a packed throughput\n");
+    }
+    return 0;
+}
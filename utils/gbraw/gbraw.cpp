@@ -0,0 +1,399 @@
+// Host side of the GBPunk raw vendor interface. Dumps ROM and SRAM, restores SRAM, flashes
+// flash carts, and benchmarks the raw path against reading the same ROM off the mass storage disk.
+//
+// Build:     gcc -O2 -c ../../software/disk/raw_codec.c -o raw_codec.o
+//            g++ -O2 -std=c++17 gbraw.cpp transport.cpp raw_codec.o -lusb-1.0 -o gbraw
+// No libusb: g++ -O2 -std=c++17 -DGBRAW_NO_LIBUSB gbraw.cpp transport.cpp raw_codec.o -o gbraw
+//
+// Usage:     gbraw [--loopback rom.gb] [--packed] <command> [args]
+//   --packed              Have the device pack ROM and SRAM reads, see RAW_OP_READ_PACKED
+//   info                  Print the cart header
+//   dump-rom out.gb       Dump the whole ROM
+//   dump-ram out.sav      Dump the save
+//   write-ram in.sav      Write a save back to the cart
+//   hashes                CRC32 of every ROM bank
+//   bench [msc_rom_path]  Time a raw ROM dump, and a read of the ROM file on the disk if given
+//   flash in.gb           Program a flash cart, and check the CRC the device read back against the file
+//   live out.bmp [frames] Stream the Game Boy Camera, rewriting out.bmp with every new frame
+//   cam-regs in.bin       Set the camera registers used for live frames (0x36 bytes, 0xA000 on)
+
+#include "transport.h"
+
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <fcntl.h>
+#include <fstream>
+#include <functional>
+#include <memory>
+#include <string>
+#include <unistd.h>
+#include <vector>
+
+#define GBPUNK_VID 0xCAFE
+#define GBPUNK_PID 0x4012 // MSC and vendor bits of the auto PID in usb_descriptors.c
+// Reads get split up so a progress callback gets called every so often
+#define CLIENT_CHUNK (64 * 1024)
+// Flash writes go a bank at a time, so erasing and programming one never runs into the USB timeout
+#define FLASH_CHUNK 0x4000
+
+class RawClient {
+public:
+    explicit RawClient(Transport& transport, bool packed = false) : transport(transport), packed(packed) {}
+
+    bool header(RawHeader& out){
+        std::vector<uint8_t> data;
+        if(!command(RAW_OP_GET_HEADER, 0, 0, 0, 0, nullptr, &data) || data.size() != sizeof(out)){
+            return false;
+        }
+        memcpy(&out, data.data(), sizeof(out));
+        return true;
+    }
+
+    bool read(uint8_t space, uint32_t addr, uint32_t len, std::vector<uint8_t>& out){
+        out.clear();
+        while(len){
+            uint32_t n = len < CLIENT_CHUNK ? len : CLIENT_CHUNK;
+            std::vector<uint8_t> chunk;
+            if(!command(packed ? RAW_OP_READ_PACKED : RAW_OP_READ, space, 0, addr, n, nullptr, &chunk)){
+                return false;
+            }
+            out.insert(out.end(), chunk.begin(), chunk.end());
+            addr += n;
+            len -= n;
+        }
+        return true;
+    }
+
+    bool write(uint8_t space, uint32_t addr, const std::vector<uint8_t>& data){
+        return command(RAW_OP_WRITE, space, 0, addr, data.size(), &data, nullptr);
+    }
+
+    bool set_bank(uint8_t space, uint16_t bank){
+        return command(RAW_OP_SET_BANK, space, bank, 0, 0, nullptr, nullptr);
+    }
+
+    bool hashes(uint16_t first_bank, uint16_t count, std::vector<uint32_t>& out){
+        std::vector<uint8_t> data;
+        if(!command(RAW_OP_GET_HASHES, RAW_SPACE_ROM, first_bank, 0, count, nullptr, &data)){
+            return false;
+        }
+        out.resize(data.size() / 4);
+        memcpy(out.data(), data.data(), out.size() * 4);
+        return true;
+    }
+
+    bool flash_info(RawFlashInfo& out){
+        std::vector<uint8_t> data;
+        if(!command(RAW_OP_FLASH_INFO, 0, 0, 0, 0, nullptr, &data) || data.size() != sizeof(out)){
+            return false;
+        }
+        memcpy(&out, data.data(), sizeof(out));
+        return true;
+    }
+
+    // The result comes back even if a chunk failed, the stats say how far it got
+    bool flash(const std::vector<uint8_t>& image, RawFlashResult& result){
+        memset(&result, 0, sizeof(result));
+        for(uint32_t addr = 0; addr < image.size(); addr += FLASH_CHUNK){
+            uint32_t n = image.size() - addr < FLASH_CHUNK ? image.size() - addr : FLASH_CHUNK;
+            std::vector<uint8_t> chunk(image.begin() + addr, image.begin() + addr + n);
+            std::vector<uint8_t> data;
+            bool ok = command(RAW_OP_FLASH_WRITE, RAW_SPACE_ROM, 0, addr, n, &chunk, &data);
+            if(data.size() == sizeof(result)){
+                memcpy(&result, data.data(), sizeof(result));
+            }
+            if(!ok){
+                return false;
+            }
+        }
+        return true;
+    }
+
+    // Waits on the device for a frame newer than last
+    bool cam_frame(uint32_t last, RawCamFrame& frame, std::vector<uint8_t>& bmp){
+        std::vector<uint8_t> data;
+        if(!command(RAW_OP_CAM_FRAME, 0, 0, last, 0, nullptr, &data) || data.size() != sizeof(frame) + RAW_CAM_FRAME_SIZE){
+            return false;
+        }
+        memcpy(&frame, data.data(), sizeof(frame));
+        bmp.assign(data.begin() + sizeof(frame), data.end());
+        return true;
+    }
+
+    bool cam_regs(const std::vector<uint8_t>& regs){
+        return command(RAW_OP_CAM_REGS, 0, 0, 0, regs.size(), &regs, nullptr);
+    }
+
+    // Totals over every packed frame received, for working out the device's pack speed
+    uint64_t pack_bytes = 0;
+    uint64_t pack_sent = 0;
+    uint64_t pack_us = 0;
+
+private:
+    bool command(uint8_t opcode, uint8_t space, uint16_t bank, uint32_t addr, uint32_t len,
+                 const std::vector<uint8_t>* payload, std::vector<uint8_t>* response_data){
+        RawCommand cmd = {RAW_MAGIC, opcode, space, bank, addr, len};
+        if(!transport.send(reinterpret_cast<uint8_t*>(&cmd), sizeof(cmd))){
+            return false;
+        }
+        if(payload && !payload->empty() && !transport.send(payload->data(), payload->size())){
+            return false;
+        }
+        RawResponse resp;
+        if(!transport.receive(reinterpret_cast<uint8_t*>(&resp), sizeof(resp))){
+            return false;
+        }
+        if(resp.magic != RAW_MAGIC || resp.opcode != opcode){
+            fprintf(stderr, "Lost sync with the device\n");
+            return false;
+        }
+        std::vector<uint8_t> data(resp.data_len);
+        if(opcode == RAW_OP_READ_PACKED){
+            if(!receive_frames(data)){
+                return false;
+            }
+        }
+        else if(resp.data_len && !transport.receive(data.data(), data.size())){
+            return false;
+        }
+        if(response_data){
+            *response_data = std::move(data);
+        }
+        if(resp.status != RAW_STATUS_OK){
+            fprintf(stderr, "Command 0x%02x failed with status 0x%02x\n", opcode, resp.status);
+            return false;
+        }
+        return true;
+    }
+
+    // Unpack frames until out is full. It comes sized to the unpacked length
+    bool receive_frames(std::vector<uint8_t>& out){
+        std::vector<uint8_t> frame_data;
+        size_t pos = 0;
+        while(pos < out.size()){
+            RawFrame frame;
+            if(!transport.receive(reinterpret_cast<uint8_t*>(&frame), sizeof(frame))){
+                return false;
+            }
+            if(!frame.raw_len || frame.raw_len > out.size() - pos || frame.packed_len > frame.raw_len){
+                fprintf(stderr, "Bad frame from the device\n");
+                return false;
+            }
+            frame_data.resize(frame.packed_len);
+            if(!transport.receive(frame_data.data(), frame_data.size())){
+                return false;
+            }
+            if(frame.packed_len == frame.raw_len){
+                memcpy(out.data() + pos, frame_data.data(), frame.raw_len);
+            }
+            else if(raw_codec_unpack(frame_data.data(), frame.packed_len, out.data() + pos, frame.raw_len) != frame.raw_len){
+                fprintf(stderr, "Frame did not unpack\n");
+                return false;
+            }
+            pos += frame.raw_len;
+            pack_bytes += frame.raw_len;
+            pack_sent += frame.packed_len;
+            pack_us += frame.pack_us;
+        }
+        return true;
+    }
+
+    Transport& transport;
+    bool packed;
+};
+
+static bool write_file(const std::string& path, const std::vector<uint8_t>& data){
+    std::ofstream file(path, std::ios::binary);
+    file.write(reinterpret_cast<const char*>(data.data()), data.size());
+    return static_cast<bool>(file);
+}
+
+static double seconds_since(std::chrono::steady_clock::time_point start){
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+// Read a file on the mass storage disk the way a user would, but with the page cache dropped
+// first so the numbers are for the device and not for RAM
+static double bench_msc(const std::string& path, size_t& bytes){
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if(fd < 0){
+        perror(path.c_str());
+        return 0;
+    }
+    posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+    std::vector<uint8_t> buf(CLIENT_CHUNK);
+    bytes = 0;
+    auto start = std::chrono::steady_clock::now();
+    ssize_t n;
+    while((n = ::read(fd, buf.data(), buf.size())) > 0){
+        bytes += n;
+    }
+    double elapsed = seconds_since(start);
+    ::close(fd);
+    return elapsed;
+}
+
+int main(int argc, char** argv){
+    std::vector<std::string> args(argv + 1, argv + argc);
+    std::unique_ptr<Transport> transport;
+    if(args.size() >= 2 && args[0] == "--loopback"){
+        auto loopback = std::make_unique<LoopbackTransport>();
+        if(!loopback->open(args[1], 0x8000)){
+            return 1;
+        }
+        transport = std::move(loopback);
+        args.erase(args.begin(), args.begin() + 2);
+    }
+    else{
+#ifndef GBRAW_NO_LIBUSB
+        auto usb = std::make_unique<LibusbTransport>();
+        if(!usb->open(GBPUNK_VID, GBPUNK_PID)){
+            return 1;
+        }
+        transport = std::move(usb);
+#else
+        fprintf(stderr, "Built without libusb, only --loopback works\n");
+        return 1;
+#endif
+    }
+    bool packed = !args.empty() && args[0] == "--packed";
+    if(packed){
+        args.erase(args.begin());
+    }
+    if(args.empty()){
+        fprintf(stderr, "Usage: gbraw [--loopback rom.gb] [--packed] info|dump-rom|dump-ram|write-ram|hashes|bench|flash|live|cam-regs [file]\n");
+        return 1;
+    }
+    RawClient client(*transport, packed);
+    RawHeader header;
+    if(!client.header(header)){
+        fprintf(stderr, "Could not read the cart header\n");
+        return 1;
+    }
+    const std::string& cmd = args[0];
+    if(cmd == "info"){
+        printf("Title:     %s\n", header.title);
+        printf("Cart type: 0x%02x\n", header.cart_type);
+        printf("ROM:       %u bytes, %u banks\n", header.rom_size_bytes, header.rom_banks);
+        printf("SRAM:      %u bytes\n", header.ram_size_bytes);
+    }
+    else if((cmd == "dump-rom" || cmd == "dump-ram") && args.size() >= 2){
+        bool rom = cmd == "dump-rom";
+        std::vector<uint8_t> data;
+        if(!client.read(rom ? RAW_SPACE_ROM : RAW_SPACE_RAM, 0, rom ? header.rom_size_bytes : header.ram_size_bytes, data)){
+            return 1;
+        }
+        return write_file(args[1], data) ? 0 : 1;
+    }
+    else if(cmd == "write-ram" && args.size() >= 2){
+        std::ifstream file(args[1], std::ios::binary);
+        std::vector<uint8_t> data((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+        if(data.size() > header.ram_size_bytes){
+            data.resize(header.ram_size_bytes);
+        }
+        return client.write(RAW_SPACE_RAM, 0, data) ? 0 : 1;
+    }
+    else if(cmd == "hashes"){
+        std::vector<uint32_t> crcs;
+        if(!client.hashes(0, header.rom_banks, crcs)){
+            return 1;
+        }
+        for(size_t i = 0; i < crcs.size(); i++){
+            printf("%3zu: %08x\n", i, crcs[i]);
+        }
+    }
+    else if(cmd == "bench"){
+        std::vector<uint8_t> data;
+        auto start = std::chrono::steady_clock::now();
+        if(!client.read(RAW_SPACE_ROM, 0, header.rom_size_bytes, data)){
+            return 1;
+        }
+        double raw_s = seconds_since(start);
+        printf("Raw: %zu bytes in %.3f s, %.3f MB/s\n", data.size(), raw_s, (data.size() / 1e6) / raw_s);
+        if(client.pack_us){
+            // What to pass codec_bench as --pack
+            printf("Device packing: %.1f%% of original size, %.3f MB/s of packing time\n",
+                   100.0 * client.pack_sent / client.pack_bytes, (client.pack_bytes / 1e6) / (client.pack_us / 1e6));
+        }
+        if(args.size() >= 2){
+            size_t bytes = 0;
+            double msc_s = bench_msc(args[1], bytes);
+            if(msc_s > 0){
+                printf("MSC: %zu bytes in %.3f s, %.3f MB/s\n", bytes, msc_s, (bytes / 1e6) / msc_s);
+            }
+        }
+    }
+    else if(cmd == "flash" && args.size() >= 2){
+        RawFlashInfo info;
+        if(!client.flash_info(info) || !info.command_set){
+            fprintf(stderr, "Not a flash cart\n");
+            return 1;
+        }
+        std::ifstream file(args[1], std::ios::binary);
+        std::vector<uint8_t> data((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+        if(data.empty() || data.size() > info.size_bytes){
+            fprintf(stderr, "%s is %zu bytes, the chip holds %u\n", args[1].c_str(), data.size(), info.size_bytes);
+            return 1;
+        }
+        const char* modes[] = {"single byte", "unlock bypass", "buffered"};
+        printf("Chip:      %02x:%04x, %s, %u bytes, %s writes\n", info.manufacturer, info.device,
+               info.command_set == 2 ? "Intel" : "AMD", info.size_bytes, modes[info.program_mode % 3]);
+        RawFlashResult result;
+        auto start = std::chrono::steady_clock::now();
+        bool ok = client.flash(data, result);
+        double flash_s = seconds_since(start);
+        uint32_t crc = ~crc32_update(data.data(), data.size(), 0xFFFFFFFF);
+        printf("Written:   %u bytes, %u sectors erased\n", result.bytes, result.sectors_erased);
+        double device_s = (static_cast<double>(result.erase_us) + result.program_us) / 1e6;
+        printf("Time:      erase %.2f s, program %.2f s, %.1f KB/s on the device, %.1f KB/s end to end\n",
+               result.erase_us / 1e6, result.program_us / 1e6,
+               device_s > 0 ? (result.bytes / 1024.0) / device_s : 0.0, (result.bytes / 1024.0) / flash_s);
+        printf("CRC32:     file %08x, device got %08x, read back %08x\n", crc, result.data_crc, result.readback_crc);
+        if(!ok || result.bytes != data.size() || result.readback_crc != crc){
+            fprintf(stderr, "Verify failed\n");
+            return 1;
+        }
+        printf("Verified. Replug the cart to see the new header\n");
+    }
+    else if(cmd == "live" && args.size() >= 2){
+        uint32_t count = args.size() >= 3 ? std::stoul(args[2]) : 0;
+        uint32_t last = 0;
+        auto start = std::chrono::steady_clock::now();
+        for(uint32_t i = 0; !count || i < count; i++){
+            RawCamFrame frame;
+            std::vector<uint8_t> bmp;
+            if(!client.cam_frame(last, frame, bmp)){
+                return 1;
+            }
+            // Written next to it and renamed, so a viewer never sees half a frame
+            std::string tmp = args[1] + ".tmp";
+            if(!write_file(tmp, bmp) || rename(tmp.c_str(), args[1].c_str())){
+                perror(args[1].c_str());
+                return 1;
+            }
+            printf("\rFrame %u, %u dropped, device %u.%u FPS, %.1f FPS here   ", frame.frame,
+                   last ? frame.frame - last - 1 : 0, frame.fps_tenths / 10, frame.fps_tenths % 10,
+                   (i + 1) / seconds_since(start));
+            fflush(stdout);
+            last = frame.frame;
+        }
+        printf("\n");
+    }
+    else if(cmd == "cam-regs" && args.size() >= 2){
+        std::ifstream file(args[1], std::ios::binary);
+        std::vector<uint8_t> data((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+        if(data.size() != RAW_CAM_REG_COUNT){
+            fprintf(stderr, "%s should be %u bytes\n", args[1].c_str(), RAW_CAM_REG_COUNT);
+            return 1;
+        }
+        if(!client.cam_regs(data)){
+            return 1;
+        }
+    }
+    else{
+        fprintf(stderr, "Unknown command %s\n", cmd.c_str());
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,114 @@
+// Measures how fast the MSC side actually moves data, against what full speed bulk can do.
+// Reads the raw ROM LUN (or any file) front to back with the page cache out of the way,
+// a transfer at a time, and reports throughput, how many of the 19 bulk packets that fit in
+// each 1ms frame were used, and the slowest transfer.
+//
+// Build: g++ -O2 -std=c++17 msc_bench.cpp -o msc_bench
+//
+// Usage: msc_bench /dev/sdX [--chunk bytes] [--passes n]
+//   /dev/sdX  The "GBPunk ROM" LUN. ROM.BIN on the FAT volume works too, but the host's
+//             own caching gets in the way more
+//   --chunk   Bytes per read, default 65536. Hosts split these into READ10s of their own
+//   --passes  Times to read the whole thing, default 1. Later passes show the ROM cache
+
+#include <cerrno>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+// Full speed bulk: 1ms frames, at most 19 packets of 64 bytes in each once the bus
+// overhead is counted
+static const double FRAME_US = 1000.0;
+static const uint32_t PACKETS_PER_FRAME = 19;
+static const uint32_t PACKET_SIZE = 64;
+
+static int open_uncached(const std::string& path){
+#ifdef O_DIRECT
+    int fd = open(path.c_str(), O_RDONLY | O_DIRECT);
+    if(fd >= 0){
+        return fd;
+    }
+#endif
+    int fd_plain = open(path.c_str(), O_RDONLY);
+#ifdef F_NOCACHE
+    if(fd_plain >= 0){
+        fcntl(fd_plain, F_NOCACHE, 1);
+    }
+#endif
+    return fd_plain;
+}
+
+int main(int argc, char** argv){
+    if(argc < 2){
+        fprintf(stderr, "Usage: %s /dev/sdX [--chunk bytes] [--passes n]\n", argv[0]);
+        return 1;
+    }
+    std::string path = argv[1];
+    uint32_t chunk = 65536;
+    uint32_t passes = 1;
+    for(int i = 2; i + 1 < argc; i += 2){
+        std::string arg = argv[i];
+        if(arg == "--chunk"){
+            chunk = strtoul(argv[i + 1], nullptr, 0);
+        }
+        else if(arg == "--passes"){
+            passes = strtoul(argv[i + 1], nullptr, 0);
+        }
+    }
+    // O_DIRECT wants whole blocks in an aligned buffer
+    chunk = (chunk + 511) & ~511u;
+    if(!chunk){
+        chunk = 512;
+    }
+    void* mem = nullptr;
+    if(posix_memalign(&mem, 4096, chunk)){
+        fprintf(stderr, "Out of memory\n");
+        return 1;
+    }
+    uint8_t* buf = static_cast<uint8_t*>(mem);
+
+    const double max_bps = (PACKETS_PER_FRAME * PACKET_SIZE) * (1000000.0 / FRAME_US);
+    printf("Full speed bulk tops out at %.0f bytes/s (%u x %u byte packets a frame)\n",
+        max_bps, PACKETS_PER_FRAME, PACKET_SIZE);
+    for(uint32_t pass = 0; pass < passes; pass++){
+        int fd = open_uncached(path);
+        if(fd < 0){
+            fprintf(stderr, "Could not open %s: %s\n", path.c_str(), strerror(errno));
+            return 1;
+        }
+        uint64_t total = 0;
+        double worst_ms = 0;
+        auto start = std::chrono::steady_clock::now();
+        while(true){
+            auto t0 = std::chrono::steady_clock::now();
+            ssize_t got = read(fd, buf, chunk);
+            auto t1 = std::chrono::steady_clock::now();
+            if(got <= 0){
+                break;
+            }
+            double ms = std::chrono::duration<double, std::milli>(t1 - t0).count();
+            if(ms > worst_ms){
+                worst_ms = ms;
+            }
+            total += got;
+        }
+        double secs = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        close(fd);
+        if(!total || secs <= 0){
+            fprintf(stderr, "Nothing read from %s\n", path.c_str());
+            return 1;
+        }
+        double bps = total / secs;
+        printf("Pass %u: %llu bytes in %.2fs, %.0f bytes/s, %.1f%% of the bus, %.1f of %u packets a frame, slowest read %.1fms\n",
+            pass + 1, static_cast<unsigned long long>(total), secs, bps, (bps * 100.0) / max_bps,
+            bps / (PACKET_SIZE * (1000000.0 / FRAME_US)), PACKETS_PER_FRAME, worst_ms);
+    }
+    free(mem);
+    return 0;
+}
@@ -0,0 +1,386 @@
+#include "transport.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+
+// Sector size of the pretend flash chip
+#define LOOPBACK_FLASH_SECTOR 0x10000
+
+uint32_t crc32_update(const uint8_t* data, size_t len, uint32_t crc){
+    for(size_t i = 0; i < len; i++){
+        crc ^= data[i];
+        for(int k = 0; k < 8; k++){
+            crc = (crc >> 1) ^ (0xEDB88320 & -(crc & 1));
+        }
+    }
+    return crc;
+}
+
+#ifndef GBRAW_NO_LIBUSB
+#include <libusb-1.0/libusb.h>
+
+LibusbTransport::LibusbTransport(){
+    libusb_init(&ctx);
+}
+
+LibusbTransport::~LibusbTransport(){
+    if(handle){
+        libusb_release_interface(handle, interface_num);
+        libusb_close(handle);
+    }
+    libusb_exit(ctx);
+}
+
+bool LibusbTransport::open(uint16_t vid, uint16_t pid){
+    handle = libusb_open_device_with_vid_pid(ctx, vid, pid);
+    if(!handle){
+        fprintf(stderr, "No device %04x:%04x\n", vid, pid);
+        return false;
+    }
+    // Find the vendor interface, the mass storage one stays with the kernel
+    libusb_config_descriptor* config = nullptr;
+    libusb_get_active_config_descriptor(libusb_get_device(handle), &config);
+    for(int i = 0; config && i < config->bNumInterfaces; i++){
+        const libusb_interface_descriptor* itf = &config->interface[i].altsetting[0];
+        if(itf->bInterfaceClass != LIBUSB_CLASS_VENDOR_SPEC){
+            continue;
+        }
+        interface_num = itf->bInterfaceNumber;
+        for(int e = 0; e < itf->bNumEndpoints; e++){
+            uint8_t addr = itf->endpoint[e].bEndpointAddress;
+            if(addr & LIBUSB_ENDPOINT_IN){
+                ep_in = addr;
+            }
+            else{
+                ep_out = addr;
+            }
+        }
+    }
+    libusb_free_config_descriptor(config);
+    if(interface_num < 0 || libusb_claim_interface(handle, interface_num)){
+        fprintf(stderr, "Could not claim the vendor interface\n");
+        return false;
+    }
+    return true;
+}
+
+bool LibusbTransport::send(const uint8_t* data, size_t len){
+    while(len){
+        int done = 0;
+        if(libusb_bulk_transfer(handle, ep_out, const_cast<uint8_t*>(data), len, &done, 5000)){
+            return false;
+        }
+        data += done;
+        len -= done;
+    }
+    return true;
+}
+
+bool LibusbTransport::receive(uint8_t* data, size_t len){
+    while(len){
+        int done = 0;
+        if(libusb_bulk_transfer(handle, ep_in, data, len, &done, 5000)){
+            return false;
+        }
+        data += done;
+        len -= done;
+    }
+    return true;
+}
+#endif
+
+bool LoopbackTransport::open(const std::string& rom_path, uint32_t ram_size){
+    std::ifstream file(rom_path, std::ios::binary);
+    if(!file){
+        fprintf(stderr, "Could not open %s\n", rom_path.c_str());
+        return false;
+    }
+    rom.assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+    ram.assign(ram_size, 0xFF);
+    return rom.size() >= 0x150;
+}
+
+bool LoopbackTransport::send(const uint8_t* data, size_t len){
+    while(len){
+        // Data for a write in progress goes straight to SRAM, or the flash
+        if(write_remaining){
+            size_t n = len < write_remaining ? len : write_remaining;
+            if(write_flash){
+                program_flash(data, n);
+            }
+            else if(write_cam_regs){
+                memcpy(cam_regs.data() + write_addr, data, n);
+            }
+            else{
+                memcpy(ram.data() + write_addr, data, n);
+            }
+            write_addr += n;
+            write_remaining -= n;
+            data += n;
+            len -= n;
+            if(!write_remaining && write_flash){
+                respond_flash_result();
+            }
+            else if(!write_remaining){
+                respond(RAW_STATUS_OK, nullptr, 0);
+            }
+            continue;
+        }
+        pending.push_back(*data);
+        data++;
+        len--;
+        if(pending.size() == sizeof(RawCommand)){
+            handle_command();
+            pending.clear();
+        }
+    }
+    return true;
+}
+
+bool LoopbackTransport::receive(uint8_t* data, size_t len){
+    if(outgoing.size() < len){
+        return false;
+    }
+    std::copy(outgoing.begin(), outgoing.begin() + len, data);
+    outgoing.erase(outgoing.begin(), outgoing.begin() + len);
+    return true;
+}
+
+void LoopbackTransport::respond(uint8_t status, const uint8_t* data, size_t len){
+    RawResponse resp = {RAW_MAGIC, current.opcode, status, 0, static_cast<uint32_t>(len)};
+    const uint8_t* resp_bytes = reinterpret_cast<const uint8_t*>(&resp);
+    outgoing.insert(outgoing.end(), resp_bytes, resp_bytes + sizeof(resp));
+    if(data){
+        outgoing.insert(outgoing.end(), data, data + len);
+    }
+}
+
+// Frames the same way vendor_raw.c does, one per bank, left as is if packing doesn't help
+void LoopbackTransport::respond_packed(const uint8_t* data, uint32_t addr, uint32_t len){
+    RawResponse resp = {RAW_MAGIC, current.opcode, RAW_STATUS_OK, 0, len};
+    const uint8_t* resp_bytes = reinterpret_cast<const uint8_t*>(&resp);
+    outgoing.insert(outgoing.end(), resp_bytes, resp_bytes + sizeof(resp));
+    std::vector<uint8_t> packed(RAW_FRAME_MAX);
+    while(len){
+        uint32_t n = RAW_FRAME_MAX - (addr % RAW_FRAME_MAX);
+        n = n < len ? n : len;
+        auto start = std::chrono::steady_clock::now();
+        uint32_t packed_len = raw_codec_pack(data, n, packed.data(), n - 1);
+        // The host's pack time, there's no device here
+        uint32_t pack_us = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start).count();
+        const uint8_t* payload = packed_len ? packed.data() : data;
+        RawFrame frame = {static_cast<uint16_t>(n), static_cast<uint16_t>(packed_len ? packed_len : n), pack_us};
+        const uint8_t* frame_bytes = reinterpret_cast<const uint8_t*>(&frame);
+        outgoing.insert(outgoing.end(), frame_bytes, frame_bytes + sizeof(frame));
+        outgoing.insert(outgoing.end(), payload, payload + frame.packed_len);
+        data += n;
+        addr += n;
+        len -= n;
+    }
+}
+
+void LoopbackTransport::respond_flash_result(){
+    RawFlashResult result = flash_result;
+    result.data_crc = ~result.data_crc;
+    result.readback_crc = ~result.readback_crc;
+    uint8_t status = result.data_crc == result.readback_crc ? RAW_STATUS_OK : RAW_STATUS_FLASH_FAILED;
+    respond(status, reinterpret_cast<uint8_t*>(&result), sizeof(result));
+}
+
+void LoopbackTransport::program_flash(const uint8_t* data, size_t len){
+    for(size_t i = 0; i < len; i++){
+        uint32_t addr = write_addr + i;
+        uint32_t sector = addr / LOOPBACK_FLASH_SECTOR;
+        if(!flash_erased[sector]){
+            uint32_t start = sector * LOOPBACK_FLASH_SECTOR;
+            uint32_t end = start + LOOPBACK_FLASH_SECTOR < rom.size() ? start + LOOPBACK_FLASH_SECTOR : rom.size();
+            std::fill(rom.begin() + start, rom.begin() + end, 0xFF);
+            flash_erased[sector] = true;
+            flash_result.sectors_erased++;
+        }
+        // Programming can only clear bits
+        rom[addr] &= data[i];
+    }
+    flash_result.bytes += len;
+    flash_result.data_crc = crc32_update(data, len, flash_result.data_crc);
+    flash_result.readback_crc = crc32_update(rom.data() + write_addr, len, flash_result.readback_crc);
+}
+
+void LoopbackTransport::respond_cam_frame(){
+    // Header, 16 entry palette, then 4 bit pixels bottom row first, like gbcam_decode_photo
+    std::vector<uint8_t> bmp(RAW_CAM_FRAME_SIZE, 0);
+    const uint32_t header_len = 14 + 40 + (16 * 4);
+    auto put32 = [&](size_t at, uint32_t v){ memcpy(bmp.data() + at, &v, 4); };
+    bmp[0] = 'B';
+    bmp[1] = 'M';
+    put32(2, RAW_CAM_FRAME_SIZE);
+    put32(10, header_len);
+    put32(14, 40);
+    put32(18, 128);
+    put32(22, 112);
+    bmp[26] = 1;
+    bmp[28] = 4;
+    put32(34, RAW_CAM_FRAME_SIZE - header_len);
+    put32(46, 4);
+    const uint8_t shades[4] = {0xFF, 0xAA, 0x55, 0x00};
+    for(int i = 0; i < 4; i++){
+        memset(bmp.data() + 54 + (i * 4), shades[i], 3);
+    }
+    cam_frames++;
+    for(uint32_t y = 0; y < 112; y++){
+        for(uint32_t x = 0; x < 128; x += 2){
+            uint8_t a = ((x + y + cam_frames) / 16) % 4;
+            uint8_t b = ((x + 1 + y + cam_frames) / 16) % 4;
+            bmp[header_len + (y * 64) + (x / 2)] = (a << 4) | b;
+        }
+    }
+    RawCamFrame frame = {cam_frames, 300, 0};
+    std::vector<uint8_t> out(sizeof(frame) + bmp.size());
+    memcpy(out.data(), &frame, sizeof(frame));
+    memcpy(out.data() + sizeof(frame), bmp.data(), bmp.size());
+    respond(RAW_STATUS_OK, out.data(), out.size());
+}
+
+void LoopbackTransport::handle_command(){
+    memcpy(&current, pending.data(), sizeof(current));
+    const RawCommand& cmd = current;
+    if(cmd.magic != RAW_MAGIC){
+        respond(RAW_STATUS_BAD_COMMAND, nullptr, 0);
+        return;
+    }
+    std::vector<uint8_t>* space = cmd.space == RAW_SPACE_ROM ? &rom : cmd.space == RAW_SPACE_RAM ? &ram : nullptr;
+    switch(cmd.opcode){
+        case RAW_OP_GET_HEADER: {
+            RawHeader header = {};
+            header.cart_type = rom[0x147];
+            header.rom_banks = rom.size() / 0x4000;
+            header.rom_size_bytes = rom.size();
+            header.ram_size_bytes = ram.size();
+            for(int i = 0; i < 16 && rom[0x134 + i] >= 0x20 && rom[0x134 + i] <= 0x7E; i++){
+                header.title[i] = rom[0x134 + i];
+            }
+            memcpy(header.header, rom.data() + 0x100, sizeof(header.header));
+            respond(RAW_STATUS_OK, reinterpret_cast<uint8_t*>(&header), sizeof(header));
+            return;
+        }
+        case RAW_OP_READ:
+        case RAW_OP_READ_PACKED: {
+            // Bus reads see bank 0, the switched ROM bank, and the switched SRAM bank
+            std::vector<uint8_t> bus;
+            if(cmd.space == RAW_SPACE_BUS){
+                bus.assign(0x10000, 0xFF);
+                for(uint32_t i = 0; i < 0x8000; i++){
+                    uint32_t rom_addr = i < 0x4000 ? i : (rom_bank * 0x4000) + (i - 0x4000);
+                    bus[i] = rom[rom_addr % rom.size()];
+                }
+                for(uint32_t i = 0; i < 0x2000 && !ram.empty(); i++){
+                    bus[0xA000 + i] = ram[((ram_bank * 0x2000) + i) % ram.size()];
+                }
+                space = &bus;
+            }
+            if(!space || cmd.addr >= space->size() || cmd.len > space->size() - cmd.addr){
+                respond(RAW_STATUS_BAD_RANGE, nullptr, 0);
+                return;
+            }
+            if(cmd.opcode == RAW_OP_READ){
+                respond(RAW_STATUS_OK, space->data() + cmd.addr, cmd.len);
+                return;
+            }
+            respond_packed(space->data() + cmd.addr, cmd.addr, cmd.len);
+            return;
+        }
+        case RAW_OP_WRITE:
+            if(cmd.space != RAW_SPACE_RAM || cmd.addr >= ram.size() || cmd.len > ram.size() - cmd.addr){
+                respond(RAW_STATUS_BAD_RANGE, nullptr, 0);
+                return;
+            }
+            write_addr = cmd.addr;
+            write_remaining = cmd.len;
+            write_flash = false;
+            write_cam_regs = false;
+            if(!write_remaining){
+                respond(RAW_STATUS_OK, nullptr, 0);
+            }
+            return;
+        case RAW_OP_SET_BANK:
+            if(cmd.space == RAW_SPACE_ROM){
+                rom_bank = cmd.bank;
+            }
+            else{
+                ram_bank = cmd.bank;
+            }
+            respond(RAW_STATUS_OK, nullptr, 0);
+            return;
+        case RAW_OP_GET_HASHES: {
+            uint32_t banks = rom.size() / 0x4000;
+            if(cmd.bank >= banks || cmd.len > banks - cmd.bank){
+                respond(RAW_STATUS_BAD_RANGE, nullptr, 0);
+                return;
+            }
+            std::vector<uint8_t> out;
+            for(uint32_t b = cmd.bank; b < cmd.bank + cmd.len; b++){
+                uint32_t crc = ~crc32_update(rom.data() + (b * 0x4000), 0x4000, 0xFFFFFFFF);
+                const uint8_t* crc_bytes = reinterpret_cast<const uint8_t*>(&crc);
+                out.insert(out.end(), crc_bytes, crc_bytes + 4);
+            }
+            respond(RAW_STATUS_OK, out.data(), out.size());
+            return;
+        }
+        case RAW_OP_FLASH_INFO: {
+            RawFlashInfo info = {};
+            info.command_set = 1;
+            info.program_mode = 2;
+            info.manufacturer = 0x01;
+            info.device = 0x7E;
+            info.buffer_size = 32;
+            info.size_bytes = rom.size();
+            respond(RAW_STATUS_OK, reinterpret_cast<uint8_t*>(&info), sizeof(info));
+            return;
+        }
+        case RAW_OP_FLASH_WRITE:
+            if(!cmd.len || cmd.addr >= rom.size() || cmd.len > rom.size() - cmd.addr){
+                respond(RAW_STATUS_BAD_RANGE, nullptr, 0);
+                return;
+            }
+            // Starting at 0 is a new flash
+            if(!cmd.addr || flash_erased.empty()){
+                flash_erased.assign((rom.size() + LOOPBACK_FLASH_SECTOR - 1) / LOOPBACK_FLASH_SECTOR, false);
+                flash_result = {};
+                flash_result.data_crc = 0xFFFFFFFF;
+                flash_result.readback_crc = 0xFFFFFFFF;
+            }
+            write_addr = cmd.addr;
+            write_remaining = cmd.len;
+            write_flash = true;
+            write_cam_regs = false;
+            return;
+        case RAW_OP_CAM_FRAME:
+        case RAW_OP_CAM_REGS:
+            if(rom[0x147] != 0xFC){
+                respond(RAW_STATUS_NO_MAPPER, nullptr, 0);
+                return;
+            }
+            if(cmd.opcode == RAW_OP_CAM_FRAME){
+                // No waiting here, there's always a newer frame
+                cam_frames = cam_frames > cmd.addr ? cam_frames : cmd.addr;
+                respond_cam_frame();
+                return;
+            }
+            if(cmd.len != RAW_CAM_REG_COUNT){
+                respond(RAW_STATUS_BAD_RANGE, nullptr, 0);
+                return;
+            }
+            write_addr = 0;
+            write_remaining = cmd.len;
+            write_flash = false;
+            write_cam_regs = true;
+            return;
+        default:
+            respond(RAW_STATUS_BAD_COMMAND, nullptr, 0);
+            return;
+    }
+}
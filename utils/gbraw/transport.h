@@ -0,0 +1,80 @@
+#ifndef GBRAW_TRANSPORT_H_
+#define GBRAW_TRANSPORT_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <string>
+#include <vector>
+
+#include "../../software/disk/raw_codec.h"
+#include "../../software/disk/raw_protocol.h"
+
+// Fold len bytes into a running CRC32, the same one the device uses. Start with 0xFFFFFFFF
+// and invert the result when done
+uint32_t crc32_update(const uint8_t* data, size_t len, uint32_t crc);
+
+// How bytes get to and from the device. Either the real thing over libusb, or a loopback
+// that speaks the same protocol against a ROM file so the client can be tested without hardware
+class Transport {
+public:
+    virtual ~Transport() {}
+    virtual bool send(const uint8_t* data, size_t len) = 0;
+    virtual bool receive(uint8_t* data, size_t len) = 0;
+};
+
+#ifndef GBRAW_NO_LIBUSB
+struct libusb_context;
+struct libusb_device_handle;
+
+class LibusbTransport : public Transport {
+public:
+    LibusbTransport();
+    ~LibusbTransport();
+    bool open(uint16_t vid, uint16_t pid);
+    bool send(const uint8_t* data, size_t len) override;
+    bool receive(uint8_t* data, size_t len) override;
+private:
+    libusb_context* ctx = nullptr;
+    libusb_device_handle* handle = nullptr;
+    int interface_num = -1;
+    uint8_t ep_out = 0;
+    uint8_t ep_in = 0;
+};
+#endif
+
+class LoopbackTransport : public Transport {
+public:
+    // ROM comes from a file, SRAM starts out as ram_size bytes of 0xFF. The ROM acts like
+    // an AMD flash chip the size of the file, so flashing can be tried out too. A camera ROM
+    // (cart type 0xFC) gets made up live frames
+    bool open(const std::string& rom_path, uint32_t ram_size);
+    bool send(const uint8_t* data, size_t len) override;
+    bool receive(uint8_t* data, size_t len) override;
+private:
+    void handle_command();
+    void respond(uint8_t status, const uint8_t* data, size_t len);
+    void respond_packed(const uint8_t* data, uint32_t addr, uint32_t len);
+    void respond_flash_result();
+    // Program data the way a flash chip would, erasing each sector the first time it's hit
+    void program_flash(const uint8_t* data, size_t len);
+    // A moving gradient as a 128x112 16 color BMP, numbered like the device numbers frames
+    void respond_cam_frame();
+    std::vector<uint8_t> rom;
+    std::vector<uint8_t> ram;
+    RawCommand current = {};        // Command being answered
+    std::vector<uint8_t> pending;   // Command bytes not handled yet
+    std::deque<uint8_t> outgoing;   // Bytes waiting for the host to read them
+    uint32_t write_addr = 0;
+    uint32_t write_remaining = 0;
+    bool write_flash = false;       // Write in progress is going to the ROM
+    bool write_cam_regs = false;    // Write in progress is camera registers
+    std::vector<uint8_t> cam_regs = std::vector<uint8_t>(RAW_CAM_REG_COUNT);
+    uint32_t cam_frames = 0;
+    std::vector<bool> flash_erased;
+    RawFlashResult flash_result = {};
+    uint16_t rom_bank = 1;
+    uint16_t ram_bank = 0;
+};
+
+#endif